@@ -0,0 +1,937 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Render Benchmark
+ *
+ * Renders a fixed set of synthetic scenes, each stressing a different part of
+ * the renderer, and reports timings as JSON so results can be compared
+ * between builds and machines. Scenes are generated in code so the benchmark
+ * has no external data, XML files can be passed in addition to them.
+ *
+ * Per kernel timings come from the sampling profiler and are only available
+ * for CPU rendering. */
+
+#include <stdio.h>
+
+#include "render/background.h"
+#include "render/buffers.h"
+#include "render/camera.h"
+#include "device/device.h"
+#include "render/graph.h"
+#include "render/image.h"
+#include "render/integrator.h"
+#include "render/light.h"
+#include "render/mesh.h"
+#include "render/nodes.h"
+#include "render/object.h"
+#include "render/scene.h"
+#include "render/session.h"
+#include "render/shader.h"
+
+#include "util/util_args.h"
+#include "util/util_foreach.h"
+#include "util/util_function.h"
+#include "util/util_hash.h"
+#include "util/util_logging.h"
+#include "util/util_path.h"
+#include "util/util_profiling.h"
+#include "util/util_progress.h"
+#include "util/util_string.h"
+#include "util/util_system.h"
+#include "util/util_time.h"
+#include "util/util_transform.h"
+#include "util/util_version.h"
+
+#include "app/cycles_xml.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct BenchmarkOptions {
+	SessionParams session_params;
+	SceneParams scene_params;
+	int width, height;
+	string scenes;
+	string output;
+	vector<string> filepaths;
+	bool quiet;
+} options;
+
+struct BenchmarkResult {
+	string name;
+	int width, height;
+	double sync_time;
+	double scene_update_time;
+	double bvh_build_time;
+	double render_time;
+	uint64_t num_rays;
+	uint64_t num_profiling_samples;
+	uint64_t event_samples[PROFILING_NUM_EVENTS];
+};
+
+/* Helpers */
+
+static float benchmark_random(uint seed, uint index)
+{
+	return (float)hash_int_2d(seed, index) * (1.0f / (float)0xFFFFFFFF);
+}
+
+static Shader *benchmark_add_shader(Scene *scene, const char *name, ShaderGraph *graph)
+{
+	Shader *shader = new Shader();
+	shader->name = ustring(name);
+	shader->set_graph(graph);
+	shader->tag_update(scene);
+	scene->shaders.push_back(shader);
+	return shader;
+}
+
+static Shader *benchmark_diffuse_shader(Scene *scene, float3 color)
+{
+	ShaderGraph *graph = new ShaderGraph();
+	DiffuseBsdfNode *diffuse = new DiffuseBsdfNode();
+	diffuse->color = color;
+	graph->add(diffuse);
+	graph->connect(diffuse->output("BSDF"), graph->output()->input("Surface"));
+	return benchmark_add_shader(scene, "diffuse", graph);
+}
+
+static Shader *benchmark_emission_shader(Scene *scene, float3 color, float strength)
+{
+	ShaderGraph *graph = new ShaderGraph();
+	EmissionNode *emission = new EmissionNode();
+	emission->color = color;
+	emission->strength = strength;
+	graph->add(emission);
+	graph->connect(emission->output("Emission"), graph->output()->input("Surface"));
+	return benchmark_add_shader(scene, "emission", graph);
+}
+
+static void benchmark_set_background(Scene *scene, float3 color, float strength)
+{
+	ShaderGraph *graph = new ShaderGraph();
+	BackgroundNode *background = new BackgroundNode();
+	background->color = color;
+	background->strength = strength;
+	graph->add(background);
+	graph->connect(background->output("Background"), graph->output()->input("Surface"));
+
+	scene->default_background->set_graph(graph);
+	scene->default_background->tag_update(scene);
+}
+
+static Mesh *benchmark_add_mesh(Scene *scene, Shader *shader)
+{
+	Mesh *mesh = new Mesh();
+	mesh->used_shaders.push_back(shader);
+	scene->meshes.push_back(mesh);
+	return mesh;
+}
+
+static Object *benchmark_add_object(Scene *scene, Mesh *mesh, const Transform& tfm)
+{
+	Object *object = new Object();
+	object->mesh = mesh;
+	object->tfm = tfm;
+	scene->objects.push_back(object);
+	return object;
+}
+
+static void benchmark_add_uv(Mesh *mesh, const vector<float2>& uv)
+{
+	Attribute *attr = mesh->attributes.add(ATTR_STD_UV, ustring("UVMap"));
+	float3 *fdata = attr->data_float3();
+
+	for(size_t i = 0; i < mesh->num_triangles(); i++) {
+		const Mesh::Triangle t = mesh->get_triangle(i);
+		for(int j = 0; j < 3; j++) {
+			const float2 co = uv[t.v[j]];
+			*(fdata++) = make_float3(co.x, co.y, 0.0f);
+		}
+	}
+}
+
+static void benchmark_add_generated(Scene *scene, Mesh *mesh)
+{
+	if(mesh->need_attribute(scene, ATTR_STD_GENERATED)) {
+		Attribute *attr = mesh->attributes.add(ATTR_STD_GENERATED);
+		memcpy(attr->data_float3(), mesh->verts.data(), sizeof(float3)*mesh->verts.size());
+	}
+}
+
+/* Square in the XZ plane, centered at the origin. */
+static void benchmark_mesh_plane(Mesh *mesh, float size)
+{
+	const float h = 0.5f * size;
+	mesh->reserve_mesh(4, 2);
+	mesh->add_vertex(make_float3(-h, 0.0f, -h));
+	mesh->add_vertex(make_float3( h, 0.0f, -h));
+	mesh->add_vertex(make_float3( h, 0.0f,  h));
+	mesh->add_vertex(make_float3(-h, 0.0f,  h));
+	mesh->add_triangle(0, 1, 2, 0, false);
+	mesh->add_triangle(0, 2, 3, 0, false);
+
+	vector<float2> uv;
+	uv.push_back(make_float2(0.0f, 0.0f));
+	uv.push_back(make_float2(1.0f, 0.0f));
+	uv.push_back(make_float2(1.0f, 1.0f));
+	uv.push_back(make_float2(0.0f, 1.0f));
+	benchmark_add_uv(mesh, uv);
+}
+
+/* Unit sphere with smooth shading. */
+static void benchmark_mesh_sphere(Mesh *mesh, int segments, int rings)
+{
+	const int num_verts = (segments + 1) * (rings + 1);
+	mesh->reserve_mesh(num_verts, segments * rings * 2);
+
+	vector<float2> uv;
+	for(int r = 0; r <= rings; r++) {
+		const float v = (float)r / rings;
+		const float theta = v * M_PI_F;
+		for(int s = 0; s <= segments; s++) {
+			const float u = (float)s / segments;
+			const float phi = u * M_2PI_F;
+			mesh->add_vertex(make_float3(sinf(theta) * cosf(phi),
+			                             cosf(theta),
+			                             sinf(theta) * sinf(phi)));
+			uv.push_back(make_float2(u, v));
+		}
+	}
+
+	for(int r = 0; r < rings; r++) {
+		for(int s = 0; s < segments; s++) {
+			const int v0 = r * (segments + 1) + s;
+			const int v1 = v0 + 1;
+			const int v2 = v0 + segments + 1;
+			const int v3 = v2 + 1;
+			if(r != 0) {
+				mesh->add_triangle(v0, v1, v3, 0, true);
+			}
+			if(r != rings - 1) {
+				mesh->add_triangle(v0, v3, v2, 0, true);
+			}
+		}
+	}
+
+	benchmark_add_uv(mesh, uv);
+}
+
+/* Cube from -1 to 1. */
+static void benchmark_mesh_box(Mesh *mesh)
+{
+	static const int faces[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1},
+	                                {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+
+	mesh->reserve_mesh(8, 12);
+	for(int i = 0; i < 8; i++) {
+		mesh->add_vertex(make_float3((i & 1) ? 1.0f : -1.0f,
+		                             (i & 2) ? 1.0f : -1.0f,
+		                             (i & 4) ? 1.0f : -1.0f));
+	}
+	for(int i = 0; i < 6; i++) {
+		mesh->add_triangle(faces[i][0], faces[i][1], faces[i][2], 0, false);
+		mesh->add_triangle(faces[i][0], faces[i][2], faces[i][3], 0, false);
+	}
+}
+
+static void benchmark_add_ground(Scene *scene)
+{
+	Shader *shader = benchmark_diffuse_shader(scene, make_float3(0.5f, 0.5f, 0.5f));
+	Mesh *mesh = benchmark_add_mesh(scene, shader);
+	benchmark_mesh_plane(mesh, 100.0f);
+	benchmark_add_object(scene, mesh, transform_identity());
+}
+
+static Light *benchmark_add_point_light(Scene *scene, Shader *shader, float3 co, float size)
+{
+	Light *light = new Light();
+	light->type = LIGHT_POINT;
+	light->co = co;
+	light->size = size;
+	light->shader = shader;
+	scene->lights.push_back(light);
+	return light;
+}
+
+static Light *benchmark_add_sun_light(Scene *scene, float3 dir, float strength)
+{
+	Light *light = new Light();
+	light->type = LIGHT_DISTANT;
+	light->dir = normalize(dir);
+	light->size = 0.05f;
+	light->shader = benchmark_emission_shader(scene, make_float3(1.0f, 1.0f, 1.0f), strength);
+	scene->lights.push_back(light);
+	return light;
+}
+
+static void benchmark_set_camera(Scene *scene, float3 P, float3 target)
+{
+	/* Camera looks along its local Z axis, with Y pointing up. */
+	const float3 up = make_float3(0.0f, 1.0f, 0.0f);
+	const float3 z = normalize(target - P);
+	const float3 x = normalize(cross(up, z));
+	const float3 y = cross(z, x);
+
+	Camera *cam = scene->camera;
+	cam->matrix = make_transform(x.x, y.x, z.x, P.x,
+	                             x.y, y.y, z.y, P.y,
+	                             x.z, y.z, z.z, P.z,
+	                             0.0f, 0.0f, 0.0f, 1.0f);
+	cam->fov = M_PI_4_F;
+	cam->need_update = true;
+}
+
+/* Scenes */
+
+/* Many instances of the same mesh, stressing top level BVH traversal. */
+static void benchmark_scene_instancing(Scene *scene)
+{
+	const int grid = 100;
+
+	benchmark_set_background(scene, make_float3(0.8f, 0.9f, 1.0f), 1.0f);
+	benchmark_add_ground(scene);
+	benchmark_add_sun_light(scene, make_float3(-0.3f, -1.0f, -0.5f), 3.0f);
+
+	Shader *shader = benchmark_diffuse_shader(scene, make_float3(0.8f, 0.3f, 0.2f));
+	Mesh *mesh = benchmark_add_mesh(scene, shader);
+	benchmark_mesh_sphere(mesh, 48, 24);
+
+	for(int i = 0; i < grid * grid; i++) {
+		const float scale = 0.1f + 0.25f * benchmark_random(1, i);
+		const float3 co = make_float3((i % grid) - 0.5f * grid + benchmark_random(2, i),
+		                              scale,
+		                              (i / grid) - 0.5f * grid + benchmark_random(3, i));
+		const Transform tfm = transform_translate(co) *
+		                      transform_rotate(M_2PI_F * benchmark_random(4, i),
+		                                       make_float3(0.0f, 1.0f, 0.0f)) *
+		                      transform_scale(scale, scale, scale);
+		benchmark_add_object(scene, mesh, tfm);
+	}
+
+	benchmark_set_camera(scene, make_float3(0.0f, 15.0f, -45.0f), make_float3(0.0f, 0.0f, 0.0f));
+}
+
+/* Dense hair on a sphere, stressing curve intersection. */
+static void benchmark_scene_hair(Scene *scene)
+{
+	const int num_curves = 100000;
+	const int num_keys = 5;
+
+	benchmark_set_background(scene, make_float3(0.8f, 0.9f, 1.0f), 1.0f);
+	benchmark_add_ground(scene);
+	benchmark_add_sun_light(scene, make_float3(-0.3f, -1.0f, 0.5f), 3.0f);
+
+	Shader *skin = benchmark_diffuse_shader(scene, make_float3(0.6f, 0.4f, 0.3f));
+	Mesh *head = benchmark_add_mesh(scene, skin);
+	benchmark_mesh_sphere(head, 64, 32);
+	const Transform tfm = transform_translate(0.0f, 1.0f, 0.0f);
+	benchmark_add_object(scene, head, tfm);
+
+	ShaderGraph *graph = new ShaderGraph();
+	HairBsdfNode *bsdf = new HairBsdfNode();
+	bsdf->color = make_float3(0.4f, 0.25f, 0.1f);
+	graph->add(bsdf);
+	graph->connect(bsdf->output("BSDF"), graph->output()->input("Surface"));
+	Shader *shader = benchmark_add_shader(scene, "hair", graph);
+
+	Mesh *hair = benchmark_add_mesh(scene, shader);
+	hair->reserve_curves(num_curves, num_curves * num_keys);
+
+	for(int i = 0; i < num_curves; i++) {
+		/* Uniform direction on the sphere, slightly curled downwards. */
+		const float z = 1.0f - 2.0f * benchmark_random(5, i);
+		const float r = safe_sqrtf(1.0f - z * z);
+		const float phi = M_2PI_F * benchmark_random(6, i);
+		const float3 N = make_float3(r * cosf(phi), z, r * sinf(phi));
+		const float length = 0.3f + 0.2f * benchmark_random(7, i);
+
+		const int first_key = hair->curve_keys.size();
+		for(int k = 0; k < num_keys; k++) {
+			const float t = (float)k / (num_keys - 1);
+			const float3 co = N * (1.0f + t * length) -
+			                  make_float3(0.0f, t * t * length, 0.0f);
+			hair->add_curve_key(co, 0.004f * (1.0f - 0.8f * t));
+		}
+		hair->add_curve(first_key, 0);
+	}
+
+	benchmark_add_object(scene, hair, tfm);
+
+	benchmark_set_camera(scene, make_float3(0.0f, 1.5f, -4.0f), make_float3(0.0f, 1.0f, 0.0f));
+}
+
+/* Heterogeneous volume lit by a sun, stressing volume stepping. */
+static void benchmark_scene_volume(Scene *scene)
+{
+	benchmark_set_background(scene, make_float3(0.2f, 0.25f, 0.3f), 1.0f);
+	benchmark_add_ground(scene);
+	benchmark_add_sun_light(scene, make_float3(0.5f, -1.0f, 0.3f), 4.0f);
+
+	ShaderGraph *graph = new ShaderGraph();
+	NoiseTextureNode *noise = new NoiseTextureNode();
+	noise->scale = 2.0f;
+	noise->detail = 4.0f;
+	graph->add(noise);
+	ScatterVolumeNode *scatter = new ScatterVolumeNode();
+	scatter->color = make_float3(0.9f, 0.9f, 0.9f);
+	scatter->anisotropy = 0.3f;
+	graph->add(scatter);
+	graph->connect(noise->output("Fac"), scatter->input("Density"));
+	graph->connect(scatter->output("Volume"), graph->output()->input("Volume"));
+	Shader *shader = benchmark_add_shader(scene, "volume", graph);
+
+	Mesh *mesh = benchmark_add_mesh(scene, shader);
+	benchmark_mesh_box(mesh);
+	benchmark_add_generated(scene, mesh);
+	benchmark_add_object(scene, mesh, transform_translate(0.0f, 1.5f, 0.0f) *
+	                                  transform_scale(2.0f, 1.5f, 2.0f));
+
+	benchmark_set_camera(scene, make_float3(0.0f, 2.5f, -8.0f), make_float3(0.0f, 1.2f, 0.0f));
+}
+
+/* Spheres with subsurface scattering, stressing BSSRDF sampling. */
+static void benchmark_scene_subsurface(Scene *scene)
+{
+	const int grid = 5;
+
+	benchmark_set_background(scene, make_float3(0.8f, 0.9f, 1.0f), 0.5f);
+	benchmark_add_ground(scene);
+	benchmark_add_sun_light(scene, make_float3(-0.5f, -1.0f, 0.5f), 3.0f);
+
+	ShaderGraph *graph = new ShaderGraph();
+	SubsurfaceScatteringNode *sss = new SubsurfaceScatteringNode();
+	sss->color = make_float3(0.9f, 0.6f, 0.5f);
+	sss->radius = make_float3(1.0f, 0.4f, 0.2f);
+	sss->scale = 0.3f;
+	sss->falloff = CLOSURE_BSSRDF_BURLEY_ID;
+	graph->add(sss);
+	graph->connect(sss->output("BSSRDF"), graph->output()->input("Surface"));
+	Shader *shader = benchmark_add_shader(scene, "subsurface", graph);
+
+	Mesh *mesh = benchmark_add_mesh(scene, shader);
+	benchmark_mesh_sphere(mesh, 64, 32);
+
+	for(int i = 0; i < grid * grid; i++) {
+		const float3 co = make_float3(2.5f * ((i % grid) - 0.5f * (grid - 1)),
+		                              1.0f,
+		                              2.5f * ((i / grid) - 0.5f * (grid - 1)));
+		benchmark_add_object(scene, mesh, transform_translate(co));
+	}
+
+	benchmark_set_camera(scene, make_float3(0.0f, 8.0f, -14.0f), make_float3(0.0f, 0.0f, 0.0f));
+}
+
+/* Many small point lights, stressing light selection. */
+static void benchmark_scene_many_lights(Scene *scene)
+{
+	const int num_lights = 1000;
+	const int num_shaders = 8;
+	const int grid = 10;
+
+	benchmark_set_background(scene, make_float3(0.0f, 0.0f, 0.0f), 0.0f);
+	benchmark_add_ground(scene);
+
+	Shader *diffuse = benchmark_diffuse_shader(scene, make_float3(0.8f, 0.8f, 0.8f));
+	Mesh *mesh = benchmark_add_mesh(scene, diffuse);
+	benchmark_mesh_sphere(mesh, 32, 16);
+	for(int i = 0; i < grid * grid; i++) {
+		const float3 co = make_float3(3.0f * ((i % grid) - 0.5f * (grid - 1)),
+		                              0.5f,
+		                              3.0f * ((i / grid) - 0.5f * (grid - 1)));
+		benchmark_add_object(scene, mesh, transform_translate(co) *
+		                                  transform_scale(0.5f, 0.5f, 0.5f));
+	}
+
+	vector<Shader*> shaders;
+	for(int i = 0; i < num_shaders; i++) {
+		const float3 color = make_float3(0.2f + 0.8f * benchmark_random(8, i),
+		                                 0.2f + 0.8f * benchmark_random(9, i),
+		                                 0.2f + 0.8f * benchmark_random(10, i));
+		shaders.push_back(benchmark_emission_shader(scene, color, 20.0f));
+	}
+
+	for(int i = 0; i < num_lights; i++) {
+		const float3 co = make_float3(30.0f * (benchmark_random(11, i) - 0.5f),
+		                              0.2f + 2.0f * benchmark_random(12, i),
+		                              30.0f * (benchmark_random(13, i) - 0.5f));
+		benchmark_add_point_light(scene, shaders[i % num_shaders], co, 0.05f);
+	}
+
+	benchmark_set_camera(scene, make_float3(0.0f, 10.0f, -25.0f), make_float3(0.0f, 0.0f, 0.0f));
+}
+
+/* Procedural image textures, generated on load so no files are needed. */
+#define BENCHMARK_TEXTURE_SIZE 2048
+#define BENCHMARK_NUM_TEXTURES 16
+
+static int benchmark_texture_ids[BENCHMARK_NUM_TEXTURES];
+
+static void benchmark_texture_info(const string& /*filename*/,
+                                   void * /*data*/,
+                                   bool& is_float,
+                                   int& width,
+                                   int& height,
+                                   int& depth,
+                                   int& channels)
+{
+	is_float = false;
+	width = BENCHMARK_TEXTURE_SIZE;
+	height = BENCHMARK_TEXTURE_SIZE;
+	depth = 1;
+	channels = 4;
+}
+
+static bool benchmark_texture_pixels(const string& /*filename*/,
+                                     void *data,
+                                     unsigned char *pixels,
+                                     const size_t pixels_size)
+{
+	const uint id = *(int*)data;
+	const size_t num_pixels = (size_t)BENCHMARK_TEXTURE_SIZE * BENCHMARK_TEXTURE_SIZE;
+	if(pixels_size != num_pixels * 4) {
+		return false;
+	}
+
+	/* Checker pattern with per-pixel noise, so textures don't compress well
+	 * and every texel lookup is a real memory access. */
+	for(size_t i = 0; i < num_pixels; i++) {
+		const int x = i % BENCHMARK_TEXTURE_SIZE;
+		const int y = i / BENCHMARK_TEXTURE_SIZE;
+		const bool checker = ((x >> 6) + (y >> 6) + id) & 1;
+		const uint noise = hash_int_2d(id, (uint)i);
+		pixels[i*4 + 0] = (checker ? 200 : 50) + (noise & 31);
+		pixels[i*4 + 1] = (checker ? 150 : 80) + ((noise >> 8) & 31);
+		pixels[i*4 + 2] = (checker ? 100 : 120) + ((noise >> 16) & 31);
+		pixels[i*4 + 3] = 255;
+	}
+	return true;
+}
+
+static bool benchmark_texture_float_pixels(const string& /*filename*/,
+                                           void * /*data*/,
+                                           float * /*pixels*/,
+                                           const size_t /*pixels_size*/)
+{
+	return false;
+}
+
+/* Many large image textures, stressing texture memory and filtering. */
+static void benchmark_scene_textures(Scene *scene)
+{
+	const int grid = 4;
+
+	benchmark_set_background(scene, make_float3(0.8f, 0.9f, 1.0f), 1.0f);
+	benchmark_add_ground(scene);
+	benchmark_add_sun_light(scene, make_float3(-0.3f, -1.0f, 0.5f), 3.0f);
+
+	ImageManager *image_manager = scene->image_manager;
+	image_manager->builtin_image_info_cb = function_bind(&benchmark_texture_info, _1, _2, _3, _4, _5, _6, _7);
+	image_manager->builtin_image_pixels_cb = function_bind(&benchmark_texture_pixels, _1, _2, _3, _4);
+	image_manager->builtin_image_float_pixels_cb = function_bind(&benchmark_texture_float_pixels, _1, _2, _3, _4);
+
+	Mesh *sphere = NULL;
+	for(int i = 0; i < BENCHMARK_NUM_TEXTURES; i++) {
+		benchmark_texture_ids[i] = i;
+
+		ShaderGraph *graph = new ShaderGraph();
+		ImageTextureNode *image = new ImageTextureNode();
+		image->filename = ustring(string_printf("benchmark_texture_%d", i));
+		image->builtin_data = &benchmark_texture_ids[i];
+		graph->add(image);
+		DiffuseBsdfNode *diffuse = new DiffuseBsdfNode();
+		graph->add(diffuse);
+		graph->connect(image->output("Color"), diffuse->input("Color"));
+		graph->connect(diffuse->output("BSDF"), graph->output()->input("Surface"));
+		Shader *shader = benchmark_add_shader(scene, "texture", graph);
+
+		/* Same geometry for all objects, only shaders differ. */
+		Mesh *mesh = benchmark_add_mesh(scene, shader);
+		if(sphere == NULL) {
+			benchmark_mesh_sphere(mesh, 64, 32);
+			sphere = mesh;
+		}
+		else {
+			mesh->verts = sphere->verts;
+			mesh->reserve_mesh(sphere->verts.size(), sphere->num_triangles());
+			for(size_t t = 0; t < sphere->num_triangles(); t++) {
+				const Mesh::Triangle tri = sphere->get_triangle(t);
+				mesh->add_triangle(tri.v[0], tri.v[1], tri.v[2], 0, true);
+			}
+			Attribute *attr = mesh->attributes.add(ATTR_STD_UV, ustring("UVMap"));
+			const Attribute *sphere_attr = sphere->attributes.find(ATTR_STD_UV);
+			memcpy(attr->data_float3(),
+			       sphere_attr->data_float3(),
+			       sizeof(float3) * 3 * sphere->num_triangles());
+		}
+
+		const float3 co = make_float3(2.5f * ((i % grid) - 0.5f * (grid - 1)),
+		                              1.0f,
+		                              2.5f * ((i / grid) - 0.5f * (grid - 1)));
+		benchmark_add_object(scene, mesh, transform_translate(co));
+	}
+
+	benchmark_set_camera(scene, make_float3(0.0f, 6.0f, -11.0f), make_float3(0.0f, 0.0f, 0.0f));
+}
+
+struct BenchmarkScene {
+	const char *name;
+	void (*create)(Scene *scene);
+};
+
+static const BenchmarkScene benchmark_scenes[] = {
+	{"instancing", benchmark_scene_instancing},
+	{"hair", benchmark_scene_hair},
+	{"volume", benchmark_scene_volume},
+	{"subsurface", benchmark_scene_subsurface},
+	{"many_lights", benchmark_scene_many_lights},
+	{"textures", benchmark_scene_textures},
+};
+
+/* Rendering */
+
+static BenchmarkResult benchmark_render(const string& name,
+                                        const BenchmarkScene *builtin_scene,
+                                        const string& filepath)
+{
+	BenchmarkResult result;
+	memset(result.event_samples, 0, sizeof(result.event_samples));
+	result.name = name;
+
+	Session *session = new Session(options.session_params);
+	Scene *scene = new Scene(options.scene_params, options.session_params.device);
+
+	/* Building the scene is what a host application spends in sync. */
+	const double sync_start = time_dt();
+	if(builtin_scene) {
+		builtin_scene->create(scene);
+	}
+	else {
+		xml_read_file(scene, filepath.c_str());
+	}
+	result.sync_time = time_dt() - sync_start;
+
+	Camera *cam = scene->camera;
+	if(options.width && options.height) {
+		cam->width = options.width;
+		cam->height = options.height;
+	}
+	cam->full_width = cam->width;
+	cam->full_height = cam->height;
+	cam->compute_auto_viewplane();
+	cam->need_update = true;
+	cam->update();
+
+	result.width = cam->width;
+	result.height = cam->height;
+
+	BufferParams buffer_params;
+	buffer_params.width = cam->width;
+	buffer_params.height = cam->height;
+	buffer_params.full_width = cam->width;
+	buffer_params.full_height = cam->height;
+
+	session->scene = scene;
+	session->reset(buffer_params, options.session_params.samples);
+
+	Profiler& profiler = session->stats.profiler;
+	profiler.reset();
+	profiler.start();
+
+	session->start();
+	session->wait();
+
+	profiler.stop();
+
+	double total_time, render_time;
+	session->progress.get_time(total_time, render_time);
+	result.render_time = render_time;
+	result.scene_update_time = total_time - render_time;
+	result.bvh_build_time = session->stats.bvh_build_time;
+
+	result.num_rays = profiler.get_num_rays();
+	result.num_profiling_samples = profiler.get_num_samples();
+	for(int i = 0; i < PROFILING_NUM_EVENTS; i++) {
+		result.event_samples[i] = profiler.get_event((ProfilingEvent)i);
+	}
+
+	delete session;
+
+	if(!options.quiet) {
+		fprintf(stderr, "%-16s render %8.3fs  update %8.3fs  bvh %8.3fs\n",
+		        name.c_str(),
+		        result.render_time,
+		        result.scene_update_time,
+		        result.bvh_build_time);
+	}
+
+	return result;
+}
+
+/* JSON Output */
+
+static string benchmark_json_string(const string& str)
+{
+	string result = "\"";
+	foreach(char c, str) {
+		if(c == '"' || c == '\\') {
+			result += '\\';
+			result += c;
+		}
+		else if((unsigned char)c < 0x20) {
+			result += string_printf("\\u%04x", c);
+		}
+		else {
+			result += c;
+		}
+	}
+	return result + "\"";
+}
+
+static double benchmark_safe_divide(double a, double b)
+{
+	return (b > 0.0) ? a / b : 0.0;
+}
+
+static string benchmark_json_result(const BenchmarkResult& result)
+{
+	const int samples = options.session_params.samples;
+	const double pixel_samples = (double)result.width * result.height * samples;
+	const double num_samples = (double)result.num_profiling_samples;
+
+	string json = "\t\t{\n";
+	json += "\t\t\t\"name\": " + benchmark_json_string(result.name) + ",\n";
+	json += string_printf("\t\t\t\"width\": %d,\n", result.width);
+	json += string_printf("\t\t\t\"height\": %d,\n", result.height);
+	json += string_printf("\t\t\t\"sync_time\": %f,\n", result.sync_time);
+	json += string_printf("\t\t\t\"scene_update_time\": %f,\n", result.scene_update_time);
+	json += string_printf("\t\t\t\"bvh_build_time\": %f,\n", result.bvh_build_time);
+	json += string_printf("\t\t\t\"render_time\": %f,\n", result.render_time);
+	json += string_printf("\t\t\t\"samples_per_second\": %f,\n",
+	                      benchmark_safe_divide(pixel_samples, result.render_time));
+	json += string_printf("\t\t\t\"num_rays\": %llu,\n", (unsigned long long)result.num_rays);
+	json += string_printf("\t\t\t\"rays_per_second\": %f,\n",
+	                      benchmark_safe_divide((double)result.num_rays, result.render_time));
+
+	/* Share of render time spent in each part of the kernel, nested parts are
+	 * not included in their parent. */
+	json += "\t\t\t\"kernel\": {\n";
+	for(int i = 0; i < PROFILING_NUM_EVENTS; i++) {
+		const double fraction = benchmark_safe_divide((double)result.event_samples[i], num_samples);
+		json += string_printf("\t\t\t\t\"%s\": {\"fraction\": %f, \"time\": %f}%s\n",
+		                      profiling_event_name((ProfilingEvent)i),
+		                      fraction,
+		                      fraction * result.render_time,
+		                      (i + 1 < PROFILING_NUM_EVENTS) ? "," : "");
+	}
+	json += "\t\t\t},\n";
+
+	/* Coarse breakdown into intersection, shading and light sampling. */
+	const uint64_t *ev = result.event_samples;
+	const double intersection = benchmark_safe_divide((double)(ev[PROFILING_INTERSECT] +
+	                                                           ev[PROFILING_INTERSECT_SHADOW] +
+	                                                           ev[PROFILING_INTERSECT_SUBSURFACE] +
+	                                                           ev[PROFILING_INTERSECT_VOLUME]),
+	                                                  num_samples);
+	const double shading = benchmark_safe_divide((double)(ev[PROFILING_SHADER_SETUP] +
+	                                                      ev[PROFILING_SHADER_EVAL] +
+	                                                      ev[PROFILING_SURFACE_BOUNCE]),
+	                                             num_samples);
+	const double light_sampling = benchmark_safe_divide((double)ev[PROFILING_LIGHT_SAMPLE], num_samples);
+	const double other = (num_samples > 0.0) ? 1.0 - intersection - shading - light_sampling : 0.0;
+
+	json += "\t\t\t\"kernel_summary\": {\n";
+	json += string_printf("\t\t\t\t\"intersection\": %f,\n", intersection);
+	json += string_printf("\t\t\t\t\"shading\": %f,\n", shading);
+	json += string_printf("\t\t\t\t\"light_sampling\": %f,\n", light_sampling);
+	json += string_printf("\t\t\t\t\"other\": %f\n", other);
+	json += "\t\t\t}\n";
+	json += "\t\t}";
+	return json;
+}
+
+static string benchmark_json(const vector<BenchmarkResult>& results)
+{
+	const DeviceInfo& device = options.session_params.device;
+
+	string json = "{\n";
+	json += "\t\"version\": " + benchmark_json_string(CYCLES_VERSION_STRING) + ",\n";
+	json += "\t\"device\": " + benchmark_json_string(device.description) + ",\n";
+	json += string_printf("\t\"threads\": %d,\n", (options.session_params.threads > 0)
+	                                                  ? options.session_params.threads
+	                                                  : system_cpu_thread_count());
+	json += string_printf("\t\"samples\": %d,\n", options.session_params.samples);
+	json += "\t\"scenes\": [\n";
+	for(size_t i = 0; i < results.size(); i++) {
+		json += benchmark_json_result(results[i]);
+		json += (i + 1 < results.size()) ? ",\n" : "\n";
+	}
+	json += "\t]\n";
+	json += "}\n";
+	return json;
+}
+
+/* Options */
+
+static int files_parse(int argc, const char *argv[])
+{
+	for(int i = 0; i < argc; i++) {
+		options.filepaths.push_back(argv[i]);
+	}
+	return 0;
+}
+
+static void options_parse(int argc, const char **argv)
+{
+	options.width = 960;
+	options.height = 540;
+	options.quiet = false;
+	options.session_params.samples = 16;
+	options.session_params.background = true;
+
+	string devicename = "CPU";
+	bool list = false, help = false, debug = false;
+	int verbosity = 1;
+
+	string scene_names;
+	for(size_t i = 0; i < sizeof(benchmark_scenes) / sizeof(*benchmark_scenes); i++) {
+		scene_names += (i == 0) ? "" : ",";
+		scene_names += benchmark_scenes[i].name;
+	}
+	options.scenes = scene_names;
+
+	ArgParse ap;
+	ap.options ("Usage: cycles_benchmark [options] [file.xml ...]",
+		"%*", files_parse, "",
+		"--device %s", &devicename, "Device to use",
+		"--samples %d", &options.session_params.samples, "Number of samples to render",
+		"--threads %d", &options.session_params.threads, "CPU Rendering Threads",
+		"--width %d", &options.width, "Image width in pixels",
+		"--height %d", &options.height, "Image height in pixels",
+		"--tile-width %d", &options.session_params.tile_size.x, "Tile width in pixels",
+		"--tile-height %d", &options.session_params.tile_size.y, "Tile height in pixels",
+		"--scenes %s", &options.scenes, ("Comma separated list of builtin scenes to render: " + scene_names).c_str(),
+		"--output %s", &options.output, "File path to write JSON results to, standard output by default",
+		"--quiet", &options.quiet, "Don't print progress messages",
+		"--list-devices", &list, "List information about all available devices",
+#ifdef WITH_CYCLES_LOGGING
+		"--debug", &debug, "Enable debug logging",
+		"--verbose %d", &verbosity, "Set verbosity of the logger",
+#endif
+		"--help", &help, "Print help message",
+		NULL);
+
+	if(ap.parse(argc, argv) < 0) {
+		fprintf(stderr, "%s\n", ap.geterror().c_str());
+		ap.usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if(debug) {
+		util_logging_start();
+		util_logging_verbosity_set(verbosity);
+	}
+
+	if(help) {
+		ap.usage();
+		exit(EXIT_SUCCESS);
+	}
+
+	if(list) {
+		vector<DeviceInfo>& devices = Device::available_devices();
+		printf("Devices:\n");
+		foreach(DeviceInfo& info, devices) {
+			printf("    %-10s%s\n",
+			       Device::string_from_type(info.type).c_str(),
+			       info.description.c_str());
+		}
+		exit(EXIT_SUCCESS);
+	}
+
+	DeviceType device_type = Device::type_from_string(devicename.c_str());
+	bool device_available = false;
+	foreach(DeviceInfo& device, Device::available_devices()) {
+		if(device_type == device.type) {
+			options.session_params.device = device;
+			device_available = true;
+			break;
+		}
+	}
+
+	if(!device_available) {
+		fprintf(stderr, "Unknown device: %s\n", devicename.c_str());
+		exit(EXIT_FAILURE);
+	}
+	else if(options.session_params.samples <= 0) {
+		fprintf(stderr, "Invalid number of samples: %d\n", options.session_params.samples);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Final render with tiles, same as background renders from Blender. */
+	options.session_params.progressive = false;
+	options.scene_params.bvh_type = SceneParams::BVH_STATIC;
+}
+
+CCL_NAMESPACE_END
+
+using namespace ccl;
+
+int main(int argc, const char **argv)
+{
+	util_logging_init(argv[0]);
+	path_init();
+	options_parse(argc, argv);
+
+	vector<BenchmarkResult> results;
+
+	vector<string> names;
+	string_split(names, options.scenes, ",");
+	foreach(const string& name, names) {
+		const BenchmarkScene *builtin_scene = NULL;
+		for(size_t i = 0; i < sizeof(benchmark_scenes) / sizeof(*benchmark_scenes); i++) {
+			if(name == benchmark_scenes[i].name) {
+				builtin_scene = &benchmark_scenes[i];
+			}
+		}
+		if(builtin_scene == NULL) {
+			fprintf(stderr, "Unknown benchmark scene: %s\n", name.c_str());
+			return EXIT_FAILURE;
+		}
+		results.push_back(benchmark_render(name, builtin_scene, ""));
+	}
+
+	foreach(const string& filepath, options.filepaths) {
+		results.push_back(benchmark_render(path_filename(filepath), NULL, filepath));
+	}
+
+	const string json = benchmark_json(results);
+
+	if(options.output == "") {
+		printf("%s", json.c_str());
+	}
+	else {
+		FILE *f = path_fopen(options.output, "wb");
+		if(!f || fwrite(json.data(), 1, json.size(), f) != json.size()) {
+			fprintf(stderr, "Failed to write %s\n", options.output.c_str());
+			if(f) {
+				fclose(f);
+			}
+			return EXIT_FAILURE;
+		}
+		fclose(f);
+	}
+
+	return 0;
+}
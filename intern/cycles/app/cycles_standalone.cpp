@@ -441,6 +441,19 @@ static void options_parse(int argc, const char **argv)
 		}
 	}
 
+	/* Distribute tiles over all listed network servers. */
+	if(device_type == DEVICE_NETWORK) {
+		vector<DeviceInfo> network_devices;
+
+		foreach(DeviceInfo& device, devices) {
+			if(device.type == DEVICE_NETWORK)
+				network_devices.push_back(device);
+		}
+
+		if(network_devices.size() > 1)
+			options.session_params.device = Device::get_multi_device(network_devices);
+	}
+
 	/* handle invalid configurations */
 	if(options.session_params.device.type == DEVICE_NONE || !device_available) {
 		fprintf(stderr, "Unknown device: %s\n", devicename.c_str());
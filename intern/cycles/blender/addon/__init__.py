@@ -136,6 +136,8 @@ def register():
         register_class(cls)
 
     bpy.app.handlers.version_update.append(version_update.do_versions)
+    bpy.app.handlers.frame_change_post.append(engine.frame_change_post)
+    bpy.app.handlers.scene_update_post.append(engine.scene_update_post)
 
 
 def unregister():
@@ -146,6 +148,8 @@ def unregister():
     import atexit
 
     bpy.app.handlers.version_update.remove(version_update.do_versions)
+    bpy.app.handlers.frame_change_post.remove(engine.frame_change_post)
+    bpy.app.handlers.scene_update_post.remove(engine.scene_update_post)
 
     ui.unregister()
     properties.unregister()
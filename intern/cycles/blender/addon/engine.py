@@ -16,6 +16,12 @@
 
 # <pep8 compliant>
 
+from bpy.app.handlers import persistent
+
+# Sessions of final renders which are not rendering at the moment, these keep
+# their scene between frames when persistent data is enabled.
+_idle_render_sessions = set()
+
 
 def _is_using_buggy_driver():
     import bgl
@@ -144,11 +150,15 @@ def create(engine, data, scene, region=None, v3d=None, rv3d=None, preview_osl=Fa
 
     engine.session = _cycles.create(engine.as_pointer(), userpref, data, scene, region, v3d, rv3d, preview_osl)
 
+    if not region:
+        _idle_render_sessions.add(engine.session)
+
 
 def free(engine):
     if hasattr(engine, "session"):
         if engine.session:
             import _cycles
+            _idle_render_sessions.discard(engine.session)
             _cycles.free(engine.session)
         del engine.session
 
@@ -156,7 +166,11 @@ def free(engine):
 def render(engine):
     import _cycles
     if hasattr(engine, "session"):
-        _cycles.render(engine.session)
+        _idle_render_sessions.discard(engine.session)
+        try:
+            _cycles.render(engine.session)
+        finally:
+            _idle_render_sessions.add(engine.session)
 
 
 def bake(engine, obj, pass_type, pass_filter, object_id, pixel_array, num_pixels, depth, result):
@@ -178,6 +192,30 @@ def update(engine, data, scene):
     _cycles.sync(engine.session)
 
 
+def _tag_recalc_idle_sessions():
+    if not _idle_render_sessions:
+        return
+
+    import _cycles
+    for session in list(_idle_render_sessions):
+        _cycles.tag_recalc(session)
+
+
+@persistent
+def frame_change_post(scene):
+    # Blender clears update tags of the depsgraph once the frame has changed,
+    # before render engines are reset for the next frame. Collect them here so
+    # persistent sessions know what to synchronize again.
+    _tag_recalc_idle_sessions()
+
+
+@persistent
+def scene_update_post(scene):
+    # Edits made between frames (by scripts or drivers) are only tagged until
+    # the next scene update, collect them the same way.
+    _tag_recalc_idle_sessions()
+
+
 def draw(engine, region, v3d, rv3d):
     import _cycles
     v3d = v3d.as_pointer()
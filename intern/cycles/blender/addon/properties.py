@@ -52,6 +52,12 @@ enum_bvh_types = (
     ('STATIC_BVH', "Static BVH", "Any object modification requires a complete BVH rebuild, but renders faster"),
     )
 
+enum_bvh_node_compression = (
+    ('NONE', "None", "Store BVH node bounds at full precision"),
+    ('8BIT', "8 bit", "Quantize BVH node bounds to 8 bits"),
+    ('16BIT', "16 bit", "Quantize BVH node bounds to 16 bits"),
+    )
+
 enum_filter_types = (
     ('BOX', "Box", "Box filter"),
     ('GAUSSIAN', "Gaussian", "Gaussian filter"),
@@ -295,6 +301,29 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 min=0.0, max=1.0,
                 default=0.05,
                 )
+        cls.use_light_tree = BoolProperty(
+                name="Light Tree",
+                description="Pick lights by their estimated contribution to the shading point instead of by power alone, "
+                            "reduces noise in scenes with many lights (CPU only)",
+                default=False,
+                )
+        cls.adaptive_threshold = FloatProperty(
+                name="Noise Threshold",
+                description="Stop sampling pixels once their estimated noise level is below this threshold, "
+                            "lower values give less noise but longer render times. "
+                            "Zero disables adaptive sampling (CPU final renders only)",
+                min=0.0, max=1.0,
+                soft_max=0.1,
+                default=0.0,
+                precision=4,
+                )
+        cls.adaptive_min_samples = IntProperty(
+                name="Adaptive Min Samples",
+                description="Number of samples every pixel gets before adaptive sampling starts to test it "
+                            "for convergence, zero to determine it automatically",
+                min=0, max=4096,
+                default=0,
+                )
 
         cls.caustics_reflective = BoolProperty(
                 name="Reflective Caustics",
@@ -393,6 +422,19 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 min=2, max=65536
                 )
 
+        cls.volume_skip_empty = BoolProperty(
+                name="Skip Empty Space",
+                description="Skip steps through parts of smoke and other voxel volumes where all voxel data is zero, "
+                            "assuming the volume shader does not produce any density there",
+                default=False,
+                )
+        cls.volume_majorant_tracking = BoolProperty(
+                name="Majorant Tracking",
+                description="Sample distances and shadows in smoke and other voxel volumes by tracking against "
+                            "an upper bound of the density per region of voxels, instead of fixed size steps",
+                default=True,
+                )
+
         cls.dicing_rate = FloatProperty(
                 name="Dicing Rate",
                 description="Size of a micropolygon in pixels",
@@ -414,6 +456,32 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 min=0, max=16,
                 default=12,
                 )
+        cls.use_dicing_cache = BoolProperty(
+                name="Dicing Cache",
+                description="Keep diced and displaced geometry of adaptive subdivision meshes "
+                            "and reuse it while subdivision, displacement and camera distance "
+                            "are unchanged",
+                default=False,
+                )
+        cls.dicing_cache_path = StringProperty(
+                name="Dicing Cache Path",
+                description="Absolute path of directory to also store diced geometry in, "
+                            "to reuse it in following sessions, leave empty to only cache in memory",
+                subtype='DIR_PATH',
+                default="",
+                )
+        cls.use_lazy_dicing = BoolProperty(
+                name="Lazy Dicing",
+                description="Only dice adaptive subdivision patches when they are first hit by a ray, "
+                            "keeping a limited amount of diced geometry in memory (Embree only)",
+                default=False,
+                )
+        cls.lazy_dicing_cache_size = IntProperty(
+                name="Cache Size",
+                description="Maximum memory in megabytes used for lazily diced geometry",
+                min=16, max=65536,
+                default=1024,
+                )
 
         cls.film_exposure = FloatProperty(
                 name="Exposure",
@@ -533,17 +601,50 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 description="Use special type BVH optimized for hair (uses more ram but renders faster)",
                 default=True,
                 )
+        cls.debug_use_hair_strands = BoolProperty(
+                name="Use Hair Strands",
+                description="Group consecutive segments of hair strands into BVH leaves oriented along the strand, "
+                            "which are intersected together",
+                default=True,
+                )
         cls.debug_bvh_time_steps = IntProperty(
                 name="BVH Time Steps",
                 description="Split BVH primitives by this number of time steps to speed up render time in cost of memory",
                 default=0,
                 min=0, max=16,
                 )
+        cls.debug_bvh_refit_threshold = FloatProperty(
+                name="BVH Refit Threshold",
+                description="Rebuild the BVH of a deforming object instead of refitting it once its "
+                            "estimated traversal cost grew by this factor, zero to always refit",
+                default=1.5,
+                min=0.0, soft_min=1.0, soft_max=4.0,
+                )
+        cls.debug_bvh_node_compression = EnumProperty(
+                name="BVH Node Compression",
+                description="Quantize BVH node bounds to use less memory and improve cache "
+                            "efficiency, in cost of slightly looser bounds (CPU only)",
+                items=enum_bvh_node_compression,
+                default='NONE',
+                )
         cls.use_bvh_embree = BoolProperty(
                 name="Use embree",
                 description="Use embree as ray accelerator",
                 default=False,
                 )
+        cls.use_bvh_cache = BoolProperty(
+                name="Use BVH Cache",
+                description="Store object BVHs on disk and reuse them for unchanged meshes "
+                            "in following renders",
+                default=False,
+                )
+        cls.bvh_cache_path = StringProperty(
+                name="BVH Cache Path",
+                description="Absolute path of directory to store BVH cache in, "
+                            "leave empty to use the user cache directory",
+                subtype='DIR_PATH',
+                default="",
+                )
         cls.tile_order = EnumProperty(
                 name="Tile Order",
                 description="Tile order for rendering",
@@ -551,6 +652,12 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 default='HILBERT_SPIRAL',
                 options=set(),  # Not animatable!
                 )
+        cls.use_tile_splitting = BoolProperty(
+                name="Split Tiles",
+                description="Split the remaining tiles at the end of the render, "
+                            "so all CPU threads stay busy until the image is finished",
+                default=True,
+                )
         cls.use_progressive_refine = BoolProperty(
                 name="Progressive Refine",
                 description="Instead of rendering each tile until it is finished, "
@@ -705,6 +812,12 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
             min = 0.0, max = 1.0
         )
 
+        cls.texture_use_half_float = BoolProperty(
+            name="Half Float Textures",
+            default=False,
+            description="Store float image textures with half precision, halving their memory usage. Values above 65504 are clamped"
+        )
+
         cls.ao_bounces = IntProperty(
             name="AO Bounces",
             default=0,
@@ -732,6 +845,11 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         cls.debug_use_cpu_sse3 = BoolProperty(name="SSE3", default=True)
         cls.debug_use_cpu_sse2 = BoolProperty(name="SSE2", default=True)
         cls.debug_use_qbvh = BoolProperty(name="QBVH", default=True)
+        cls.debug_use_cpu_ray_packets = BoolProperty(
+                name="Ray Packets",
+                description="Intersect camera rays of neighbour pixels together",
+                default=True,
+                )
         cls.debug_use_cpu_split_kernel = BoolProperty(name="Split Kernel", default=False)
 
         cls.debug_use_cuda_adaptive_compile = BoolProperty(name="Adaptive Compile", default=False)
@@ -972,6 +1090,14 @@ class CyclesMaterialSettings(bpy.types.PropertyGroup):
                 items=enum_displacement_methods,
                 default='BUMP',
                 )
+        cls.displacement_bound = FloatProperty(
+                name="Displacement Bound",
+                description="Maximum distance true displacement moves the surface, "
+                            "patches diced lazily are not hit beyond it",
+                min=0.0, soft_max=10.0,
+                default=0.1,
+                subtype='DISTANCE',
+                )
 
         cls.override_samples = BoolProperty(
                 name="Override Samples",
@@ -1422,6 +1548,33 @@ class CyclesRenderLayerSettings(bpy.types.PropertyGroup):
                 default=False,
                 update=update_render_passes,
                 )
+        cls.use_denoising = BoolProperty(
+                name="Use Denoising",
+                description="Denoise the rendered image, only for final renders on the CPU "
+                            "without adaptive sampling",
+                default=False,
+                )
+        cls.denoising_radius = IntProperty(
+                name="Denoising Radius",
+                description="Size of the image area that's used to denoise a pixel "
+                            "(higher values are smoother, but might lose detail and are slower)",
+                min=1, max=25,
+                default=8,
+                )
+        cls.denoising_strength = FloatProperty(
+                name="Denoising Strength",
+                description="Controls neighbor pixel weighting for the denoising filter "
+                            "(lower values preserve more detail, but aren't as smooth)",
+                min=0.0, max=1.0,
+                default=0.5,
+                )
+        cls.denoising_feature_strength = FloatProperty(
+                name="Denoising Feature Strength",
+                description="Controls how much pixels with different normal, albedo and depth are mixed "
+                            "(lower values preserve more detail, but aren't as smooth)",
+                min=0.0, max=1.0,
+                default=0.5,
+                )
     @classmethod
     def unregister(cls):
         del bpy.types.SceneRenderLayer.cycles
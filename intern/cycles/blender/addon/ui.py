@@ -228,6 +228,14 @@ class CyclesRender_PT_sampling(CyclesButtonsPanel, Panel):
         sub.prop(cscene, "sample_clamp_indirect")
         sub.prop(cscene, "light_sampling_threshold")
 
+        sub = col.column(align=True)
+        sub.active = use_cpu(context)
+        sub.prop(cscene, "use_light_tree")
+        sub.prop(cscene, "adaptive_threshold")
+        subsub = sub.row(align=True)
+        subsub.active = cscene.adaptive_threshold > 0.0
+        subsub.prop(cscene, "adaptive_min_samples", text="Min Samples")
+
         if cscene.progressive == 'PATH' or use_branched_path(context) is False:
             col = split.column()
             sub = col.column(align=True)
@@ -290,6 +298,8 @@ class CyclesRender_PT_geometry(CyclesButtonsPanel, Panel):
             sub.label("Volume Sampling:")
             sub.prop(cscene, "volume_step_size")
             sub.prop(cscene, "volume_max_steps")
+            sub.prop(cscene, "volume_skip_empty")
+            sub.prop(cscene, "volume_majorant_tracking")
 
             col = split.column()
 
@@ -299,12 +309,24 @@ class CyclesRender_PT_geometry(CyclesButtonsPanel, Panel):
             sub.prop(cscene, "preview_dicing_rate", text="Preview")
             sub.separator()
             sub.prop(cscene, "max_subdivisions")
+            sub.separator()
+            sub.prop(cscene, "use_dicing_cache")
+            row = sub.row()
+            row.active = cscene.use_dicing_cache
+            row.prop(cscene, "dicing_cache_path", text="")
+            sub.separator()
+            sub.prop(cscene, "use_lazy_dicing")
+            row = sub.row()
+            row.active = cscene.use_lazy_dicing and cscene.use_bvh_embree
+            row.prop(cscene, "lazy_dicing_cache_size")
         else:
             row = layout.row()
             row.label("Volume Sampling:")
             row = layout.row()
             row.prop(cscene, "volume_step_size")
             row.prop(cscene, "volume_max_steps")
+            layout.prop(cscene, "volume_skip_empty")
+            layout.prop(cscene, "volume_majorant_tracking")
 
         layout.prop(ccscene, "use_curves", text="Use Hair")
         col = layout.column()
@@ -462,6 +484,10 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         sub.prop(rd, "tile_x", text="X")
         sub.prop(rd, "tile_y", text="Y")
 
+        subsub = sub.column(align=True)
+        subsub.active = not cscene.use_progressive_refine and not rd.use_save_buffers
+        subsub.prop(cscene, "use_tile_splitting")
+
         sub.prop(cscene, "use_progressive_refine")
 
         subsub = sub.column(align=True)
@@ -478,6 +504,7 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         sub.prop(cscene, "texture_tile_size")
         sub.prop(cscene, "texture_blur_diffuse")
         sub.prop(cscene, "texture_blur_glossy")
+        sub.prop(cscene, "texture_use_half_float")
 
         col = split.column(align=True)
 
@@ -489,7 +516,7 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         col.separator()
 
         col.label(text="Final Render:")
-        col.prop(rd, "use_persistent_data", text="Persistent Images")
+        col.prop(rd, "use_persistent_data", text="Persistent Data")
 
         col.separator()
 
@@ -502,11 +529,29 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         row = col.row()
         row.active = not cscene.use_bvh_embree
         row.prop(cscene, "debug_use_hair_bvh")
+        row = col.row()
+        row.active = cscene.debug_use_hair_bvh and not cscene.debug_use_spatial_splits and not cscene.use_bvh_embree
+        row.prop(cscene, "debug_use_hair_strands")
 
         row = col.row()
         row.active = not cscene.debug_use_spatial_splits and not cscene.use_bvh_embree
         row.prop(cscene, "debug_bvh_time_steps")
 
+        row = col.row()
+        row.active = not cscene.use_bvh_embree
+        row.prop(cscene, "debug_bvh_refit_threshold", text="Refit Threshold")
+
+        row = col.row()
+        row.active = use_cpu(context) and not cscene.use_bvh_embree
+        row.prop(cscene, "debug_bvh_node_compression", text="Compression")
+
+        row = col.row()
+        row.active = not cscene.use_bvh_embree
+        row.prop(cscene, "use_bvh_cache")
+        row = col.row()
+        row.active = cscene.use_bvh_cache and not cscene.use_bvh_embree
+        row.prop(cscene, "bvh_cache_path", text="")
+
 class CyclesRender_AOV_add(bpy.types.Operator):
     """Add an AOV pass"""
     bl_idname="scenerenderlayer.aov_add"
@@ -717,6 +762,31 @@ class CyclesRender_PT_views(CyclesButtonsPanel, Panel):
             row.prop(rv, "camera_suffix", text="")
 
 
+class CyclesRender_PT_denoising(CyclesButtonsPanel, Panel):
+    bl_label = "Denoising"
+    bl_context = "render_layer"
+    bl_options = {'DEFAULT_CLOSED'}
+
+    def draw_header(self, context):
+        rl = context.scene.render.layers.active
+        crl = rl.cycles
+        self.layout.prop(crl, "use_denoising", text="")
+
+    def draw(self, context):
+        layout = self.layout
+
+        cscene = context.scene.cycles
+        rl = context.scene.render.layers.active
+        crl = rl.cycles
+
+        layout.active = crl.use_denoising and use_cpu(context) and cscene.adaptive_threshold == 0.0
+
+        col = layout.column(align=True)
+        col.prop(crl, "denoising_radius", text="Radius")
+        col.prop(crl, "denoising_strength", slider=True, text="Strength")
+        col.prop(crl, "denoising_feature_strength", slider=True, text="Feature Strength")
+
+
 class Cycles_PT_post_processing(CyclesButtonsPanel, Panel):
     bl_label = "Post Processing"
     bl_options = {'DEFAULT_CLOSED'}
@@ -1386,6 +1456,9 @@ class CyclesMaterial_PT_settings(CyclesButtonsPanel, Panel):
             col.separator()
             col.label(text="Displacement:")
             col.prop(cmat, "displacement_method", text="")
+            sub = col.column()
+            sub.active = cmat.displacement_method != 'BUMP' and context.scene.cycles.use_lazy_dicing
+            sub.prop(cmat, "displacement_bound", text="Bound")
 
         col = split.column()
         col.label(text="Volume:")
@@ -1705,6 +1778,7 @@ class CyclesRender_PT_debug(CyclesButtonsPanel, Panel):
         row.prop(cscene, "debug_use_cpu_avx", toggle=True)
         row.prop(cscene, "debug_use_cpu_avx2", toggle=True)
         col.prop(cscene, "debug_use_qbvh")
+        col.prop(cscene, "debug_use_cpu_ray_packets")
         col.prop(cscene, "debug_use_cpu_split_kernel")
 
         col = layout.column()
@@ -1915,6 +1989,7 @@ classes = (
     CyclesRender_PT_layer_options,
     CyclesRender_PT_layer_passes,
     CyclesRender_PT_views,
+    CyclesRender_PT_denoising,
     Cycles_PT_post_processing,
     CyclesCamera_PT_dof,
     Cycles_PT_context_material,
@@ -1186,6 +1186,8 @@ Mesh *BlenderSync::sync_mesh(BL::Object& b_ob,
 	array<float3> oldcurve_keys = mesh->curve_keys;
 	array<float> oldcurve_radius = mesh->curve_radius;
 
+	/* Keep diced geometry to restore in case the mesh did not change. */
+	scene->mesh_manager->dicing_cache.release(mesh);
 	mesh->clear();
 	mesh->used_shaders = used_shaders;
 	mesh->name = ustring(b_ob_data.name().c_str());
@@ -310,6 +310,11 @@ Object *BlenderSync::sync_object(BL::Object& b_parent,
 		object_updated = true;
 	
 	bool use_holdout = (layer_flag & render_layer.holdout_layer) != 0;
+
+	/* remember state which needs a full object update when changed */
+	Mesh *prev_mesh = object->mesh;
+	uint prev_visibility = object->visibility;
+	bool prev_is_shadow_catcher = object->is_shadow_catcher;
 	
 	/* mesh sync */
 	object->mesh = sync_mesh(b_ob, object_updated, hide_tris);
@@ -419,7 +424,22 @@ Object *BlenderSync::sync_object(BL::Object& b_parent,
 			printf( "\t dupli object\n" );
 		}
 		*/
-		object->tag_update(scene);
+
+		/* Moving objects around is the most common interactive edit, only
+		 * update the packed object and top level BVH when the mesh and flags
+		 * which affect the BVH stay the same. Everything else the object
+		 * update writes is part of its packed data anyway. */
+		bool transform_only = object->mesh &&
+		                      object->mesh == prev_mesh &&
+		                      !object->mesh->need_update &&
+		                      object->visibility == prev_visibility &&
+		                      object->is_shadow_catcher == prev_is_shadow_catcher &&
+		                      scene->need_motion() == Scene::MOTION_NONE;
+
+		if(transform_only)
+			object->tag_transform_update(scene);
+		else
+			object->tag_update(scene);
 	}
 
 	return object;
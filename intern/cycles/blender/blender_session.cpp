@@ -71,6 +71,7 @@ BlenderSession::BlenderSession(BL::RenderEngine& b_engine,
 	last_redraw_time = 0.0;
 	start_resize_time = 0.0;
 	last_status_time = 0.0;
+	recalc_frame = -1;
 }
 
 BlenderSession::BlenderSession(BL::RenderEngine& b_engine,
@@ -97,6 +98,7 @@ BlenderSession::BlenderSession(BL::RenderEngine& b_engine,
 	last_redraw_time = 0.0;
 	start_resize_time = 0.0;
 	last_status_time = 0.0;
+	recalc_frame = -1;
 }
 
 BlenderSession::~BlenderSession()
@@ -174,6 +176,17 @@ void BlenderSession::create_session()
 
 void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 {
+	/* sync object of the previous render is only kept with persistent data,
+	 * and can only be reused if it refers to the same blender data. if the
+	 * frame changed without the update handlers collecting its recalc flags
+	 * we can not know what changed, so everything is synchronized again */
+	const bool reuse_sync = (sync != NULL &&
+	                         b_data_.ptr.data == b_data.ptr.data &&
+	                         b_scene_.ptr.data == b_scene.ptr.data &&
+	                         recalc_frame == b_scene_.frame_current());
+
+	recalc_frame = -1;
+
 	b_data = b_data_;
 	b_render = b_engine.render();
 	b_scene = b_scene_;
@@ -193,7 +206,7 @@ void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 		 * them rather than trying to distinguish which settings need to be updated
 		 */
 
-		delete session;
+		free_session();
 
 		create_session();
 
@@ -201,7 +214,22 @@ void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 	}
 
 	session->progress.reset();
-	scene->reset();
+
+	if(reuse_sync) {
+		/* keep scene and device data of the previous frame, only what changed
+		 * since then is synchronized again. most of the recalc flags were
+		 * already collected by tag_recalc() from the scene update and frame
+		 * change handlers, blender clears them before the render engine gets
+		 * reset for the next frame */
+		sync->sync_recalc();
+	}
+	else {
+		scene->reset();
+
+		/* sync object should be re-created */
+		delete sync;
+		sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, is_cpu);
+	}
 
 	session->tile_manager.set_tile_order(session_params.tile_order);
 
@@ -210,9 +238,6 @@ void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 	 */
 	session->stats.mem_peak = session->stats.mem_used;
 
-	/* sync object should be re-created */
-	sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, is_cpu);
-
 	/* for final render we will do full data sync per render layer, only
 	 * do some basic syncing here, no objects or materials for speed */
 	BL::Object b_camera_override(b_engine.camera_override());
@@ -405,6 +430,14 @@ void BlenderSession::render()
 		buffer_params.passes = scene->film->passes;
 		scene->integrator->tag_update(scene);
 
+		/* Denoising settings are per render layer. */
+		PointerRNA crl = RNA_pointer_get(&b_layer_iter->ptr, "cycles");
+		DenoiseParams denoising;
+		denoising.radius = get_int(crl, "denoising_radius");
+		denoising.strength = get_float(crl, "denoising_strength");
+		denoising.feature_strength = get_float(crl, "denoising_feature_strength");
+		session->set_denoising(get_boolean(crl, "use_denoising"), denoising);
+
 		int view_index = 0;
 		for(b_rr.views.begin(b_view_iter); b_view_iter != b_rr.views.end(); ++b_view_iter, ++view_index) {
 			b_rview_name = b_view_iter->name();
@@ -479,6 +512,14 @@ void BlenderSession::render()
 	session->write_render_tile_cb = function_null;
 	session->update_render_tile_cb = function_null;
 
+	/* with persistent data, scene and device memory are kept for the next
+	 * frame, which only needs to update what changed */
+	if(scene->params.persistent_data) {
+		VLOG(1) << "Keeping device data for the next render.";
+		recalc_frame = b_scene.frame_current();
+		return;
+	}
+
 	/* free all memory used (host and device), so we wouldn't leave render
 	 * engine with extra memory allocated
 	 */
@@ -489,21 +530,22 @@ void BlenderSession::render()
 	sync = NULL;
 }
 
-static void populate_bake_data(BakeData *data, const
-                               int object_id,
-                               BL::BakePixel& pixel_array,
-                               const int num_pixels)
+/* Tiles are populated in order, so the pixel array is walked once with bp
+ * pointing to the first pixel of the next tile. */
+static void populate_bake_data(BakeData *data,
+                               size_t /*offset*/,
+                               const int object_id,
+                               BL::BakePixel *bp)
 {
-	BL::BakePixel bp = pixel_array;
+	const size_t num_pixels = data->size();
 
-	int i;
-	for(i = 0; i < num_pixels; i++) {
-		if(bp.object_id() == object_id) {
-			data->set(i, bp.primitive_id(), bp.uv(), bp.du_dx(), bp.du_dy(), bp.dv_dx(), bp.dv_dy());
+	for(size_t i = 0; i < num_pixels; i++) {
+		if(bp->object_id() == object_id) {
+			data->set(i, bp->primitive_id(), bp->uv(), bp->du_dx(), bp->du_dy(), bp->dv_dx(), bp->dv_dy());
 		} else {
 			data->set_null(i);
 		}
-		bp = bp.next();
+		*bp = bp->next();
 	}
 }
 
@@ -608,9 +650,8 @@ void BlenderSession::bake(BL::Object& b_object,
 
 	int object = object_index;
 
-	BakeData *bake_data = scene->bake_manager->init(object, tri_offset, num_pixels);
-
-	populate_bake_data(bake_data, object_id, pixel_array, num_pixels);
+	BL::BakePixel bp = pixel_array;
+	scene->bake_manager->populate_tile_cb = function_bind(&populate_bake_data, _1, _2, object_id, &bp);
 
 	/* set number of samples */
 	session->tile_manager.set_samples(session_params.samples);
@@ -619,7 +660,8 @@ void BlenderSession::bake(BL::Object& b_object,
 
 	session->progress.set_update_callback(function_bind(&BlenderSession::update_bake_progress, this));
 
-	scene->bake_manager->bake(scene->device, &scene->dscene, scene, session->progress, shader_type, bake_pass_filter, bake_data, result);
+	scene->bake_manager->bake(scene->device, &scene->dscene, scene, session->progress, shader_type, bake_pass_filter, object, tri_offset, num_pixels, result);
+	scene->bake_manager->populate_tile_cb = function_null;
 
 	/* free all memory used (host and device), so we wouldn't leave render
 	 * engine with extra memory allocated
@@ -708,6 +750,17 @@ void BlenderSession::update_render_result(BL::RenderResult& b_rr,
 	do_write_update_render_result(b_rr, b_rlay, rtile, true);
 }
 
+void BlenderSession::tag_recalc()
+{
+	/* only used between frames of a background render with persistent data,
+	 * where the sync object and its maps outlive the render */
+	if(sync == NULL || recalc_frame == -1)
+		return;
+
+	sync->sync_recalc();
+	recalc_frame = b_scene.frame_current();
+}
+
 void BlenderSession::synchronize()
 {
 	/* only used for viewport render */
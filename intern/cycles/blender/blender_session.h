@@ -84,6 +84,9 @@ public:
 	/* interactive updates */
 	void synchronize();
 
+	/* collect recalc flags for the next frame of a persistent render */
+	void tag_recalc();
+
 	/* drawing */
 	bool draw(int w, int h);
 	void tag_redraw();
@@ -118,6 +121,10 @@ public:
 	int width, height;
 	double start_resize_time;
 
+	/* frame up to which recalc flags were collected into the sync object of
+	 * a persistent render, -1 when nothing is kept between renders */
+	int recalc_frame;
+
 	void *python_thread_state;
 
 	/* Global state which is common for all render sessions created from Blender.
@@ -1391,6 +1391,7 @@ void BlenderSync::sync_materials(bool update_all)
 			shader->ao_alpha = get_float(cmat, "ao_alpha");
 			shader->shadow_alpha = get_float(cmat, "shadow_alpha");
 			shader->displacement_method = (experimental) ? get_displacement_method(cmat) : DISPLACE_BUMP;
+			shader->displacement_bound = get_float(cmat, "displacement_bound");
 
 			shader->override_samples = get_boolean(cmat, "override_samples");
 			shader->diffuse_samples = get_int(cmat, "diffuse_samples");
@@ -1585,7 +1586,7 @@ void BlenderSync::sync_shaders()
 	/* for auto refresh images */
 	bool auto_refresh_update = false;
 
-	if(preview) {
+	if(preview || scene->params.persistent_data) {
 		ImageManager *image_manager = scene->image_manager;
 		int frame = b_scene.frame_current();
 		auto_refresh_update = image_manager->set_animation_frame_update(frame);
@@ -276,6 +276,8 @@ void BlenderSync::sync_integrator()
 
 	integrator->volume_max_steps = get_int(cscene, "volume_max_steps");
 	integrator->volume_step_size = get_float(cscene, "volume_step_size");
+	integrator->volume_skip_empty = get_boolean(cscene, "volume_skip_empty");
+	integrator->volume_majorant_tracking = get_boolean(cscene, "volume_majorant_tracking");
 
 	integrator->caustics_reflective = get_boolean(cscene, "caustics_reflective");
 	integrator->caustics_refractive = get_boolean(cscene, "caustics_refractive");
@@ -321,6 +323,10 @@ void BlenderSync::sync_integrator()
 	integrator->sample_all_lights_direct = get_boolean(cscene, "sample_all_lights_direct");
 	integrator->sample_all_lights_indirect = get_boolean(cscene, "sample_all_lights_indirect");
 	integrator->light_sampling_threshold = get_float(cscene, "light_sampling_threshold");
+	integrator->use_light_tree = get_boolean(cscene, "use_light_tree");
+
+	integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
 
 	int diffuse_samples = get_int(cscene, "diffuse_samples");
 	int glossy_samples = get_int(cscene, "glossy_samples");
@@ -358,6 +364,10 @@ void BlenderSync::sync_integrator()
 		}
 	}
 
+	/* Light tree is built together with the light distribution. */
+	if(integrator->use_light_tree != previntegrator.use_light_tree)
+		scene->light_manager->tag_update(scene);
+
 	if(integrator->modified(previntegrator))
 		integrator->tag_update(scene);
 }
@@ -646,8 +656,11 @@ void BlenderSync::sync_film(BL::RenderLayer& b_rlay,
 			b_engine.add_pass(passname.c_str(), is_color? 3: 1, is_color? "RGB": "X", b_srlay.name().c_str(), 0);
 		} RNA_END
 
-		passes.denoising_passes = get_boolean(crp, "write_denoising_data");
-		if(passes.denoising_passes) {
+		/* Denoising reads the passes while rendering, even when they are
+		 * not written out. */
+		bool write_denoising_data = get_boolean(crp, "write_denoising_data");
+		passes.denoising_passes = write_denoising_data || get_boolean(crp, "use_denoising");
+		if(write_denoising_data) {
 			b_engine.add_pass("Denoising Normal", 3, "XYZ", b_srlay.name().c_str(), 0);
 			b_engine.add_pass("Denoising Normal Variance", 3, "XYZ", b_srlay.name().c_str(), 0);
 			b_engine.add_pass("Denoising Albedo", 3, "RGB", b_srlay.name().c_str(), 0);
@@ -659,6 +672,10 @@ void BlenderSync::sync_film(BL::RenderLayer& b_rlay,
 			b_engine.add_pass("Denoising Image", 3, "RGB", b_srlay.name().c_str(), 0);
 			b_engine.add_pass("Denoising Image Variance", 3, "RGB", b_srlay.name().c_str(), 0);
 		}
+
+		/* Internal pass, not exposed to Blender. */
+		PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
+		passes.adaptive_passes = (get_float(cscene, "adaptive_threshold") > 0.0f);
 	}
 
 	scene->film->pass_alpha_threshold = b_srlay.pass_alpha_threshold();
@@ -693,7 +710,9 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 
 	params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
 	params.use_bvh_unaligned_nodes = RNA_boolean_get(&cscene, "debug_use_hair_bvh");
+	params.use_bvh_curve_strands = RNA_boolean_get(&cscene, "debug_use_hair_strands");
 	params.num_bvh_time_steps = RNA_int_get(&cscene, "debug_bvh_time_steps");
+	params.bvh_refit_sah_threshold = RNA_float_get(&cscene, "debug_bvh_refit_threshold");
 	if(is_cpu) {
 		params.use_bvh_embree = RNA_boolean_get(&cscene, "use_bvh_embree");
 	}
@@ -701,6 +720,21 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 		params.use_bvh_embree = false;
 	}
 
+	if(get_boolean(cscene, "use_bvh_cache")) {
+		string cache_path = get_string(cscene, "bvh_cache_path");
+		params.bvh_cache_path = (cache_path != "")? cache_path: path_cache_get("bvh");
+	}
+
+	params.use_dicing_cache = get_boolean(cscene, "use_dicing_cache");
+	if(params.use_dicing_cache) {
+		params.dicing_cache_path = get_string(cscene, "dicing_cache_path");
+	}
+
+	params.use_lazy_dicing = params.use_bvh_embree && get_boolean(cscene, "use_lazy_dicing");
+	if(params.use_lazy_dicing) {
+		params.lazy_dicing_cache_size = get_int(cscene, "lazy_dicing_cache_size");
+	}
+
 	if(background && params.shadingsystem != SHADINGSYSTEM_OSL)
 		params.persistent_data = r.use_persistent_data();
 	else
@@ -729,10 +763,12 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 	params.texture.auto_tile = RNA_boolean_get(&cscene, "texture_auto_tile");
 	params.texture.diffuse_blur = RNA_float_get(&cscene, "texture_blur_diffuse");
 	params.texture.glossy_blur = RNA_float_get(&cscene, "texture_blur_glossy");
+	params.texture.use_half_float = RNA_boolean_get(&cscene, "texture_use_half_float");
 	
 #if !(defined(__GNUC__) && (defined(i386) || defined(_M_IX86)))
 	if(is_cpu) {
 		params.use_qbvh = DebugFlags().cpu.qbvh && system_cpu_support_sse2();
+		params.num_bvh_compressed_node_bits = get_enum(cscene, "debug_bvh_node_compression") * 8;
 	}
 	else
 #endif
@@ -892,6 +928,10 @@ SessionParams BlenderSync::get_session_params(BL::RenderEngine& b_engine,
 
 	params.progressive_refine = get_boolean(cscene, "use_progressive_refine");
 
+	/* Saved buffers are merged by render parts, which need to match tiles. */
+	params.use_tile_splitting = get_boolean(cscene, "use_tile_splitting") &&
+	                            !b_scene.render().use_save_buffers();
+
 	if(background) {
 		if(params.progressive_refine)
 			params.progressive = true;
@@ -23,10 +23,13 @@
 #include "bvh/bvh2.h"
 #include "bvh/bvh4.h"
 #include "bvh/bvh_build.h"
+#include "bvh/bvh_cache.h"
 #include "bvh/bvh_node.h"
 
 #include "util/util_foreach.h"
+#include "util/util_logging.h"
 #include "util/util_progress.h"
+#include "util/util_stats.h"
 
 #ifdef WITH_EMBREE
 #  include "bvh_embree.h"
@@ -49,7 +52,7 @@ int BVHStackEntry::encodeIdx() const
 /* BVH */
 
 BVH::BVH(const BVHParams& params_, const vector<Object*>& objects_)
-: params(params_), objects(objects_)
+: params(params_), objects(objects_), sah_cost(0.0f)
 {
 }
 
@@ -67,8 +70,39 @@ BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 
 /* Building */
 
-void BVH::build(Progress& progress, Stats*)
+void BVH::build(Progress& progress, Stats *stats)
 {
+	/* try loading from persistent cache */
+	string cache_filepath;
+	if(params.cache_path != "") {
+		const string cache_key = BVHCache::key(params, objects);
+
+		if(cache_key != "") {
+			cache_filepath = BVHCache::filepath(params, cache_key);
+
+			progress.set_substatus("Loading BVH from cache");
+
+			if(BVHCache::read(cache_filepath, pack)) {
+				VLOG(2) << "Loaded BVH from cache " << cache_filepath;
+				if(stats) {
+					stats->bvh_cache_hit();
+				}
+
+				progress.set_substatus("Packing BVH triangles and strands");
+				pack_primitives();
+
+				if(!params.top_level && params.refit_sah_threshold > 0.0f) {
+					sah_cost = compute_sah_cost();
+				}
+				return;
+			}
+
+			if(stats) {
+				stats->bvh_cache_miss();
+			}
+		}
+	}
+
 	progress.set_substatus("Building BVH");
 
 	/* build nodes */
@@ -99,21 +133,117 @@ void BVH::build(Progress& progress, Stats*)
 	progress.set_substatus("Packing BVH nodes");
 	pack_nodes(root);
 
+	/* for top level BVH, merge instance BVH's */
+	if(params.top_level) {
+		pack_instances();
+	}
+
 	/* free build nodes */
 	root->deleteSubtree();
+
+	/* remember quality of the new tree to compare against after refit */
+	if(!params.top_level && params.refit_sah_threshold > 0.0f) {
+		sah_cost = compute_sah_cost();
+	}
+
+	/* store in persistent cache */
+	if(cache_filepath != "") {
+		if(!BVHCache::write(cache_filepath, pack)) {
+			VLOG(1) << "Failed to write BVH cache file " << cache_filepath;
+		}
+	}
 }
 
 /* Refitting */
 
-void BVH::refit(Progress& progress)
+bool BVH::refit(Progress& progress)
 {
 	progress.set_substatus("Packing BVH primitives");
 	pack_primitives();
 
-	if(progress.get_cancel()) return;
+	if(progress.get_cancel()) return true;
 
 	progress.set_substatus("Refitting BVH nodes");
-	refit_nodes();
+	const float refit_sah_cost = refit_nodes();
+
+	/* Deforming geometry makes refitted bounds grow and overlap more and more,
+	 * so let caller rebuild once quality degraded too much. */
+	if(params.refit_sah_threshold > 0.0f && sah_cost > 0.0f &&
+	   refit_sah_cost > sah_cost * params.refit_sah_threshold)
+	{
+		VLOG(2) << "BVH SAH cost grew from " << sah_cost
+		        << " to " << refit_sah_cost << ", rebuild needed.";
+		return false;
+	}
+
+	return true;
+}
+
+void BVH::refit_primitives(int start, int end, BoundBox& bbox, uint& visibility)
+{
+	for(int prim = start; prim < end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* Object instance. */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* Primitives. */
+			const Mesh *mesh = ob->mesh;
+
+			if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
+				/* Curves. */
+				int str_offset = (params.top_level)? mesh->curve_offset: 0;
+				Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
+				int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
+
+				curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
+
+				visibility |= PATH_RAY_CURVE;
+
+				/* Motion curves. */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->curve_keys.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *key_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
+					}
+				}
+			}
+			else {
+				/* Triangles. */
+				int tri_offset = (params.top_level)? mesh->tri_offset: 0;
+				Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
+				const float3 *vpos = &mesh->verts[0];
+
+				triangle.bounds_grow(vpos, bbox);
+
+				/* Motion triangles. */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->verts.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *vert_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
+					}
+				}
+			}
+		}
+
+		visibility |= ob->visibility;
+	}
 }
 
 /* Triangles */
@@ -185,11 +315,106 @@ void BVH::pack_primitives()
 
 /* Pack Instances */
 
-void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
+/* Copy packed inner nodes, offsetting child indexes. */
+static void pack_merge_nodes(int4 *dst,
+                             const int4 *src,
+                             size_t size,
+                             int noffset,
+                             int noffset_leaf,
+                             bool use_qbvh)
+{
+	for(size_t i = 0; i < size;) {
+		size_t nsize, nsize_bbox;
+		if(src[i].x & PATH_RAY_NODE_UNALIGNED) {
+			nsize = use_qbvh
+			            ? BVH_UNALIGNED_QNODE_SIZE
+			            : BVH_UNALIGNED_NODE_SIZE;
+			nsize_bbox = (use_qbvh)? 13: 0;
+		}
+		else if(use_qbvh && src[i].w != 0) {
+			/* Compressed node, children follow the header. */
+			nsize = (src[i].w == 8)
+			            ? BVH_COMPRESSED8_QNODE_SIZE
+			            : BVH_COMPRESSED16_QNODE_SIZE;
+			nsize_bbox = 1;
+		}
+		else {
+			nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
+			nsize_bbox = (use_qbvh)? 7: 0;
+		}
+
+		memcpy(dst + i, src + i, nsize_bbox*sizeof(int4));
+
+		/* Modify offsets into arrays */
+		int4 data = src[i + nsize_bbox];
+
+		data.z += (data.z < 0)? -noffset_leaf: noffset;
+		data.w += (data.w < 0)? -noffset_leaf: noffset;
+
+		if(use_qbvh) {
+			data.x += (data.x < 0)? -noffset_leaf: noffset;
+			data.y += (data.y < 0)? -noffset_leaf: noffset;
+		}
+
+		dst[i + nsize_bbox] = data;
+
+		/* Usually this copies nothing, but we better
+		 * be prepared for possible node size extension.
+		 */
+		memcpy(&dst[i + nsize_bbox+1],
+		       &src[i + nsize_bbox+1],
+		       sizeof(int4) * (nsize - (nsize_bbox+1)));
+
+		i += nsize;
+	}
+}
+
+/* Copy packed leaf nodes, offsetting primitive indexes. */
+static void pack_merge_leaf_nodes(int4 *dst,
+                                  const int4 *src,
+                                  size_t size,
+                                  int prim_offset)
+{
+	for(size_t i = 0; i < size; i += BVH_NODE_LEAF_SIZE) {
+		int4 data = src[i];
+		if(data.x < 0) {
+			/* Object leaf of the top level, stores ~prim. */
+			data.x -= prim_offset;
+		}
+		else {
+			data.x += prim_offset;
+			data.y += prim_offset;
+		}
+		dst[i] = data;
+		for(int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
+			dst[i + j] = src[i + j];
+		}
+	}
+}
+
+void BVH::take_instances(BVH *other)
+{
+	prev_pack.nodes.steal_data(other->pack.nodes);
+	prev_pack.leaf_nodes.steal_data(other->pack.leaf_nodes);
+	prev_pack.prim_tri_index.steal_data(other->pack.prim_tri_index);
+	prev_pack.prim_tri_verts.steal_data(other->pack.prim_tri_verts);
+	prev_pack.prim_type.steal_data(other->pack.prim_type);
+	prev_pack.prim_visibility.steal_data(other->pack.prim_visibility);
+	prev_pack.prim_index.steal_data(other->pack.prim_index);
+	prev_pack.prim_object.steal_data(other->pack.prim_object);
+	prev_pack.prim_time.steal_data(other->pack.prim_time);
+	prev_instances.swap(other->instances);
+}
+
+void BVH::pack_instances()
 {
 	/* The BVH's for instances are built separately, but for traversal all
 	 * BVH's are stored in global arrays. This function merges them into the
 	 * top level BVH, adjusting indexes and offsets where appropriate.
+	 *
+	 * Merged object level BVH's come first, followed by the top level nodes
+	 * and primitives. This way merged data does not depend on the top level
+	 * and is reused when only object transforms changed.
 	 */
 	const bool use_qbvh = params.use_qbvh;
 
@@ -204,43 +429,171 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 				pack.prim_index[i] += objects[pack.prim_object[i]]->mesh->tri_offset;
 		}
 
-	/* track offsets of instanced BVH data in global array */
-	size_t prim_offset = pack.prim_index.size();
-	size_t nodes_offset = nodes_size;
-	size_t nodes_leaf_offset = leaf_nodes_size;
+	/* Object level BVH's to be merged, each mesh is only stored once. */
+	vector<PackedInstance> merge_instances;
+	map<Mesh*, int> mesh_map;
 
-	/* clear array that gives the node indexes for instanced objects */
-	pack.object_node.clear();
+	foreach(Object *ob, objects) {
+		Mesh *mesh = ob->mesh;
 
-	/* reserve */
-	size_t prim_index_size = pack.prim_index.size();
-	size_t prim_tri_verts_size = pack.prim_tri_verts.size();
+		if(mesh->need_build_bvh() && mesh_map.find(mesh) == mesh_map.end()) {
+			PackedInstance instance;
+			instance.mesh = mesh;
+			instance.bvh = mesh->bvh;
+			instance.tri_offset = mesh->tri_offset;
+			instance.curve_offset = mesh->curve_offset;
+			instance.node = 0;
 
-	size_t pack_prim_index_offset = prim_index_size;
-	size_t pack_prim_tri_verts_offset = prim_tri_verts_size;
-	size_t pack_nodes_offset = nodes_size;
-	size_t pack_leaf_nodes_offset = leaf_nodes_size;
-	size_t object_offset = 0;
+			mesh_map[mesh] = merge_instances.size();
+			merge_instances.push_back(instance);
+		}
+	}
 
-	map<Mesh*, int> mesh_map;
+	/* Move top level data out of the way. */
+	PackedBVH top_pack;
+	top_pack.nodes.steal_data(pack.nodes);
+	top_pack.leaf_nodes.steal_data(pack.leaf_nodes);
+	top_pack.prim_tri_index.steal_data(pack.prim_tri_index);
+	top_pack.prim_tri_verts.steal_data(pack.prim_tri_verts);
+	top_pack.prim_type.steal_data(pack.prim_type);
+	top_pack.prim_visibility.steal_data(pack.prim_visibility);
+	top_pack.prim_index.steal_data(pack.prim_index);
+	top_pack.prim_object.steal_data(pack.prim_object);
+	top_pack.prim_time.steal_data(pack.prim_time);
+	top_pack.root_index = pack.root_index;
+
+	if(prev_instances.size() && prev_instances == merge_instances) {
+		/* Object level BVH's are the same, reuse previously merged data. It is
+		 * followed by the previous top level which gets overwritten below. */
+		VLOG(1) << "Reusing " << prev_instances.size()
+		        << " merged object level BVHs.";
+
+		pack.nodes.steal_data(prev_pack.nodes);
+		pack.leaf_nodes.steal_data(prev_pack.leaf_nodes);
+		pack.prim_tri_index.steal_data(prev_pack.prim_tri_index);
+		pack.prim_tri_verts.steal_data(prev_pack.prim_tri_verts);
+		pack.prim_type.steal_data(prev_pack.prim_type);
+		pack.prim_visibility.steal_data(prev_pack.prim_visibility);
+		pack.prim_index.steal_data(prev_pack.prim_index);
+		pack.prim_object.steal_data(prev_pack.prim_object);
+		pack.prim_time.steal_data(prev_pack.prim_time);
+		instances.swap(prev_instances);
+	}
+	else {
+		pack_instances_merge(merge_instances);
+	}
 
-	foreach(Object *ob, objects) {
-		Mesh *mesh = ob->mesh;
-		BVH *bvh = mesh->bvh;
+	prev_pack = PackedBVH();
+	prev_instances.clear();
 
-		if(mesh->need_build_bvh()) {
-			if(mesh_map.find(mesh) == mesh_map.end()) {
-				prim_index_size += bvh->pack.prim_index.size();
-				prim_tri_verts_size += bvh->pack.prim_tri_verts.size();
-				nodes_size += bvh->pack.nodes.size();
-				leaf_nodes_size += bvh->pack.leaf_nodes.size();
+	/* Size of merged data. */
+	size_t prim_offset = 0;
+	size_t prim_tri_verts_offset = 0;
+	size_t nodes_offset = 0;
+	size_t nodes_leaf_offset = 0;
 
-				mesh_map[mesh] = 1;
-			}
+	foreach(const PackedInstance& instance, instances) {
+		prim_offset += instance.bvh->pack.prim_index.size();
+		prim_tri_verts_offset += instance.bvh->pack.prim_tri_verts.size();
+		nodes_offset += instance.bvh->pack.nodes.size();
+		nodes_leaf_offset += instance.bvh->pack.leaf_nodes.size();
+	}
+
+	/* Append top level. */
+	const size_t top_prim_size = top_pack.prim_index.size();
+	const size_t prim_index_size = prim_offset + top_prim_size;
+
+	pack.prim_index.resize(prim_index_size);
+	pack.prim_type.resize(prim_index_size);
+	pack.prim_object.resize(prim_index_size);
+	pack.prim_visibility.resize(prim_index_size);
+	pack.prim_tri_index.resize(prim_index_size);
+	pack.prim_tri_verts.resize(prim_tri_verts_offset + top_pack.prim_tri_verts.size());
+	pack.nodes.resize(nodes_offset + top_pack.nodes.size());
+	pack.leaf_nodes.resize(nodes_leaf_offset + top_pack.leaf_nodes.size());
+
+	if(params.num_motion_curve_steps > 0 || params.num_motion_triangle_steps > 0) {
+		pack.prim_time.resize(prim_index_size);
+	}
+
+	for(size_t i = 0; i < top_prim_size; i++) {
+		const size_t dst = prim_offset + i;
+		pack.prim_index[dst] = top_pack.prim_index[i];
+		pack.prim_type[dst] = top_pack.prim_type[i];
+		pack.prim_object[dst] = top_pack.prim_object[i];
+		pack.prim_visibility[dst] = top_pack.prim_visibility[i];
+		const uint tri_index = top_pack.prim_tri_index[i];
+		pack.prim_tri_index[dst] = (tri_index != (uint)-1)
+		        ? tri_index + (uint)prim_tri_verts_offset
+		        : (uint)-1;
+		if(top_pack.prim_time.size()) {
+			pack.prim_time[dst] = top_pack.prim_time[i];
 		}
 	}
 
-	mesh_map.clear();
+	if(top_pack.prim_tri_verts.size()) {
+		memcpy(&pack.prim_tri_verts[prim_tri_verts_offset],
+		       &top_pack.prim_tri_verts[0],
+		       top_pack.prim_tri_verts.size()*sizeof(float4));
+	}
+
+	if(top_pack.nodes.size()) {
+		pack_merge_nodes(&pack.nodes[nodes_offset],
+		                 &top_pack.nodes[0],
+		                 top_pack.nodes.size(),
+		                 nodes_offset,
+		                 nodes_leaf_offset,
+		                 use_qbvh);
+	}
+
+	if(top_pack.leaf_nodes.size()) {
+		pack_merge_leaf_nodes(&pack.leaf_nodes[nodes_leaf_offset],
+		                      &top_pack.leaf_nodes[0],
+		                      top_pack.leaf_nodes.size(),
+		                      prim_offset);
+	}
+
+	/* Root of the top level, either an inner node or a single leaf. */
+	pack.root_index = (top_pack.root_index == -1)
+	        ? -(int)nodes_leaf_offset-1
+	        : (int)nodes_offset;
+
+	/* Fill in node indexes for instanced objects. */
+	pack.object_node.clear();
+	pack.object_node.resize(objects.size());
+
+	for(size_t i = 0; i < objects.size(); i++) {
+		Mesh *mesh = objects[i]->mesh;
+
+		/* We assume that if mesh doesn't need own BVH it was already included
+		 * into a top-level BVH and no packing here is needed.
+		 */
+		if(!mesh->need_build_bvh()) {
+			pack.object_node[i] = 0;
+			continue;
+		}
+
+		pack.object_node[i] = instances[mesh_map[mesh]].node;
+	}
+}
+
+void BVH::pack_instances_merge(const vector<PackedInstance>& merge_instances)
+{
+	const bool use_qbvh = params.use_qbvh;
+
+	/* reserve */
+	size_t prim_index_size = 0;
+	size_t prim_tri_verts_size = 0;
+	size_t nodes_size = 0;
+	size_t leaf_nodes_size = 0;
+
+	foreach(const PackedInstance& instance, merge_instances) {
+		BVH *bvh = instance.bvh;
+		prim_index_size += bvh->pack.prim_index.size();
+		prim_tri_verts_size += bvh->pack.prim_tri_verts.size();
+		nodes_size += bvh->pack.nodes.size();
+		leaf_nodes_size += bvh->pack.leaf_nodes.size();
+	}
 
 	pack.prim_index.resize(prim_index_size);
 	pack.prim_type.resize(prim_index_size);
@@ -250,7 +603,6 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	pack.prim_tri_index.resize(prim_index_size);
 	pack.nodes.resize(nodes_size);
 	pack.leaf_nodes.resize(leaf_nodes_size);
-	pack.object_node.resize(objects.size());
 
 	if(params.num_motion_curve_steps > 0 || params.num_motion_triangle_steps > 0) {
 		pack.prim_time.resize(prim_index_size);
@@ -266,42 +618,28 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	int4 *pack_leaf_nodes = (pack.leaf_nodes.size())? &pack.leaf_nodes[0]: NULL;
 	float2 *pack_prim_time = (pack.prim_time.size())? &pack.prim_time[0]: NULL;
 
-	/* merge */
-	foreach(Object *ob, objects) {
-		Mesh *mesh = ob->mesh;
-
-		/* We assume that if mesh doesn't need own BVH it was already included
-		 * into a top-level BVH and no packing here is needed.
-		 */
-		if(!mesh->need_build_bvh()) {
-			pack.object_node[object_offset++] = 0;
-			continue;
-		}
+	/* track offsets of instanced BVH data in global array */
+	size_t prim_offset = 0;
+	size_t pack_prim_tri_verts_offset = 0;
+	size_t nodes_offset = 0;
+	size_t nodes_leaf_offset = 0;
 
-		/* if mesh already added once, don't add it again, but used set
-		 * node offset for this object */
-		map<Mesh*, int>::iterator it = mesh_map.find(mesh);
+	instances = merge_instances;
 
-		if(mesh_map.find(mesh) != mesh_map.end()) {
-			int noffset = it->second;
-			pack.object_node[object_offset++] = noffset;
-			continue;
-		}
-
-		BVH *bvh = mesh->bvh;
+	/* merge */
+	foreach(PackedInstance& instance, instances) {
+		BVH *bvh = instance.bvh;
 
 		int noffset = nodes_offset;
 		int noffset_leaf = nodes_leaf_offset;
-		int mesh_tri_offset = mesh->tri_offset;
-		int mesh_curve_offset = mesh->curve_offset;
+		int mesh_tri_offset = instance.tri_offset;
+		int mesh_curve_offset = instance.curve_offset;
 
-		/* fill in node indexes for instances */
+		/* fill in node index for instances */
 		if(bvh->pack.root_index == -1)
-			pack.object_node[object_offset++] = -noffset_leaf-1;
+			instance.node = -noffset_leaf-1;
 		else
-			pack.object_node[object_offset++] = noffset;
-
-		mesh_map[mesh] = pack.object_node[object_offset-1];
+			instance.node = noffset;
 
 		/* merge primitive, object and triangle indexes */
 		if(bvh->pack.prim_index.size()) {
@@ -313,6 +651,8 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 			float2 *bvh_prim_time = bvh->pack.prim_time.size()? &bvh->pack.prim_time[0]: NULL;
 
 			for(size_t i = 0; i < bvh_prim_index_size; i++) {
+				const size_t pack_prim_index_offset = prim_offset + i;
+
 				if(bvh->pack.prim_type[i] & PRIMITIVE_ALL_CURVE) {
 					pack_prim_index[pack_prim_index_offset] = bvh_prim_index[i] + mesh_curve_offset;
 					pack_prim_tri_index[pack_prim_index_offset] = -1;
@@ -329,7 +669,6 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 				if(bvh_prim_time != NULL) {
 					pack_prim_time[pack_prim_index_offset] = bvh_prim_time[i];
 				}
-				pack_prim_index_offset++;
 			}
 		}
 
@@ -344,67 +683,19 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 
 		/* merge nodes */
 		if(bvh->pack.leaf_nodes.size()) {
-			int4 *leaf_nodes_offset = &bvh->pack.leaf_nodes[0];
-			size_t leaf_nodes_offset_size = bvh->pack.leaf_nodes.size();
-			for(size_t i = 0, j = 0;
-			    i < leaf_nodes_offset_size;
-			    i += BVH_NODE_LEAF_SIZE, j++)
-			{
-				int4 data = leaf_nodes_offset[i];
-				data.x += prim_offset;
-				data.y += prim_offset;
-				pack_leaf_nodes[pack_leaf_nodes_offset] = data;
-				for(int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
-					pack_leaf_nodes[pack_leaf_nodes_offset + j] = leaf_nodes_offset[i + j];
-				}
-				pack_leaf_nodes_offset += BVH_NODE_LEAF_SIZE;
-			}
+			pack_merge_leaf_nodes(pack_leaf_nodes + nodes_leaf_offset,
+			                      &bvh->pack.leaf_nodes[0],
+			                      bvh->pack.leaf_nodes.size(),
+			                      prim_offset);
 		}
 
 		if(bvh->pack.nodes.size()) {
-			int4 *bvh_nodes = &bvh->pack.nodes[0];
-			size_t bvh_nodes_size = bvh->pack.nodes.size();
-
-			for(size_t i = 0, j = 0; i < bvh_nodes_size; j++) {
-				size_t nsize, nsize_bbox;
-				if(bvh_nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
-					nsize = use_qbvh
-					            ? BVH_UNALIGNED_QNODE_SIZE
-					            : BVH_UNALIGNED_NODE_SIZE;
-					nsize_bbox = (use_qbvh)? 13: 0;
-				}
-				else {
-					nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
-					nsize_bbox = (use_qbvh)? 7: 0;
-				}
-
-				memcpy(pack_nodes + pack_nodes_offset,
-				       bvh_nodes + i,
-				       nsize_bbox*sizeof(int4));
-
-				/* Modify offsets into arrays */
-				int4 data = bvh_nodes[i + nsize_bbox];
-
-				data.z += (data.z < 0)? -noffset_leaf: noffset;
-				data.w += (data.w < 0)? -noffset_leaf: noffset;
-
-				if(use_qbvh) {
-					data.x += (data.x < 0)? -noffset_leaf: noffset;
-					data.y += (data.y < 0)? -noffset_leaf: noffset;
-				}
-
-				pack_nodes[pack_nodes_offset + nsize_bbox] = data;
-
-				/* Usually this copies nothing, but we better
-				 * be prepared for possible node size extension.
-				 */
-				memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox+1],
-				       &bvh_nodes[i + nsize_bbox+1],
-				       sizeof(int4) * (nsize - (nsize_bbox+1)));
-
-				pack_nodes_offset += nsize;
-				i += nsize;
-			}
+			pack_merge_nodes(pack_nodes + nodes_offset,
+			                 &bvh->pack.nodes[0],
+			                 bvh->pack.nodes.size(),
+			                 noffset,
+			                 noffset_leaf,
+			                 use_qbvh);
 		}
 
 		nodes_offset += bvh->pack.nodes.size();
@@ -26,11 +26,13 @@
 CCL_NAMESPACE_BEGIN
 
 class Stats;
+class BVH;
 class BVHNode;
 struct BVHStackEntry;
 class BVHParams;
 class BoundBox;
 class LeafNode;
+class Mesh;
 class Object;
 class Progress;
 
@@ -76,6 +78,29 @@ struct PackedBVH {
 	}
 };
 
+/* Packed Instance
+ *
+ * Object level BVH merged into the packed arrays of the top level BVH. Merged
+ * BVH's are stored in front of the top level nodes and primitives, so their
+ * offsets do not depend on the top level tree and the merged data stays valid
+ * for as long as the object level BVH's and mesh offsets did not change. */
+
+struct PackedInstance {
+	Mesh *mesh;
+	BVH *bvh;
+	int tri_offset;
+	int curve_offset;
+	/* node index of the instance root, as stored in object_node */
+	int node;
+
+	bool operator==(const PackedInstance& other) const
+	{
+		return mesh == other.mesh && bvh == other.bvh &&
+		       tri_offset == other.tri_offset &&
+		       curve_offset == other.curve_offset;
+	}
+};
+
 /* BVH */
 
 class BVH
@@ -85,11 +110,24 @@ public:
 	BVHParams params;
 	vector<Object*> objects;
 
+	/* SAH cost of the tree right after it was built, used to detect quality
+	 * degradation when refitting. Zero if not known. */
+	float sah_cost;
+
 	static BVH *create(const BVHParams& params, const vector<Object*>& objects);
 	virtual ~BVH() {}
 
 	virtual void build(Progress& progress, Stats *stats=NULL);
-	void refit(Progress& progress);
+
+	/* Update bounds for the new primitive positions, keeping the topology.
+	 * Returns false if tree quality degraded too much and a full rebuild is
+	 * to be done instead. */
+	bool refit(Progress& progress);
+
+	/* Take over merged object level BVH's of the previous top level BVH, to be
+	 * reused when only the top level changed. Object level BVH's must not have
+	 * been rebuilt or refitted since the previous top level BVH was built. */
+	void take_instances(BVH *other);
 
 protected:
 	BVH(const BVHParams& params, const vector<Object*>& objects);
@@ -98,12 +136,28 @@ protected:
 	void pack_primitives();
 	void pack_triangle(int idx, float4 storage[3]);
 
-	/* merge instance BVH's */
-	void pack_instances(size_t nodes_size, size_t leaf_nodes_size);
+	/* merge instance BVH's in front of the top level nodes and primitives */
+	void pack_instances();
+	void pack_instances_merge(const vector<PackedInstance>& merge_instances);
+
+	/* grow bounds and visibility by the given range of primitives */
+	void refit_primitives(int start, int end, BoundBox& bbox, uint& visibility);
 
 	/* for subclasses to implement */
 	virtual void pack_nodes(const BVHNode *root) = 0;
-	virtual void refit_nodes() = 0;
+	/* refit nodes to current primitive positions, returns SAH cost of the
+	 * refitted tree, zero if not supported */
+	virtual float refit_nodes() = 0;
+
+	/* SAH cost of the packed tree with bounds computed from current primitive
+	 * positions, without modifying the nodes. Zero if not supported. */
+	virtual float compute_sah_cost() { return 0.0f; }
+
+	/* object level BVH's merged into this top level BVH, in storage order */
+	vector<PackedInstance> instances;
+	/* merged data taken over from the previous top level BVH */
+	PackedBVH prev_pack;
+	vector<PackedInstance> prev_instances;
 };
 
 /* Pack Utility */
@@ -177,14 +177,10 @@ void BVH2::pack_nodes(const BVHNode *root)
 	/* Resize arrays */
 	pack.nodes.clear();
 	pack.leaf_nodes.clear();
-	/* For top level BVH, first merge existing BVH's so we know the offsets. */
-	if(params.top_level) {
-		pack_instances(node_size, num_leaf_nodes*BVH_NODE_LEAF_SIZE);
-	}
-	else {
-		pack.nodes.resize(node_size);
-		pack.leaf_nodes.resize(num_leaf_nodes*BVH_NODE_LEAF_SIZE);
-	}
+	/* Top level nodes are packed the same way, object level BVH's are merged
+	 * in front of them afterwards by pack_instances(). */
+	pack.nodes.resize(node_size);
+	pack.leaf_nodes.resize(num_leaf_nodes*BVH_NODE_LEAF_SIZE);
 
 	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
 
@@ -235,16 +231,20 @@ void BVH2::pack_nodes(const BVHNode *root)
 	pack.root_index = (root->is_leaf())? -1: 0;
 }
 
-void BVH2::refit_nodes()
+float BVH2::refit_nodes()
 {
 	assert(!params.top_level);
 
 	BoundBox bbox = BoundBox::empty;
 	uint visibility = 0;
-	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+	float cost = refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+	float area = bbox.safe_area();
+
+	return (area > 0.0f)? cost/area: 0.0f;
 }
 
-void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+/* Returns SAH cost of the subtree, weighted the same as compute_sah_cost_node(). */
+float BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 {
 	if(leaf) {
 		assert(idx + BVH_NODE_LEAF_SIZE <= pack.leaf_nodes.size());
@@ -252,69 +252,7 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		const int c0 = data[0].x;
 		const int c1 = data[0].y;
 		/* refit leaf node */
-		for(int prim = c0; prim < c1; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* primitives */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* curves */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* motion curves */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *key_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
-						}
-					}
-				}
-				else {
-					/* triangles */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* motion triangles */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c0, c1, bbox, visibility);
 
 		/* TODO(sergey): De-duplicate with pack_leaf(). */
 		float4 leaf_data[BVH_NODE_LEAF_SIZE];
@@ -323,6 +261,8 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		leaf_data[0].z = __uint_as_float(visibility);
 		leaf_data[0].w = __uint_as_float(data[0].w);
 		memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4)*BVH_NODE_LEAF_SIZE);
+
+		return bbox.safe_area() * params.primitive_cost(c1 - c0);
 	}
 	else {
 		assert(idx + BVH_NODE_SIZE <= pack.nodes.size());
@@ -334,9 +274,10 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		/* refit inner node, set bbox from children */
 		BoundBox bbox0 = BoundBox::empty, bbox1 = BoundBox::empty;
 		uint visibility0 = 0, visibility1 = 0;
+		float cost = 0.0f;
 
-		refit_node((c0 < 0)? -c0-1: c0, (c0 < 0), bbox0, visibility0);
-		refit_node((c1 < 0)? -c1-1: c1, (c1 < 0), bbox1, visibility1);
+		cost += refit_node((c0 < 0)? -c0-1: c0, (c0 < 0), bbox0, visibility0);
+		cost += refit_node((c1 < 0)? -c1-1: c1, (c1 < 0), bbox1, visibility1);
 
 		if(is_unaligned) {
 			Transform aligned_space = transform_identity();
@@ -358,6 +299,46 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		bbox.grow(bbox0);
 		bbox.grow(bbox1);
 		visibility = visibility0|visibility1;
+
+		return cost + bbox.safe_area() * params.node_cost(2);
+	}
+}
+
+float BVH2::compute_sah_cost()
+{
+	assert(!params.top_level);
+
+	BoundBox bbox = BoundBox::empty;
+	float cost = compute_sah_cost_node(0, (pack.root_index == -1)? true: false, bbox);
+	float area = bbox.safe_area();
+
+	return (area > 0.0f)? cost/area: 0.0f;
+}
+
+float BVH2::compute_sah_cost_node(int idx, bool leaf, BoundBox& bbox)
+{
+	/* Cost is weighted by surface area rather than probability, so it is
+	 * to be normalized by the root node area. */
+	if(leaf) {
+		const int4 *data = &pack.leaf_nodes[idx];
+		uint visibility = 0;
+		refit_primitives(data[0].x, data[0].y, bbox, visibility);
+		return bbox.safe_area() * params.primitive_cost(data[0].y - data[0].x);
+	}
+	else {
+		const int4 *data = &pack.nodes[idx];
+		const int c0 = data[0].z;
+		const int c1 = data[0].w;
+		BoundBox bbox0 = BoundBox::empty, bbox1 = BoundBox::empty;
+		float cost = 0.0f;
+
+		cost += compute_sah_cost_node((c0 < 0)? -c0-1: c0, (c0 < 0), bbox0);
+		cost += compute_sah_cost_node((c1 < 0)? -c1-1: c1, (c1 < 0), bbox1);
+
+		bbox.grow(bbox0);
+		bbox.grow(bbox1);
+
+		return cost + bbox.safe_area() * params.node_cost(2);
 	}
 }
 
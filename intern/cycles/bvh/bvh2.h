@@ -78,8 +78,12 @@ protected:
 	                         uint visibility0, uint visibility1);
 
 	/* refit */
-	void refit_nodes();
-	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+	float refit_nodes();
+	float refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* quality */
+	float compute_sah_cost();
+	float compute_sah_cost_node(int idx, bool leaf, BoundBox& bbox);
 };
 
 CCL_NAMESPACE_END
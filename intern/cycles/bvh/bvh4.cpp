@@ -135,6 +135,17 @@ void BVH4::pack_aligned_node(int idx,
                              const float time_to,
                              const int num)
 {
+	if(params.num_compressed_node_bits != 0) {
+		pack_compressed_node(idx,
+		                     bounds,
+		                     child,
+		                     visibility,
+		                     time_from,
+		                     time_to,
+		                     num);
+		return;
+	}
+
 	float4 data[BVH_QNODE_SIZE];
 	memset(data, 0, sizeof(data));
 
@@ -175,6 +186,136 @@ void BVH4::pack_aligned_node(int idx,
 	memcpy(&pack.nodes[idx], data, sizeof(float4)*BVH_QNODE_SIZE);
 }
 
+/* Value of quantized bound as decoded by the kernel, and tolerance for the
+ * rounding differences between instruction sets used for decoding. */
+static float compressed_decode(float lower, float scale, uint q)
+{
+	return lower + (float)q * scale;
+}
+
+static float compressed_tolerance(float lower, float scale, uint q)
+{
+	return (fabsf(lower) + (float)q * scale) * 4.0f * FLT_EPSILON;
+}
+
+static uint compressed_quantize_min(float lower, float scale, uint qmax, float v)
+{
+	uint q = (uint)clamp(floorf((v - lower) / scale), 0.0f, (float)qmax);
+	/* Decoded value at zero is exact, for others make sure bound is never
+	 * moved inside the child. */
+	while(q > 0 && compressed_decode(lower, scale, q) +
+	               compressed_tolerance(lower, scale, q) > v)
+	{
+		q--;
+	}
+	return q;
+}
+
+static uint compressed_quantize_max(float lower, float scale, uint qmax, float v)
+{
+	uint q = (uint)clamp(ceilf((v - lower) / scale), 0.0f, (float)qmax);
+	while(q < qmax && compressed_decode(lower, scale, q) -
+	                  compressed_tolerance(lower, scale, q) < v)
+	{
+		q++;
+	}
+	return q;
+}
+
+int BVH4::aligned_node_size() const
+{
+	switch(params.num_compressed_node_bits) {
+		case 8: return BVH_COMPRESSED8_QNODE_SIZE;
+		case 16: return BVH_COMPRESSED16_QNODE_SIZE;
+		default: return BVH_QNODE_SIZE;
+	}
+}
+
+void BVH4::pack_compressed_node(int idx,
+                                const BoundBox *bounds,
+                                const int *child,
+                                const uint visibility,
+                                const float time_from,
+                                const float time_to,
+                                const int num)
+{
+	const int bits = params.num_compressed_node_bits;
+	const uint qmax = (1u << bits) - 1;
+	assert(bits == 8 || bits == 16);
+
+	float4 data[BVH_COMPRESSED16_QNODE_SIZE];
+	memset(data, 0, sizeof(data));
+
+	data[0].x = __uint_as_float(visibility & ~PATH_RAY_NODE_UNALIGNED);
+	data[0].y = time_from;
+	data[0].z = time_to;
+	data[0].w = __int_as_float(bits);
+
+	/* Quantization grid covers bounds of all children. */
+	BoundBox node_bounds = BoundBox::empty;
+	for(int i = 0; i < num; i++) {
+		node_bounds.grow(bounds[i]);
+	}
+
+	float lower[3], scale[3];
+	for(int axis = 0; axis < 3; axis++) {
+		const float min = node_bounds.min[axis];
+		const float max = node_bounds.max[axis];
+		/* Pad extent so the upper bound survives decoding tolerance. Flat
+		 * bounds still need non-zero scale, so unused children stored as
+		 * inverted bounds are never intersected. */
+		const float extent = (max - min) +
+		                     (fabsf(min) + fabsf(max)) * 8.0f * FLT_EPSILON;
+		lower[axis] = min;
+		scale[axis] = (extent > 0.0f)? extent / qmax: 1.0f;
+		while(compressed_decode(min, scale[axis], qmax) -
+		      compressed_tolerance(min, scale[axis], qmax) < max)
+		{
+			scale[axis] *= 1.0f + 16.0f * FLT_EPSILON;
+		}
+	}
+
+	for(int i = 0; i < 4; i++) {
+		data[1][i] = __int_as_float((i < num)? child[i]: 0);
+	}
+	data[2] = make_float4(lower[0], lower[1], lower[2], 0.0f);
+	data[3] = make_float4(scale[0], scale[1], scale[2], 0.0f);
+
+	/* Planes are stored as min x, max x, min y, max y, min z, max z, with
+	 * value of each child next to each other. */
+	uint8_t *planes8 = (uint8_t*)&data[4];
+	uint16_t *planes16 = (uint16_t*)&data[4];
+	for(int axis = 0; axis < 3; axis++) {
+		for(int i = 0; i < 4; i++) {
+			uint qmin, qmax_child;
+			if(i < num) {
+				qmin = compressed_quantize_min(lower[axis], scale[axis], qmax,
+				                               bounds[i].min[axis]);
+				qmax_child = compressed_quantize_max(lower[axis], scale[axis], qmax,
+				                                     bounds[i].max[axis]);
+			}
+			else {
+				/* Inverted bounds which would never be recorded as
+				 * intersection. */
+				qmin = qmax;
+				qmax_child = 0;
+			}
+			const int min_index = (axis*2 + 0)*4 + i;
+			const int max_index = (axis*2 + 1)*4 + i;
+			if(bits == 8) {
+				planes8[min_index] = (uint8_t)qmin;
+				planes8[max_index] = (uint8_t)qmax_child;
+			}
+			else {
+				planes16[min_index] = (uint16_t)qmin;
+				planes16[max_index] = (uint16_t)qmax_child;
+			}
+		}
+	}
+
+	memcpy(&pack.nodes[idx], data, sizeof(float4)*aligned_node_size());
+}
+
 void BVH4::pack_unaligned_inner(const BVHStackEntry& e,
                                 const BVHStackEntry *en,
                                 int num)
@@ -278,22 +419,18 @@ void BVH4::pack_nodes(const BVHNode *root)
 		const size_t num_unaligned_nodes =
 		        root->getSubtreeSize(BVH_STAT_UNALIGNED_INNER_QNODE_COUNT);
 		node_size = (num_unaligned_nodes * BVH_UNALIGNED_QNODE_SIZE) +
-		            (num_inner_nodes - num_unaligned_nodes) * BVH_QNODE_SIZE;
+		            (num_inner_nodes - num_unaligned_nodes) * aligned_node_size();
 	}
 	else {
-		node_size = num_inner_nodes * BVH_QNODE_SIZE;
+		node_size = num_inner_nodes * aligned_node_size();
 	}
 	/* Resize arrays. */
 	pack.nodes.clear();
 	pack.leaf_nodes.clear();
-	/* For top level BVH, first merge existing BVH's so we know the offsets. */
-	if(params.top_level) {
-		pack_instances(node_size, num_leaf_nodes*BVH_QNODE_LEAF_SIZE);
-	}
-	else {
-		pack.nodes.resize(node_size);
-		pack.leaf_nodes.resize(num_leaf_nodes*BVH_QNODE_LEAF_SIZE);
-	}
+	/* Top level nodes are packed the same way, object level BVH's are merged
+	 * in front of them afterwards by pack_instances(). */
+	pack.nodes.resize(node_size);
+	pack.leaf_nodes.resize(num_leaf_nodes*BVH_QNODE_LEAF_SIZE);
 
 	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
 
@@ -306,7 +443,7 @@ void BVH4::pack_nodes(const BVHNode *root)
 		stack.push_back(BVHStackEntry(root, nextNodeIdx));
 		nextNodeIdx += node_qbvh_is_unaligned(root)
 		                       ? BVH_UNALIGNED_QNODE_SIZE
-		                       : BVH_QNODE_SIZE;
+		                       : aligned_node_size();
 	}
 
 	while(stack.size()) {
@@ -350,7 +487,7 @@ void BVH4::pack_nodes(const BVHNode *root)
 					idx = nextNodeIdx;
 					nextNodeIdx += node_qbvh_is_unaligned(nodes[i])
 					                       ? BVH_UNALIGNED_QNODE_SIZE
-					                       : BVH_QNODE_SIZE;
+					                       : aligned_node_size();
 				}
 				stack.push_back(BVHStackEntry(nodes[i], idx));
 			}
@@ -363,84 +500,26 @@ void BVH4::pack_nodes(const BVHNode *root)
 	pack.root_index = (root->is_leaf())? -1: 0;
 }
 
-void BVH4::refit_nodes()
+float BVH4::refit_nodes()
 {
 	assert(!params.top_level);
 
 	BoundBox bbox = BoundBox::empty;
 	uint visibility = 0;
-	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+	float cost = refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+	float area = bbox.safe_area();
+
+	return (area > 0.0f)? cost/area: 0.0f;
 }
 
-void BVH4::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+/* Returns SAH cost of the subtree, weighted the same as compute_sah_cost_node(). */
+float BVH4::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 {
 	if(leaf) {
 		int4 *data = &pack.leaf_nodes[idx];
 		int4 c = data[0];
 		/* Refit leaf node. */
-		for(int prim = c.x; prim < c.y; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* Object instance. */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* Primitives. */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* Curves. */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* Motion curves. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *key_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
-						}
-					}
-				}
-				else {
-					/* Triangles. */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* Motion triangles. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c.x, c.y, bbox, visibility);
 
 		/* TODO(sergey): This is actually a copy of pack_leaf(),
 		 * but this chunk of code only knows actual data and has
@@ -458,6 +537,8 @@ void BVH4::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		leaf_data[0].z = __uint_as_float(visibility);
 		leaf_data[0].w = __uint_as_float(c.w);
 		memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4)*BVH_QNODE_LEAF_SIZE);
+
+		return bbox.safe_area() * params.primitive_cost(c.y - c.x);
 	}
 	else {
 		int4 *data = &pack.nodes[idx];
@@ -466,6 +547,10 @@ void BVH4::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		if(is_unaligned) {
 			c = data[13];
 		}
+		else if(data[0].w != 0) {
+			/* Compressed node. */
+			c = data[1];
+		}
 		else {
 			c = data[7];
 		}
@@ -476,11 +561,12 @@ void BVH4::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		                          BoundBox::empty};
 		uint child_visibility[4] = {0};
 		int num_nodes = 0;
+		float cost = 0.0f;
 
 		for(int i = 0; i < 4; ++i) {
 			if(c[i] != 0) {
-				refit_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
-				           child_bbox[i], child_visibility[i]);
+				cost += refit_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+				                   child_bbox[i], child_visibility[i]);
 				++num_nodes;
 				bbox.grow(child_bbox[i]);
 				visibility |= child_visibility[i];
@@ -510,6 +596,49 @@ void BVH4::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 			                  1.0f,
 			                  4);
 		}
+
+		return cost + bbox.safe_area() * params.node_cost(num_nodes);
+	}
+}
+
+float BVH4::compute_sah_cost()
+{
+	assert(!params.top_level);
+
+	BoundBox bbox = BoundBox::empty;
+	float cost = compute_sah_cost_node(0, (pack.root_index == -1)? true: false, bbox);
+	float area = bbox.safe_area();
+
+	return (area > 0.0f)? cost/area: 0.0f;
+}
+
+float BVH4::compute_sah_cost_node(int idx, bool leaf, BoundBox& bbox)
+{
+	/* Same as BVH2, cost is to be normalized by the root node area. */
+	if(leaf) {
+		const int4 c = pack.leaf_nodes[idx];
+		uint visibility = 0;
+		refit_primitives(c.x, c.y, bbox, visibility);
+		return bbox.safe_area() * params.primitive_cost(c.y - c.x);
+	}
+	else {
+		const int4 *data = &pack.nodes[idx];
+		const bool is_unaligned = (data[0].x & PATH_RAY_NODE_UNALIGNED) != 0;
+		const int4 c = is_unaligned? data[13]: (data[0].w != 0)? data[1]: data[7];
+		int num_nodes = 0;
+		float cost = 0.0f;
+
+		for(int i = 0; i < 4; ++i) {
+			if(c[i] != 0) {
+				BoundBox child_bbox = BoundBox::empty;
+				cost += compute_sah_cost_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+				                              child_bbox);
+				bbox.grow(child_bbox);
+				++num_nodes;
+			}
+		}
+
+		return cost + bbox.safe_area() * params.node_cost(num_nodes);
 	}
 }
 
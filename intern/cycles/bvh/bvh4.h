@@ -37,6 +37,8 @@ class Progress;
 #define BVH_QNODE_SIZE           8
 #define BVH_QNODE_LEAF_SIZE      1
 #define BVH_UNALIGNED_QNODE_SIZE 14
+#define BVH_COMPRESSED8_QNODE_SIZE  6
+#define BVH_COMPRESSED16_QNODE_SIZE 7
 
 /* BVH4
  *
@@ -65,6 +67,17 @@ protected:
 	                       const float time_to,
 	                       const int num);
 
+	void pack_compressed_node(int idx,
+	                          const BoundBox *bounds,
+	                          const int *child,
+	                          const uint visibility,
+	                          const float time_from,
+	                          const float time_to,
+	                          const int num);
+
+	/* size of aligned inner node, depends on node compression */
+	int aligned_node_size() const;
+
 	void pack_unaligned_inner(const BVHStackEntry& e,
 	                          const BVHStackEntry *en,
 	                          int num);
@@ -78,8 +91,12 @@ protected:
 	                         const int num);
 
 	/* refit */
-	void refit_nodes();
-	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+	float refit_nodes();
+	float refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* quality */
+	float compute_sah_cost();
+	float compute_sah_cost_node(int idx, bool leaf, BoundBox& bbox);
 };
 
 CCL_NAMESPACE_END
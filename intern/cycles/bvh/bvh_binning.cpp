@@ -23,6 +23,8 @@
 
 #include "util/util_algorithm.h"
 #include "util/util_boundbox.h"
+#include "util/util_foreach.h"
+#include "util/util_task.h"
 #include "util/util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -82,56 +84,41 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange& job,
 	num_bins = min(size_t(MAX_BINS), size_t(4.0f + 0.05f*size()));
 	scale = rcp(cent_bounds_.size()) * make_float3((float)num_bins);
 
-	/* initialize binning counter and bounds */
-	BoundBox bin_bounds[MAX_BINS][4];	/* bounds for every bin in every dimension */
-	int4 bin_count[MAX_BINS];			/* number of primitives mapped to bin */
-
-	for(size_t i = 0; i < num_bins; i++) {
-		bin_count[i] = make_int4(0);
-		bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
-	}
-
-	/* map geometry to bins, unrolled once */
-	{
-		ssize_t i;
-
-		for(i = 0; i < ssize_t(size()) - 1; i += 2) {
-			prefetch_L2(&prims[start() + i + 8]);
-
-			/* map even and odd primitive to bin */
-			const BVHReference& prim0 = prims[start() + i + 0];
-			const BVHReference& prim1 = prims[start() + i + 1];
-
-			BoundBox bounds0 = get_prim_bounds(prim0);
-			BoundBox bounds1 = get_prim_bounds(prim1);
-
-			int4 bin0 = get_bin(bounds0);
-			int4 bin1 = get_bin(bounds1);
-
-			/* increase bounds for bins for even primitive */
-			int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
-			int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
-			int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
-
-			/* increase bounds of bins for odd primitive */
-			int b10 = (int)extract<0>(bin1); bin_count[b10][0]++; bin_bounds[b10][0].grow(bounds1);
-			int b11 = (int)extract<1>(bin1); bin_count[b11][1]++; bin_bounds[b11][1].grow(bounds1);
-			int b12 = (int)extract<2>(bin1); bin_count[b12][2]++; bin_bounds[b12][2].grow(bounds1);
+	/* map geometry to bins */
+	BinStorage bins;
+
+	if(size() >= PARALLEL_MIN_SIZE) {
+		/* Bin chunks of primitives in separate threads and merge results. */
+		const size_t num_chunks = num_parallel_chunks();
+		vector<BinStorage> chunk_bins(num_chunks);
+		TaskPool pool;
+
+		for(size_t chunk = 0; chunk < num_chunks; chunk++) {
+			pool.push(function_bind(&BVHObjectBinning::bin_primitives,
+			                        this,
+			                        prims,
+			                        start() + (size()*chunk)/num_chunks,
+			                        start() + (size()*(chunk + 1))/num_chunks,
+			                        &chunk_bins[chunk]), true);
 		}
-
-		/* for uneven number of primitives */
-		if(i < ssize_t(size())) {
-			/* map primitive to bin */
-			const BVHReference& prim0 = prims[start() + i];
-			BoundBox bounds0 = get_prim_bounds(prim0);
-			int4 bin0 = get_bin(bounds0);
-
-			/* increase bounds of bins */
-			int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
-			int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
-			int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
+		pool.wait_work();
+
+		bins = chunk_bins[0];
+		for(size_t chunk = 1; chunk < num_chunks; chunk++) {
+			for(size_t i = 0; i < num_bins; i++) {
+				bins.count[i] = bins.count[i] + chunk_bins[chunk].count[i];
+				for(int j = 0; j < 3; j++) {
+					bins.bounds[i][j].grow(chunk_bins[chunk].bounds[i][j]);
+				}
+			}
 		}
 	}
+	else {
+		bin_primitives(prims, start(), end(), &bins);
+	}
+
+	const int4 *bin_count = bins.count;
+	const BoundBox (*bin_bounds)[4] = bins.bounds;
 
 	/* sweep from right to left and compute parallel prefix of merged bounds */
 	float4 r_area[MAX_BINS];	/* area of bounds of primitives on the right */
@@ -188,10 +175,80 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange& job,
 	leafSAH = bounds_.half_area() * blocks(size());
 }
 
+size_t BVHObjectBinning::num_parallel_chunks() const
+{
+	/* Some extra chunks per thread for better load balancing. Number of chunks
+	 * does not affect the result, only how the work is distributed. */
+	const size_t max_chunks = max(TaskScheduler::num_threads(), 1) * 4;
+	return clamp(size() / PARALLEL_CHUNK_SIZE, (size_t)1, max_chunks);
+}
+
+void BVHObjectBinning::bin_primitives(const BVHReference *prims,
+                                      size_t begin,
+                                      size_t end,
+                                      BinStorage *bins) const
+{
+	/* initialize binning counter and bounds */
+	BoundBox (*bin_bounds)[4] = bins->bounds;
+	int4 *bin_count = bins->count;
+
+	for(size_t i = 0; i < num_bins; i++) {
+		bin_count[i] = make_int4(0);
+		bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
+	}
+
+	/* map geometry to bins, unrolled once */
+	{
+		ssize_t i;
+
+		for(i = begin; i < ssize_t(end) - 1; i += 2) {
+			prefetch_L2(&prims[i + 8]);
+
+			/* map even and odd primitive to bin */
+			const BVHReference& prim0 = prims[i + 0];
+			const BVHReference& prim1 = prims[i + 1];
+
+			BoundBox bounds0 = get_prim_bounds(prim0);
+			BoundBox bounds1 = get_prim_bounds(prim1);
+
+			int4 bin0 = get_bin(bounds0);
+			int4 bin1 = get_bin(bounds1);
+
+			/* increase bounds for bins for even primitive */
+			int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
+			int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
+			int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
+
+			/* increase bounds of bins for odd primitive */
+			int b10 = (int)extract<0>(bin1); bin_count[b10][0]++; bin_bounds[b10][0].grow(bounds1);
+			int b11 = (int)extract<1>(bin1); bin_count[b11][1]++; bin_bounds[b11][1].grow(bounds1);
+			int b12 = (int)extract<2>(bin1); bin_count[b12][2]++; bin_bounds[b12][2].grow(bounds1);
+		}
+
+		/* for uneven number of primitives */
+		if(i < ssize_t(end)) {
+			/* map primitive to bin */
+			const BVHReference& prim0 = prims[i];
+			BoundBox bounds0 = get_prim_bounds(prim0);
+			int4 bin0 = get_bin(bounds0);
+
+			/* increase bounds of bins */
+			int b00 = (int)extract<0>(bin0); bin_count[b00][0]++; bin_bounds[b00][0].grow(bounds0);
+			int b01 = (int)extract<1>(bin0); bin_count[b01][1]++; bin_bounds[b01][1].grow(bounds0);
+			int b02 = (int)extract<2>(bin0); bin_count[b02][2]++; bin_bounds[b02][2].grow(bounds0);
+		}
+	}
+}
+
 void BVHObjectBinning::split(BVHReference* prims,
                              BVHObjectBinning& left_o,
                              BVHObjectBinning& right_o) const
 {
+	if(size() >= PARALLEL_MIN_SIZE) {
+		split_parallel(prims, left_o, right_o);
+		return;
+	}
+
 	size_t N = size();
 
 	BoundBox lgeom_bounds = BoundBox::empty;
@@ -206,11 +263,9 @@ void BVHObjectBinning::split(BVHReference* prims,
 		prefetch_L2(&prims[start() + r - 8]);
 
 		BVHReference prim = prims[start() + l];
-		BoundBox unaligned_bounds = get_prim_bounds(prim);
-		float3 unaligned_center = unaligned_bounds.center2();
 		float3 center = prim.bounds().center2();
 
-		if(get_bin(unaligned_center)[dim] < pos) {
+		if(is_left(prim)) {
 			lgeom_bounds.grow(prim.bounds());
 			lcent_bounds.grow(center);
 			l++;
@@ -231,10 +286,19 @@ void BVHObjectBinning::split(BVHReference* prims,
 
 	/* object medium split if we did not make progress, can happen when all
 	 * primitives have same centroid */
-	lgeom_bounds = BoundBox::empty;
-	rgeom_bounds = BoundBox::empty;
-	lcent_bounds = BoundBox::empty;
-	rcent_bounds = BoundBox::empty;
+	split_median(prims, left_o, right_o);
+}
+
+void BVHObjectBinning::split_median(BVHReference *prims,
+                                    BVHObjectBinning& left_o,
+                                    BVHObjectBinning& right_o) const
+{
+	size_t N = size();
+
+	BoundBox lgeom_bounds = BoundBox::empty;
+	BoundBox rgeom_bounds = BoundBox::empty;
+	BoundBox lcent_bounds = BoundBox::empty;
+	BoundBox rcent_bounds = BoundBox::empty;
 
 	for(size_t i = 0; i < N/2; i++) {
 		lgeom_bounds.grow(prims[start()+i].bounds());
@@ -250,5 +314,128 @@ void BVHObjectBinning::split(BVHReference* prims,
 	left_o  = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), N/2), prims);
 }
 
+void BVHObjectBinning::split_parallel(BVHReference *prims,
+                                      BVHObjectBinning& left_o,
+                                      BVHObjectBinning& right_o) const
+{
+	const size_t N = size();
+	const size_t num_chunks = num_parallel_chunks();
+	vector<PartitionChunk> chunks(num_chunks);
+
+	/* Count primitives going to the left for every chunk. */
+	TaskPool pool;
+
+	for(size_t chunk = 0; chunk < num_chunks; chunk++) {
+		chunks[chunk].begin = start() + (N*chunk)/num_chunks;
+		chunks[chunk].end = start() + (N*(chunk + 1))/num_chunks;
+		pool.push(function_bind(&BVHObjectBinning::partition_count,
+		                        this,
+		                        prims,
+		                        &chunks[chunk]), true);
+	}
+	pool.wait_work();
+
+	size_t num_left = 0;
+	BoundBox lgeom_bounds = BoundBox::empty;
+	BoundBox rgeom_bounds = BoundBox::empty;
+	BoundBox lcent_bounds = BoundBox::empty;
+	BoundBox rcent_bounds = BoundBox::empty;
+
+	foreach(const PartitionChunk& chunk, chunks) {
+		num_left += chunk.num_left;
+		lgeom_bounds.grow(chunk.lgeom_bounds);
+		rgeom_bounds.grow(chunk.rgeom_bounds);
+		lcent_bounds.grow(chunk.lcent_bounds);
+		rcent_bounds.grow(chunk.rcent_bounds);
+	}
+
+	if(num_left == 0 || num_left == N) {
+		split_median(prims, left_o, right_o);
+		return;
+	}
+
+	/* Stable partition into temporary storage, chunk by chunk, and copy back. */
+	vector<BVHReference> partitioned(N);
+	size_t left_offset = 0, right_offset = num_left;
+
+	for(size_t chunk = 0; chunk < num_chunks; chunk++) {
+		pool.push(function_bind(&BVHObjectBinning::partition_scatter,
+		                        this,
+		                        prims,
+		                        &chunks[chunk],
+		                        left_offset,
+		                        right_offset,
+		                        &partitioned[0]), true);
+		left_offset += chunks[chunk].num_left;
+		right_offset += (chunks[chunk].end - chunks[chunk].begin) - chunks[chunk].num_left;
+	}
+	pool.wait_work();
+
+	for(size_t chunk = 0; chunk < num_chunks; chunk++) {
+		pool.push(function_bind(&BVHObjectBinning::partition_copy,
+		                        this,
+		                        &partitioned[0],
+		                        prims,
+		                        chunks[chunk].begin,
+		                        chunks[chunk].end), true);
+	}
+	pool.wait_work();
+
+	right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + num_left, N - num_left), prims);
+	left_o  = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), num_left), prims);
+}
+
+void BVHObjectBinning::partition_count(const BVHReference *prims,
+                                       PartitionChunk *chunk) const
+{
+	chunk->num_left = 0;
+	chunk->lgeom_bounds = BoundBox::empty;
+	chunk->rgeom_bounds = BoundBox::empty;
+	chunk->lcent_bounds = BoundBox::empty;
+	chunk->rcent_bounds = BoundBox::empty;
+
+	for(size_t i = chunk->begin; i < chunk->end; i++) {
+		const BVHReference& prim = prims[i];
+		float3 center = prim.bounds().center2();
+
+		if(is_left(prim)) {
+			chunk->lgeom_bounds.grow(prim.bounds());
+			chunk->lcent_bounds.grow(center);
+			chunk->num_left++;
+		}
+		else {
+			chunk->rgeom_bounds.grow(prim.bounds());
+			chunk->rcent_bounds.grow(center);
+		}
+	}
+}
+
+void BVHObjectBinning::partition_scatter(const BVHReference *prims,
+                                         const PartitionChunk *chunk,
+                                         size_t left_offset,
+                                         size_t right_offset,
+                                         BVHReference *dest) const
+{
+	for(size_t i = chunk->begin; i < chunk->end; i++) {
+		const BVHReference& prim = prims[i];
+
+		if(is_left(prim)) {
+			dest[left_offset++] = prim;
+		}
+		else {
+			dest[right_offset++] = prim;
+		}
+	}
+}
+
+void BVHObjectBinning::partition_copy(const BVHReference *src,
+                                      BVHReference *dest,
+                                      size_t begin,
+                                      size_t end) const
+{
+	/* src is relative to the range start. */
+	memcpy(dest + begin, src + (begin - start()), sizeof(BVHReference)*(end - begin));
+}
+
 CCL_NAMESPACE_END
 
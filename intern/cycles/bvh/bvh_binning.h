@@ -27,12 +27,16 @@ CCL_NAMESPACE_BEGIN
 
 class BVHBuild;
 
-/* Single threaded object binner. Finds the split with the best SAH heuristic
- * by testing for each dimension multiple partitionings for regular spaced
- * partition locations. A partitioning for a partition location is computed,
- * by putting primitives whose centroid is on the left and right of the split
- * location to different sets. The SAH is evaluated by computing the number of
- * blocks occupied by the primitives in the partitions. */
+/* Object binner. Finds the split with the best SAH heuristic by testing for
+ * each dimension multiple partitionings for regular spaced partition
+ * locations. A partitioning for a partition location is computed, by putting
+ * primitives whose centroid is on the left and right of the split location to
+ * different sets. The SAH is evaluated by computing the number of blocks
+ * occupied by the primitives in the partitions.
+ *
+ * Large ranges are binned and partitioned by multiple threads, each working
+ * on its own chunk of primitives. Results do not depend on the number of
+ * threads, so the same tree is built on every machine. */
 
 class BVHObjectBinning : public BVHRange
 {
@@ -69,6 +73,55 @@ protected:
 	enum { MAX_BINS = 32 };
 	enum { LOG_BLOCK_SIZE = 2 };
 
+	/* Ranges with at least this number of primitives are binned and split
+	 * using multiple threads, in chunks of at least given size. */
+	enum { PARALLEL_MIN_SIZE = 65536 };
+	enum { PARALLEL_CHUNK_SIZE = 16384 };
+
+	/* Bins filled by a single thread. */
+	struct BinStorage {
+		BoundBox bounds[MAX_BINS][4];	/* bounds for every bin in every dimension */
+		int4 count[MAX_BINS];			/* number of primitives mapped to bin */
+	};
+
+	/* Per-chunk state of the parallel partitioning. */
+	struct PartitionChunk {
+		size_t begin, end;
+		size_t num_left;
+		BoundBox lgeom_bounds, rgeom_bounds;
+		BoundBox lcent_bounds, rcent_bounds;
+	};
+
+	size_t num_parallel_chunks() const;
+
+	void bin_primitives(const BVHReference *prims,
+	                    size_t begin,
+	                    size_t end,
+	                    BinStorage *bins) const;
+
+	void split_median(BVHReference *prims,
+	                  BVHObjectBinning& left_o,
+	                  BVHObjectBinning& right_o) const;
+	void split_parallel(BVHReference *prims,
+	                    BVHObjectBinning& left_o,
+	                    BVHObjectBinning& right_o) const;
+	void partition_count(const BVHReference *prims, PartitionChunk *chunk) const;
+	void partition_scatter(const BVHReference *prims,
+	                       const PartitionChunk *chunk,
+	                       size_t left_offset,
+	                       size_t right_offset,
+	                       BVHReference *dest) const;
+	void partition_copy(const BVHReference *src,
+	                    BVHReference *dest,
+	                    size_t begin,
+	                    size_t end) const;
+
+	__forceinline bool is_left(const BVHReference& prim) const
+	{
+		BoundBox unaligned_bounds = get_prim_bounds(prim);
+		return get_bin(unaligned_bounds.center2())[dim] < pos;
+	}
+
 	/* computes the bin numbers for each dimension for a box. */
 	__forceinline int4 get_bin(const BoundBox& box) const
 	{
@@ -108,6 +108,7 @@ BVHBuild::BVHBuild(const vector<Object*>& objects_,
    unaligned_heuristic(objects_)
 {
 	spatial_min_overlap = 0.0f;
+	have_curve_strands = false;
 }
 
 BVHBuild::~BVHBuild()
@@ -230,10 +231,46 @@ void BVHBuild::add_reference_curves(BoundBox& root, BoundBox& center, Mesh *mesh
 	if(mesh->has_motion_blur()) {
 		curve_attr_mP = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
 	}
+	bool use_curve_strands = params.use_curve_strands &&
+	                         params.num_curve_strand_segments > 1;
+	/* Strands are only supported for static hair in a BVH without spatial
+	 * splits, the splitter clips single segments only.
+	 */
+	if(params.use_spatial_split || curve_attr_mP != NULL) {
+		use_curve_strands = false;
+	}
 	const size_t num_curves = mesh->num_curves();
 	for(uint j = 0; j < num_curves; j++) {
 		const Mesh::Curve curve = mesh->get_curve(j);
 		const float *curve_radius = &mesh->curve_radius[0];
+		if(use_curve_strands) {
+			/* Static hair with consecutive segments of the strand grouped
+			 * into one reference, which is expanded again into a leaf of
+			 * segment primitives oriented along the strand.
+			 */
+			const int num_segments = curve.num_keys - 1;
+			for(int k = 0; k < num_segments; k += params.num_curve_strand_segments) {
+				const int num = min(params.num_curve_strand_segments, num_segments - k);
+				BoundBox bounds = BoundBox::empty;
+				for(int s = 0; s < num; s++) {
+					curve.bounds_grow(k + s, &mesh->curve_keys[0], curve_radius, bounds);
+				}
+				if(bounds.valid()) {
+					int packed_type = PRIMITIVE_PACK_SEGMENT(PRIMITIVE_CURVE, k);
+					references.push_back(BVHReference(bounds,
+					                                  j,
+					                                  i,
+					                                  packed_type,
+					                                  0.0f,
+					                                  1.0f,
+					                                  num));
+					root.grow(bounds);
+					center.grow(bounds.center2());
+					have_curve_strands |= (num > 1);
+				}
+			}
+			continue;
+		}
 		for(int k = 0; k < curve.num_keys - 1; k++) {
 			if(curve_attr_mP == NULL) {
 				/* Really simple logic for static hair. */
@@ -468,6 +505,14 @@ BVHNode* BVHBuild::run()
 	}
 	spatial_free_index = 0;
 
+	if(have_curve_strands) {
+		/* Leaf size is counted in segments, allow leaves of a full strand
+		 * reference.
+		 */
+		params.max_curve_leaf_size = max(params.max_curve_leaf_size,
+		                                 params.num_curve_strand_segments);
+	}
+
 	need_prim_time = params.num_motion_curve_steps > 0 ||
 	                 params.num_motion_triangle_steps > 0;
 
@@ -613,7 +658,7 @@ bool BVHBuild::range_within_max_leaf_size(const BVHRange& range,
 		const BVHReference& ref = references[range.start() + i];
 
 		if(ref.prim_type() & PRIMITIVE_CURVE)
-			num_curves++;
+			num_curves += ref.num_segments();
 		if(ref.prim_type() & PRIMITIVE_MOTION_CURVE)
 			num_motion_curves++;
 		else if(ref.prim_type() & PRIMITIVE_TRIANGLE)
@@ -932,18 +977,26 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 		if(ref.prim_index() != -1) {
 			int type_index = bitscan(ref.prim_type() & PRIMITIVE_ALL);
 			p_ref[type_index].push_back(ref);
-			p_type[type_index].push_back(ref.prim_type());
-			p_index[type_index].push_back(ref.prim_index());
-			p_object[type_index].push_back(ref.prim_object());
-			p_time[type_index].push_back(make_float2(ref.time_from(),
-			                                         ref.time_to()));
+			/* Curve strand references expand to a primitive per segment. */
+			const int first_segment = PRIMITIVE_UNPACK_SEGMENT(ref.prim_type());
+			for(int s = 0; s < ref.num_segments(); s++) {
+				const int type = (ref.num_segments() > 1)
+				        ? PRIMITIVE_PACK_SEGMENT(ref.prim_type() & PRIMITIVE_ALL,
+				                                 first_segment + s)
+				        : ref.prim_type();
+				p_type[type_index].push_back(type);
+				p_index[type_index].push_back(ref.prim_index());
+				p_object[type_index].push_back(ref.prim_object());
+				p_time[type_index].push_back(make_float2(ref.time_from(),
+				                                         ref.time_to()));
+				++num_new_prims;
+			}
 
 			bounds[type_index].grow(ref.bounds());
 			visibility[type_index] |= objects[ref.prim_object()]->visibility;
 			if(ref.prim_type() & PRIMITIVE_ALL_CURVE) {
 				visibility[type_index] |= PATH_RAY_CURVE;
 			}
-			++num_new_prims;
 		}
 		else {
 			object_references.push_back(ref);
@@ -978,6 +1031,7 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 		if(num != 0) {
 			assert(p_type[i].size() == p_index[i].size());
 			assert(p_type[i].size() == p_object[i].size());
+			const int num_refs = (int)p_ref[i].size();
 			Transform aligned_space;
 			bool alignment_found = false;
 			for(int j = 0; j < num; ++j) {
@@ -988,10 +1042,13 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 				if(need_prim_time) {
 					local_prim_time[index] = p_time[i][j];
 				}
-				if(params.use_unaligned_nodes && !alignment_found) {
-					alignment_found =
-						unaligned_heuristic.compute_aligned_space(p_ref[i][j],
-						                                          &aligned_space);
+			}
+			for(int j = 0; j < num_refs && params.use_unaligned_nodes; ++j) {
+				alignment_found =
+					unaligned_heuristic.compute_aligned_space(p_ref[i][j],
+					                                          &aligned_space);
+				if(alignment_found) {
+					break;
 				}
 			}
 			LeafNode *leaf_node = new LeafNode(bounds[i],
@@ -1000,7 +1057,7 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 			                                   start_index + num);
 			if(true) {
 				float time_from = 1.0f, time_to = 0.0f;
-				for(int j = 0; j < num; ++j) {
+				for(int j = 0; j < num_refs; ++j) {
 					const BVHReference &ref = p_ref[i][j];
 					time_from = min(time_from, ref.time_from());
 					time_to = max(time_to, ref.time_to());
@@ -1011,7 +1068,7 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 			if(alignment_found) {
 				/* Need to recalculate leaf bounds with new alignment. */
 				leaf_node->bounds = BoundBox::empty;
-				for(int j = 0; j < num; ++j) {
+				for(int j = 0; j < num_refs; ++j) {
 					const BVHReference &ref = p_ref[i][j];
 					BoundBox ref_bounds =
 					        unaligned_heuristic.compute_aligned_prim_boundbox(
@@ -1030,7 +1087,7 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 	const int num_new_leaf_data = start_index;
 	const size_t new_leaf_data_size = sizeof(int) * num_new_leaf_data;
 	/* Copy actual data to the packed array. */
-	if(params.use_spatial_split) {
+	if(params.use_spatial_split || have_curve_strands) {
 		spatial_spin_lock.lock();
 		/* We use first free index in the packed arrays and mode pointer to the
 		 * end of the current range.
@@ -1038,11 +1095,12 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 		 * This doesn't give deterministic packed arrays, but it shouldn't really
 		 * matter because order of children in BVH is deterministic.
 		 */
+		const size_t num_leaf_prims = num_new_leaf_data + ob_num;
 		start_index = spatial_free_index;
-		spatial_free_index += range.size();
+		spatial_free_index += num_leaf_prims;
 
 		/* Extend an array when needed. */
-		const size_t range_end = start_index + range.size();
+		const size_t range_end = start_index + num_leaf_prims;
 		if(prim_type.size() < range_end) {
 			/* Avoid extra re-allocations by pre-allocating bigger array in an
 			 * advance.
@@ -1066,9 +1124,10 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 				prim_time.resize(range_end);
 			}
 		}
-		spatial_spin_lock.unlock();
 
-		/* Perform actual data copy. */
+		/* Perform actual data copy. This must happen under the lock, another
+		 * thread might re-allocate the arrays as soon as it is released.
+		 */
 		if(new_leaf_data_size > 0) {
 			memcpy(&prim_type[start_index], &local_prim_type[0], new_leaf_data_size);
 			memcpy(&prim_index[start_index], &local_prim_index[0], new_leaf_data_size);
@@ -1077,6 +1136,7 @@ BVHNode* BVHBuild::create_leaf_node(const BVHRange& range,
 				memcpy(&prim_time[start_index], &local_prim_time[0], sizeof(float2)*num_new_leaf_data);
 			}
 		}
+		spatial_spin_lock.unlock();
 	}
 	else {
 		/* For the regular BVH builder we simply copy new data starting at the
@@ -117,6 +117,12 @@ protected:
 
 	bool need_prim_time;
 
+	/* References of multiple curve segments were created, so leaves have
+	 * more primitives than references and are appended to the packed arrays
+	 * at the first free index, same as for spatial splits.
+	 */
+	bool have_curve_strands;
+
 	/* Build parameters. */
 	BVHParams params;
 
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bvh/bvh_cache.h"
+
+#include "render/mesh.h"
+#include "render/object.h"
+
+#include "bvh/bvh.h"
+#include "bvh/bvh_params.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Bump this whenever packed node layout or build algorithm changes, so old
+ * cache files are not used anymore. */
+#define BVH_CACHE_VERSION 1
+
+static const char bvh_cache_magic[8] = {'C', 'Y', 'C', 'L', 'B', 'V', 'H', '\0'};
+
+struct BVHCacheHeader {
+	char magic[8];
+	uint32_t version;
+	int32_t root_index;
+	uint64_t num_nodes;
+	uint64_t num_leaf_nodes;
+	uint64_t num_prim_type;
+	uint64_t num_prim_index;
+	uint64_t num_prim_object;
+	uint64_t num_prim_time;
+};
+
+/* Hashing */
+
+static void md5_append_motion(MD5Hash& md5, const AttributeSet& attributes)
+{
+	const Attribute *attr = attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+	if(attr) {
+		md5_append_float3(md5,
+		                  attr->data_float3(),
+		                  attr->buffer.size() / sizeof(float3));
+	}
+	else {
+		md5_append_value(md5, (uint64_t)0);
+	}
+}
+
+string BVHCache::key(const BVHParams& params, const vector<Object*>& objects)
+{
+	/* Only object level BVH of a single mesh is cached, top level BVH depends
+	 * on the whole scene and is expected to be cheap to build anyway. */
+	if(params.top_level || params.use_bvh_embree || objects.size() != 1) {
+		return "";
+	}
+
+	const Object *ob = objects[0];
+	const Mesh *mesh = ob->mesh;
+
+	MD5Hash md5;
+
+	md5_append_value(md5, (int)BVH_CACHE_VERSION);
+
+	/* Parameters which affect the resulting tree. */
+	md5_append_value(md5, params.use_spatial_split);
+	md5_append_value(md5, params.spatial_split_alpha);
+	md5_append_value(md5, params.unaligned_split_threshold);
+	md5_append_value(md5, params.sah_node_cost);
+	md5_append_value(md5, params.sah_primitive_cost);
+	md5_append_value(md5, params.min_leaf_size);
+	md5_append_value(md5, params.max_triangle_leaf_size);
+	md5_append_value(md5, params.max_motion_triangle_leaf_size);
+	md5_append_value(md5, params.max_curve_leaf_size);
+	md5_append_value(md5, params.max_motion_curve_leaf_size);
+	md5_append_value(md5, params.use_qbvh);
+	md5_append_value(md5, params.num_compressed_node_bits);
+	md5_append_value(md5, params.primitive_mask);
+	md5_append_value(md5, params.use_unaligned_nodes);
+	md5_append_value(md5, params.use_curve_strands);
+	md5_append_value(md5, params.num_curve_strand_segments);
+	md5_append_value(md5, params.num_motion_curve_steps);
+	md5_append_value(md5, params.num_motion_triangle_steps);
+	md5_append_value(md5, params.bvh_type);
+	/* Curve settings are synced after objects, only include them when they
+	 * matter so lookups done before that find the same entry. */
+	if(mesh->num_curves()) {
+		md5_append_value(md5, params.curve_flags);
+		md5_append_value(md5, params.curve_subdivisions);
+	}
+
+	/* Leaf visibility comes from the object. */
+	md5_append_value(md5, ob->visibility);
+
+	/* Mesh content. */
+	md5_append_float3(md5, mesh->verts.data(), mesh->verts.size());
+	md5_append_array(md5, mesh->triangles);
+	md5_append_float3(md5, mesh->curve_keys.data(), mesh->curve_keys.size());
+	md5_append_array(md5, mesh->curve_radius);
+	md5_append_array(md5, mesh->curve_first_key);
+
+	md5_append_value(md5, mesh->use_motion_blur);
+	md5_append_value(md5, mesh->motion_steps);
+	if(mesh->use_motion_blur) {
+		md5_append_motion(md5, mesh->attributes);
+		md5_append_motion(md5, mesh->curve_attributes);
+	}
+
+	return md5.get_hex();
+}
+
+string BVHCache::filepath(const BVHParams& params, const string& key)
+{
+	/* Spread files over sub-directories to keep directory listings small. */
+	return path_join(path_join(params.cache_path, key.substr(0, 2)),
+	                 key + ".bvh");
+}
+
+/* Reading and Writing */
+
+static size_t cache_align_up(size_t offset)
+{
+	return (offset + BVH_ALIGN - 1) & ~((size_t)BVH_ALIGN - 1);
+}
+
+static bool cache_skip_padding(FILE *f, size_t& offset)
+{
+	uint8_t padding[BVH_ALIGN];
+	const size_t size = cache_align_up(offset) - offset;
+	if(size && fread(padding, 1, size, f) != size) {
+		return false;
+	}
+	offset += size;
+	return true;
+}
+
+static bool cache_write_padding(FILE *f, size_t& offset)
+{
+	static const uint8_t padding[BVH_ALIGN] = {0};
+	const size_t size = cache_align_up(offset) - offset;
+	if(size && fwrite(padding, 1, size, f) != size) {
+		return false;
+	}
+	offset += size;
+	return true;
+}
+
+template<typename T>
+static bool cache_read_array(FILE *f,
+                             size_t& offset,
+                             array<T>& data,
+                             uint64_t size,
+                             size_t file_size)
+{
+	if(!cache_skip_padding(f, offset)) {
+		return false;
+	}
+	/* Sizes come from the file, never allocate more than it can hold. */
+	if(offset > file_size || size > (file_size - offset)/sizeof(T)) {
+		return false;
+	}
+	data.resize(size);
+	if(size && fread(data.data(), sizeof(T), size, f) != size) {
+		return false;
+	}
+	offset += sizeof(T)*size;
+	return true;
+}
+
+template<typename T>
+static bool cache_write_array(FILE *f, size_t& offset, const array<T>& data)
+{
+	if(!cache_write_padding(f, offset)) {
+		return false;
+	}
+	const size_t size = data.size();
+	if(size && fwrite(data.data(), sizeof(T), size, f) != size) {
+		return false;
+	}
+	offset += sizeof(T)*size;
+	return true;
+}
+
+bool BVHCache::read(const string& filepath, PackedBVH& pack)
+{
+	FILE *f = path_fopen(filepath, "rb");
+	if(!f) {
+		return false;
+	}
+
+	const size_t file_size = path_file_size(filepath);
+
+	BVHCacheHeader header;
+	bool ok = (fread(&header, sizeof(header), 1, f) == 1) &&
+	          memcmp(header.magic, bvh_cache_magic, sizeof(header.magic)) == 0 &&
+	          header.version == BVH_CACHE_VERSION;
+
+	if(ok) {
+		size_t offset = sizeof(header);
+		ok = cache_read_array(f, offset, pack.nodes, header.num_nodes, file_size) &&
+		     cache_read_array(f, offset, pack.leaf_nodes, header.num_leaf_nodes, file_size) &&
+		     cache_read_array(f, offset, pack.prim_type, header.num_prim_type, file_size) &&
+		     cache_read_array(f, offset, pack.prim_index, header.num_prim_index, file_size) &&
+		     cache_read_array(f, offset, pack.prim_object, header.num_prim_object, file_size) &&
+		     cache_read_array(f, offset, pack.prim_time, header.num_prim_time, file_size);
+		/* Primitive arrays are indexed together, and the root must be a
+		 * node of the tree. */
+		ok = ok &&
+		     header.num_prim_index == header.num_prim_type &&
+		     header.num_prim_object == header.num_prim_type &&
+		     (header.num_prim_time == 0 || header.num_prim_time == header.num_prim_type) &&
+		     (header.root_index == -1 || (header.root_index == 0 && header.num_nodes > 0)) &&
+		     offset == file_size;
+		pack.root_index = header.root_index;
+	}
+
+	fclose(f);
+
+	if(!ok) {
+		VLOG(1) << "Ignoring invalid BVH cache file " << filepath;
+		pack = PackedBVH();
+	}
+
+	return ok;
+}
+
+bool BVHCache::write(const string& filepath, const PackedBVH& pack)
+{
+	BVHCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, bvh_cache_magic, sizeof(header.magic));
+	header.version = BVH_CACHE_VERSION;
+	header.root_index = pack.root_index;
+	header.num_nodes = pack.nodes.size();
+	header.num_leaf_nodes = pack.leaf_nodes.size();
+	header.num_prim_type = pack.prim_type.size();
+	header.num_prim_index = pack.prim_index.size();
+	header.num_prim_object = pack.prim_object.size();
+	header.num_prim_time = pack.prim_time.size();
+
+	/* Write to a temporary file first and move it in place once complete, so
+	 * concurrent renders sharing the cache never see partially written files. */
+	const string tmp_filepath = string_printf("%s.%llx.tmp",
+	                                          filepath.c_str(),
+	                                          (unsigned long long)(time_dt()*1e6));
+
+	path_create_directories(tmp_filepath);
+
+	FILE *f = path_fopen(tmp_filepath, "wb");
+	if(!f) {
+		return false;
+	}
+
+	size_t offset = sizeof(header);
+	bool ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+	          cache_write_array(f, offset, pack.nodes) &&
+	          cache_write_array(f, offset, pack.leaf_nodes) &&
+	          cache_write_array(f, offset, pack.prim_type) &&
+	          cache_write_array(f, offset, pack.prim_index) &&
+	          cache_write_array(f, offset, pack.prim_object) &&
+	          cache_write_array(f, offset, pack.prim_time);
+
+	if(fclose(f) != 0) {
+		ok = false;
+	}
+
+	if(ok && rename(tmp_filepath.c_str(), filepath.c_str()) != 0) {
+		/* Most likely another process wrote the same entry already. */
+		ok = path_exists(filepath);
+	}
+
+	path_remove(tmp_filepath);
+
+	return ok;
+}
+
+CCL_NAMESPACE_END
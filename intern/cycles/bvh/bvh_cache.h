@@ -0,0 +1,57 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BVH_CACHE_H__
+#define __BVH_CACHE_H__
+
+#include "util/util_string.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class BVHParams;
+class Object;
+struct PackedBVH;
+
+/* BVH Cache
+ *
+ * Persistent on-disk storage of packed object level BVHs, so meshes which did
+ * not change between renders (static set geometry in animation renders, for
+ * example) can load their BVH instead of building it again.
+ *
+ * Entries are keyed by MD5 of the mesh content and all BVH parameters which
+ * affect the resulting tree. The file stores a small header followed by the
+ * raw packed arrays, each starting at a BVH_ALIGN boundary so the file can be
+ * memory mapped directly. */
+
+class BVHCache {
+public:
+	/* Compute key of the BVH built from given objects with given parameters.
+	 * Returns empty string if the BVH can not be cached. */
+	static string key(const BVHParams& params, const vector<Object*>& objects);
+
+	/* Full path of the cache file for the given key. */
+	static string filepath(const BVHParams& params, const string& key);
+
+	/* Read packed nodes and primitive arrays from the cache. Triangle vertices
+	 * and visibility are not stored, they are to be re-packed by the caller. */
+	static bool read(const string& filepath, PackedBVH& pack);
+	static bool write(const string& filepath, const PackedBVH& pack);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __BVH_CACHE_H__ */
@@ -18,6 +18,7 @@
 
 #include "bvh/bvh_embree.h"
 
+#include "render/lazy_dicing.h"
 #include "render/mesh.h"
 #include "render/object.h"
 #include "util/util_progress.h"
@@ -198,6 +199,332 @@ bool rtc_memory_monitor_func(void* userPtr, const ssize_t bytes, const bool)
 	return true;
 }
 
+/* Lazy dicing of subdivision patches.
+ *
+ * Coarse patches are user geometry, diced and displaced into a grid the first
+ * time a ray enters their bounds. Grids are intersected by traversing their
+ * implicit 4-ary tree, hits are passed through rtc_filter_func the same as
+ * Embree does for regular triangles. */
+
+static LazyDicingGrid *rtc_lazy_dice(KernelGlobals *kg, const LazyDicing *lazy_dicing, int tri)
+{
+	const uint params = lazy_dicing->tri_params[tri];
+	const int level = (int)max(max(LAZY_DICING_EDGE_LEVEL(params, 0),
+	                               LAZY_DICING_EDGE_LEVEL(params, 1)),
+	                               LAZY_DICING_EDGE_LEVEL(params, 2));
+
+	LazyDicingGrid *grid = new LazyDicingGrid(tri, level);
+	const int resolution = grid->resolution;
+	const float inv_resolution = 1.0f/resolution;
+
+	const uint4 tri_vindex = kernel_tex_fetch(__tri_vindex, tri);
+	float3 V[3], N[3];
+	for(int k = 0; k < 3; k++) {
+		V[k] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + k));
+	}
+
+	const bool smooth = (params & LAZY_DICING_SMOOTH) != 0;
+	if(smooth) {
+		N[0] = float4_to_float3(kernel_tex_fetch(__tri_vnormal, tri_vindex.x));
+		N[1] = float4_to_float3(kernel_tex_fetch(__tri_vnormal, tri_vindex.y));
+		N[2] = float4_to_float3(kernel_tex_fetch(__tri_vnormal, tri_vindex.z));
+	}
+
+	const bool displace = (params & LAZY_DICING_DISPLACE) && kg->shader_kernel;
+	const int object = lazy_dicing->tri_object[tri];
+	vector<uint4> input;
+	vector<float4> output;
+
+	if(displace) {
+		input.resize(grid->verts.size());
+		output.resize(grid->verts.size());
+	}
+	else if(smooth) {
+		grid->normals.resize(grid->verts.size());
+	}
+
+	for(int a = 0; a <= resolution; a++) {
+		for(int b = 0; b <= resolution - a; b++) {
+			/* Points on edges shared with coarser diced patches are moved to the
+			 * points of that patch, to avoid cracks. */
+			int snap_a, snap_b;
+			LazyDicing::snap(params, level, a, b, &snap_a, &snap_b);
+
+			const float u = snap_a*inv_resolution;
+			const float v = snap_b*inv_resolution;
+			const float w = 1.0f - u - v;
+			float3 P = u*V[0] + v*V[1] + w*V[2];
+
+			if(smooth) {
+				/* Phong tessellation. */
+				float3 Q = make_float3(0.0f, 0.0f, 0.0f);
+				const float weight[3] = {u, v, w};
+
+				for(int k = 0; k < 3; k++) {
+					Q += weight[k]*(P - dot(P - V[k], N[k])*N[k]);
+				}
+
+				P = (1.0f - LAZY_DICING_PHONG_ALPHA)*P + LAZY_DICING_PHONG_ALPHA*Q;
+			}
+
+			const int index = grid->vert_index(a, b);
+			grid->verts[index] = P;
+
+			if(displace) {
+				input[index] = make_uint4(object, tri, __float_as_uint(u), __float_as_uint(v));
+			}
+			else if(smooth) {
+				grid->normals[index] = safe_normalize(u*N[0] + v*N[1] + w*N[2]);
+			}
+		}
+	}
+
+	if(displace) {
+		const int num_verts = (int)input.size();
+		for(int k = 0; k < num_verts; k++) {
+			kg->shader_kernel(kg, &input[0], &output[0], NULL, SHADER_EVAL_DISPLACE, 0, k, 0, 0);
+			grid->verts[k] += float4_to_float3(output[k]);
+		}
+
+		/* Displaced patches are shaded with the normals of the diced surface,
+		 * same as regular displacement recomputes vertex normals. */
+		if(smooth) {
+			grid->compute_normals();
+		}
+	}
+
+	grid->build();
+
+	return grid;
+}
+
+static LazyDicingGrid *rtc_lazy_dicing_grid(KernelGlobals *kg, int tri)
+{
+	LazyDicing *lazy_dicing = kernel_data.bvh.lazy_dicing;
+	LazyDicingGrid *grid = lazy_dicing->find(tri);
+
+	if(!grid) {
+		/* Dice without holding any lock, if another thread diced the patch in
+		 * the meantime its grid is used instead. */
+		grid = lazy_dicing->insert(rtc_lazy_dice(kg, lazy_dicing, tri));
+	}
+
+	return grid;
+}
+
+static bool rtc_lazy_dicing_bounds_hit(const BoundBox& bounds, const float3& P, const float3& idir, float tnear, float tfar)
+{
+	const float3 t0 = (bounds.min - P)*idir;
+	const float3 t1 = (bounds.max - P)*idir;
+	const float3 tmin = min(t0, t1);
+	const float3 tmax = max(t0, t1);
+
+	const float t_near = max(max(tmin.x, tmin.y), max(tmin.z, tnear));
+	const float t_far = min(min(tmax.x, tmax.y), min(tmax.z, tfar));
+
+	return t_near <= t_far;
+}
+
+/* Intersect all micropolygons of the grid, returns true if a hit passed the
+ * filter. Intersect queries keep searching for a closer hit, occluded queries
+ * stop at the first one. */
+static bool rtc_lazy_dicing_traverse(CCLRay& ray, const LazyDicingGrid *grid, unsigned geom_id, size_t item, bool occluded)
+{
+	KernelGlobals *kg = ray.kg;
+	const uint params = kernel_data.bvh.lazy_dicing->tri_params[grid->tri];
+	const float inv_resolution = 1.0f/grid->resolution;
+
+	const float3 P = make_float3(ray.org[0], ray.org[1], ray.org[2]);
+	const float3 D = make_float3(ray.dir[0], ray.dir[1], ray.dir[2]);
+	const float3 idir = bvh_inverse_direction(D);
+
+	/* Node index, level, corner and orientation. */
+	int stack[4*LAZY_DICING_MAX_LEVEL + 1][5];
+	int stack_size = 1;
+	stack[0][0] = 0;
+	stack[0][1] = 0;
+	stack[0][2] = 0;
+	stack[0][3] = 0;
+	stack[0][4] = 1;
+
+	bool hit = false;
+
+	while(stack_size) {
+		const int *node = stack[--stack_size];
+		const int index = node[0], node_level = node[1], a = node[2], b = node[3];
+		const bool upright = node[4] != 0;
+
+		if(node_level < grid->level) {
+			if(!rtc_lazy_dicing_bounds_hit(grid->nodes[index], P, idir, ray.tnear, ray.tfar)) {
+				continue;
+			}
+
+			int child_a[4], child_b[4];
+			bool child_upright[4];
+			LazyDicingGrid::children(a, b, grid->resolution >> node_level, upright,
+			                         child_a, child_b, child_upright);
+
+			for(int k = 3; k >= 0; k--) {
+				int *child = stack[stack_size++];
+				child[0] = 4*index + 1 + k;
+				child[1] = node_level + 1;
+				child[2] = child_a[k];
+				child[3] = child_b[k];
+				child[4] = child_upright[k];
+			}
+
+			continue;
+		}
+
+		/* Micropolygon, see triangle_refine() for the barycentric convention. */
+		int v[3][2];
+		grid->triangle(a, b, upright, v);
+
+		const float3 p0 = grid->verts[grid->vert_index(v[0][0], v[0][1])];
+		const float3 p1 = grid->verts[grid->vert_index(v[1][0], v[1][1])];
+		const float3 p2 = grid->verts[grid->vert_index(v[2][0], v[2][1])];
+
+		const float3 e1 = p0 - p2;
+		const float3 e2 = p1 - p2;
+		const float3 pvec = cross(D, e2);
+		const float det = dot(e1, pvec);
+
+		if(det == 0.0f) {
+			continue;
+		}
+
+		const float inv_det = 1.0f/det;
+		const float3 tvec = P - p2;
+		const float u = dot(tvec, pvec)*inv_det;
+		if(u < 0.0f || u > 1.0f) {
+			continue;
+		}
+
+		const float3 qvec = cross(tvec, e1);
+		const float v_ = dot(D, qvec)*inv_det;
+		if(v_ < 0.0f || u + v_ > 1.0f) {
+			continue;
+		}
+
+		const float t = dot(e2, qvec)*inv_det;
+		if(t <= ray.tnear || t >= ray.tfar) {
+			continue;
+		}
+
+		/* Barycentrics on the coarse patch, from those of the grid points. */
+		float patch_u = 0.0f, patch_v = 0.0f;
+		const float weight[3] = {u, v_, 1.0f - u - v_};
+
+		for(int k = 0; k < 3; k++) {
+			int snap_a, snap_b;
+			LazyDicing::snap(params, grid->level, v[k][0], v[k][1], &snap_a, &snap_b);
+			patch_u += weight[k]*snap_a*inv_resolution;
+			patch_v += weight[k]*snap_b*inv_resolution;
+		}
+
+		const float3 Ng = cross(p1 - p0, p2 - p0);
+
+		/* Smooth normal interpolated from the diced vertices, zero for flat
+		 * patches. */
+		float3 N = make_float3(0.0f, 0.0f, 0.0f);
+		if(!grid->normals.empty()) {
+			N = weight[0]*grid->normals[grid->vert_index(v[0][0], v[0][1])] +
+			    weight[1]*grid->normals[grid->vert_index(v[1][0], v[1][1])] +
+			    weight[2]*grid->normals[grid->vert_index(v[2][0], v[2][1])];
+		}
+
+		/* Pass the hit to the filter in Embree's convention, restoring the
+		 * previous closest hit if it gets rejected. */
+		const float prev_tfar = ray.tfar, prev_u = ray.u, prev_v = ray.v;
+		const float prev_Ng[3] = {ray.Ng[0], ray.Ng[1], ray.Ng[2]};
+		const unsigned prev_geom_id = ray.geomID, prev_prim_id = ray.primID;
+		const float3 prev_N = ray.lazy_dicing_N;
+		const float prev_plane = ray.lazy_dicing_plane;
+
+		ray.tfar = t;
+		ray.u = patch_v;
+		ray.v = 1.0f - patch_u - patch_v;
+		ray.Ng[0] = Ng.x;
+		ray.Ng[1] = Ng.y;
+		ray.Ng[2] = Ng.z;
+		ray.geomID = geom_id;
+		ray.primID = item;
+		ray.lazy_dicing_N = N;
+		ray.lazy_dicing_plane = dot(Ng, p2);
+
+		rtc_filter_func(NULL, ray);
+
+		if(ray.geomID == RTC_INVALID_GEOMETRY_ID) {
+			ray.tfar = prev_tfar;
+			ray.u = prev_u;
+			ray.v = prev_v;
+			ray.Ng[0] = prev_Ng[0];
+			ray.Ng[1] = prev_Ng[1];
+			ray.Ng[2] = prev_Ng[2];
+			ray.geomID = prev_geom_id;
+			ray.primID = prev_prim_id;
+			ray.lazy_dicing_N = prev_N;
+			ray.lazy_dicing_plane = prev_plane;
+			continue;
+		}
+
+		if(occluded) {
+			/* Embree's convention for an occluded ray, no need to look any
+			 * further. */
+			ray.tfar = prev_tfar;
+			ray.geomID = 0;
+			return true;
+		}
+
+		hit = true;
+	}
+
+	return hit;
+}
+
+static void rtc_lazy_dicing_query(void *ptr, RTCRay& ray_, size_t item, bool occluded)
+{
+	CCLRay &ray = (CCLRay&)ray_;
+	KernelGlobals *kg = ray.kg;
+
+	/* Same as CCLRay::isect_to_ccl(), the user data is the primitive offset. */
+	int prim = (int)((intptr_t)ptr + item);
+	if(ray.instID != RTC_INVALID_GEOMETRY_ID) {
+		prim += kernel_tex_fetch(__object_node, ray.instID/2);
+	}
+
+	/* Geometry of lazily diced patches is added with the object index, which
+	 * is always zero for instanced meshes. */
+	const unsigned geom_id = kernel_tex_fetch(__prim_object, prim)*2;
+
+	LazyDicingGrid *grid = rtc_lazy_dicing_grid(kg, kernel_tex_fetch(__prim_index, prim));
+	rtc_lazy_dicing_traverse(ray, grid, geom_id, item, occluded);
+	kernel_data.bvh.lazy_dicing->release(grid);
+}
+
+static void rtc_lazy_dicing_intersect_func(void *ptr, RTCRay& ray, size_t item)
+{
+	rtc_lazy_dicing_query(ptr, ray, item, false);
+}
+
+static void rtc_lazy_dicing_occluded_func(void *ptr, RTCRay& ray, size_t item)
+{
+	rtc_lazy_dicing_query(ptr, ray, item, true);
+}
+
+static void rtc_lazy_dicing_bounds_func(void *user_ptr, void *, size_t item, size_t, RTCBounds& bounds_o)
+{
+	const Mesh *mesh = (const Mesh*)user_ptr;
+	const BoundBox bounds = mesh->lazy_dicing_patch_bounds(item);
+
+	bounds_o.lower_x = bounds.min.x;
+	bounds_o.lower_y = bounds.min.y;
+	bounds_o.lower_z = bounds.min.z;
+	bounds_o.upper_x = bounds.max.x;
+	bounds_o.upper_y = bounds.max.y;
+	bounds_o.upper_z = bounds.max.z;
+}
+
 static double progress_start_time = 0.0f;
 
 bool rtc_progress_func(void* user_ptr, const double n);
@@ -386,10 +713,17 @@ unsigned BVHEmbree::add_object(Object *ob, int i)
 	unsigned geom_id = RTC_INVALID_GEOMETRY_ID;
 	if(params.primitive_mask & PRIMITIVE_ALL_TRIANGLE && mesh->num_triangles() > 0) {
 		size_t prim_offset = pack.prim_index.size();
-		geom_id = add_triangles(mesh, i);
-		rtcSetUserData(scene, geom_id, (void*)prim_offset);
-		rtcSetOcclusionFilterFunction(scene, geom_id, rtc_filter_func);
-		rtcSetIntersectionFilterFunction(scene, geom_id, rtc_filter_func);
+		if(mesh->use_lazy_dicing) {
+			/* Filter function is called from the intersection callbacks. */
+			geom_id = add_lazy_patches(mesh, i);
+			rtcSetUserData(scene, geom_id, (void*)prim_offset);
+		}
+		else {
+			geom_id = add_triangles(mesh, i);
+			rtcSetUserData(scene, geom_id, (void*)prim_offset);
+			rtcSetOcclusionFilterFunction(scene, geom_id, rtc_filter_func);
+			rtcSetIntersectionFilterFunction(scene, geom_id, rtc_filter_func);
+		}
 		rtcSetMask(scene, geom_id, ob->visibility);
 	}
 	if(params.primitive_mask & PRIMITIVE_ALL_CURVE && mesh->num_curves() > 0) {
@@ -491,6 +825,33 @@ unsigned BVHEmbree::add_triangles(Mesh *mesh, int i)
 	return geom_id;
 }
 
+unsigned BVHEmbree::add_lazy_patches(Mesh *mesh, int i)
+{
+	const size_t num_triangles = mesh->num_triangles();
+	unsigned geom_id = rtcNewUserGeometry3(scene,
+						params.bvh_type == SceneParams::BVH_DYNAMIC ? RTC_GEOMETRY_DEFORMABLE : RTC_GEOMETRY_STATIC,
+						num_triangles,
+						1,
+						i*2);
+
+	rtcSetBoundsFunction3(scene, geom_id, rtc_lazy_dicing_bounds_func, mesh);
+	rtcSetIntersectFunction(scene, geom_id, rtc_lazy_dicing_intersect_func);
+	rtcSetOccludedFunction(scene, geom_id, rtc_lazy_dicing_occluded_func);
+
+	pack.prim_object.reserve(pack.prim_object.size() + num_triangles);
+	pack.prim_type.reserve(pack.prim_type.size() + num_triangles);
+	pack.prim_index.reserve(pack.prim_index.size() + num_triangles);
+	pack.prim_tri_index.reserve(pack.prim_index.size() + num_triangles);
+	for(size_t j = 0; j < num_triangles; j++) {
+		pack.prim_object.push_back_reserved(i);
+		pack.prim_type.push_back_reserved(PRIMITIVE_TRIANGLE);
+		pack.prim_index.push_back_reserved(j);
+		pack.prim_tri_index.push_back_reserved(j);
+	}
+
+	return geom_id;
+}
+
 void BVHEmbree::update_tri_vertex_buffer(unsigned geom_id, const Mesh* mesh)
 {
 	const Attribute *attr_mP = NULL;
@@ -858,14 +1219,17 @@ void BVHEmbree::pack_nodes(const BVHNode *)
 	}
 }
 
-void BVHEmbree::refit_nodes()
+float BVHEmbree::refit_nodes()
 {
 	unsigned geom_id = 0;
 
 	foreach(Object *ob, objects) {
 		if(!params.top_level || (ob->is_traceable() && !ob->mesh->is_instanced())) {
 			if(params.primitive_mask & PRIMITIVE_ALL_TRIANGLE && ob->mesh->num_triangles() > 0) {
-				update_tri_vertex_buffer(geom_id, ob->mesh);
+				/* Bounds of lazily diced patches are updated from the mesh. */
+				if(!ob->mesh->use_lazy_dicing) {
+					update_tri_vertex_buffer(geom_id, ob->mesh);
+				}
 				rtcUpdate(scene, geom_id);
 			}
 
@@ -877,6 +1241,8 @@ void BVHEmbree::refit_nodes()
 		geom_id += 2;
 	}
 	rtcCommit(scene);
+
+	return 0.0f;
 }
 CCL_NAMESPACE_END
 
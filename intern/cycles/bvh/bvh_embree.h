@@ -47,12 +47,13 @@ protected:
 	BVHEmbree(const BVHParams& params, const vector<Object*>& objects);
 
 	virtual void pack_nodes(const BVHNode *root);
-	virtual void refit_nodes();
+	virtual float refit_nodes();
 
 	unsigned add_object(Object *ob, int i);
 	unsigned add_instance(Object *ob, int i);
 	unsigned add_curves(Mesh *mesh, int i);
 	unsigned add_triangles(Mesh *mesh, int i);
+	unsigned add_lazy_patches(Mesh *mesh, int i);
 
 	ssize_t mem_used;
 
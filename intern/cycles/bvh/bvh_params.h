@@ -19,6 +19,7 @@
 #define __BVH_PARAMS_H__
 
 #include "util/util_boundbox.h"
+#include "util/util_string.h"
 
 #include "kernel/kernel_types.h"
 
@@ -53,6 +54,12 @@ public:
 	/* QBVH */
 	bool use_qbvh;
 
+	/* Quantize child bounds of aligned QBVH nodes to this number of bits
+	 * relative to the node bounds, 0 to store full precision floats.
+	 * Supported values are 8 and 16, only used by the CPU kernel.
+	 */
+	int num_compressed_node_bits;
+
 	/* Mask of primitives to be included into the BVH. */
 	int primitive_mask;
 
@@ -61,6 +68,14 @@ public:
 	 */
 	bool use_unaligned_nodes;
 
+	/* Group up to this number of consecutive segments of a static hair strand
+	 * into a single reference, so they end up in one leaf oriented along the
+	 * strand and can be intersected together.
+	 * Only used for curves BVH with unaligned nodes and no spatial splits.
+	 */
+	bool use_curve_strands;
+	int num_curve_strand_segments;
+
 	/* Split time range to this number of steps and create leaf node for each
 	 * of this time steps.
 	 *
@@ -80,6 +95,13 @@ public:
 	int curve_flags;
 	int curve_subdivisions;
 
+	/* Refitted BVH is rebuilt once its SAH cost grew by more than this
+	 * factor compared to the freshly built tree, zero to always refit. */
+	float refit_sah_threshold;
+
+	/* Directory of the persistent BVH cache, empty to disable caching. */
+	string cache_path;
+
 	/* fixed parameters */
 	enum {
 		MAX_DEPTH = 64,
@@ -107,7 +129,10 @@ public:
 
 		top_level = false;
 		use_qbvh = false;
+		num_compressed_node_bits = 0;
 		use_unaligned_nodes = false;
+		use_curve_strands = false;
+		num_curve_strand_segments = 4;
 
 		primitive_mask = PRIMITIVE_ALL;
 
@@ -119,6 +144,10 @@ public:
 		use_bvh_embree = false;
 		curve_flags = 0;
 		curve_subdivisions = 4;
+
+		refit_sah_threshold = 1.5f;
+
+		cache_path = "";
 	}
 
 	/* SAH costs */
@@ -150,10 +179,12 @@ public:
 	                           int prim_object_,
 	                           int prim_type,
 	                           float time_from = 0.0f,
-	                           float time_to = 1.0f)
+	                           float time_to = 1.0f,
+	                           int num_segments = 1)
 	        : rbounds(bounds_),
 	          time_from_(time_from),
-	          time_to_(time_to)
+	          time_to_(time_to),
+	          num_segments_(num_segments)
 	{
 		rbounds.min.w = __int_as_float(prim_index_);
 		rbounds.max.w = __int_as_float(prim_object_);
@@ -166,6 +197,8 @@ public:
 	__forceinline int prim_type() const { return type; }
 	__forceinline float time_from() const { return time_from_; }
 	__forceinline float time_to() const { return time_to_; }
+	/* Number of consecutive curve segments, starting with the packed one. */
+	__forceinline int num_segments() const { return num_segments_; }
 
 
 	BVHReference& operator=(const BVHReference &arg) {
@@ -180,6 +213,7 @@ protected:
 	BoundBox rbounds;
 	uint type;
 	float time_from_, time_to_;
+	int num_segments_;
 };
 
 /* BVH Range
@@ -80,8 +80,9 @@ bool BVHUnaligned::compute_aligned_space(const BVHReference& ref,
 		const Mesh *mesh = object->mesh;
 		const Mesh::Curve& curve = mesh->get_curve(curve_index);
 		const int key = curve.first_key + segment;
+		/* Strand references are oriented from their first to last key. */
 		const float3 v1 = mesh->curve_keys[key],
-		             v2 = mesh->curve_keys[key + 1];
+		             v2 = mesh->curve_keys[key + ref.num_segments()];
 		float length;
 		const float3 axis = normalize_len(v2 - v1, &length);
 		if(length > 1e-6f) {
@@ -106,11 +107,13 @@ BoundBox BVHUnaligned::compute_aligned_prim_boundbox(
 		const int segment = PRIMITIVE_UNPACK_SEGMENT(packed_type);
 		const Mesh *mesh = object->mesh;
 		const Mesh::Curve& curve = mesh->get_curve(curve_index);
-		curve.bounds_grow(segment,
-		                  &mesh->curve_keys[0],
-		                  &mesh->curve_radius[0],
-		                  aligned_space,
-		                  bounds);
+		for(int s = 0; s < prim.num_segments(); s++) {
+			curve.bounds_grow(segment + s,
+			                  &mesh->curve_keys[0],
+			                  &mesh->curve_radius[0],
+			                  aligned_space,
+			                  bounds);
+		}
 	}
 	else {
 		bounds = prim.bounds().transformed(&aligned_space);
@@ -240,7 +240,10 @@ Device *Device::create(DeviceInfo& info, Stats &stats, bool background)
 #endif
 #ifdef WITH_NETWORK
 		case DEVICE_NETWORK:
-			device = device_network_create(info, stats, "127.0.0.1");
+			if(string_startswith(info.id, "NETWORK_"))
+				device = device_network_create(info, stats, info.id.substr(8).c_str());
+			else
+				device = device_network_create(info, stats, "127.0.0.1");
 			break;
 #endif
 #ifdef WITH_OPENCL
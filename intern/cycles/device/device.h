@@ -300,8 +300,8 @@ public:
 		const DeviceDrawParams &draw_params);
 
 #ifdef WITH_NETWORK
-	/* networking */
-	void server_run();
+	/* networking, cache_size limits texture data kept between sessions */
+	void server_run(int port, size_t cache_size);
 #endif
 
 	/* multi device */
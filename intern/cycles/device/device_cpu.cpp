@@ -27,6 +27,7 @@
 #include "kernel/kernel_oiio_globals.h"
 
 #include "device/device.h"
+#include "device/device_denoising.h"
 #include "device/device_intern.h"
 #include "device/device_split_kernel.h"
 
@@ -289,6 +290,11 @@ public:
 			VLOG(1) << "Will be using regular kernels.";
 		}
 
+#ifdef WITH_EMBREE
+		/* Used by Embree callbacks to displace lazily diced patches. */
+		kernel_globals.shader_kernel = get_shader_kernel();
+#endif
+
 		use_split_kernel = DebugFlags().cpu.split_kernel;
 		if(use_split_kernel) {
 			VLOG(1) << "Will be using split kernel.";
@@ -445,6 +451,101 @@ public:
 		}
 	};
 
+	/* Adaptive sampling needs all samples of a tile rendered in one go, so it
+	 * is not used for progressive rendering. */
+	bool use_adaptive_sampling(KernelGlobals *kg, const RenderTile& tile)
+	{
+		return kg->__data.film.pass_adaptive != 0 &&
+		       kg->__data.integrator.adaptive_threshold > 0.0f &&
+		       tile.start_sample == 0 &&
+		       tile.num_samples > kg->__data.integrator.adaptive_min_samples;
+	}
+
+	bool adaptive_pixel_converged(KernelGlobals *kg, const RenderTile& tile, int x, int y)
+	{
+		const float *buffer = (float*)tile.buffer;
+		const int index = tile.offset + x + y*tile.stride;
+		return buffer[index*kg->__data.film.pass_stride + kg->__data.film.pass_adaptive + 3] != 0.0f;
+	}
+
+	bool adaptive_any_converged(KernelGlobals *kg, const RenderTile& tile, int x, int y, int num)
+	{
+		for(int i = 0; i < num; i++) {
+			if(adaptive_pixel_converged(kg, tile, x + i, y)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/* Test all pixels of the tile for convergence, returns true when there is
+	 * nothing left to sample. The mask of pixels below the threshold is
+	 * dilated, so a pixel only stops once its neighbours within the tile are
+	 * below the threshold too. */
+	bool adaptive_check_convergence(KernelGlobals *kg, const RenderTile& tile, int sample)
+	{
+		vector<uchar> below_threshold(tile.w*tile.h);
+		for(int y = tile.y; y < tile.y + tile.h; y++) {
+			for(int x = tile.x; x < tile.x + tile.w; x++) {
+				below_threshold[(y - tile.y)*tile.w + (x - tile.x)] =
+				        kernel_cpu_adaptive_check_convergence(kg, (float*)tile.buffer,
+				                                              x, y, sample,
+				                                              tile.offset, tile.stride);
+			}
+		}
+
+		bool all_converged = true;
+		for(int y = 0; y < tile.h; y++) {
+			for(int x = 0; x < tile.w; x++) {
+				bool converged = true;
+				for(int dy = max(y - 1, 0); dy <= min(y + 1, tile.h - 1) && converged; dy++) {
+					for(int dx = max(x - 1, 0); dx <= min(x + 1, tile.w - 1); dx++) {
+						if(!below_threshold[dy*tile.w + dx]) {
+							converged = false;
+							break;
+						}
+					}
+				}
+
+				if(converged) {
+					kernel_cpu_adaptive_mark_converged(kg, (float*)tile.buffer,
+					                                   tile.x + x, tile.y + y, sample,
+					                                   tile.offset, tile.stride);
+				}
+				else {
+					all_converged = false;
+				}
+			}
+		}
+		return all_converged;
+	}
+
+	void adaptive_post_adjust(KernelGlobals *kg, const RenderTile& tile, int num_samples)
+	{
+		for(int y = tile.y; y < tile.y + tile.h; y++) {
+			for(int x = tile.x; x < tile.x + tile.w; x++) {
+				kernel_cpu_adaptive_post_adjust(kg, (float*)tile.buffer,
+				                                x, y, num_samples,
+				                                tile.offset, tile.stride);
+			}
+		}
+	}
+
+	/* Filter a tile using pixels of the neighbouring tiles, which must be
+	 * rendered already. */
+	void denoise(KernelGlobals *kg, DeviceTask& task, RenderTile& tile)
+	{
+		RenderTile tiles[9];
+		tiles[4] = tile;
+		task.map_neighbor_tiles(tiles, this);
+
+		DenoisingTask denoising(task.denoising_params,
+		                        kg->__data.film.pass_stride,
+		                        kg->__data.film.pass_denoising,
+		                        kg->__data.film.pass_combined);
+		denoising.run(tiles);
+	}
+
 	void thread_path_trace(DeviceTask& task)
 	{
 		if(task_pool.canceled()) {
@@ -455,40 +556,49 @@ public:
 		KernelGlobals kg = thread_kernel_globals_init();
 		RenderTile tile;
 
+		stats.profiler.add_state(&kg.profiler);
+
 		void(*path_trace_kernel)(KernelGlobals*, float*, unsigned int*, int, int, int, int, int);
+		void(*path_trace_packet_kernel)(KernelGlobals*, float*, unsigned int*, int, int, int, int, int, int);
 
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
 		if(system_cpu_support_avx2()) {
 			path_trace_kernel = kernel_cpu_avx2_path_trace;
+			path_trace_packet_kernel = kernel_cpu_avx2_path_trace_packet;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
 		if(system_cpu_support_avx()) {
 			path_trace_kernel = kernel_cpu_avx_path_trace;
+			path_trace_packet_kernel = kernel_cpu_avx_path_trace_packet;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
 		if(system_cpu_support_sse41()) {
 			path_trace_kernel = kernel_cpu_sse41_path_trace;
+			path_trace_packet_kernel = kernel_cpu_sse41_path_trace_packet;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
 		if(system_cpu_support_sse3()) {
 			path_trace_kernel = kernel_cpu_sse3_path_trace;
+			path_trace_packet_kernel = kernel_cpu_sse3_path_trace_packet;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
 		if(system_cpu_support_sse2()) {
 			path_trace_kernel = kernel_cpu_sse2_path_trace;
+			path_trace_packet_kernel = kernel_cpu_sse2_path_trace_packet;
 		}
 		else
 #endif
 		{
 			path_trace_kernel = kernel_cpu_path_trace;
+			path_trace_packet_kernel = kernel_cpu_path_trace_packet;
 		}
 
 		/* cryptomatte data. This needs a better place than here. */
@@ -501,7 +611,20 @@ public:
 		kg.coverage_object = kg.coverage_material = kg.coverage_asset = NULL;
 		kg.coverage_object_index = kg.coverage_material_index = NULL;
 
+		/* Camera rays of neighbour pixels are traced in packets, unless per
+		 * pixel cryptomatte coverage is needed. */
+		const bool use_ray_packets = DebugFlags().cpu.ray_packets &&
+		                             !(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE);
+
 		while(task.acquire_tile(this, tile)) {
+			if(tile.task == RenderTile::DENOISE) {
+				if(kg.__data.film.pass_denoising) {
+					denoise(&kg, task, tile);
+				}
+				task.release_tile(tile);
+				continue;
+			}
+
 			if(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE) {
 				if(kg.__data.film.use_cryptomatte & CRYPT_OBJECT) {
 					coverage_object.clear();
@@ -528,6 +651,7 @@ public:
 			uint *rng_state = (uint*)tile.rng_state;
 			int start_sample = tile.start_sample;
 			int end_sample = tile.start_sample + tile.num_samples;
+			const bool use_adaptive = use_adaptive_sampling(&kg, tile);
 
 			for(int sample = start_sample; sample < end_sample; sample++) {
 				if(task.get_cancel() || task_pool.canceled()) {
@@ -536,7 +660,29 @@ public:
 				}
 
 				for(int y = tile.y; y < tile.y + tile.h; y++) {
+					if(use_ray_packets) {
+						for(int x = tile.x; x < tile.x + tile.w; x += RAY_PACKET_SIZE) {
+							const int num = min(RAY_PACKET_SIZE, tile.x + tile.w - x);
+							if(use_adaptive && adaptive_any_converged(&kg, tile, x, y, num)) {
+								/* Trace rest of a partially converged packet pixel by pixel. */
+								for(int i = 0; i < num; i++) {
+									if(!adaptive_pixel_converged(&kg, tile, x + i, y)) {
+										path_trace_kernel(&kg, render_buffer, rng_state,
+										                  sample, x + i, y, tile.offset, tile.stride);
+									}
+								}
+								continue;
+							}
+							path_trace_packet_kernel(&kg, render_buffer, rng_state,
+							                         sample, x, y, num, tile.offset, tile.stride);
+						}
+						continue;
+					}
+
 					for(int x = tile.x; x < tile.x + tile.w; x++) {
+						if(use_adaptive && adaptive_pixel_converged(&kg, tile, x, y)) {
+							continue;
+						}
 						if(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE) {
 							if(kg.__data.film.use_cryptomatte & CRYPT_OBJECT) {
 								kg.coverage_object = &coverage_object[tile.w * (y - tile.y) + x - tile.x];
@@ -561,6 +707,20 @@ public:
 
 				tile.sample = sample + 1;
 
+				int pixel_samples = tile.w*tile.h;
+
+				if(use_adaptive &&
+				   tile.sample >= kg.__data.integrator.adaptive_min_samples &&
+				   tile.sample % kg.__data.integrator.adaptive_step == 0)
+				{
+					if(adaptive_check_convergence(&kg, tile, sample)) {
+						/* All pixels converged, skip remaining samples. */
+						pixel_samples += tile.w*tile.h*(end_sample - tile.sample);
+						tile.sample = end_sample;
+						sample = end_sample - 1;
+					}
+				}
+
 				if(tile.sample == end_sample) {
 					int aov_index = 0;
 					if(kg.__data.film.use_cryptomatte & CRYPT_ACCURATE) {
@@ -580,9 +740,15 @@ public:
 							aov_index += flatten_coverage(&kg, coverage_asset, tile, aov_index);
 						}
 					}
+
+					/* After flattening, so cryptomatte weights of converged
+					 * pixels are scaled as well. */
+					if(use_adaptive) {
+						adaptive_post_adjust(&kg, tile, end_sample);
+					}
 				}
 
-				task.update_progress(&tile, tile.w*tile.h);
+				task.update_progress(&tile, pixel_samples);
 			}
 
 			task.release_tile(tile);
@@ -593,6 +759,8 @@ public:
 			}
 		}
 
+		stats.profiler.remove_state(&kg.profiler);
+
 		thread_kernel_globals_free(&kg);
 	}
 
@@ -624,6 +792,14 @@ public:
 		}
 
 		while(task.acquire_tile(this, tile)) {
+			if(tile.task == RenderTile::DENOISE) {
+				if(kg->__data.film.pass_denoising) {
+					denoise(kg, task, tile);
+				}
+				task.release_tile(tile);
+				continue;
+			}
+
 			device_memory data;
 			split_kernel.path_trace(&task, tile, kgbuffer, data);
 
@@ -728,55 +904,53 @@ public:
 		}
 	}
 
-	void thread_shader(DeviceTask& task)
-	{
-		KernelGlobals kg = kernel_globals;
-
-#ifdef WITH_OSL
-		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
-#endif
-		if(kg.oiio && kg.oiio->tex_sys) {
-			kg.oiio_tdata = kg.oiio->tex_sys->get_perthread_info();
-		}
-		else {
-			kg.oiio_tdata = NULL;
-		}
-
-		void(*shader_kernel)(KernelGlobals*, uint4*, float4*, float*, int, int, int, int, int);
+	typedef void(*ShaderKernelFunction)(KernelGlobals*, uint4*, float4*, float*, int, int, int, int, int);
 
+	static ShaderKernelFunction get_shader_kernel()
+	{
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
 		if(system_cpu_support_avx2()) {
-			shader_kernel = kernel_cpu_avx2_shader;
+			return kernel_cpu_avx2_shader;
 		}
-		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
 		if(system_cpu_support_avx()) {
-			shader_kernel = kernel_cpu_avx_shader;
+			return kernel_cpu_avx_shader;
 		}
-		else
 #endif
-#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41			
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
 		if(system_cpu_support_sse41()) {
-			shader_kernel = kernel_cpu_sse41_shader;
+			return kernel_cpu_sse41_shader;
 		}
-		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
 		if(system_cpu_support_sse3()) {
-			shader_kernel = kernel_cpu_sse3_shader;
+			return kernel_cpu_sse3_shader;
 		}
-		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
 		if(system_cpu_support_sse2()) {
-			shader_kernel = kernel_cpu_sse2_shader;
+			return kernel_cpu_sse2_shader;
 		}
-		else
 #endif
-		{
-			shader_kernel = kernel_cpu_shader;
+		return kernel_cpu_shader;
+	}
+
+	void thread_shader(DeviceTask& task)
+	{
+		KernelGlobals kg = kernel_globals;
+
+#ifdef WITH_OSL
+		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
+#endif
+		if(kg.oiio && kg.oiio->tex_sys) {
+			kg.oiio_tdata = kg.oiio->tex_sys->get_perthread_info();
 		}
+		else {
+			kg.oiio_tdata = NULL;
+		}
+
+		ShaderKernelFunction shader_kernel = get_shader_kernel();
 
 		for(int sample = 0; sample < task.num_samples; sample++) {
 			for(int x = task.shader_x; x < task.shader_x + task.shader_w; x++)
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "device/device_denoising.h"
+
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Layout of the denoising passes, see kernel_write_result(). */
+#define DENOISING_NORMAL 0
+#define DENOISING_ALBEDO 6
+#define DENOISING_DEPTH 12
+#define DENOISING_IMAGE 20
+
+static inline float3 pass_mean(const float *pass, float inv_samples)
+{
+	return make_float3(pass[0], pass[1], pass[2])*inv_samples;
+}
+
+/* Variance of the mean, from the sum and sum of squares of samples stored
+ * after it. */
+static inline float3 pass_variance(const float *pass, float inv_samples)
+{
+	float3 sum = make_float3(pass[0], pass[1], pass[2]);
+	float3 sum_sq = make_float3(pass[3], pass[4], pass[5]);
+	return max(sum_sq - sum*sum*inv_samples, make_float3(0.0f, 0.0f, 0.0f))*(inv_samples*inv_samples);
+}
+
+static inline float gradient_sq(float a, float b)
+{
+	return (a - b)*(a - b);
+}
+
+static inline float gradient_sq(float3 a, float3 b)
+{
+	return len_squared(a - b)*(1.0f/3.0f);
+}
+
+/* Squared gradient of a feature by central differences, one sided at the
+ * border of the region. */
+template<typename T>
+static void compute_gradient(const vector<T>& feature, vector<float>& gradient, int w, int h)
+{
+	gradient.resize(w*h);
+
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			int x0 = max(x - 1, 0), x1 = min(x + 1, w - 1);
+			int y0 = max(y - 1, 0), y1 = min(y + 1, h - 1);
+
+			float gx = gradient_sq(feature[y*w + x1], feature[y*w + x0]);
+			float gy = gradient_sq(feature[y1*w + x], feature[y0*w + x]);
+
+			gx /= max((float)((x1 - x0)*(x1 - x0)), 1.0f);
+			gy /= max((float)((y1 - y0)*(y1 - y0)), 1.0f);
+
+			gradient[y*w + x] = gx + gy;
+		}
+	}
+}
+
+DenoisingTask::DenoisingTask(const DenoiseParams& params_,
+                             int pass_stride_,
+                             int pass_denoising_,
+                             int pass_combined_)
+: params(params_),
+  pass_stride(pass_stride_),
+  pass_denoising(pass_denoising_),
+  pass_combined(pass_combined_),
+  width(0)
+{
+}
+
+const RenderTile& DenoisingTask::pixel_tile(const RenderTile *tiles, int x, int y)
+{
+	const RenderTile& center = tiles[4];
+	int tx = (x < center.x)? 0: (x >= center.x + center.w)? 2: 1;
+	int ty = (y < center.y)? 0: (y >= center.y + center.h)? 2: 1;
+
+	return tiles[ty*3 + tx];
+}
+
+float *DenoisingTask::pixel(const RenderTile *tiles, int x, int y)
+{
+	const RenderTile& tile = pixel_tile(tiles, x, y);
+	return (float*)tile.buffer + (size_t)(tile.offset + x + y*tile.stride)*pass_stride;
+}
+
+void DenoisingTask::run(const RenderTile *tiles)
+{
+	const RenderTile& center = tiles[4];
+	const int margin = params.radius + DENOISE_PATCH_RADIUS;
+
+	/* Region includes neighbouring tiles up to the margin, where they exist. */
+	rect = make_int4(center.x, center.y, center.x + center.w, center.y + center.h);
+	tile_rect = rect;
+
+	if(tiles[3].w > 0) rect.x = max(center.x - margin, tiles[3].x);
+	if(tiles[1].h > 0) rect.y = max(center.y - margin, tiles[1].y);
+	if(tiles[5].w > 0) rect.z = min(center.x + center.w + margin, tiles[5].x + tiles[5].w);
+	if(tiles[7].h > 0) rect.w = min(center.y + center.h + margin, tiles[7].y + tiles[7].h);
+
+	width = rect.z - rect.x;
+
+	read_passes(tiles);
+	filter(tiles, max(center.sample, 1));
+}
+
+void DenoisingTask::read_passes(const RenderTile *tiles)
+{
+	const int height = rect.w - rect.y;
+	const int size = width*height;
+
+	image.resize(size);
+	image_variance.resize(size);
+	normal.resize(size);
+	normal_variance.resize(size);
+	albedo.resize(size);
+	albedo_variance.resize(size);
+	depth.resize(size);
+	depth_variance.resize(size);
+
+	for(int y = rect.y; y < rect.w; y++) {
+		for(int x = rect.x; x < rect.z; x++) {
+			/* Neighbours may have rendered fewer samples when rendering
+			 * was canceled. */
+			const float inv_samples = 1.0f/max(pixel_tile(tiles, x, y).sample, 1);
+			const float *buffer = pixel(tiles, x, y) + pass_denoising;
+			const int i = (y - rect.y)*width + (x - rect.x);
+
+			image[i] = pass_mean(buffer + DENOISING_IMAGE, inv_samples);
+			image_variance[i] = pass_variance(buffer + DENOISING_IMAGE, inv_samples);
+
+			normal[i] = pass_mean(buffer + DENOISING_NORMAL, inv_samples);
+			normal_variance[i] = average(pass_variance(buffer + DENOISING_NORMAL, inv_samples));
+
+			albedo[i] = pass_mean(buffer + DENOISING_ALBEDO, inv_samples);
+			albedo_variance[i] = average(pass_variance(buffer + DENOISING_ALBEDO, inv_samples));
+
+			float depth_sum = buffer[DENOISING_DEPTH];
+			float depth_sum_sq = buffer[DENOISING_DEPTH + 1];
+			depth[i] = depth_sum*inv_samples;
+			depth_variance[i] = max(depth_sum_sq - depth_sum*depth_sum*inv_samples, 0.0f)*(inv_samples*inv_samples);
+		}
+	}
+
+	compute_gradient(normal, normal_gradient, width, height);
+	compute_gradient(albedo, albedo_gradient, width, height);
+	compute_gradient(depth, depth_gradient, width, height);
+}
+
+/* Largest of the normalized distances of the feature passes between pixels,
+ * features which vary due to noise or geometry are penalized less. */
+float DenoisingTask::feature_distance(int p, int q, float k_2)
+{
+	float normal_dist = len_squared(normal[p] - normal[q])*(1.0f/3.0f);
+	normal_dist -= normal_variance[p] + min(normal_variance[p], normal_variance[q]);
+	normal_dist /= k_2*max(DENOISE_FEATURE_EPSILON, max(normal_variance[p], normal_gradient[p]));
+
+	float albedo_dist = len_squared(albedo[p] - albedo[q])*(1.0f/3.0f);
+	albedo_dist -= albedo_variance[p] + min(albedo_variance[p], albedo_variance[q]);
+	albedo_dist /= k_2*max(DENOISE_FEATURE_EPSILON, max(albedo_variance[p], albedo_gradient[p]));
+
+	float depth_dist = (depth[p] - depth[q])*(depth[p] - depth[q]);
+	depth_dist -= depth_variance[p] + min(depth_variance[p], depth_variance[q]);
+	depth_dist /= k_2*max(DENOISE_FEATURE_EPSILON, max(depth_variance[p], depth_gradient[p]));
+
+	return max(normal_dist, max(albedo_dist, depth_dist));
+}
+
+void DenoisingTask::filter(const RenderTile *tiles, int num_samples)
+{
+	const int r = params.radius;
+	const int f = DENOISE_PATCH_RADIUS;
+	const int height = rect.w - rect.y;
+
+	/* Strength parameters are mapped to a logarithmic scale. */
+	const float k_2 = powf(2.0f, lerp(-5.0f, 3.0f, params.strength));
+	const float feature_k_2 = powf(2.0f, lerp(-5.0f, 3.0f, params.feature_strength));
+
+	/* Tile in region coordinates, and the area around it from which patches
+	 * are compared. */
+	const int tx0 = tile_rect.x - rect.x, tx1 = tile_rect.z - rect.x;
+	const int ty0 = tile_rect.y - rect.y, ty1 = tile_rect.w - rect.y;
+	const int ax0 = max(tx0 - f, 0), ax1 = min(tx1 + f, width);
+	const int ay0 = max(ty0 - f, 0), ay1 = min(ty1 + f, height);
+	const int aw = ax1 - ax0, ah = ay1 - ay0;
+	const int tw = tx1 - tx0, th = ty1 - ty0;
+
+	vector<float> difference(aw*ah), valid(aw*ah);
+	vector<float> blur_difference(aw*ah), blur_valid(aw*ah);
+	vector<float3> accum(tw*th, make_float3(0.0f, 0.0f, 0.0f));
+	vector<float> weight_sum(tw*th, 0.0f);
+
+	/* Non-local means evaluated for one offset between pixels at a time, so
+	 * patch distances are box filtered differences of the whole area. */
+	for(int dy = -r; dy <= r; dy++) {
+		for(int dx = -r; dx <= r; dx++) {
+			for(int y = ay0; y < ay1; y++) {
+				for(int x = ax0; x < ax1; x++) {
+					const int a = (y - ay0)*aw + (x - ax0);
+					const int qx = x + dx, qy = y + dy;
+
+					if(qx < 0 || qy < 0 || qx >= width || qy >= height) {
+						difference[a] = 0.0f;
+						valid[a] = 0.0f;
+						continue;
+					}
+
+					const int p = y*width + x, q = qy*width + qx;
+					float3 delta = image[p] - image[q];
+					float3 var_p = image_variance[p], var_q = image_variance[q];
+					float3 dist = (delta*delta - (var_p + min(var_p, var_q))) /
+					              (make_float3(1e-8f, 1e-8f, 1e-8f) + k_2*(var_p + var_q));
+
+					difference[a] = average(dist);
+					valid[a] = 1.0f;
+				}
+			}
+
+			/* Separable box filter over the patch. */
+			for(int y = 0; y < ah; y++) {
+				for(int x = 0; x < aw; x++) {
+					float sum = 0.0f, count = 0.0f;
+					for(int i = max(x - f, 0); i <= min(x + f, aw - 1); i++) {
+						sum += difference[y*aw + i];
+						count += valid[y*aw + i];
+					}
+					blur_difference[y*aw + x] = sum;
+					blur_valid[y*aw + x] = count;
+				}
+			}
+
+			for(int y = ty0; y < ty1; y++) {
+				for(int x = tx0; x < tx1; x++) {
+					const int qx = x + dx, qy = y + dy;
+					if(qx < 0 || qy < 0 || qx >= width || qy >= height)
+						continue;
+
+					float sum = 0.0f, count = 0.0f;
+					for(int i = max(y - ay0 - f, 0); i <= min(y - ay0 + f, ah - 1); i++) {
+						sum += blur_difference[i*aw + (x - ax0)];
+						count += blur_valid[i*aw + (x - ax0)];
+					}
+
+					const int p = y*width + x, q = qy*width + qx;
+					float color_dist = sum/max(count, 1.0f);
+					float dist = max(color_dist, feature_distance(p, q, feature_k_2));
+					float weight = expf(-max(dist, 0.0f));
+
+					const int t = (y - ty0)*tw + (x - tx0);
+					accum[t] += weight*image[q];
+					weight_sum[t] += weight;
+				}
+			}
+		}
+	}
+
+	/* Combined pass stores the sum of samples, alpha is left as it is. */
+	for(int y = ty0; y < ty1; y++) {
+		for(int x = tx0; x < tx1; x++) {
+			const int t = (y - ty0)*tw + (x - tx0);
+			float3 color = accum[t]*((float)num_samples/weight_sum[t]);
+
+			float *combined = pixel(tiles, rect.x + x, rect.y + y) + pass_combined;
+			combined[0] = color.x;
+			combined[1] = color.y;
+			combined[2] = color.z;
+		}
+	}
+}
+
+CCL_NAMESPACE_END
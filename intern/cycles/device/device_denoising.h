@@ -0,0 +1,84 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DEVICE_DENOISING_H__
+#define __DEVICE_DENOISING_H__
+
+#include "device/device_task.h"
+
+#include "render/buffers.h"
+
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Denoising
+ *
+ * Feature guided non-local means filter for completed tiles, run by the CPU
+ * device in between rendering other tiles. Weights of pixels in the filter
+ * window are the minimum of a patch based distance of the noisy image and
+ * per pixel distances of the normal, albedo and depth feature passes, each
+ * normalized by the variance of the pass [Rousselle et al. 2013]. The window
+ * extends into neighbouring tiles, so no seams appear at tile borders. */
+
+/* Radius of patches compared for the image distance. */
+#define DENOISE_PATCH_RADIUS 3
+/* Lower bound of the normalization of feature distances. */
+#define DENOISE_FEATURE_EPSILON 1e-3f
+
+class DenoisingTask {
+public:
+	DenoisingTask(const DenoiseParams& params,
+	              int pass_stride,
+	              int pass_denoising,
+	              int pass_combined);
+
+	/* Filter the tile at index 4 of a 3x3 neighbourhood of tiles, replacing
+	 * the color of its combined pass. Reads denoising passes only, so the
+	 * neighbours may be filtered at the same time. */
+	void run(const RenderTile *tiles);
+
+protected:
+	DenoiseParams params;
+	int pass_stride;
+	int pass_denoising;
+	int pass_combined;
+
+	/* Region of the image which is read, and the tile which is filtered. */
+	int4 rect;
+	int4 tile_rect;
+	int width;
+
+	/* Mean and variance of the passes over the region. Variances and
+	 * gradients of features are averaged over channels. */
+	vector<float3> image, image_variance;
+	vector<float3> normal, albedo;
+	vector<float> depth;
+	vector<float> normal_variance, albedo_variance, depth_variance;
+	vector<float> normal_gradient, albedo_gradient, depth_gradient;
+
+	const RenderTile& pixel_tile(const RenderTile *tiles, int x, int y);
+	float *pixel(const RenderTile *tiles, int x, int y);
+	void read_passes(const RenderTile *tiles);
+	void filter(const RenderTile *tiles, int num_samples);
+
+	float feature_distance(int p, int q, float k_2);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __DEVICE_DENOISING_H__ */
@@ -27,6 +27,7 @@
 #include "util/util_list.h"
 #include "util/util_logging.h"
 #include "util/util_map.h"
+#include "util/util_thread.h"
 #include "util/util_time.h"
 
 CCL_NAMESPACE_BEGIN
@@ -56,16 +57,32 @@ public:
 		}
 
 #ifdef WITH_NETWORK
-		/* try to add network devices */
-		ServerDiscovery discovery(true);
-		time_sleep(1.0);
+		/* try to add network devices, unless servers were listed explicitly
+		 * in which case discovery would connect to them a second time */
+		bool have_network_devices = false;
 
-		vector<string> servers = discovery.get_server_list();
+		foreach(DeviceInfo& subinfo, info.multi_devices)
+			have_network_devices |= (subinfo.type == DEVICE_NETWORK);
 
-		foreach(string& server, servers) {
-			device = device_network_create(info, stats, server.c_str());
-			if(device)
-				devices.push_back(SubDevice(device));
+		if(!have_network_devices) {
+			ServerDiscovery discovery(true);
+			time_sleep(1.0);
+
+			vector<string> servers = discovery.get_server_list();
+
+			foreach(string& server, servers) {
+				DeviceInfo network_info;
+
+				network_info.type = DEVICE_NETWORK;
+				network_info.description = "Network Device (" + server + ")";
+				network_info.id = "NETWORK_" + server;
+				network_info.advanced_shading = true;
+				network_info.pack_images = false;
+
+				device = device_network_create(network_info, stats, server.c_str());
+				if(device)
+					devices.push_back(SubDevice(device));
+			}
 		}
 #endif
 	}
@@ -339,8 +356,26 @@ public:
 
 	void task_wait()
 	{
-		foreach(SubDevice& sub, devices)
-			sub.device->task_wait();
+		/* Network devices only hand out tiles to their server while waiting,
+		 * wait on them in parallel so all servers keep rendering. */
+		vector<thread*> threads;
+
+		foreach(SubDevice& sub, devices) {
+			if(sub.device->info.type == DEVICE_NETWORK)
+				threads.push_back(new thread(function_bind(&Device::task_wait, sub.device)));
+		}
+
+		/* Local devices render in their own threads already, so it's fine to
+		 * wait on them here once all network waits are started. */
+		foreach(SubDevice& sub, devices) {
+			if(sub.device->info.type != DEVICE_NETWORK)
+				sub.device->task_wait();
+		}
+
+		foreach(thread *t, threads) {
+			t->join();
+			delete t;
+		}
 	}
 
 	void task_cancel()
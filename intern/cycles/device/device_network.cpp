@@ -20,9 +20,15 @@
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_time.h"
 
 #if defined(WITH_NETWORK)
 
+#ifndef _WIN32
+#  include <sys/select.h>
+#endif
+
 CCL_NAMESPACE_BEGIN
 
 typedef map<device_ptr, device_ptr> PtrMap;
@@ -41,6 +47,41 @@ static TileList::iterator tile_list_find(TileList& tile_list, RenderTile& tile)
 	return tile_list.end();
 }
 
+/* Split "host:port" address, port is optional. */
+static void network_address_split(const string& address, string& host, string& port)
+{
+	size_t pos = address.rfind(':');
+
+	if(pos == string::npos) {
+		host = address;
+		port = string_printf("%d", SERVER_PORT);
+	}
+	else {
+		host = address.substr(0, pos);
+		port = address.substr(pos + 1);
+	}
+}
+
+/* Hash of data content, so data which the server still has from an earlier
+ * session does not need to be sent again. */
+static string network_data_hash(const void *data, size_t size)
+{
+	MD5Hash md5;
+	uint64_t size64 = size;
+	md5.append((const uint8_t*)&size64, sizeof(size64));
+
+	/* MD5Hash works with int sizes, feed huge buffers in chunks. */
+	const uint8_t *bytes = (const uint8_t*)data;
+	while(size > 0) {
+		size_t chunk = std::min(size, (size_t)(1 << 30));
+		md5.append(bytes, (int)chunk);
+		bytes += chunk;
+		size -= chunk;
+	}
+
+	return md5.get_hex();
+}
+
 class NetworkDevice : public Device
 {
 public:
@@ -60,11 +101,12 @@ public:
 	: Device(info, stats, true), socket(io_service)
 	{
 		error_func = NetworkError();
-		stringstream portstr;
-		portstr << SERVER_PORT;
+
+		string host, port;
+		network_address_split(address, host, port);
 
 		tcp::resolver resolver(io_service);
-		tcp::resolver::query query(address, portstr.str());
+		tcp::resolver::query query(host, port);
 		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
 		tcp::resolver::iterator end;
 
@@ -114,7 +156,7 @@ public:
 
 		snd.add(mem);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+		snd.write_buffer_compressed((void*)mem.data_pointer, mem.memory_size());
 	}
 
 	void mem_copy_from(device_memory& mem, int y, int w, int h, int elem)
@@ -183,6 +225,8 @@ public:
 		        << string_human_readable_number(mem.memory_size()) << " bytes. ("
 		        << string_human_readable_size(mem.memory_size()) << ")";
 
+		string hash = network_data_hash((void*)mem.data_pointer, mem.memory_size());
+
 		thread_scoped_lock lock(rpc_lock);
 
 		mem.device_pointer = ++mem_counter;
@@ -195,8 +239,18 @@ public:
 		snd.add(mem);
 		snd.add(interpolation);
 		snd.add(extension);
+		snd.add(hash);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+
+		/* Server tells if it has the data cached already. */
+		bool need_data = true;
+		RPCReceive rcv(socket, &error_func);
+		rcv.read(need_data);
+
+		if(need_data)
+			snd.write_buffer_compressed((void*)mem.data_pointer, mem.memory_size());
+		else
+			VLOG(1) << "Texture " << name << " is cached on the server.";
 	}
 
 	void tex_free(device_memory& mem)
@@ -261,6 +315,13 @@ public:
 			if(error_func.have_error())
 				break;
 
+			/* Server reports progress regularly while rendering, so when it
+			 * stays silent it is stuck or the connection is gone. */
+			if(!wait_readable(NETWORK_TIMEOUT)) {
+				error_func.network_error("Network receive error: server stopped responding");
+				break;
+			}
+
 			RenderTile tile;
 
 			lock.lock();
@@ -309,9 +370,28 @@ public:
 				lock.unlock();
 				break;
 			}
+			else if(rcv.name == "tile_progress") {
+				lock.unlock();
+			}
 			else
 				lock.unlock();
 		}
+
+		if(error_func.have_error()) {
+			VLOG(1) << "Network device failed, giving back "
+			        << the_tiles.size() << " tiles.";
+
+			/* Close connection, so further calls fail right away instead of
+			 * waiting for a server which does not respond. */
+			boost::system::error_code error;
+			socket.close(error);
+
+			/* Let other devices render the tiles this server did not finish. */
+			foreach(RenderTile& tile, the_tiles) {
+				if(!(the_task.requeue_tile && the_task.requeue_tile(tile)))
+					the_task.release_tile(tile);
+			}
+		}
 	}
 
 	void task_cancel()
@@ -327,6 +407,27 @@ public:
 	}
 
 private:
+	/* Wait until data from the server arrives, returns false on timeout. */
+	bool wait_readable(double timeout)
+	{
+		boost::system::error_code error;
+		if(socket.available(error) > 0 || error)
+			return true;
+
+		tcp::socket::native_handle_type fd = socket.native_handle();
+
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+
+		timeval tv;
+		tv.tv_sec = (long)timeout;
+		tv.tv_usec = (long)((timeout - tv.tv_sec) * 1e6);
+
+		/* Errors are reported by the following receive. */
+		return select((int)fd + 1, &fds, NULL, NULL, &tv) != 0;
+	}
+
 	NetworkError error_func;
 };
 
@@ -337,18 +438,142 @@ Device *device_network_create(DeviceInfo& info, Stats &stats, const char *addres
 
 void device_network_info(vector<DeviceInfo>& devices)
 {
-	DeviceInfo info;
+	/* Servers can be listed as "host:port" separated by spaces or commas,
+	 * otherwise a server on the local host is used. */
+	vector<string> servers;
+	const char *servers_env = getenv("CYCLES_NETWORK_SERVERS");
+
+	if(servers_env)
+		string_split(servers, servers_env, " ,");
+
+	if(servers.empty()) {
+		DeviceInfo info;
+
+		info.type = DEVICE_NETWORK;
+		info.description = "Network Device";
+		info.id = "NETWORK";
+		info.num = 0;
+		info.advanced_shading = true; /* todo: get this info from device */
+		info.pack_images = false;
+
+		devices.push_back(info);
+		return;
+	}
+
+	int num = 0;
+
+	foreach(string& server, servers) {
+		DeviceInfo info;
 
-	info.type = DEVICE_NETWORK;
-	info.description = "Network Device";
-	info.id = "NETWORK";
-	info.num = 0;
-	info.advanced_shading = true; /* todo: get this info from device */
-	info.pack_images = false;
+		info.type = DEVICE_NETWORK;
+		info.description = "Network Device (" + server + ")";
+		info.id = "NETWORK_" + server;
+		info.num = num++;
+		info.advanced_shading = true;
+		info.pack_images = false;
 
-	devices.push_back(info);
+		devices.push_back(info);
+	}
 }
 
+/* Texture data on the server, kept around after the client disconnects so
+ * that reconnecting with the same scene, for the next frame or after a
+ * network failure, does not need to upload it again. Entries are identified
+ * by a hash of their content, least recently used ones which are not in use
+ * are freed once the cache exceeds its size limit. */
+class NetworkDataCache {
+public:
+	explicit NetworkDataCache(size_t max_size_)
+	: max_size(max_size_), size(0), time(0)
+	{
+	}
+
+	/* Get data for the hash and add a user, or NULL if it is not cached. */
+	DataVector *acquire(const string& hash)
+	{
+		EntryMap::iterator it = entries.find(hash);
+		if(it == entries.end())
+			return NULL;
+
+		it->second.users++;
+		it->second.last_used = ++time;
+
+		return &it->second.data;
+	}
+
+	/* Add new entry with one user, data is to be filled in by the caller. */
+	DataVector *insert(const string& hash, size_t data_size)
+	{
+		Entry& entry = entries[hash];
+
+		size -= entry.data.size();
+		entry.data.resize(data_size);
+		size += data_size;
+
+		entry.users = 1;
+		entry.last_used = ++time;
+
+		return &entry.data;
+	}
+
+	/* Remove entry right away, when its data could not be received. */
+	void remove(const string& hash)
+	{
+		EntryMap::iterator it = entries.find(hash);
+		if(it != entries.end()) {
+			size -= it->second.data.size();
+			entries.erase(it);
+		}
+	}
+
+	void release(const string& hash)
+	{
+		EntryMap::iterator it = entries.find(hash);
+		assert(it != entries.end() && it->second.users > 0);
+
+		it->second.users--;
+
+		trim();
+	}
+
+protected:
+	void trim()
+	{
+		while(size > max_size) {
+			EntryMap::iterator oldest = entries.end();
+
+			for(EntryMap::iterator it = entries.begin(); it != entries.end(); ++it) {
+				if(it->second.users == 0 &&
+				   (oldest == entries.end() || it->second.last_used < oldest->second.last_used))
+				{
+					oldest = it;
+				}
+			}
+
+			if(oldest == entries.end())
+				break;
+
+			size -= oldest->second.data.size();
+			entries.erase(oldest);
+		}
+	}
+
+	struct Entry {
+		Entry() : users(0), last_used(0) {}
+
+		DataVector data;
+		int users;
+		uint64_t last_used;
+	};
+
+	typedef map<string, Entry> EntryMap;
+
+	EntryMap entries;
+	size_t max_size;
+	size_t size;
+	uint64_t time;
+};
+
 class DeviceServer {
 public:
 	thread_mutex rpc_lock;
@@ -359,8 +584,9 @@ public:
 
 	bool have_error() { return error_func.have_error(); }
 
-	DeviceServer(Device *device_, tcp::socket& socket_)
-	: device(device_), socket(socket_), stop(false), blocked_waiting(false)
+	DeviceServer(Device *device_, tcp::socket& socket_, NetworkDataCache *data_cache_)
+	: device(device_), socket(socket_), data_cache(data_cache_),
+	  stop(false), blocked_waiting(false), last_heartbeat_time(0.0)
 	{
 		error_func = NetworkError();
 	}
@@ -371,9 +597,17 @@ public:
 		for(;;) {
 			listen_step();
 
-			if(stop)
+			if(stop || have_error())
 				break;
 		}
+
+		if(have_error()) {
+			/* connection was lost, possibly in the middle of rendering */
+			device->task_cancel();
+			device->task_wait();
+		}
+
+		free_memory();
 	}
 
 protected:
@@ -382,12 +616,44 @@ protected:
 		thread_scoped_lock lock(rpc_lock);
 		RPCReceive rcv(socket, &error_func);
 
+		if(have_error())
+			return;
+
 		if(rcv.name == "stop")
 			stop = true;
 		else
 			process(rcv, lock);
 	}
 
+	/* free all memory the client did not free itself */
+	void free_memory()
+	{
+		for(PtrMap::iterator it = ptr_map.begin(); it != ptr_map.end(); ++it) {
+			network_device_memory mem;
+			mem.device_pointer = it->second;
+
+			map<device_ptr, string>::iterator ihash = tex_hashes.find(it->first);
+
+			if(ihash != tex_hashes.end()) {
+				device->tex_free(mem);
+				data_cache->release(ihash->second);
+			}
+			else {
+				/* data is owned by mem_data, so the device does not free it */
+				DataMap::iterator idata = mem_data.find(it->first);
+				if(idata != mem_data.end() && idata->second.size())
+					mem.data_pointer = (device_ptr)&(idata->second[0]);
+
+				device->mem_free(mem);
+			}
+		}
+
+		ptr_map.clear();
+		ptr_imap.clear();
+		mem_data.clear();
+		tex_hashes.clear();
+	}
+
 	/* create a memory buffer for a device buffer and insert it into mem_data */
 	DataVector &data_vector_insert(device_ptr client_pointer, size_t data_size)
 	{
@@ -450,10 +716,10 @@ protected:
 		assert(irev != ptr_imap.end());
 		ptr_imap.erase(irev);
 
-		/* erase the data vector */
+		/* erase the data vector, cached texture data is not in here */
 		DataMap::iterator idata = mem_data.find(client_pointer);
-		assert(idata != mem_data.end());
-		mem_data.erase(idata);
+		if(idata != mem_data.end())
+			mem_data.erase(idata);
 
 		return result;
 	}
@@ -508,7 +774,7 @@ protected:
 			mem.data_pointer = (device_ptr)&data_v[0];
 
 			/* copy data from network into memory buffer */
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			rcv.read_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
 
 			/* translate the client pointer to a real device pointer */
 			mem.device_pointer = device_ptr_from_client_pointer(client_pointer);
@@ -537,9 +803,12 @@ protected:
 
 			size_t data_size = mem.memory_size();
 
-			RPCSend snd(socket, &error_func, "mem_copy_from");
-			snd.write();
-			snd.write_buffer((uint8_t*)mem.data_pointer, data_size);
+			{
+				thread_scoped_lock send_lock(send_mutex);
+				RPCSend snd(socket, &error_func, "mem_copy_from");
+				snd.write();
+				snd.write_buffer((uint8_t*)mem.data_pointer, data_size);
+			}
 			lock.unlock();
 		}
 		else if(rcv.name == "mem_zero") {
@@ -566,6 +835,11 @@ protected:
 
 			client_pointer = mem.device_pointer;
 
+			/* data is owned by mem_data, so the device does not free it */
+			DataVector &data_v = data_vector_find(client_pointer);
+			if(data_v.size())
+				mem.data_pointer = (device_ptr)&(data_v[0]);
+
 			mem.device_pointer = device_ptr_from_client_pointer_erase(client_pointer);
 
 			device->mem_free(mem);
@@ -590,28 +864,54 @@ protected:
 			ExtensionType extension_type;
 			device_ptr client_pointer;
 
+			string hash;
+
 			rcv.read(name);
 			rcv.read(mem);
 			rcv.read(interpolation);
 			rcv.read(extension_type);
-			lock.unlock();
+			rcv.read(hash);
 
 			client_pointer = mem.device_pointer;
 
 			size_t data_size = mem.memory_size();
 
-			DataVector &data_v = data_vector_insert(client_pointer, data_size);
+			/* only ask for the data if it is not cached from earlier sessions */
+			DataVector *data_v = data_cache->acquire(hash);
+			bool need_data = (data_v == NULL);
+
+			{
+				thread_scoped_lock send_lock(send_mutex);
+				RPCSend snd(socket, &error_func, "tex_alloc");
+				snd.add(need_data);
+				snd.write();
+			}
+			lock.unlock();
+
+			if(need_data)
+				data_v = data_cache->insert(hash, data_size);
 
 			if(data_size)
-				mem.data_pointer = (device_ptr)&(data_v[0]);
+				mem.data_pointer = (device_ptr)&((*data_v)[0]);
 			else
 				mem.data_pointer = 0;
 
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			if(need_data) {
+				rcv.read_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
+
+				if(have_error()) {
+					data_cache->remove(hash);
+					return;
+				}
+			}
+			else {
+				VLOG(1) << "Using cached data for texture " << name << ".";
+			}
 
 			device->tex_alloc(name.c_str(), mem, interpolation, extension_type);
 
 			pointer_mapping_insert(client_pointer, mem.device_pointer);
+			tex_hashes[client_pointer] = hash;
 		}
 		else if(rcv.name == "tex_free") {
 			network_device_memory mem;
@@ -625,6 +925,12 @@ protected:
 			mem.device_pointer = device_ptr_from_client_pointer_erase(client_pointer);
 
 			device->tex_free(mem);
+
+			map<device_ptr, string>::iterator ihash = tex_hashes.find(client_pointer);
+			if(ihash != tex_hashes.end()) {
+				data_cache->release(ihash->second);
+				tex_hashes.erase(ihash);
+			}
 		}
 		else if(rcv.name == "load_kernels") {
 			DeviceRequestedFeatures requested_features;
@@ -635,9 +941,12 @@ protected:
 
 			bool result;
 			result = device->load_kernels(requested_features);
-			RPCSend snd(socket, &error_func, "load_kernels");
-			snd.add(result);
-			snd.write();
+			{
+				thread_scoped_lock send_lock(send_mutex);
+				RPCSend snd(socket, &error_func, "load_kernels");
+				snd.add(result);
+				snd.write();
+			}
 			lock.unlock();
 		}
 		else if(rcv.name == "task_add") {
@@ -681,8 +990,11 @@ protected:
 			blocked_waiting = false;
 
 			lock.lock();
-			RPCSend snd(socket, &error_func, "task_wait_done");
-			snd.write();
+			{
+				thread_scoped_lock send_lock(send_mutex);
+				RPCSend snd(socket, &error_func, "task_wait_done");
+				snd.write();
+			}
 			lock.unlock();
 		}
 		else if(rcv.name == "task_cancel") {
@@ -720,8 +1032,11 @@ protected:
 
 		bool result = false;
 
-		RPCSend snd(socket, &error_func, "acquire_tile");
-		snd.write();
+		{
+			thread_scoped_lock send_lock(send_mutex);
+			RPCSend snd(socket, &error_func, "acquire_tile");
+			snd.write();
+		}
 
 		do {
 			if(blocked_waiting)
@@ -762,7 +1077,18 @@ protected:
 
 	void task_update_tile_sample(RenderTile&)
 	{
-		; /* skip */
+		/* let the client know we are still alive while rendering tiles,
+		 * rpc_lock is not needed since nothing is received here */
+		thread_scoped_lock send_lock(send_mutex);
+
+		double current_time = time_dt();
+
+		if(current_time - last_heartbeat_time >= NETWORK_HEARTBEAT_INTERVAL) {
+			RPCSend snd(socket, &error_func, "tile_progress");
+			snd.write();
+
+			last_heartbeat_time = current_time;
+		}
 	}
 
 	void task_release_tile(RenderTile& tile)
@@ -773,11 +1099,10 @@ protected:
 		if(tile.rng_state) tile.rng_state = ptr_imap[tile.rng_state];
 
 		{
-			thread_scoped_lock lock(rpc_lock);
+			thread_scoped_lock send_lock(send_mutex);
 			RPCSend snd(socket, &error_func, "release_tile");
 			snd.add(tile);
 			snd.write();
-			lock.unlock();
 		}
 
 		do {
@@ -799,12 +1124,12 @@ protected:
 					cout << "Error: unexpected release RPC receive call \"" + entry.name + "\"\n";
 				}
 			}
-		} while(acquire_queue.empty() && !stop);
+		} while(acquire_queue.empty() && !stop && !have_error());
 	}
 
 	bool task_get_cancel()
 	{
-		return false;
+		return have_error();
 	}
 
 	/* properties */
@@ -816,6 +1141,10 @@ protected:
 	PtrMap ptr_imap;
 	DataMap mem_data;
 
+	/* texture data shared between sessions, by client pointer */
+	NetworkDataCache *data_cache;
+	map<device_ptr, string> tex_hashes;
+
 	struct AcquireEntry {
 		string name;
 		RenderTile tile;
@@ -824,25 +1153,30 @@ protected:
 	thread_mutex acquire_mutex;
 	list<AcquireEntry> acquire_queue;
 
+	/* all writes to the socket go through this, so messages sent from
+	 * different render threads never interleave */
+	thread_mutex send_mutex;
+
 	bool stop;
 	bool blocked_waiting;
+	double last_heartbeat_time;
 private:
 	NetworkError error_func;
-
-	/* todo: free memory and device (osl) on network error */
-
 };
 
-void Device::server_run()
+void Device::server_run(int port, size_t cache_size)
 {
 	try {
 		/* starts thread that responds to discovery requests */
-		ServerDiscovery discovery;
+		ServerDiscovery discovery(false, port);
+
+		/* texture data cache which persists between connections */
+		NetworkDataCache data_cache(cache_size);
 
 		for(;;) {
 			/* accept connection */
 			boost::asio::io_service io_service;
-			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), SERVER_PORT));
+			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
 
 			tcp::socket socket(io_service);
 			acceptor.accept(socket);
@@ -850,7 +1184,7 @@ void Device::server_run()
 			string remote_address = socket.remote_endpoint().address().to_string();
 			printf("Connected to remote client at: %s\n", remote_address.c_str());
 
-			DeviceServer server(this, socket);
+			DeviceServer server(this, socket, &data_cache);
 			server.listen();
 
 			printf("Disconnected.\n");
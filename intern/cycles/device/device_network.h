@@ -33,6 +33,8 @@
 #include <sstream>
 #include <deque>
 
+#include <zlib.h>
+
 #include "render/buffers.h"
 
 #include "util/util_foreach.h"
@@ -55,6 +57,13 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
+/* Buffers are compressed in chunks of this size. */
+static const size_t NETWORK_CHUNK_SIZE = 64*1024*1024;
+/* Servers report progress at least this often while rendering tiles, the
+ * client gives up on a server which stays silent for longer than the timeout. */
+static const double NETWORK_HEARTBEAT_INTERVAL = 1.0;
+static const double NETWORK_TIMEOUT = 60.0;
+
 #if 0
 typedef boost::archive::text_oarchive o_archive;
 typedef boost::archive::text_iarchive i_archive;
@@ -139,6 +148,7 @@ public:
 
 	void add(const RenderTile& tile)
 	{
+		archive & tile.tile_index;
 		archive & tile.x & tile.y & tile.w & tile.h;
 		archive & tile.start_sample & tile.num_samples & tile.sample;
 		archive & tile.resolution & tile.offset & tile.stride;
@@ -187,6 +197,39 @@ public:
 			error_func->network_error(error.message());
 	}
 
+	/* Send buffer compressed, in chunks which are each preceded by a fixed
+	 * size header with the compressed size. Chunks which do not get smaller
+	 * are sent uncompressed, with the header matching the chunk size. */
+	void write_buffer_compressed(void *buffer, size_t size)
+	{
+		uint8_t *data = (uint8_t*)buffer;
+		vector<uint8_t> compressed;
+
+		for(size_t offset = 0; offset < size; offset += NETWORK_CHUNK_SIZE) {
+			size_t chunk_size = std::min(size - offset, NETWORK_CHUNK_SIZE);
+			uLongf compressed_size = compressBound(chunk_size);
+			uint8_t *chunk = data + offset;
+
+			compressed.resize(compressed_size);
+
+			if(compress2(&compressed[0], &compressed_size, chunk, chunk_size, 1) == Z_OK &&
+			   compressed_size < chunk_size)
+			{
+				chunk = &compressed[0];
+			}
+			else {
+				compressed_size = chunk_size;
+			}
+
+			ostringstream header_stream;
+			header_stream << setw(8) << hex << compressed_size;
+			string header_str = header_stream.str();
+
+			write_buffer(&header_str[0], header_str.size());
+			write_buffer(chunk, compressed_size);
+		}
+	}
+
 protected:
 	string name;
 	tcp::socket& socket;
@@ -268,7 +311,9 @@ public:
 
 	template<typename T> void read(T& data)
 	{
-		*archive & data;
+		/* Archive is missing when receiving failed. */
+		if(archive)
+			*archive & data;
 	}
 
 	void read_buffer(void *buffer, size_t size)
@@ -284,6 +329,47 @@ public:
 			cout << "Network receive error: buffer size doesn't match expected size\n";
 	}
 
+	/* Receive buffer written by RPCSend::write_buffer_compressed. */
+	void read_buffer_compressed(void *buffer, size_t size)
+	{
+		uint8_t *data = (uint8_t*)buffer;
+		vector<uint8_t> compressed;
+
+		for(size_t offset = 0; offset < size; offset += NETWORK_CHUNK_SIZE) {
+			size_t chunk_size = std::min(size - offset, NETWORK_CHUNK_SIZE);
+
+			char header[8];
+			read_buffer(header, sizeof(header));
+
+			if(error_func->have_error())
+				return;
+
+			istringstream header_stream(string(header, sizeof(header)));
+			size_t compressed_size;
+
+			if(!(header_stream >> hex >> compressed_size) || compressed_size > chunk_size) {
+				error_func->network_error("Network receive error: invalid compressed chunk header");
+				return;
+			}
+
+			if(compressed_size == chunk_size) {
+				read_buffer(data + offset, chunk_size);
+				continue;
+			}
+
+			compressed.resize(compressed_size);
+			read_buffer(&compressed[0], compressed_size);
+
+			uLongf uncompressed_size = chunk_size;
+			if(uncompress(data + offset, &uncompressed_size, &compressed[0], compressed_size) != Z_OK ||
+			   uncompressed_size != chunk_size)
+			{
+				error_func->network_error("Network receive error: can't decompress data");
+				return;
+			}
+		}
+	}
+
 	void read(DeviceTask& task)
 	{
 		int type;
@@ -300,6 +386,7 @@ public:
 
 	void read(RenderTile& tile)
 	{
+		*archive & tile.tile_index;
 		*archive & tile.x & tile.y & tile.w & tile.h;
 		*archive & tile.start_sample & tile.num_samples & tile.sample;
 		*archive & tile.resolution & tile.offset & tile.stride;
@@ -322,8 +409,8 @@ protected:
 
 class ServerDiscovery {
 public:
-	explicit ServerDiscovery(bool discover = false)
-	: listen_socket(io_service), collect_servers(false)
+	explicit ServerDiscovery(bool discover = false, int server_port_ = SERVER_PORT)
+	: listen_socket(io_service), server_port(server_port_), collect_servers(false)
 	{
 		/* setup listen socket */
 		listen_endpoint.address(boost::asio::ip::address_v4::any());
@@ -384,8 +471,13 @@ private:
 
 			/* handle incoming message */
 			if(collect_servers) {
-				if(msg == DISCOVER_REPLY_MSG) {
+				if(msg.compare(0, DISCOVER_REPLY_MSG.size(), DISCOVER_REPLY_MSG) == 0) {
+					/* Reply carries the port the server listens on, so multiple
+					 * servers can run on the same host. */
+					string port = string_strip(msg.substr(DISCOVER_REPLY_MSG.size()));
+
 					string address = receive_endpoint.address().to_string();
+					address += ":" + (port.empty()? string_printf("%d", SERVER_PORT): port);
 
 					mutex.lock();
 
@@ -402,7 +494,7 @@ private:
 			else {
 				/* reply to request */
 				if(msg == DISCOVER_REQUEST_MSG)
-					broadcast_message(DISCOVER_REPLY_MSG);
+					broadcast_message(string_printf("%s %d", DISCOVER_REPLY_MSG.c_str(), server_port));
 			}
 		}
 
@@ -438,6 +530,7 @@ private:
 	boost::asio::io_service io_service;
 	boost::asio::ip::udp::endpoint listen_endpoint;
 	boost::asio::ip::udp::socket listen_socket;
+	int server_port;
 
 	/* threading */
 	boost::thread *thread;
@@ -32,6 +32,25 @@ class RenderBuffers;
 class RenderTile;
 class Tile;
 
+/* Denoising Parameters */
+
+class DenoiseParams {
+public:
+	/* Radius of the filter window in pixels. */
+	int radius;
+	/* Controls how strongly pixels with a different color are mixed, and
+	 * how strongly pixels with different feature passes are mixed. */
+	float strength;
+	float feature_strength;
+
+	DenoiseParams()
+	{
+		radius = 8;
+		strength = 0.5f;
+		feature_strength = 0.5f;
+	}
+};
+
 class DeviceTask : public Task {
 public:
 	typedef enum { PATH_TRACE, FILM_CONVERT, SHADER } Type;
@@ -64,7 +83,15 @@ public:
 	function<void(long, int)> update_progress_sample;
 	function<void(RenderTile&)> update_tile_sample;
 	function<void(RenderTile&)> release_tile;
+	/* Give back an acquired tile which the device failed to render, so it is
+	 * rendered again by another device. Returns false if not supported. */
+	function<bool(RenderTile&)> requeue_tile;
 	function<bool(void)> get_cancel;
+	/* Fill in the 3x3 tiles around a tile acquired for denoising, the tile
+	 * itself is at index 4. Tiles outside of the image get a zero size. */
+	function<void(RenderTile*, Device*)> map_neighbor_tiles;
+
+	DenoiseParams denoising_params;
 
 	bool need_finish_queue;
 	bool integrator_branched;
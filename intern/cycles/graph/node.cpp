@@ -18,6 +18,7 @@
 #include "graph/node_type.h"
 
 #include "util/util_foreach.h"
+#include "util/util_md5.h"
 #include "util/util_param.h"
 #include "util/util_transform.h"
 
@@ -403,5 +404,95 @@ bool Node::equals(const Node& other) const
 	return true;
 }
 
+/* hash */
+
+template<typename T>
+static void array_hash(const Node *node, const SocketType& socket, MD5Hash& md5)
+{
+	const array<T>& a = *(const array<T>*)(((char*)node) + socket.struct_offset);
+	md5_append_array(md5, a);
+}
+
+static void float3_array_hash(const Node *node, const SocketType& socket, MD5Hash& md5)
+{
+	const array<float3>& a = *(const array<float3>*)(((char*)node) + socket.struct_offset);
+	md5_append_float3(md5, a.data(), a.size());
+}
+
+static void string_array_hash(const Node *node, const SocketType& socket, MD5Hash& md5)
+{
+	const array<ustring>& a = *(const array<ustring>*)(((char*)node) + socket.struct_offset);
+	md5_append_value(md5, (uint64_t)a.size());
+	for(size_t i = 0; i < a.size(); i++) {
+		md5.append(a[i].string());
+		md5_append_value(md5, '\0');
+	}
+}
+
+/* Hash content of referenced nodes rather than their pointers, so keys stay
+ * the same between sessions. */
+static void node_ref_hash(const Node *node, MD5Hash& md5)
+{
+	md5_append_value(md5, (node != NULL));
+	if(node) {
+		node->hash(md5);
+	}
+}
+
+static void node_array_hash(const Node *node, const SocketType& socket, MD5Hash& md5)
+{
+	const array<Node*>& a = node->get_node_array(socket);
+	md5_append_value(md5, (uint64_t)a.size());
+	for(size_t i = 0; i < a.size(); i++) {
+		node_ref_hash(a[i], md5);
+	}
+}
+
+void Node::hash(MD5Hash& md5) const
+{
+	md5.append(type->name.string());
+
+	foreach(const SocketType& socket, type->inputs) {
+		md5.append(socket.name.string());
+
+		const void *value = ((char*)this) + socket.struct_offset;
+
+		switch(socket.type) {
+			case SocketType::COLOR:
+			case SocketType::VECTOR:
+			case SocketType::POINT:
+			case SocketType::NORMAL:
+				md5_append_float3(md5, (const float3*)value, 1);
+				break;
+			case SocketType::STRING:
+				/* hash content rather than ustring pointer, so keys stay the
+				 * same between sessions */
+				md5.append(get_string(socket).string());
+				md5_append_value(md5, '\0');
+				break;
+			case SocketType::CLOSURE:
+			case SocketType::UNDEFINED:
+				break;
+			case SocketType::BOOLEAN_ARRAY: array_hash<bool>(this, socket, md5); break;
+			case SocketType::FLOAT_ARRAY: array_hash<float>(this, socket, md5); break;
+			case SocketType::INT_ARRAY: array_hash<int>(this, socket, md5); break;
+			case SocketType::COLOR_ARRAY:
+			case SocketType::VECTOR_ARRAY:
+			case SocketType::POINT_ARRAY:
+			case SocketType::NORMAL_ARRAY:
+				float3_array_hash(this, socket, md5);
+				break;
+			case SocketType::POINT2_ARRAY: array_hash<float2>(this, socket, md5); break;
+			case SocketType::STRING_ARRAY: string_array_hash(this, socket, md5); break;
+			case SocketType::TRANSFORM_ARRAY: array_hash<Transform>(this, socket, md5); break;
+			case SocketType::NODE: node_ref_hash(get_node(socket), md5); break;
+			case SocketType::NODE_ARRAY: node_array_hash(this, socket, md5); break;
+			default:
+				md5_append_data(md5, value, socket.size());
+				break;
+		}
+	}
+}
+
 CCL_NAMESPACE_END
 
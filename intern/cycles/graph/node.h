@@ -24,6 +24,7 @@
 
 CCL_NAMESPACE_BEGIN
 
+class MD5Hash;
 struct Node;
 struct NodeType;
 struct Transform;
@@ -88,6 +89,9 @@ struct Node
 	/* equals */
 	bool equals(const Node& other) const;
 
+	/* hash of type and all input values, for cache keys */
+	void hash(MD5Hash& md5) const;
+
 	ustring name;
 	const NodeType *type;
 };
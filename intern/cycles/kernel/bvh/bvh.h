@@ -171,6 +171,10 @@ ccl_device_intersect bool scene_intersect(KernelGlobals *kg,
                                           float extmax,
                                           uint shadow_linking)
 {
+	PROFILING_INIT(kg, (visibility & PATH_RAY_SHADOW) ? PROFILING_INTERSECT_SHADOW
+	                                                   : PROFILING_INTERSECT);
+	PROFILING_COUNT_RAY();
+
 #ifdef __EMBREE__
 	if(kernel_data.bvh.scene) {
 		isect->t = ray.t;
@@ -218,6 +222,10 @@ ccl_device_intersect bool scene_intersect(KernelGlobals *kg,
 #endif /* __KERNEL_CPU__ */
 }
 
+#ifdef __RAY_PACKETS__
+#  include "kernel/bvh/qbvh_packet.h"
+#endif
+
 #ifdef __SUBSURFACE__
 /* Note: ray is passed by value to work around a possible CUDA compiler bug. */
 ccl_device_intersect void scene_intersect_subsurface(KernelGlobals *kg,
@@ -228,6 +236,9 @@ ccl_device_intersect void scene_intersect_subsurface(KernelGlobals *kg,
                                                      int max_hits,
                                                      uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_INTERSECT_SUBSURFACE);
+	PROFILING_COUNT_RAY();
+
 #ifdef __EMBREE__
 	if(kernel_data.bvh.scene) {
 		CCLRay rtc_ray(ray, kg, PATH_RAY_ALL_VISIBILITY, CCLRay::RAY_SSS, shadow_linking);
@@ -264,6 +275,9 @@ ccl_device_intersect void scene_intersect_subsurface(KernelGlobals *kg,
 #ifdef __SHADOW_RECORD_ALL__
 ccl_device_intersect bool scene_intersect_shadow_all(KernelGlobals *kg, const Ray *ray, Intersection *isect, uint max_hits, uint *num_hits, uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_INTERSECT_SHADOW);
+	PROFILING_COUNT_RAY();
+
 #ifdef __EMBREE__
 	if(kernel_data.bvh.scene) {
 		CCLRay rtc_ray(*ray, kg, PATH_RAY_SHADOW, CCLRay::RAY_SHADOW_ALL, shadow_linking);
@@ -314,6 +328,9 @@ ccl_device_intersect bool scene_intersect_volume(KernelGlobals *kg,
                                                  const uint visibility,
                                                  uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_INTERSECT_VOLUME);
+	PROFILING_COUNT_RAY();
+
 #  ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 		return bvh_intersect_volume_motion(kg, ray, isect, visibility, shadow_linking);
@@ -343,6 +360,9 @@ ccl_device_intersect uint scene_intersect_volume_all(KernelGlobals *kg,
                                                      const uint visibility,
                                                      uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_INTERSECT_VOLUME);
+	PROFILING_COUNT_RAY();
+
 #ifdef __EMBREE__
 	if(kernel_data.bvh.scene) {
 		CCLRay rtc_ray(*ray, kg, visibility, CCLRay::RAY_VOLUME_ALL, shadow_linking);
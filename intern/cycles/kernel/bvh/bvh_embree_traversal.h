@@ -41,6 +41,10 @@ struct RTCORE_ALIGN(16) CCLRay : public RTCRay {
 	int sss_object_id;
 	ccl::uint *lcg_state;
 
+	// for hits on lazily diced patches, see ccl::Intersection
+	ccl::float3 lazy_dicing_N;
+	float lazy_dicing_plane;
+
 	CCLRay(const ccl::Ray& ray, ccl::KernelGlobals *kg_, const ccl::uint visibility, RayType type_, const ccl::uint shadow_linking_)
 	{
 		org[0] = ray.P.x;
@@ -64,6 +68,8 @@ struct RTCORE_ALIGN(16) CCLRay : public RTCRay {
 		ss_isect = NULL;
 		sss_object_id = -1;
 		lcg_state = NULL;
+		lazy_dicing_N = ccl::make_float3(0.0f, 0.0f, 0.0f);
+		lazy_dicing_plane = 0.0f;
 	}
 
 	void isect_to_ccl(ccl::Intersection *isect)
@@ -73,6 +79,8 @@ struct RTCORE_ALIGN(16) CCLRay : public RTCRay {
 		isect->v = is_hair ? v : u;
 		isect->t = tfar;
 		isect->Ng = ccl::make_float3(Ng[0], Ng[1], Ng[2]);
+		isect->N = lazy_dicing_N;
+		isect->plane = lazy_dicing_plane;
 		if(instID != RTC_INVALID_GEOMETRY_ID) {
 			RTCScene inst_scene = (RTCScene)rtcGetUserData(kernel_data.bvh.scene, instID);
 			isect->prim = primID + (intptr_t)rtcGetUserData(inst_scene, geomID) + kernel_tex_fetch(__object_node, instID/2);
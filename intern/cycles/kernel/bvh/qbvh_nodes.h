@@ -83,6 +83,138 @@ ccl_device_inline void qbvh_stack_sort(QBVHStackItem *ccl_restrict s1,
 	if(s3->dist < s2->dist) { qbvh_item_swap(s3, s2); }
 }
 
+/* Compressed nodes intersection
+ *
+ * Child bounds are quantized to 8 or 16 bits relative to the bounds of the
+ * node, number of bits is stored in the node header. Layout is:
+ *
+ *   0: visibility, time_from, time_to, number of bits
+ *   1: child indices
+ *   2: lower corner of quantization grid
+ *   3: size of quantization grid cell
+ *   4: quantized planes in the order of min x, max x, min y, max y, min z and
+ *      max z, each of them holding values for four children.
+ */
+
+ccl_device_forceinline ssef qbvh_compressed_node_plane(KernelGlobals *ccl_restrict kg,
+                                                       const int node_addr,
+                                                       const int bits,
+                                                       const int plane,
+                                                       const float4& lower,
+                                                       const float4& scale)
+{
+	const int axis = plane >> 1;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i q;
+	if(bits == 8) {
+		const float4 data = kernel_tex_fetch(__bvh_nodes, node_addr + 4 + (plane >> 2));
+		const int word = __float_as_int(data[plane & 3]);
+		q = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero);
+	}
+	else {
+		const float4 data = kernel_tex_fetch(__bvh_nodes, node_addr + 4 + (plane >> 1));
+		const int word = (plane & 1) * 2;
+		q = _mm_unpacklo_epi16(_mm_set_epi32(0,
+		                                     0,
+		                                     __float_as_int(data[word + 1]),
+		                                     __float_as_int(data[word])),
+		                       zero);
+	}
+	return ssef(lower[axis]) + ssef(_mm_cvtepi32_ps(q)) * ssef(scale[axis]);
+}
+
+ccl_device_inline int qbvh_compressed_node_intersect(KernelGlobals *ccl_restrict kg,
+                                                     const ssef& isect_near,
+                                                     const ssef& isect_far,
+#ifdef __KERNEL_AVX2__
+                                                     const sse3f& org_idir,
+#else
+                                                     const sse3f& org,
+#endif
+                                                     const sse3f& idir,
+                                                     const int near_x,
+                                                     const int near_y,
+                                                     const int near_z,
+                                                     const int far_x,
+                                                     const int far_y,
+                                                     const int far_z,
+                                                     const int node_addr,
+                                                     const int bits,
+                                                     ssef *ccl_restrict dist)
+{
+	const float4 lower = kernel_tex_fetch(__bvh_nodes, node_addr+2);
+	const float4 scale = kernel_tex_fetch(__bvh_nodes, node_addr+3);
+#ifdef __KERNEL_AVX2__
+	const ssef tnear_x = msub(qbvh_compressed_node_plane(kg, node_addr, bits, near_x, lower, scale), idir.x, org_idir.x);
+	const ssef tnear_y = msub(qbvh_compressed_node_plane(kg, node_addr, bits, near_y, lower, scale), idir.y, org_idir.y);
+	const ssef tnear_z = msub(qbvh_compressed_node_plane(kg, node_addr, bits, near_z, lower, scale), idir.z, org_idir.z);
+	const ssef tfar_x = msub(qbvh_compressed_node_plane(kg, node_addr, bits, far_x, lower, scale), idir.x, org_idir.x);
+	const ssef tfar_y = msub(qbvh_compressed_node_plane(kg, node_addr, bits, far_y, lower, scale), idir.y, org_idir.y);
+	const ssef tfar_z = msub(qbvh_compressed_node_plane(kg, node_addr, bits, far_z, lower, scale), idir.z, org_idir.z);
+#else
+	const ssef tnear_x = (qbvh_compressed_node_plane(kg, node_addr, bits, near_x, lower, scale) - org.x) * idir.x;
+	const ssef tnear_y = (qbvh_compressed_node_plane(kg, node_addr, bits, near_y, lower, scale) - org.y) * idir.y;
+	const ssef tnear_z = (qbvh_compressed_node_plane(kg, node_addr, bits, near_z, lower, scale) - org.z) * idir.z;
+	const ssef tfar_x = (qbvh_compressed_node_plane(kg, node_addr, bits, far_x, lower, scale) - org.x) * idir.x;
+	const ssef tfar_y = (qbvh_compressed_node_plane(kg, node_addr, bits, far_y, lower, scale) - org.y) * idir.y;
+	const ssef tfar_z = (qbvh_compressed_node_plane(kg, node_addr, bits, far_z, lower, scale) - org.z) * idir.z;
+#endif
+
+	const ssef tnear = max4(tnear_x, tnear_y, tnear_z, isect_near);
+	const ssef tfar = min4(tfar_x, tfar_y, tfar_z, isect_far);
+	const sseb vmask = tnear <= tfar;
+	*dist = tnear;
+	return (int)movemask(vmask);
+}
+
+ccl_device_inline int qbvh_compressed_node_intersect_robust(
+        KernelGlobals *ccl_restrict kg,
+        const ssef& isect_near,
+        const ssef& isect_far,
+#ifdef __KERNEL_AVX2__
+        const sse3f& P_idir,
+#else
+        const sse3f& P,
+#endif
+        const sse3f& idir,
+        const int near_x,
+        const int near_y,
+        const int near_z,
+        const int far_x,
+        const int far_y,
+        const int far_z,
+        const int node_addr,
+        const int bits,
+        const float difl,
+        ssef *ccl_restrict dist)
+{
+	const float4 lower = kernel_tex_fetch(__bvh_nodes, node_addr+2);
+	const float4 scale = kernel_tex_fetch(__bvh_nodes, node_addr+3);
+#ifdef __KERNEL_AVX2__
+	const ssef tnear_x = msub(qbvh_compressed_node_plane(kg, node_addr, bits, near_x, lower, scale), idir.x, P_idir.x);
+	const ssef tnear_y = msub(qbvh_compressed_node_plane(kg, node_addr, bits, near_y, lower, scale), idir.y, P_idir.y);
+	const ssef tnear_z = msub(qbvh_compressed_node_plane(kg, node_addr, bits, near_z, lower, scale), idir.z, P_idir.z);
+	const ssef tfar_x = msub(qbvh_compressed_node_plane(kg, node_addr, bits, far_x, lower, scale), idir.x, P_idir.x);
+	const ssef tfar_y = msub(qbvh_compressed_node_plane(kg, node_addr, bits, far_y, lower, scale), idir.y, P_idir.y);
+	const ssef tfar_z = msub(qbvh_compressed_node_plane(kg, node_addr, bits, far_z, lower, scale), idir.z, P_idir.z);
+#else
+	const ssef tnear_x = (qbvh_compressed_node_plane(kg, node_addr, bits, near_x, lower, scale) - P.x) * idir.x;
+	const ssef tnear_y = (qbvh_compressed_node_plane(kg, node_addr, bits, near_y, lower, scale) - P.y) * idir.y;
+	const ssef tnear_z = (qbvh_compressed_node_plane(kg, node_addr, bits, near_z, lower, scale) - P.z) * idir.z;
+	const ssef tfar_x = (qbvh_compressed_node_plane(kg, node_addr, bits, far_x, lower, scale) - P.x) * idir.x;
+	const ssef tfar_y = (qbvh_compressed_node_plane(kg, node_addr, bits, far_y, lower, scale) - P.y) * idir.y;
+	const ssef tfar_z = (qbvh_compressed_node_plane(kg, node_addr, bits, far_z, lower, scale) - P.z) * idir.z;
+#endif
+
+	const float round_down = 1.0f - difl;
+	const float round_up = 1.0f + difl;
+	const ssef tnear = max4(tnear_x, tnear_y, tnear_z, isect_near);
+	const ssef tfar = min4(tfar_x, tfar_y, tfar_z, isect_far);
+	const sseb vmask = round_down*tnear <= round_up*tfar;
+	*dist = tnear;
+	return (int)movemask(vmask);
+}
+
 /* Axis-aligned nodes intersection */
 
 ccl_device_inline int qbvh_aligned_node_intersect(KernelGlobals *ccl_restrict kg,
@@ -103,6 +235,26 @@ ccl_device_inline int qbvh_aligned_node_intersect(KernelGlobals *ccl_restrict kg
                                                   const int node_addr,
                                                   ssef *ccl_restrict dist)
 {
+	/* All aligned nodes of the BVH share the same layout, so this does not
+	 * need the node header and is the same branch for every node. */
+	const int bits = kernel_data.bvh.num_compressed_node_bits;
+	if(UNLIKELY(bits != 0)) {
+		return qbvh_compressed_node_intersect(kg,
+		                                      isect_near,
+		                                      isect_far,
+#ifdef __KERNEL_AVX2__
+		                                      org_idir,
+#else
+		                                      org,
+#endif
+		                                      idir,
+		                                      near_x, near_y, near_z,
+		                                      far_x, far_y, far_z,
+		                                      node_addr,
+		                                      bits,
+		                                      dist);
+	}
+
 	const int offset = node_addr + 1;
 #ifdef __KERNEL_AVX2__
 	const ssef tnear_x = msub(kernel_tex_fetch_ssef(__bvh_nodes, offset+near_x), idir.x, org_idir.x);
@@ -155,6 +307,25 @@ ccl_device_inline int qbvh_aligned_node_intersect_robust(
         const float difl,
         ssef *ccl_restrict dist)
 {
+	const int bits = kernel_data.bvh.num_compressed_node_bits;
+	if(UNLIKELY(bits != 0)) {
+		return qbvh_compressed_node_intersect_robust(kg,
+		                                             isect_near,
+		                                             isect_far,
+#ifdef __KERNEL_AVX2__
+		                                             P_idir,
+#else
+		                                             P,
+#endif
+		                                             idir,
+		                                             near_x, near_y, near_z,
+		                                             far_x, far_y, far_z,
+		                                             node_addr,
+		                                             bits,
+		                                             difl,
+		                                             dist);
+	}
+
 	const int offset = node_addr + 1;
 #ifdef __KERNEL_AVX2__
 	const ssef tnear_x = msub(kernel_tex_fetch_ssef(__bvh_nodes, offset+near_x), idir.x, P_idir.x);
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* QBVH packet traversal
+ *
+ * Traverses the QBVH with a packet of coherent rays at once, one ray per SIMD
+ * lane. A child node is visited as soon as any of the active rays hits it, so
+ * node data is fetched once for the whole packet. Primitives are intersected
+ * ray by ray.
+ *
+ * This is only meant for camera rays, which are coherent enough for the packet
+ * to stay mostly populated. Only triangles and instancing are supported, scenes
+ * with motion blur or hair use regular single ray traversal.
+ */
+
+ccl_device_inline bool scene_intersect_packet_supported(KernelGlobals *kg)
+{
+#ifdef __EMBREE__
+	if(kernel_data.bvh.scene) {
+		return false;
+	}
+#endif
+	return kernel_data.bvh.use_qbvh &&
+	       !kernel_data.bvh.have_motion &&
+	       !kernel_data.bvh.have_curves;
+}
+
+/* Fetch all six planes of an aligned node, in the order of min x, max x,
+ * min y, max y, min z and max z. */
+ccl_device_forceinline void qbvh_packet_node_planes(KernelGlobals *kg,
+                                                    const int node_addr,
+                                                    ssef planes[6])
+{
+	const int bits = kernel_data.bvh.num_compressed_node_bits;
+	if(bits != 0) {
+		const float4 lower = kernel_tex_fetch(__bvh_nodes, node_addr+2);
+		const float4 scale = kernel_tex_fetch(__bvh_nodes, node_addr+3);
+		for(int i = 0; i < 6; i++) {
+			planes[i] = qbvh_compressed_node_plane(kg, node_addr, bits, i, lower, scale);
+		}
+	}
+	else {
+		for(int i = 0; i < 6; i++) {
+			planes[i] = ssef(kernel_tex_fetch_ssef(__bvh_nodes, node_addr+1+i));
+		}
+	}
+}
+
+/* Gather per ray origin, inverse direction and distance into SIMD lanes.
+ * Inactive rays get negative distance, so they never hit any node. */
+ccl_device_forceinline void qbvh_packet_update(const float3 *P,
+                                               const float3 *idir,
+                                               const Intersection *isect,
+                                               const int active,
+                                               sse3f *org4,
+                                               sse3f *idir4,
+                                               ssef *tfar)
+{
+	for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+		org4->x[i] = P[i].x;
+		org4->y[i] = P[i].y;
+		org4->z[i] = P[i].z;
+		idir4->x[i] = idir[i].x;
+		idir4->y[i] = idir[i].y;
+		idir4->z[i] = idir[i].z;
+		(*tfar)[i] = (active & (1 << i)) ? isect[i].t : -FLT_MAX;
+	}
+}
+
+ccl_device bool qbvh_intersect_packet(KernelGlobals *kg,
+                                      const Ray *rays,
+                                      Intersection *isect,
+                                      const uint visibility,
+                                      const int active)
+{
+	PROFILING_INIT(kg, PROFILING_INTERSECT);
+
+	/* Traversal stack in CPU thread-local memory. Unlike single ray traversal
+	 * children are not sorted by distance, since there is no single distance
+	 * for the whole packet. */
+	int traversal_stack[BVH_QSTACK_SIZE];
+	traversal_stack[0] = ENTRYPOINT_SENTINEL;
+
+	/* Traversal variables in registers. */
+	int stack_ptr = 0;
+	int node_addr = kernel_data.bvh.root;
+	int object = OBJECT_NONE;
+
+	/* Ray parameters in registers. */
+	float3 P[RAY_PACKET_SIZE];
+	float3 dir[RAY_PACKET_SIZE];
+	float3 idir[RAY_PACKET_SIZE];
+
+	for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+		P[i] = rays[i].P;
+		dir[i] = bvh_clamp_direction(rays[i].D);
+		idir[i] = bvh_inverse_direction(dir[i]);
+
+		isect[i].t = rays[i].t;
+		isect[i].u = 0.0f;
+		isect[i].v = 0.0f;
+		isect[i].prim = PRIM_NONE;
+		isect[i].object = OBJECT_NONE;
+		if(active & (1 << i)) {
+			PROFILING_COUNT_RAY();
+		}
+#if defined(__KERNEL_DEBUG__)
+		isect[i].num_traversed_nodes = 0;
+		isect[i].num_traversed_instances = 0;
+		isect[i].num_intersections = 0;
+#endif
+	}
+
+	sse3f org4, idir4;
+	ssef tfar;
+	qbvh_packet_update(P, idir, isect, active, &org4, &idir4, &tfar);
+
+	/* Traversal loop. */
+	do {
+		do {
+			/* Traverse internal nodes. */
+			while(node_addr >= 0 && node_addr != ENTRYPOINT_SENTINEL) {
+				float4 inodes = kernel_tex_fetch(__bvh_nodes, node_addr+0);
+
+#ifdef __VISIBILITY_FLAG__
+				if((__float_as_uint(inodes.x) & visibility) == 0) {
+					/* Pop. */
+					node_addr = traversal_stack[stack_ptr];
+					--stack_ptr;
+					continue;
+				}
+#endif
+
+#ifdef __KERNEL_DEBUG__
+				/* Nodes are fetched for all rays of the packet. */
+				for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+					++isect[i].num_traversed_nodes;
+				}
+#endif
+
+				ssef planes[6];
+				qbvh_packet_node_planes(kg, node_addr, planes);
+
+				const sseb neg_x = (idir4.x < ssef(0.0f));
+				const sseb neg_y = (idir4.y < ssef(0.0f));
+				const sseb neg_z = (idir4.z < ssef(0.0f));
+
+				const float4 cnodes = (kernel_data.bvh.num_compressed_node_bits != 0)
+				                          ? kernel_tex_fetch(__bvh_nodes, node_addr+1)
+				                          : kernel_tex_fetch(__bvh_nodes, node_addr+7);
+
+				/* Push hit children in reverse order, so the first child is
+				 * traversed first. */
+				for(int c = 3; c >= 0; c--) {
+					const ssef t0x = (ssef(planes[0][c]) - org4.x) * idir4.x;
+					const ssef t1x = (ssef(planes[1][c]) - org4.x) * idir4.x;
+					const ssef t0y = (ssef(planes[2][c]) - org4.y) * idir4.y;
+					const ssef t1y = (ssef(planes[3][c]) - org4.y) * idir4.y;
+					const ssef t0z = (ssef(planes[4][c]) - org4.z) * idir4.z;
+					const ssef t1z = (ssef(planes[5][c]) - org4.z) * idir4.z;
+
+					/* Near and far planes are picked per ray from the direction
+					 * sign like qbvh_near_far_idx_calc() does, rather than with
+					 * min and max. Empty child slots have inverted bounds, which
+					 * then never count as a hit. */
+					const ssef tnear = max4(select(neg_x, t1x, t0x),
+					                        select(neg_y, t1y, t0y),
+					                        select(neg_z, t1z, t0z),
+					                        ssef(0.0f));
+					const ssef tfar_child = min4(select(neg_x, t0x, t1x),
+					                             select(neg_y, t0y, t1y),
+					                             select(neg_z, t0z, t1z),
+					                             tfar);
+
+					if(movemask(tnear <= tfar_child) != 0) {
+						++stack_ptr;
+						kernel_assert(stack_ptr < BVH_QSTACK_SIZE);
+						traversal_stack[stack_ptr] = __float_as_int(cnodes[c]);
+					}
+				}
+
+				node_addr = traversal_stack[stack_ptr];
+				--stack_ptr;
+			}
+
+			/* If node is leaf, fetch triangle list. */
+			if(node_addr < 0) {
+				float4 leaf = kernel_tex_fetch(__bvh_leaf_nodes, (-node_addr-1));
+				int prim_addr = __float_as_int(leaf.x);
+
+#ifdef __VISIBILITY_FLAG__
+				if((__float_as_uint(leaf.z) & visibility) == 0) {
+					/* Pop. */
+					node_addr = traversal_stack[stack_ptr];
+					--stack_ptr;
+					continue;
+				}
+#endif
+
+#ifdef __INSTANCING__
+				if(prim_addr >= 0) {
+#endif
+					const int prim_addr2 = __float_as_int(leaf.y);
+					const uint type = __float_as_int(leaf.w);
+
+					/* Pop. */
+					node_addr = traversal_stack[stack_ptr];
+					--stack_ptr;
+
+					/* Primitive intersection, motion and curves are not supported
+					 * so only triangles are expected here. */
+					kernel_assert((type & PRIMITIVE_ALL) == PRIMITIVE_TRIANGLE);
+					(void)type;
+
+					for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+						if(!(active & (1 << i))) {
+							continue;
+						}
+						for(int addr = prim_addr; addr < prim_addr2; addr++) {
+							if(!object_in_shadow_linking(kg, visibility, object, addr, 0)) {
+								continue;
+							}
+#ifdef __KERNEL_DEBUG__
+							++isect[i].num_intersections;
+#endif
+							if(triangle_intersect(kg,
+							                      &isect[i],
+							                      P[i],
+							                      dir[i],
+							                      visibility,
+							                      object,
+							                      addr))
+							{
+								tfar[i] = isect[i].t;
+							}
+						}
+					}
+				}
+#ifdef __INSTANCING__
+				else {
+					/* Instance push. */
+					object = kernel_tex_fetch(__prim_object, -prim_addr-1);
+
+					for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+						isect[i].t = bvh_instance_push(kg, object, &rays[i], &P[i], &dir[i], &idir[i], isect[i].t);
+#ifdef __KERNEL_DEBUG__
+						++isect[i].num_traversed_instances;
+#endif
+					}
+					qbvh_packet_update(P, idir, isect, active, &org4, &idir4, &tfar);
+
+					++stack_ptr;
+					kernel_assert(stack_ptr < BVH_QSTACK_SIZE);
+					traversal_stack[stack_ptr] = ENTRYPOINT_SENTINEL;
+
+					node_addr = kernel_tex_fetch(__object_node, object);
+				}
+			}
+#endif  /* __INSTANCING__ */
+		} while(node_addr != ENTRYPOINT_SENTINEL);
+
+#ifdef __INSTANCING__
+		if(stack_ptr >= 0) {
+			kernel_assert(object != OBJECT_NONE);
+
+			/* Instance pop. */
+			for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+				isect[i].t = bvh_instance_pop(kg, object, &rays[i], &P[i], &dir[i], &idir[i], isect[i].t);
+			}
+			qbvh_packet_update(P, idir, isect, active, &org4, &idir4, &tfar);
+
+			object = OBJECT_NONE;
+			node_addr = traversal_stack[stack_ptr];
+			--stack_ptr;
+		}
+#endif  /* __INSTANCING__ */
+	} while(node_addr != ENTRYPOINT_SENTINEL);
+
+	bool hit = false;
+	for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+		if((active & (1 << i)) && isect[i].prim != PRIM_NONE) {
+			hit = true;
+		}
+	}
+	return hit;
+}
@@ -197,7 +197,11 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(QBVH)(KernelGlobals *kg,
 					}
 					else
 #endif
-					{
+					if(UNLIKELY(kernel_data.bvh.num_compressed_node_bits != 0)) {
+						/* Compressed node, children follow the header. */
+						cnodes = kernel_tex_fetch(__bvh_nodes, node_addr+1);
+					}
+					else {
 						cnodes = kernel_tex_fetch(__bvh_nodes, node_addr+7);
 					}
 
@@ -401,6 +405,25 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(QBVH)(KernelGlobals *kg,
 									                                   difl,
 									                                   extmax);
 								}
+#if defined(__KERNEL_SSE2__)
+								else if((curve_type & PRIMITIVE_CURVE) && prim_addr + 1 < prim_addr2) {
+									/* Consecutive segments of hair strand leaves. */
+									int num_prims = prim_addr2 - prim_addr;
+									hit = bvh_curve_intersect_segments(kg,
+									                                   isect,
+									                                   P,
+									                                   dir,
+									                                   visibility,
+									                                   object,
+									                                   prim_addr,
+									                                   &num_prims,
+									                                   ray->time,
+									                                   lcg_state,
+									                                   difl,
+									                                   extmax);
+									prim_addr += num_prims - 1;
+								}
+#endif
 								else {
 									hit = bvh_curve_intersect(kg,
 									                          isect,
@@ -135,7 +135,11 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(QBVH)(KernelGlobals *kg,
 					}
 					else
 #endif
-					{
+					if(UNLIKELY(kernel_data.bvh.num_compressed_node_bits != 0)) {
+						/* Compressed node, children follow the header. */
+						cnodes = kernel_tex_fetch(__bvh_nodes, node_addr+1);
+					}
+					else {
 						cnodes = kernel_tex_fetch(__bvh_nodes, node_addr+7);
 					}
 
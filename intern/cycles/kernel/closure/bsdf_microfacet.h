@@ -1148,6 +1148,123 @@ ccl_device int bsdf_microfacet_beckmann_sample(KernelGlobals *kg, const ShaderCl
 	return label;
 }
 
+#ifdef __BSDF_SIMD_EVAL__
+
+/* SIMD evaluation of isotropic GGX reflection
+ *
+ * Layered materials tend to stack several GGX lobes, evaluate up to four of
+ * them together with one closure per SSE lane. Results match those of
+ * bsdf_microfacet_ggx_eval_reflect(), only the fresnel color is computed per
+ * closure afterwards since it is only needed by some of them. */
+
+ccl_device_forceinline bool bsdf_microfacet_ggx_eval_simd_supported(const ShaderClosure *sc)
+{
+	switch(sc->type) {
+		case CLOSURE_BSDF_MICROFACET_GGX_ID:
+		case CLOSURE_BSDF_MICROFACET_GGX_FRESNEL_ID:
+		case CLOSURE_BSDF_MICROFACET_GGX_CLEARCOAT_ID:
+		case CLOSURE_BSDF_MICROFACET_GGX_ANISO_ID:
+		case CLOSURE_BSDF_MICROFACET_GGX_ANISO_FRESNEL_ID: {
+			const MicrofacetBsdf *bsdf = (const MicrofacetBsdf*)sc;
+			return (bsdf->alpha_x == bsdf->alpha_y && bsdf->alpha_x*bsdf->alpha_y > 1e-7f);
+		}
+		default:
+			return false;
+	}
+}
+
+ccl_device void bsdf_microfacet_ggx_eval_reflect_simd(const ShaderClosure **closures,
+                                                      int num_closures,
+                                                      const float3 I,
+                                                      const float3 omega_in,
+                                                      float3 *eval,
+                                                      float *pdf)
+{
+	/* gather closure parameters, unused lanes repeat the first closure */
+	float N_x[4], N_y[4], N_z[4];
+	float alpha2_D[4], alpha2_G[4];
+	float gtr1_k[4], gtr1_c[4];
+	float use_gtr1[4];
+
+	for(int i = 0; i < 4; i++) {
+		const MicrofacetBsdf *bsdf = (const MicrofacetBsdf*)closures[(i < num_closures)? i: 0];
+		const float alpha = bsdf->alpha_x;
+
+		N_x[i] = bsdf->N.x;
+		N_y[i] = bsdf->N.y;
+		N_z[i] = bsdf->N.z;
+		alpha2_D[i] = alpha*alpha;
+		alpha2_G[i] = alpha*alpha;
+		use_gtr1[i] = 0.0f;
+		gtr1_k[i] = 0.0f;
+		gtr1_c[i] = 0.0f;
+
+		if(bsdf->type == CLOSURE_BSDF_MICROFACET_GGX_CLEARCOAT_ID) {
+			/* D_GTR1() written as c / (1 + k*cosThetaM2), the alpha value for
+			 * shadowing is a fixed 0.25 */
+			use_gtr1[i] = 1.0f;
+			alpha2_G[i] = 0.0625f;
+
+			if(alpha < 1.0f) {
+				gtr1_k[i] = alpha2_D[i] - 1.0f;
+				gtr1_c[i] = gtr1_k[i] / (M_PI_F * logf(alpha2_D[i]));
+			}
+			else {
+				gtr1_c[i] = M_1_PI_F;
+			}
+		}
+	}
+
+	const ssef Nx = loadu4f(N_x), Ny = loadu4f(N_y), Nz = loadu4f(N_z);
+	const ssef a2_D = loadu4f(alpha2_D), a2_G = loadu4f(alpha2_G);
+	const sseb gtr1 = (loadu4f(use_gtr1) != 0.0f);
+
+	const float3 m = normalize(omega_in + I);
+
+	const ssef cosNO = Nx*I.x + Ny*I.y + Nz*I.z;
+	const ssef cosNI = Nx*omega_in.x + Ny*omega_in.y + Nz*omega_in.z;
+	const ssef cosThetaM = Nx*m.x + Ny*m.y + Nz*m.z;
+
+	/* eq. 33: distribution, GTR1 for clearcoat and GTR2 otherwise */
+	const ssef cosThetaM2 = cosThetaM * cosThetaM;
+	const ssef cosThetaM4 = cosThetaM2 * cosThetaM2;
+	const ssef tanThetaM2 = (1.0f - cosThetaM2) / cosThetaM2;
+	const ssef D_GTR2 = a2_D / (M_PI_F * cosThetaM4 * sqr(a2_D + tanThetaM2));
+	const ssef D_GTR1 = loadu4f(gtr1_c) / madd(loadu4f(gtr1_k), cosThetaM2, ssef(1.0f));
+	const ssef D = select(gtr1, D_GTR1, D_GTR2);
+
+	/* eq. 34: G1(i,m) and G1(o,m) */
+	const ssef cosNO2 = cosNO * cosNO;
+	const ssef cosNI2 = cosNI * cosNI;
+	const ssef G1o = 2.0f / (1.0f + mm_sqrt(max(1.0f + a2_G * (1.0f - cosNO2) / cosNO2, ssef(0.0f))));
+	const ssef G1i = 2.0f / (1.0f + mm_sqrt(max(1.0f + a2_G * (1.0f - cosNI2) / cosNI2, ssef(0.0f))));
+
+	/* eq. 20 */
+	const ssef common = D * 0.25f / cosNO;
+	const sseb valid = (cosNI > 0.0f) & (cosNO > 0.0f);
+	const ssef out = select(valid, G1o * G1i * common, ssef(0.0f));
+	const ssef out_pdf = select(valid, G1o * common, ssef(0.0f));
+
+	for(int i = 0; i < num_closures; i++) {
+		pdf[i] = out_pdf[i];
+
+		if(out[i] == 0.0f) {
+			eval[i] = make_float3(0.0f, 0.0f, 0.0f);
+			continue;
+		}
+
+		const MicrofacetBsdf *bsdf = (const MicrofacetBsdf*)closures[i];
+		float3 F = reflection_color(bsdf, omega_in, m);
+		if(bsdf->type == CLOSURE_BSDF_MICROFACET_GGX_CLEARCOAT_ID) {
+			F *= 0.25f * bsdf->extra->clearcoat;
+		}
+
+		eval[i] = F * out[i];
+	}
+}
+
+#endif  /* __BSDF_SIMD_EVAL__ */
+
 CCL_NAMESPACE_END
 
 #endif /* __BSDF_MICROFACET_H__ */
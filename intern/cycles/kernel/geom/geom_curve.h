@@ -938,6 +938,154 @@ ccl_device_curveintersect bool bvh_curve_intersect(KernelGlobals *kg, Intersecti
 #endif
 }
 
+#ifdef __KERNEL_SSE2__
+/* Intersection of consecutive segments of a static curve, as grouped into
+ * leaves by the strand BVH. Segments are culled in SIMD lanes with the same
+ * bounding sphere and minimum distance tests as bvh_curve_intersect(), only
+ * the segments passing them go through the full intersection.
+ *
+ * num_prims is the number of primitives left in the leaf, and is set to the
+ * number of primitives which were handled.
+ */
+
+#  ifdef __KERNEL_AVX__
+typedef avxf curve_simdf;
+#    define CURVE_SIMD_WIDTH 8
+#  else
+typedef ssef curve_simdf;
+#    define CURVE_SIMD_WIDTH 4
+#  endif
+
+/* Relative tolerance of the culling tests, so segments are never culled
+ * which the full intersection would find due to different rounding. */
+#  define CURVE_SIMD_CULL_TOLERANCE 1.001f
+
+ccl_device_inline curve_simdf curve_simd_load(const float *a)
+{
+#  ifdef __KERNEL_AVX__
+	return _mm256_load_ps(a);
+#  else
+	return _mm_load_ps(a);
+#  endif
+}
+
+ccl_device_inline curve_simdf curve_simd_sqrt(const curve_simdf& a)
+{
+#  ifdef __KERNEL_AVX__
+	return mm256_sqrt(a);
+#  else
+	return mm_sqrt(a);
+#  endif
+}
+
+ccl_device_curveintersect bool bvh_curve_intersect_segments(KernelGlobals *kg, Intersection *isect,
+	float3 P, float3 direction, uint visibility, int object, int curveAddr, int *num_prims, float time, uint *lcg_state, float difl, float extmax)
+{
+	const int type = kernel_tex_fetch(__prim_type, curveAddr);
+	const int prim = kernel_tex_fetch(__prim_index, curveAddr);
+	const int segment = PRIMITIVE_UNPACK_SEGMENT(type);
+	const int k0 = __float_as_int(kernel_tex_fetch(__curves, prim).x) + segment;
+
+	/* Segments of the same curve following the first one. */
+	const int max_num = min(*num_prims, CURVE_SIMD_WIDTH);
+	int num = 1;
+	while(num < max_num &&
+	      kernel_tex_fetch(__prim_index, curveAddr + num) == prim &&
+	      kernel_tex_fetch(__prim_type, curveAddr + num) == PRIMITIVE_PACK_SEGMENT(PRIMITIVE_CURVE, segment + num))
+	{
+		num++;
+	}
+	*num_prims = num;
+
+	/* Gather keys into lanes, unused lanes repeat the last segment. */
+	ccl_align(32) float key1[4][CURVE_SIMD_WIDTH];
+	ccl_align(32) float key2[4][CURVE_SIMD_WIDTH];
+	for(int i = 0; i < CURVE_SIMD_WIDTH; i++) {
+		const int k = k0 + min(i, num - 1);
+		const float4 P1 = kernel_tex_fetch(__curve_keys, k);
+		const float4 P2 = kernel_tex_fetch(__curve_keys, k + 1);
+		key1[0][i] = P1.x; key1[1][i] = P1.y; key1[2][i] = P1.z; key1[3][i] = P1.w;
+		key2[0][i] = P2.x; key2[1][i] = P2.y; key2[2][i] = P2.z; key2[3][i] = P2.w;
+	}
+
+	const curve_simdf Px(P.x), Py(P.y), Pz(P.z);
+	const curve_simdf dx(direction.x), dy(direction.y), dz(direction.z);
+
+	const curve_simdf dif1x = Px - curve_simd_load(key1[0]);
+	const curve_simdf dif1y = Py - curve_simd_load(key1[1]);
+	const curve_simdf dif1z = Pz - curve_simd_load(key1[2]);
+	const curve_simdf dif2x = Px - curve_simd_load(key2[0]);
+	const curve_simdf dif2y = Py - curve_simd_load(key2[1]);
+	const curve_simdf dif2z = Pz - curve_simd_load(key2[2]);
+
+	/* Minimum width extension. */
+	curve_simdf r1 = curve_simd_load(key1[3]);
+	curve_simdf r2 = curve_simd_load(key2[3]);
+	if(difl != 0.0f) {
+		const curve_simdf len1 = curve_simd_sqrt(dif1x*dif1x + dif1y*dif1y + dif1z*dif1z);
+		const curve_simdf len2 = curve_simd_sqrt(dif2x*dif2x + dif2y*dif2y + dif2z*dif2z);
+		r1 = max(r1, min(len1*difl, curve_simdf(extmax)));
+		r2 = max(r2, min(len2*difl, curve_simdf(extmax)));
+	}
+	const curve_simdf mr = max(r1, r2) * CURVE_SIMD_CULL_TOLERANCE;
+
+	/* Bounding sphere test. */
+	const curve_simdf p21x = dif1x - dif2x;
+	const curve_simdf p21y = dif1y - dif2y;
+	const curve_simdf p21z = dif1z - dif2z;
+	const curve_simdf l = curve_simd_sqrt(p21x*p21x + p21y*p21y + p21z*p21z);
+	const curve_simdf sp_r = madd(l, curve_simdf(0.5f), mr);
+
+	const curve_simdf sdif1x = (dif1x + dif2x) * 0.5f;
+	const curve_simdf sdif1y = (dif1y + dif2y) * 0.5f;
+	const curve_simdf sdif1z = (dif1z + dif2z) * 0.5f;
+	const curve_simdf sphere_b_tmp = dx*sdif1x + dy*sdif1y + dz*sdif1z;
+	const curve_simdf sdif2x = nmadd(sphere_b_tmp, dx, sdif1x);
+	const curve_simdf sdif2y = nmadd(sphere_b_tmp, dy, sdif1y);
+	const curve_simdf sdif2z = nmadd(sphere_b_tmp, dz, sdif1z);
+	const curve_simdf sphere_b = dx*sdif2x + dy*sdif2y + dz*sdif2z;
+	const curve_simdf sphere_c = sdif2x*sdif2x + sdif2y*sdif2y + sdif2z*sdif2z - sphere_b*sphere_b;
+
+	/* Minimum separation test, scaled by the squared length of the cross
+	 * product to avoid the division. Parallel segments always pass. */
+	const curve_simdf cx = p21y*dz - p21z*dy;
+	const curve_simdf cy = p21z*dx - p21x*dz;
+	const curve_simdf cz = p21x*dy - p21y*dx;
+	const curve_simdf cdist = cx*dif1x + cy*dif1y + cz*dif1z;
+	const curve_simdf csq = cx*cx + cy*cy + cz*cz;
+
+	int mask = movemask((sphere_c <= sp_r*sp_r) &
+	                    (cdist*cdist <= mr*mr*csq));
+	mask &= (1 << num) - 1;
+
+	bool hit = false;
+	for(int i = 0; mask != 0; i++, mask >>= 1) {
+		if(mask & 1) {
+			hit |= bvh_curve_intersect(kg,
+			                           isect,
+			                           P,
+			                           direction,
+			                           visibility,
+			                           object,
+			                           curveAddr + i,
+			                           time,
+			                           PRIMITIVE_PACK_SEGMENT(PRIMITIVE_CURVE, segment + i),
+			                           lcg_state,
+			                           difl,
+			                           extmax);
+			/* Any hit terminates shadow rays. */
+			if(hit && visibility == PATH_RAY_SHADOW_OPAQUE) {
+				break;
+			}
+		}
+	}
+
+	return hit;
+}
+
+#  undef CURVE_SIMD_CULL_TOLERANCE
+#endif  /* __KERNEL_SSE2__ */
+
 ccl_device_inline float3 curvetangent(float t, float3 p0, float3 p1, float3 p2, float3 p3)
 {
 	float fc = 0.71f;
@@ -86,6 +86,71 @@ ccl_device_inline float3 triangle_smooth_normal(KernelGlobals *kg, int prim, flo
 	return normalize((1.0f - u - v)*n2 + u*n0 + v*n1);
 }
 
+#ifdef __EMBREE__
+/* Lazily diced patches are intersected by Embree callbacks, which store the
+ * object space plane of the micropolygon hit and the normal interpolated from
+ * the diced vertices in the intersection. */
+
+/* Refine the position on the micropolygon plane, like triangle_refine(). */
+ccl_device_inline float3 triangle_lazy_dicing_refine(KernelGlobals *kg,
+                                                     ShaderData *sd,
+                                                     const Intersection *isect,
+                                                     const Ray *ray)
+{
+	float3 P = ray->P;
+	float3 D = ray->D;
+	float t = isect->t;
+
+	if(isect->object != OBJECT_NONE) {
+		if(UNLIKELY(t == 0.0f)) {
+			return P;
+		}
+#  ifdef __OBJECT_MOTION__
+		Transform tfm = sd->ob_itfm;
+#  else
+		Transform tfm = object_fetch_transform(kg, isect->object, OBJECT_INVERSE_TRANSFORM);
+#  endif
+
+		P = transform_point(&tfm, P);
+		D = transform_direction(&tfm, D*t);
+		D = normalize_len(D, &t);
+	}
+
+	P = P + D*t;
+
+	const float det = dot(isect->Ng, D);
+	if(det != 0.0f) {
+		P = P + D*((isect->plane - dot(isect->Ng, P))/det);
+	}
+
+	if(isect->object != OBJECT_NONE) {
+#  ifdef __OBJECT_MOTION__
+		Transform tfm = sd->ob_tfm;
+#  else
+		Transform tfm = object_fetch_transform(kg, isect->object, OBJECT_TRANSFORM);
+#  endif
+
+		P = transform_point(&tfm, P);
+	}
+
+	return P;
+}
+
+ccl_device_inline void triangle_lazy_dicing_shader_setup(KernelGlobals *kg,
+                                                         ShaderData *sd,
+                                                         const Intersection *isect,
+                                                         const Ray *ray)
+{
+	sd->P = triangle_lazy_dicing_refine(kg, sd, isect, ray);
+	sd->Ng = normalize(isect->Ng);
+	sd->N = sd->Ng;
+
+	if((sd->shader & SHADER_SMOOTH_NORMAL) && !is_zero(isect->N)) {
+		sd->N = normalize(isect->N);
+	}
+}
+#endif
+
 /* Ray differentials on triangle */
 
 ccl_device_inline void triangle_dPdudv(KernelGlobals *kg, int prim, ccl_addr_space float3 *dPdu, ccl_addr_space float3 *dPdv)
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+CCL_NAMESPACE_BEGIN
+
+/* Adaptive Sampling
+ *
+ * Noise of a pixel is estimated by comparing the combined pass, which holds all
+ * samples, with a second image accumulated from odd samples only. Once the
+ * difference falls below the threshold the pixel is marked as converged and
+ * the device stops sampling it.
+ *
+ * The adaptive pass holds 4 floats per pixel:
+ *   0-2: sum of odd samples of the combined pass
+ *   3:   number of samples the pixel converged at, zero while still sampling */
+
+/* Test pixel for convergence after given sample, which must leave an even
+ * number of samples in the buffer. Returns true if the pixel is converged or
+ * its error is below the threshold. The device marks pixels as converged
+ * only once their neighbours are below the threshold as well, since the
+ * error estimate of a single pixel is noisy itself. */
+ccl_device bool kernel_adaptive_check_convergence(KernelGlobals *kg,
+                                                  ccl_global float *buffer,
+                                                  int sample)
+{
+	ccl_global float *aux = buffer + kernel_data.film.pass_adaptive;
+	if(aux[3] != 0.0f) {
+		return true;
+	}
+
+	const float num_samples = (float)(sample + 1);
+	const float3 I = make_float3(buffer[0], buffer[1], buffer[2]);
+	const float3 A = 2.0f * make_float3(aux[0], aux[1], aux[2]);
+
+	/* Relative error, with square root of intensity in the denominator, so
+	 * dark areas are allowed more absolute noise same as the eye perceives it. */
+	const float error = (fabsf(I.x - A.x) + fabsf(I.y - A.y) + fabsf(I.z - A.z)) /
+	                    (num_samples * 0.0001f + sqrtf(max(I.x + I.y + I.z, 0.0f)));
+
+	return (error < kernel_data.integrator.adaptive_threshold * num_samples);
+}
+
+ccl_device void kernel_adaptive_mark_converged(KernelGlobals *kg,
+                                               ccl_global float *buffer,
+                                               int sample)
+{
+	ccl_global float *aux = buffer + kernel_data.film.pass_adaptive;
+	if(aux[3] == 0.0f) {
+		aux[3] = (float)(sample + 1);
+	}
+}
+
+/* Cryptomatte passes hold pairs of id and weight, ids must not be scaled. */
+ccl_device_inline bool kernel_adaptive_is_cryptomatte_id(KernelGlobals *kg, int offset)
+{
+	const int use_cryptomatte = kernel_data.film.use_cryptomatte;
+	if(use_cryptomatte == 0) {
+		return false;
+	}
+
+	const int num_types = ((use_cryptomatte & CRYPT_OBJECT) != 0) +
+	                      ((use_cryptomatte & CRYPT_OBJECT_PASS_INDEX) != 0) +
+	                      ((use_cryptomatte & CRYPT_MATERIAL) != 0) +
+	                      ((use_cryptomatte & CRYPT_MATERIAL_PASS_INDEX) != 0) +
+	                      ((use_cryptomatte & CRYPT_ASSET) != 0);
+	const int num_aovs = min(num_types * (use_cryptomatte & 255), 32);
+
+	for(int i = 0; i < num_aovs; i++) {
+		const int aov_offset = kernel_data.film.pass_aov[i] & ~(1 << 31);
+		if(offset == aov_offset || offset == aov_offset + 2) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Scale sums and sums of squares of a pass from pixel_samples to
+ * num_samples, keeping the variance of the mean of the samples taken. */
+ccl_device_inline void kernel_adaptive_scale_variance_pass(ccl_global float *buffer,
+                                                           int channels,
+                                                           float pixel_samples,
+                                                           float num_samples)
+{
+	for(int i = 0; i < channels; i++) {
+		const float mean = buffer[i] / pixel_samples;
+		const float variance = max(buffer[channels + i] / pixel_samples - mean*mean, 0.0f);
+
+		buffer[i] = mean * num_samples;
+		buffer[channels + i] = num_samples * (num_samples * variance / pixel_samples + mean*mean);
+	}
+}
+
+/* Scale passes of a pixel which stopped sampling early, so it matches the
+ * number of samples of the rest of the image. Only values accumulated per
+ * sample are scaled, denoising passes keep the variance of the samples which
+ * were actually taken. */
+ccl_device void kernel_adaptive_post_adjust(KernelGlobals *kg,
+                                            ccl_global float *buffer,
+                                            int num_samples)
+{
+	ccl_global float *aux = buffer + kernel_data.film.pass_adaptive;
+	const float pixel_samples = aux[3];
+	if(pixel_samples == 0.0f || pixel_samples >= (float)num_samples) {
+		return;
+	}
+
+	const float scale = (float)num_samples / pixel_samples;
+	const int pass_denoising = kernel_data.film.pass_denoising;
+	const int num_passes = (pass_denoising)? pass_denoising: kernel_data.film.pass_adaptive;
+
+	for(int i = 0; i < num_passes; i++) {
+		if(!kernel_adaptive_is_cryptomatte_id(kg, i)) {
+			buffer[i] *= scale;
+		}
+	}
+
+	if(pass_denoising) {
+		/* Layout as written by kernel_write_result(). */
+		ccl_global float *denoising = buffer + pass_denoising;
+		kernel_adaptive_scale_variance_pass(denoising, 3, pixel_samples, (float)num_samples);
+		kernel_adaptive_scale_variance_pass(denoising + 6, 3, pixel_samples, (float)num_samples);
+		kernel_adaptive_scale_variance_pass(denoising + 12, 1, pixel_samples, (float)num_samples);
+		for(int i = 14; i < 20; i++) {
+			denoising[i] *= scale;
+		}
+		kernel_adaptive_scale_variance_pass(denoising + 20, 3, pixel_samples, (float)num_samples);
+	}
+	aux[0] *= scale;
+	aux[1] *= scale;
+	aux[2] *= scale;
+	aux[3] = (float)num_samples;
+}
+
+CCL_NAMESPACE_END
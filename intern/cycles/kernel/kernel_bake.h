@@ -534,6 +534,43 @@ ccl_device void kernel_shader_evaluate(KernelGlobals *kg,
 
 		object_inverse_dir_transform(kg, &sd, &out);
 	}
+#ifdef __VOLUME__
+	else if(type == SHADER_EVAL_VOLUME) {
+		/* input is a world space position followed by object and shader */
+		uint4 in_P = input[i*2];
+		uint4 in_shader = input[i*2 + 1];
+
+		Ray ray;
+		ray.P = make_float3(__uint_as_float(in_P.x),
+		                    __uint_as_float(in_P.y),
+		                    __uint_as_float(in_P.z));
+		ray.D = make_float3(0.0f, 0.0f, 1.0f);
+		ray.t = 0.0f;
+#ifdef __CAMERA_MOTION__
+		ray.time = 0.5f;
+#endif
+
+#ifdef __RAY_DIFFERENTIALS__
+		ray.dD = differential3_zero();
+		ray.dP = differential3_zero();
+#endif
+
+		/* volume stack with only this object */
+		state.volume_stack[0].object = in_shader.x;
+		state.volume_stack[0].shader = in_shader.y;
+		state.volume_stack[0].t_enter = 0.0f;
+		state.volume_stack[0].t_exit = FLT_MAX;
+		state.volume_stack[1].shader = SHADER_NONE;
+
+		/* setup shader data */
+		shader_setup_from_volume(kg, &sd, &ray);
+
+		/* evaluate extinction */
+		if(!volume_shader_extinction_sample(kg, &sd, &state, ray.P, &out)) {
+			out = make_float3(0.0f, 0.0f, 0.0f);
+		}
+	}
+#endif
 	else { // SHADER_EVAL_BACKGROUND
 		/* setup ray */
 		Ray ray;
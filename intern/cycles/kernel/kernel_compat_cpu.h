@@ -328,6 +328,15 @@ template<typename T> struct texture_image  {
 		return interp_3d_ex(x, y, z, interpolation);
 	}
 
+	/* Voxel of a 3D image, with dense or sparse storage. */
+	ccl_always_inline T voxel(int x, int y, int z)
+	{
+		if(grid) {
+			return data[tex_sparse_voxel_index(grid, grid_width, grid_height, x, y, z)];
+		}
+		return data[x + y*width + z*width*height];
+	}
+
 	ccl_always_inline float4 interp_3d_ex_closest(float x, float y, float z)
 	{
 		int ix, iy, iz;
@@ -358,7 +367,7 @@ template<typename T> struct texture_image  {
 				return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
 		}
 
-		return read(data[ix + iy*width + iz*width*height]);
+		return read(voxel(ix, iy, iz));
 	}
 
 	ccl_always_inline float4 interp_3d_ex_linear(float x, float y, float z)
@@ -403,15 +412,15 @@ template<typename T> struct texture_image  {
 
 		float4 r;
 
-		r  = (1.0f - tz)*(1.0f - ty)*(1.0f - tx)*read(data[ix + iy*width + iz*width*height]);
-		r += (1.0f - tz)*(1.0f - ty)*tx*read(data[nix + iy*width + iz*width*height]);
-		r += (1.0f - tz)*ty*(1.0f - tx)*read(data[ix + niy*width + iz*width*height]);
-		r += (1.0f - tz)*ty*tx*read(data[nix + niy*width + iz*width*height]);
+		r  = (1.0f - tz)*(1.0f - ty)*(1.0f - tx)*read(voxel(ix, iy, iz));
+		r += (1.0f - tz)*(1.0f - ty)*tx*read(voxel(nix, iy, iz));
+		r += (1.0f - tz)*ty*(1.0f - tx)*read(voxel(ix, niy, iz));
+		r += (1.0f - tz)*ty*tx*read(voxel(nix, niy, iz));
 
-		r += tz*(1.0f - ty)*(1.0f - tx)*read(data[ix + iy*width + niz*width*height]);
-		r += tz*(1.0f - ty)*tx*read(data[nix + iy*width + niz*width*height]);
-		r += tz*ty*(1.0f - tx)*read(data[ix + niy*width + niz*width*height]);
-		r += tz*ty*tx*read(data[nix + niy*width + niz*width*height]);
+		r += tz*(1.0f - ty)*(1.0f - tx)*read(voxel(ix, iy, niz));
+		r += tz*(1.0f - ty)*tx*read(voxel(nix, iy, niz));
+		r += tz*ty*(1.0f - tx)*read(voxel(ix, niy, niz));
+		r += tz*ty*tx*read(voxel(nix, niy, niz));
 
 		return r;
 	}
@@ -485,20 +494,14 @@ template<typename T> struct texture_image  {
 		}
 
 		const int xc[4] = {pix, ix, nix, nnix};
-		const int yc[4] = {width * piy,
-		                   width * iy,
-		                   width * niy,
-		                   width * nniy};
-		const int zc[4] = {width * height * piz,
-		                   width * height * iz,
-		                   width * height * niz,
-		                   width * height * nniz};
+		const int yc[4] = {piy, iy, niy, nniy};
+		const int zc[4] = {piz, iz, niz, nniz};
 		float u[4], v[4], w[4];
 
 		/* Some helper macro to keep code reasonable size,
 		 * let compiler to inline all the matrix multiplications.
 		 */
-#define DATA(x, y, z) (read(data[xc[x] + yc[y] + zc[z]]))
+#define DATA(x, y, z) (read(voxel(xc[x], yc[y], zc[z])))
 #define COL_TERM(col, row) \
 		(v[col] * (u[0] * DATA(0, col, row) + \
 		           u[1] * DATA(1, col, row) + \
@@ -538,6 +541,85 @@ template<typename T> struct texture_image  {
 		}
 	}
 
+	/* Ray parameter up to which the ray from P in direction D, both in
+	 * normalized texture coordinates, passes only through tiles of a sparse
+	 * image which are empty including their neighbours. Interpolation never
+	 * reaches non-empty voxels there. Zero for dense images. */
+	float sparse_empty_distance(float3 P, float3 D)
+	{
+		if(!grid || !data) {
+			return 0.0f;
+		}
+
+		/* Positions in units of tiles. */
+		const float3 scale = make_float3((float)width, (float)height, (float)depth) *
+		                     (1.0f/TEX_SPARSE_TILE_SIZE);
+		const float3 tile_P = P*scale;
+		const float3 tile_D = D*scale;
+
+		int tx = (int)floorf(tile_P.x);
+		int ty = (int)floorf(tile_P.y);
+		int tz = (int)floorf(tile_P.z);
+
+		if(tx < 0 || ty < 0 || tz < 0 ||
+		   tx >= grid_width || ty >= grid_height || tz >= grid_depth)
+		{
+			return 0.0f;
+		}
+
+		/* Walk through tiles along the ray. When leaving the image, the
+		 * remainder of the ray is empty too unless the image repeats. */
+		const int step_x = (tile_D.x > 0.0f)? 1: -1;
+		const int step_y = (tile_D.y > 0.0f)? 1: -1;
+		const int step_z = (tile_D.z > 0.0f)? 1: -1;
+		const float3 inv_D = make_float3((tile_D.x != 0.0f)? 1.0f/tile_D.x: -FLT_MAX,
+		                                 (tile_D.y != 0.0f)? 1.0f/tile_D.y: -FLT_MAX,
+		                                 (tile_D.z != 0.0f)? 1.0f/tile_D.z: -FLT_MAX);
+		const float t_outside = (extension == EXTENSION_REPEAT)? 0.0f: FLT_MAX;
+
+		float t = 0.0f;
+
+		while(!(grid[tx + (ty + tz*grid_height)*grid_width] & TEX_SPARSE_TILE_ACTIVE)) {
+			const float t_x = ((tx + (step_x > 0)) - tile_P.x)*inv_D.x;
+			const float t_y = ((ty + (step_y > 0)) - tile_P.y)*inv_D.y;
+			const float t_z = ((tz + (step_z > 0)) - tile_P.z)*inv_D.z;
+
+			if(t_x <= t_y && t_x <= t_z) {
+				t = t_x;
+				tx += step_x;
+				if(tx < 0 || tx >= grid_width) return max(t, t_outside);
+			}
+			else if(t_y <= t_z) {
+				t = t_y;
+				ty += step_y;
+				if(ty < 0 || ty >= grid_height) return max(t, t_outside);
+			}
+			else {
+				t = t_z;
+				tz += step_z;
+				if(tz < 0 || tz >= grid_depth) return max(t, t_outside);
+			}
+		}
+
+		return t;
+	}
+
+	/* Per tile extinction majorant of a sparse image, along with the size of
+	 * the tile grid and the scale from normalized texture coordinates to
+	 * tiles. NULL when there is none, or when tiles outside the image can not
+	 * be found by clamping. */
+	const float *sparse_majorant(float3 *tile_scale, int3 *grid_size)
+	{
+		if(!grid || !majorant || !data || extension == EXTENSION_REPEAT) {
+			return NULL;
+		}
+
+		*tile_scale = make_float3((float)width, (float)height, (float)depth) *
+		              (1.0f/TEX_SPARSE_TILE_SIZE);
+		*grid_size = make_int3(grid_width, grid_height, grid_depth);
+		return majorant;
+	}
+
 	ccl_always_inline void dimensions_set(int width_, int height_, int depth_)
 	{
 		width = width_;
@@ -545,10 +627,29 @@ template<typename T> struct texture_image  {
 		depth = depth_;
 	}
 
+	ccl_always_inline void grid_set(int *grid_, int width_, int height_, int depth_)
+	{
+		grid = grid_;
+		grid_width = width_;
+		grid_height = height_;
+		grid_depth = depth_;
+	}
+
+	ccl_always_inline void majorant_set(float *majorant_)
+	{
+		majorant = majorant_;
+	}
+
 	T *data;
 	int interpolation;
 	ExtensionType extension;
 	int width, height, depth;
+	/* Tile grid of sparse 3D images, NULL for dense storage. */
+	int *grid;
+	int grid_width, grid_height, grid_depth;
+	/* Upper bound of the extinction of the volume shader per tile of a sparse
+	 * density image, NULL when not known. */
+	float *majorant;
 #undef SET_CUBIC_SPLINE_WEIGHTS
 };
 
@@ -244,6 +244,8 @@ ccl_device_noinline bool indirect_lamp_emission(KernelGlobals *kg,
                                                 float3 *emission,
                                                 uint light_linking)
 {
+	PROFILING_INIT(kg, PROFILING_LIGHT_SAMPLE);
+
 	bool hit_lamp = false;
 
 	*emission = make_float3(0.0f, 0.0f, 0.0f);
@@ -257,6 +259,14 @@ ccl_device_noinline bool indirect_lamp_emission(KernelGlobals *kg,
 		if(!lamp_light_eval(kg, lamp, ray->P, ray->D, ray->t, &ls))
 			continue;
 
+#ifdef __LIGHT_TREE__
+		/* Include the probability of picking the lamp from the light tree. */
+		const int emitter = light_tree_lamp_emitter(kg, lamp);
+		if(emitter != -1) {
+			ls.pdf *= light_tree_lamp_pdf(kg, emitter, ray->P);
+		}
+#endif
+
 #ifdef __PASSES__
 		/* use visibility flag to skip lights */
 		if(ls.shader & SHADER_EXCLUDE_ANY) {
@@ -24,6 +24,8 @@
 #include "util/util_map.h"
 #endif
 
+#include "kernel/kernel_profiling.h"
+
 CCL_NAMESPACE_BEGIN
 
 /* On the CPU, we pass along the struct KernelGlobals to nearly everywhere in
@@ -90,6 +92,16 @@ typedef struct KernelGlobals {
 	map<float, float> *coverage_material_index;
 	map<float, float> *coverage_asset;
 
+	/* State of this thread for the sampling profiler. */
+	ProfilingState profiler;
+
+#  ifdef __EMBREE__
+	/* Shader evaluation kernel for the instruction set in use, to displace
+	 * lazily diced patches from within Embree callbacks. */
+	void (*shader_kernel)(KernelGlobals *kg, uint4 *input, float4 *output, float *output_luma,
+	                      int type, int filter, int i, int offset, int sample);
+#  endif
+
 	/* split kernel */
 	SplitData split_data;
 	SplitParams split_param_data;
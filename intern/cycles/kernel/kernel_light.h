@@ -786,8 +786,224 @@ ccl_device void lamp_light_dPdudv(KernelGlobals *kg, int lamp, float u, float v,
 	}
 }
 
+/* Light Tree
+ *
+ * Triangles and lamps picked from the light distribution are refined by a tree
+ * which estimates the contribution of groups of lights to the shading point.
+ * See render/light_tree.h for the node layout. */
+
+#ifdef __LIGHT_TREE__
+
+/* Estimated contribution of all emitters below the node to the shading point,
+ * zero when none of them can illuminate it. */
+ccl_device float light_tree_node_importance(KernelGlobals *kg, int node, float3 P)
+{
+	const float4 n0 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0);
+	const float energy = n0.w;
+
+	if(energy == 0.0f) {
+		return 0.0f;
+	}
+
+	const float4 n1 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1);
+	const float3 bmin = make_float3(n0.x, n0.y, n0.z);
+	const float3 bmax = make_float3(n1.x, n1.y, n1.z);
+	const float theta_o = n1.w;
+
+	const float3 D = P - 0.5f*(bmin + bmax);
+	const float distance_squared = len_squared(D);
+	const float radius_squared = 0.25f*len_squared(bmax - bmin);
+
+	float cos_theta = 1.0f;
+
+	/* Orientation bound, skipped for nodes emitting in all directions and for
+	 * points inside the bounding sphere of the node. */
+	if(theta_o < M_PI_F && distance_squared > radius_squared) {
+		const float4 n2 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2);
+		const float3 axis = make_float3(n2.x, n2.y, n2.z);
+		const float distance = sqrtf(distance_squared);
+
+		/* Smallest angle between any normal in the cone and any direction from
+		 * the node to the point. */
+		const float theta = safe_acosf(dot(axis, D)/distance);
+		const float theta_u = safe_asinf(sqrtf(radius_squared)/distance);
+		const float theta_min = max(theta - theta_o - theta_u, 0.0f);
+
+		/* Surfaces only emit into the hemisphere around their normal. */
+		if(theta_min >= M_PI_2_F) {
+			return 0.0f;
+		}
+
+		cos_theta = cosf(theta_min);
+	}
+
+	/* Distance is clamped to the node size, to avoid singularity for points
+	 * close to or inside of the node. */
+	return energy*cos_theta/max(max(distance_squared, radius_squared), 1e-12f);
+}
+
+/* Pick emitter from the tree, returns its index in the light distribution or
+ * -1 if no emitter of the tree can illuminate the point. */
+ccl_device int light_tree_sample(KernelGlobals *kg, int root, float3 P, float randu, float *pdf)
+{
+	int node = root;
+	*pdf = 1.0f;
+
+	for(;;) {
+		const float4 n3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+		const int num_emitters = __float_as_int(n3.y);
+
+		if(num_emitters > 0) {
+			/* Leaf node, pick emitter proportional to its energy. */
+			const float energy = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0).w;
+			const int first_emitter = __float_as_int(n3.x);
+			float target = randu*energy;
+
+			for(int i = 0; i < num_emitters; i++) {
+				const float4 emitter = kernel_tex_fetch(__light_tree_emitters, first_emitter + i);
+
+				if(target < emitter.y || i == num_emitters - 1) {
+					if(emitter.y == 0.0f) {
+						return -1;
+					}
+					*pdf *= emitter.y/energy;
+					return __float_as_int(emitter.x);
+				}
+
+				target -= emitter.y;
+			}
+
+			return -1;
+		}
+
+		/* Inner node, descend into child proportional to its importance and
+		 * reuse the random number. */
+		const int left = node + 1;
+		const int right = __float_as_int(n3.x);
+		const float importance_left = light_tree_node_importance(kg, left, P);
+		const float importance_right = light_tree_node_importance(kg, right, P);
+		const float importance = importance_left + importance_right;
+
+		if(importance == 0.0f) {
+			return -1;
+		}
+
+		const float p_left = importance_left/importance;
+
+		if(randu < p_left) {
+			node = left;
+			randu = randu/p_left;
+			*pdf *= p_left;
+		}
+		else {
+			const float p_right = importance_right/importance;
+			node = right;
+			randu = (randu - p_left)/p_right;
+			*pdf *= p_right;
+		}
+
+		randu = min(randu, 1.0f - FLT_EPSILON);
+	}
+}
+
+/* Probability of picking the emitter from its tree, must match the product of
+ * probabilities along the path taken by light_tree_sample(). */
+ccl_device float light_tree_emitter_pdf(KernelGlobals *kg, int emitter, float3 P)
+{
+	const float4 data = kernel_tex_fetch(__light_tree_emitters, emitter);
+	int node = __float_as_int(data.z);
+
+	const float leaf_energy = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0).w;
+	if(leaf_energy == 0.0f) {
+		return 0.0f;
+	}
+
+	float pdf = data.y/leaf_energy;
+	int parent = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3).z);
+
+	while(parent != -1) {
+		const float4 n3 = kernel_tex_fetch(__light_tree_nodes, parent*LIGHT_TREE_NODE_SIZE + 3);
+		const int left = parent + 1;
+		const int right = __float_as_int(n3.x);
+		const float importance_left = light_tree_node_importance(kg, left, P);
+		const float importance_right = light_tree_node_importance(kg, right, P);
+		const float importance = importance_left + importance_right;
+
+		if(importance == 0.0f) {
+			return 0.0f;
+		}
+
+		pdf *= ((node == left)? importance_left: importance_right)/importance;
+
+		node = parent;
+		parent = __float_as_int(n3.z);
+	}
+
+	return pdf;
+}
+
+/* Emitter index of a mesh light triangle, -1 if it is not in the tree. */
+ccl_device int light_tree_triangle_emitter(KernelGlobals *kg, int object, int prim)
+{
+	const uint4 info = kernel_tex_fetch(__light_tree_objects, object);
+	const uint index = (uint)prim - info.y;
+
+	if(index >= info.z) {
+		return -1;
+	}
+
+	return (int)kernel_tex_fetch(__light_tree_triangles, info.x + index) - 1;
+}
+
+/* Emitter index of a lamp, -1 if it is not picked from the tree. Branched path
+ * tracing may sample all lamps one by one, so it never uses the lamp tree and
+ * light and BSDF samples agree on the pdf used for MIS. */
+ccl_device int light_tree_lamp_emitter(KernelGlobals *kg, int lamp)
+{
+	if(!kernel_data.integrator.use_light_tree ||
+	   kernel_data.integrator.light_tree_lamp_root == -1 ||
+	   kernel_data.integrator.branched)
+	{
+		return -1;
+	}
+
+	return (int)kernel_tex_fetch(__light_tree_lamps, lamp) - 1;
+}
+
+/* Probability of picking a lamp from the tree relative to picking it uniformly,
+ * which is what the pdf of lamp_light_sample() and lamp_light_eval() assumes. */
+ccl_device float light_tree_lamp_pdf(KernelGlobals *kg, int emitter, float3 P)
+{
+	return kernel_data.integrator.num_light_tree_lamps*light_tree_emitter_pdf(kg, emitter, P);
+}
+
+#endif  /* __LIGHT_TREE__ */
+
 /* Triangle Light */
 
+/* Probability per unit area of picking the triangle as light, area being the
+ * triangle area at the center of the shutter. Without light tree triangles are
+ * picked proportional to their area, so it is the same for all of them. */
+ccl_device_inline float triangle_light_pdf_triangles(KernelGlobals *kg, int object, int prim, float3 P, float area)
+{
+#ifdef __LIGHT_TREE__
+	if(kernel_data.integrator.use_light_tree &&
+	   kernel_data.integrator.light_tree_triangle_root != -1)
+	{
+		const int emitter = light_tree_triangle_emitter(kg, object, prim);
+		if(emitter == -1 || area == 0.0f) {
+			return 0.0f;
+		}
+
+		/* Share of triangles in the light distribution. */
+		const float pdf_group = (kernel_data.integrator.num_all_lights)? 0.5f: 1.0f;
+		return pdf_group*light_tree_emitter_pdf(kg, emitter, P)/area;
+	}
+#endif
+
+	return kernel_data.integrator.pdf_triangles;
+}
+
 /* returns true if the triangle is has motion blur or an instancing transform applied */
 ccl_device_inline bool triangle_world_space_vertices(KernelGlobals *kg, int object, int prim, float time, float3 V[3])
 {
@@ -817,9 +1033,8 @@ ccl_device_inline bool triangle_world_space_vertices(KernelGlobals *kg, int obje
 	return has_motion;
 }
 
-ccl_device_inline float triangle_light_pdf_area(KernelGlobals *kg, const float3 Ng, const float3 I, float t)
+ccl_device_inline float triangle_light_pdf_area(KernelGlobals *kg, const float3 Ng, const float3 I, float t, float pdf)
 {
-	float pdf = kernel_data.integrator.pdf_triangles;
 	float cos_pi = fabsf(dot(Ng, I));
 
 	if(cos_pi == 0.0f)
@@ -844,10 +1059,11 @@ ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *s
 	const float3 N = cross(e0, e1);
 	const float distance_to_plane = fabsf(dot(N, sd->I * t))/dot(N, N);
 
+	/* sd contains the point on the light source
+	 * calculate Px, the point that we're shading */
+	const float3 Px = sd->P + sd->I * t;
+
 	if(longest_edge_squared > distance_to_plane*distance_to_plane) {
-		/* sd contains the point on the light source
-		 * calculate Px, the point that we're shading */
-		const float3 Px = sd->P + sd->I * t;
 		const float3 v0_p = V[0] - Px;
 		const float3 v1_p = V[1] - Px;
 		const float3 v2_p = V[2] - Px;
@@ -873,22 +1089,26 @@ ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *s
 			} else {
 				area = 0.5f * len(N);
 			}
-			const float pdf = area * kernel_data.integrator.pdf_triangles;
+			const float pdf = area * triangle_light_pdf_triangles(kg, sd->object, sd->prim, Px, area);
 			return pdf / solid_angle;
 		}
 	}
 	else {
-		float pdf = triangle_light_pdf_area(kg, sd->Ng, sd->I, t);
+		const float area = 0.5f * len(N);
+		float area_pre = area;
 		if(has_motion) {
-			const float	area = 0.5f * len(N);
 			if(UNLIKELY(area == 0.0f)) {
 				return 0.0f;
 			}
+			triangle_world_space_vertices(kg, sd->object, sd->prim, -1.0f, V);
+			area_pre = triangle_area(V[0], V[1], V[2]);
+		}
+		const float pdf_triangles = triangle_light_pdf_triangles(kg, sd->object, sd->prim, Px, area_pre);
+		float pdf = triangle_light_pdf_area(kg, sd->Ng, sd->I, t, pdf_triangles);
+		if(has_motion) {
 			/* scale the PDF.
 			 * area = the area the sample was taken from
 			 * area_pre = the are from which pdf_triangles was calculated from */
-			triangle_world_space_vertices(kg, sd->object, sd->prim, -1.0f, V);
-			const float area_pre = triangle_area(V[0], V[1], V[2]);
 			pdf = pdf * area_pre / area;
 		}
 		return pdf;
@@ -1008,7 +1228,7 @@ ccl_device_forceinline void triangle_light_sample(KernelGlobals *kg, int prim, i
 				triangle_world_space_vertices(kg, object, prim, -1.0f, V);
 				area = triangle_area(V[0], V[1], V[2]);
 			}
-			const float pdf = area * kernel_data.integrator.pdf_triangles;
+			const float pdf = area * triangle_light_pdf_triangles(kg, object, prim, P, area);
 			ls->pdf = pdf / solid_angle;
 		}
 	}
@@ -1022,13 +1242,17 @@ ccl_device_forceinline void triangle_light_sample(KernelGlobals *kg, int prim, i
 		ls->P = u * V[0] + v * V[1] + t * V[2];
 		/* compute incoming direction, distance and pdf */
 		ls->D = normalize_len(ls->P - P, &ls->t);
-		ls->pdf = triangle_light_pdf_area(kg, ls->Ng, -ls->D, ls->t);
+		float area_pre = area;
+		if(has_motion && area != 0.0f) {
+			triangle_world_space_vertices(kg, object, prim, -1.0f, V);
+			area_pre = triangle_area(V[0], V[1], V[2]);
+		}
+		const float pdf_triangles = triangle_light_pdf_triangles(kg, object, prim, P, area_pre);
+		ls->pdf = triangle_light_pdf_area(kg, ls->Ng, -ls->D, ls->t, pdf_triangles);
 		if(has_motion && area != 0.0f) {
 			/* scale the PDF.
 			 * area = the area the sample was taken from
 			 * area_pre = the are from which pdf_triangles was calculated from */
-			triangle_world_space_vertices(kg, object, prim, -1.0f, V);
-			const float area_pre = triangle_area(V[0], V[1], V[2]);
 			ls->pdf = ls->pdf * area_pre / area;
 		}
 		ls->u = u;
@@ -1098,6 +1322,37 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 	float4 l = kernel_tex_fetch(__light_distribution, index);
 	int prim = __float_as_int(l.y);
 
+#ifdef __LIGHT_TREE__
+	int tree_root = -1;
+	float tree_pdf = 1.0f;
+
+	if(kernel_data.integrator.use_light_tree) {
+		if(prim >= 0) {
+			tree_root = kernel_data.integrator.light_tree_triangle_root;
+		}
+		else if(light_tree_lamp_emitter(kg, -prim-1) != -1) {
+			tree_root = kernel_data.integrator.light_tree_lamp_root;
+		}
+	}
+
+	if(tree_root != -1) {
+		/* The distribution only decides between triangles, lamps in the tree
+		 * and the remaining lamps. The actual light is picked from the tree,
+		 * reusing the random number within the picked distribution entry. */
+		const float cdf_start = l.x;
+		const float cdf_end = kernel_tex_fetch(__light_distribution, index + 1).x;
+		const float randt_tree = (cdf_end > cdf_start)? saturate((randt - cdf_start)/(cdf_end - cdf_start)): 0.0f;
+
+		index = light_tree_sample(kg, tree_root, P, randt_tree, &tree_pdf);
+		if(index == -1) {
+			return false;
+		}
+
+		l = kernel_tex_fetch(__light_distribution, index);
+		prim = __float_as_int(l.y);
+	}
+#endif
+
 	if(prim >= 0) {
 		int object = __float_as_int(l.w);
 		int shader_flag = __float_as_int(l.z);
@@ -1118,7 +1373,20 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 			return false;
 		}
 
-		return lamp_light_sample(kg, lamp, randu, randv, P, ls);
+		if(!lamp_light_sample(kg, lamp, randu, randv, P, ls)) {
+			return false;
+		}
+
+#ifdef __LIGHT_TREE__
+		if(tree_root != -1) {
+			/* lamp_light_sample() assumes all lamps are picked with the same
+			 * probability, correct for the tree. Must match light_tree_lamp_pdf()
+			 * used for BSDF samples hitting the lamp. */
+			ls->pdf *= kernel_data.integrator.num_light_tree_lamps*tree_pdf;
+		}
+#endif
+
+		return true;
 	}
 }
 
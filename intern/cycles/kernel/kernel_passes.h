@@ -431,8 +431,19 @@ ccl_device_inline void kernel_write_light_passes(KernelGlobals *kg, ccl_global f
 
 ccl_device_inline void kernel_write_result(KernelGlobals *kg, ccl_global float *buffer, int sample, PathRadiance *L, float L_transparent, bool is_shadowcatcher)
 {
+	PROFILING_INIT(kg, PROFILING_WRITE_RESULT);
+
 	if(!L) {
 		kernel_write_pass_float4(buffer, sample, make_float4(0.0f, 0.0f, 0.0f, 0.0f));
+		if(kernel_data.film.pass_adaptive) {
+			ccl_global float *aux = buffer + kernel_data.film.pass_adaptive;
+			if(sample == 0) {
+				aux[3] = 0.0f;
+			}
+			if(sample & 1) {
+				kernel_write_pass_float3_unaligned(aux, sample/2, make_float3(0.0f, 0.0f, 0.0f));
+			}
+		}
 		return;
 	}
 
@@ -468,6 +479,18 @@ ccl_device_inline void kernel_write_result(KernelGlobals *kg, ccl_global float *
 		kernel_write_pass_float3_variance(buffer + kernel_data.film.pass_denoising + 20, sample, ensure_finite3(L_sum));
 	}
 
+	if(kernel_data.film.pass_adaptive) {
+		/* Odd samples are accumulated separately to estimate noise level,
+		 * see kernel_adaptive_sampling.h. */
+		ccl_global float *aux = buffer + kernel_data.film.pass_adaptive;
+		if(sample == 0) {
+			aux[3] = 0.0f;
+		}
+		if(sample & 1) {
+			kernel_write_pass_float3_unaligned(aux, sample/2, ensure_finite3(L_sum));
+		}
+	}
+
 	kernel_write_pass_float4(buffer, sample, make_float4(L_sum.x, L_sum.y, L_sum.z, 1.0f - L_transparent));
 }
 
@@ -62,6 +62,8 @@ ccl_device_noinline void kernel_path_ao(KernelGlobals *kg,
                                         float3 throughput,
                                         float3 ao_alpha)
 {
+	PROFILING_INIT(kg, PROFILING_AO);
+
 	/* todo: solve correlation */
 	float bsdf_u, bsdf_v;
 
@@ -470,6 +472,8 @@ bool kernel_path_subsurface_scatter(
         float3 *throughput,
         SubsurfaceIndirectRays *ss_indirect)
 {
+	PROFILING_INIT(kg, PROFILING_SUBSURFACE);
+
 	float bssrdf_probability;
 	ShaderClosure *sc = subsurface_scatter_pick_closure(kg, sd, &bssrdf_probability);
 
@@ -625,8 +629,11 @@ ccl_device_inline void kernel_path_integrate(KernelGlobals *kg,
                                              uint rng_hash,
                                              int sample,
                                              Ray ray,
+                                             const Intersection *first_isect,
                                              ccl_global float *buffer)
 {
+	PROFILING_INIT(kg, PROFILING_PATH_INTEGRATE);
+
 	/* initialize */
 	PathRadiance L;
 	float3 throughput = make_float3(1.0f, 1.0f, 1.0f);
@@ -659,26 +666,35 @@ ccl_device_inline void kernel_path_integrate(KernelGlobals *kg,
 		/* intersect scene */
 		Intersection isect;
 		uint visibility = path_state_ray_visibility(kg, &state);
+		bool hit;
 
+		if(first_isect != NULL) {
+			/* Camera ray was already intersected as part of a ray packet. */
+			isect = *first_isect;
+			hit = (isect.prim != PRIM_NONE);
+			first_isect = NULL;
+		}
+		else {
 #ifdef __HAIR__
-		float difl = 0.0f, extmax = 0.0f;
-		uint lcg_state = 0;
-
-		if(kernel_data.bvh.have_curves) {
-			if((kernel_data.cam.resolution == 1) && (state.flag & PATH_RAY_CAMERA)) {	
-				float3 pixdiff = ray.dD.dx + ray.dD.dy;
-				/*pixdiff = pixdiff - dot(pixdiff, ray.D)*ray.D;*/
-				difl = kernel_data.curve.minimum_width * len(pixdiff) * 0.5f;
-			}
+			float difl = 0.0f, extmax = 0.0f;
+			uint lcg_state = 0;
+
+			if(kernel_data.bvh.have_curves) {
+				if((kernel_data.cam.resolution == 1) && (state.flag & PATH_RAY_CAMERA)) {	
+					float3 pixdiff = ray.dD.dx + ray.dD.dy;
+					/*pixdiff = pixdiff - dot(pixdiff, ray.D)*ray.D;*/
+					difl = kernel_data.curve.minimum_width * len(pixdiff) * 0.5f;
+				}
 
-			extmax = kernel_data.curve.maximum_width;
-			lcg_state = lcg_state_init(&state, 0x51633e2d);
-		}
+				extmax = kernel_data.curve.maximum_width;
+				lcg_state = lcg_state_init(&state, 0x51633e2d);
+			}
 
-		bool hit = scene_intersect(kg, ray, visibility, &isect, &lcg_state, difl, extmax, 0x00000000/*TODO:What goes here*/);
+			hit = scene_intersect(kg, ray, visibility, &isect, &lcg_state, difl, extmax, 0x00000000/*TODO:What goes here*/);
 #else
-		bool hit = scene_intersect(kg, ray, visibility, &isect, NULL, 0.0f, 0.0f, 0x00000000/*TODO:What goes here*/);
+			hit = scene_intersect(kg, ray, visibility, &isect, NULL, 0.0f, 0.0f, 0x00000000/*TODO:What goes here*/);
 #endif
+		}
 
 #ifdef __KERNEL_DEBUG__
 		if(state.flag & PATH_RAY_CAMERA) {
@@ -986,6 +1002,8 @@ ccl_device void kernel_path_trace(KernelGlobals *kg,
 	ccl_global float *buffer, ccl_global uint *rng_state,
 	int sample, int x, int y, int offset, int stride)
 {
+	PROFILING_INIT(kg, PROFILING_RAY_SETUP);
+
 	/* buffer offset */
 	int index = offset + x + y*stride;
 	int pass_stride = kernel_data.film.pass_stride;
@@ -1001,10 +1019,70 @@ ccl_device void kernel_path_trace(KernelGlobals *kg,
 
 	/* integrate */
 	if(ray.t != 0.0f)
-		kernel_path_integrate(kg, rng_hash, sample, ray, buffer);
+		kernel_path_integrate(kg, rng_hash, sample, ray, NULL, buffer);
 	else
 		kernel_write_result(kg, buffer, sample, NULL, 0.0f, false);
 }
 
+#ifdef __RAY_PACKETS__
+/* Trace a row of up to RAY_PACKET_SIZE neighbour pixels, intersecting their
+ * camera rays together as one packet. Only the first intersection is done in
+ * the packet, rest of the path is traced ray by ray. */
+ccl_device void kernel_path_trace_packet(KernelGlobals *kg,
+	ccl_global float *buffer, ccl_global uint *rng_state,
+	int sample, int x, int y, int num, int offset, int stride)
+{
+	PROFILING_INIT(kg, PROFILING_RAY_SETUP);
+
+	kernel_assert(num > 0 && num <= RAY_PACKET_SIZE);
+
+	if(num == 1 || !scene_intersect_packet_supported(kg)) {
+		for(int i = 0; i < num; i++) {
+			kernel_path_trace(kg, buffer, rng_state, sample, x + i, y, offset, stride);
+		}
+		return;
+	}
+
+	int pass_stride = kernel_data.film.pass_stride;
+
+	/* initialize random numbers and rays */
+	uint rng_hash[RAY_PACKET_SIZE];
+	Ray rays[RAY_PACKET_SIZE];
+	int active = 0;
+
+	for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+		if(i < num) {
+			int index = offset + x + i + y*stride;
+			kernel_path_trace_setup(kg, rng_state + index, sample, x + i, y, &rng_hash[i], &rays[i]);
+			if(rays[i].t != 0.0f) {
+				active |= (1 << i);
+			}
+		}
+		else {
+			rays[i] = rays[0];
+		}
+	}
+
+	/* intersect camera rays with the visibility of the initial path state,
+	 * same as kernel_path_integrate() would use for them */
+	Intersection isect[RAY_PACKET_SIZE];
+	if(active != 0) {
+		const uint visibility = path_state_flag_visibility(path_state_camera_flag(kg));
+		qbvh_intersect_packet(kg, rays, isect, visibility, active);
+	}
+
+	/* integrate */
+	for(int i = 0; i < num; i++) {
+		int index = offset + x + i + y*stride;
+		ccl_global float *pixel_buffer = buffer + index*pass_stride;
+
+		if(active & (1 << i))
+			kernel_path_integrate(kg, rng_hash[i], sample, rays[i], &isect[i], pixel_buffer);
+		else
+			kernel_write_result(kg, pixel_buffer, sample, NULL, 0.0f, false);
+	}
+}
+#endif  /* __RAY_PACKETS__ */
+
 CCL_NAMESPACE_END
 
@@ -25,6 +25,8 @@ ccl_device_inline void kernel_branched_path_ao(KernelGlobals *kg,
                                                PathState *state,
                                                float3 throughput)
 {
+	PROFILING_INIT(kg, PROFILING_AO);
+
 	int num_samples = kernel_data.integrator.ao_samples;
 	float num_samples_inv = 1.0f/num_samples;
 	float ao_factor = kernel_data.background.ao_factor;
@@ -174,6 +176,8 @@ ccl_device void kernel_branched_path_subsurface_scatter(KernelGlobals *kg,
                                                         Ray *ray,
                                                         float3 throughput)
 {
+	PROFILING_INIT(kg, PROFILING_SUBSURFACE);
+
 	for(int i = 0; i < sd->num_closure; i++) {
 		ShaderClosure *sc = &sd->closure[i];
 
@@ -277,6 +281,8 @@ ccl_device void kernel_branched_path_subsurface_scatter(KernelGlobals *kg,
 
 ccl_device void kernel_branched_path_integrate(KernelGlobals *kg, uint rng_hash, int sample, Ray ray, ccl_global float *buffer)
 {
+	PROFILING_INIT(kg, PROFILING_PATH_INTEGRATE);
+
 	/* initialize */
 	PathRadiance L;
 	float3 throughput = make_float3(1.0f, 1.0f, 1.0f);
@@ -762,6 +768,8 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 	ccl_global float *buffer, ccl_global uint *rng_state,
 	int sample, int x, int y, int offset, int stride)
 {
+	PROFILING_INIT(kg, PROFILING_RAY_SETUP);
+
 	/* buffer offset */
 	int index = offset + x + y*stride;
 	int pass_stride = kernel_data.film.pass_stride;
@@ -16,6 +16,18 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Flags of a path state at the camera, before the first bounce. */
+ccl_device_inline uint path_state_camera_flag(KernelGlobals *kg)
+{
+	uint flag = PATH_RAY_CAMERA|PATH_RAY_MIS_SKIP;
+
+	if(kernel_data.film.pass_denoising) {
+		flag |= PATH_RAY_STORE_SHADOW_INFO;
+	}
+
+	return flag;
+}
+
 ccl_device_inline void path_state_init(KernelGlobals *kg,
                                        ShaderData *stack_sd,
                                        ccl_addr_space PathState *state,
@@ -23,7 +35,7 @@ ccl_device_inline void path_state_init(KernelGlobals *kg,
                                        int sample,
                                        ccl_addr_space Ray *ray)
 {
-	state->flag = PATH_RAY_CAMERA|PATH_RAY_MIS_SKIP;
+	state->flag = path_state_camera_flag(kg);
 
 	state->rng_hash = rng_hash;
 	state->rng_offset = PRNG_BASE_NUM;
@@ -37,7 +49,6 @@ ccl_device_inline void path_state_init(KernelGlobals *kg,
 	state->transparent_bounce = 0;
 
 	if(kernel_data.film.pass_denoising) {
-		state->flag |= PATH_RAY_STORE_SHADOW_INFO;
 		state->denoising_feature_weight = 1.0f;
 	}
 	else {
@@ -161,20 +172,25 @@ ccl_device_inline bool path_state_volume_next(KernelGlobals *kg, ccl_addr_space
 	return true;
 }
 
-ccl_device_inline uint path_state_ray_visibility(KernelGlobals *kg, PathState *state)
+ccl_device_inline uint path_state_flag_visibility(uint state_flag)
 {
-	uint flag = state->flag & PATH_RAY_ALL_VISIBILITY;
+	uint flag = state_flag & PATH_RAY_ALL_VISIBILITY;
 
 	/* for visibility, diffuse/glossy are for reflection only */
 	if(flag & PATH_RAY_TRANSMIT)
 		flag &= ~(PATH_RAY_DIFFUSE|PATH_RAY_GLOSSY);
 	/* todo: this is not supported as its own ray visibility yet */
-	if(state->flag & PATH_RAY_VOLUME_SCATTER)
+	if(state_flag & PATH_RAY_VOLUME_SCATTER)
 		flag |= PATH_RAY_DIFFUSE;
 
 	return flag;
 }
 
+ccl_device_inline uint path_state_ray_visibility(KernelGlobals *kg, PathState *state)
+{
+	return path_state_flag_visibility(state->flag);
+}
+
 ccl_device_inline float path_state_terminate_probability(KernelGlobals *kg, ccl_addr_space PathState *state, ShaderData *sd, const float3 throughput)
 {
 	if(state->flag & PATH_RAY_TRANSPARENT) {
@@ -22,6 +22,8 @@ ccl_device_noinline void kernel_branched_path_surface_connect_light(KernelGlobal
 	ShaderData *sd, ShaderData *emission_sd, PathState *state, float3 throughput,
 	float num_samples_adjust, PathRadiance *L, int sample_all_lights, uint light_linking, uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_LIGHT_SAMPLE);
+
 #ifdef __EMISSION__
 	/* sample illumination from lights to find path contribution */
 	if(!(ccl_fetch(sd, runtime_flag) & SD_RUNTIME_BSDF_HAS_EVAL))
@@ -153,6 +155,8 @@ ccl_device bool kernel_branched_path_surface_bounce(
         Ray *ray,
         float sum_sample_weight)
 {
+	PROFILING_INIT(kg, PROFILING_SURFACE_BOUNCE);
+
 	/* sample BSDF */
 	float bsdf_pdf;
 	BsdfEval bsdf_eval;
@@ -219,6 +223,8 @@ ccl_device_inline void kernel_path_surface_connect_light(KernelGlobals *kg,
 														 uint light_linking, 
 														 uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_LIGHT_SAMPLE);
+
 #ifdef __EMISSION__
 	if(!(kernel_data.integrator.use_direct_light && (ccl_fetch(sd, runtime_flag) & SD_RUNTIME_BSDF_HAS_EVAL)))
 		return;
@@ -279,6 +285,8 @@ ccl_device bool kernel_path_surface_bounce(KernelGlobals *kg,
                                            PathRadiance *L,
                                            ccl_addr_space Ray *ray)
 {
+	PROFILING_INIT(kg, PROFILING_SURFACE_BOUNCE);
+
 	/* no BSDF? we can stop here */
 	if(ccl_fetch(sd, runtime_flag) & SD_RUNTIME_BSDF) {
 		/* sample BSDF */
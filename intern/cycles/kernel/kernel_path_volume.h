@@ -27,6 +27,8 @@ ccl_device_inline void kernel_path_volume_connect_light(
         PathRadiance *L,
         uint light_linking, uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_LIGHT_SAMPLE);
+
 #ifdef __EMISSION__
 	if(!kernel_data.integrator.use_direct_light)
 		return;
@@ -122,6 +124,8 @@ ccl_device void kernel_branched_path_volume_connect_light(KernelGlobals *kg,
 	bool sample_all_lights, Ray *ray, const VolumeSegment *segment,
     uint light_linking, uint shadow_linking)
 {
+	PROFILING_INIT(kg, PROFILING_LIGHT_SAMPLE);
+
 #ifdef __EMISSION__
 	if(!kernel_data.integrator.use_direct_light)
 		return;
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_PROFILING_H__
+#define __KERNEL_PROFILING_H__
+
+/* Mark parts of the kernel for the sampling profiler, see util_profiling.h.
+ * Only supported on the CPU, on other devices these compile to nothing. */
+
+#ifdef __KERNEL_CPU__
+#  include "util/util_profiling.h"
+
+#  define PROFILING_INIT(kg, event) ProfilingHelper profiling_helper(&(kg)->profiler, event)
+#  define PROFILING_EVENT(event) profiling_helper.set_event(event)
+#  define PROFILING_COUNT_RAY() profiling_helper.count_ray()
+#else
+#  define PROFILING_INIT(kg, event)
+#  define PROFILING_EVENT(event)
+#  define PROFILING_COUNT_RAY()
+#endif
+
+#endif  /* __KERNEL_PROFILING_H__ */
@@ -54,6 +54,8 @@ ccl_device_noinline void shader_setup_from_ray(KernelGlobals *kg,
                                                const Intersection *isect,
                                                const Ray *ray)
 {
+	PROFILING_INIT(kg, PROFILING_SHADER_SETUP);
+
 #ifdef __INSTANCING__
 	ccl_fetch(sd, object) = (isect->object == PRIM_NONE) ? kernel_tex_fetch(__prim_object, isect->prim) : isect->object;
 #endif
@@ -85,6 +87,19 @@ ccl_device_noinline void shader_setup_from_ray(KernelGlobals *kg,
 		sd->P = bvh_curve_refine(kg, sd, isect, ray);
 	}
 	else
+#endif
+#ifdef __EMBREE__
+	if((sd->type & PRIMITIVE_TRIANGLE) && (sd->object_flag & SD_OBJECT_LAZY_DICING)) {
+		/* micropolygon of lazily diced patch */
+		sd->shader = kernel_tex_fetch(__tri_shader, sd->prim);
+		triangle_lazy_dicing_shader_setup(kg, sd, isect, ray);
+
+#  ifdef __DPDU__
+		/* dPdu/dPdv */
+		triangle_dPdudv(kg, sd->prim, &sd->dPdu, &sd->dPdv);
+#  endif
+	}
+	else
 #endif
 	if(sd->type & PRIMITIVE_TRIANGLE) {
 		/* static triangle */
@@ -211,6 +226,19 @@ void shader_setup_from_subsurface(
 #  endif
 
 	/* fetch triangle data */
+#  ifdef __EMBREE__
+	if(sd->type == PRIMITIVE_TRIANGLE && (sd->object_flag & SD_OBJECT_LAZY_DICING)) {
+		/* micropolygon of lazily diced patch */
+		sd->shader = kernel_tex_fetch(__tri_shader, sd->prim);
+		triangle_lazy_dicing_shader_setup(kg, sd, isect, ray);
+
+#    ifdef __DPDU__
+		/* dPdu/dPdv */
+		triangle_dPdudv(kg, sd->prim, &sd->dPdu, &sd->dPdv);
+#    endif
+	}
+	else
+#  endif
 	if(sd->type == PRIMITIVE_TRIANGLE) {
 		float3 Ng = triangle_normal(kg, sd);
 		sd->shader = kernel_tex_fetch(__tri_shader, sd->prim);
@@ -643,9 +671,60 @@ ccl_device_inline void shader_merge_closures(ShaderData *sd)
 
 /* BSDF */
 
+#ifdef __BSDF_SIMD_EVAL__
+/* Microfacet closures are collected into batches which are evaluated together,
+ * while other closures are evaluated one by one as they come. */
+#  define SHADER_BSDF_SIMD_BATCH_SIZE 4
+
+ccl_device_inline bool shader_bsdf_simd_batch_supported(ShaderData *sd,
+                                                        const ShaderClosure *sc,
+                                                        const float3 omega_in)
+{
+	/* bsdf_eval() only evaluates reflection for directions above Ng */
+	return (dot(sd->Ng, omega_in) >= 0.0f && bsdf_microfacet_ggx_eval_simd_supported(sc));
+}
+
+ccl_device_inline void shader_bsdf_simd_batch_eval(KernelGlobals *kg,
+                                                   ShaderData *sd,
+                                                   const float3 omega_in,
+                                                   const ShaderClosure **batch,
+                                                   int num_batch,
+                                                   float3 *eval,
+                                                   float *pdf)
+{
+	if(num_batch == 1) {
+		/* nothing to gain from SIMD for a single closure */
+		pdf[0] = 0.0f;
+		eval[0] = bsdf_eval(kg, sd, batch[0], omega_in, &pdf[0]);
+	}
+	else {
+		bsdf_microfacet_ggx_eval_reflect_simd(batch, num_batch, sd->I, omega_in, eval, pdf);
+	}
+}
+#endif  /* __BSDF_SIMD_EVAL__ */
+
+ccl_device_inline void _shader_bsdf_multi_eval_accum(BsdfEval *result_eval,
+                                                     const ShaderClosure *sc,
+                                                     float3 eval,
+                                                     float bsdf_pdf,
+                                                     float *sum_pdf)
+{
+	if(bsdf_pdf != 0.0f) {
+		bsdf_eval_accum(result_eval, sc->type, eval*sc->weight, 1.0f);
+		*sum_pdf += bsdf_pdf*sc->sample_weight;
+	}
+}
+
 ccl_device_inline void _shader_bsdf_multi_eval(KernelGlobals *kg, ShaderData *sd, const float3 omega_in, float *pdf,
 	int skip_bsdf, BsdfEval *result_eval, float sum_pdf, float sum_sample_weight)
 {
+#ifdef __BSDF_SIMD_EVAL__
+	const ShaderClosure *batch[SHADER_BSDF_SIMD_BATCH_SIZE];
+	float3 batch_eval[SHADER_BSDF_SIMD_BATCH_SIZE];
+	float batch_pdf[SHADER_BSDF_SIMD_BATCH_SIZE];
+	int num_batch = 0;
+#endif
+
 	/* this is the veach one-sample model with balance heuristic, some pdf
 	 * factors drop out when using balance heuristic weighting */
 	for(int i = 0; i < sd->num_closure; i++) {
@@ -655,22 +734,56 @@ ccl_device_inline void _shader_bsdf_multi_eval(KernelGlobals *kg, ShaderData *sd
 		const ShaderClosure *sc = &sd->closure[i];
 
 		if(CLOSURE_IS_BSDF(sc->type)) {
-			float bsdf_pdf = 0.0f;
-			float3 eval = bsdf_eval(kg, sd, sc, omega_in, &bsdf_pdf);
+			sum_sample_weight += sc->sample_weight;
+
+#ifdef __BSDF_SIMD_EVAL__
+			if(shader_bsdf_simd_batch_supported(sd, sc, omega_in)) {
+				batch[num_batch++] = sc;
 
-			if(bsdf_pdf != 0.0f) {
-				bsdf_eval_accum(result_eval, sc->type, eval*sc->weight, 1.0f);
-				sum_pdf += bsdf_pdf*sc->sample_weight;
+				if(num_batch == SHADER_BSDF_SIMD_BATCH_SIZE) {
+					shader_bsdf_simd_batch_eval(kg, sd, omega_in, batch, num_batch, batch_eval, batch_pdf);
+					for(int j = 0; j < num_batch; j++)
+						_shader_bsdf_multi_eval_accum(result_eval, batch[j], batch_eval[j], batch_pdf[j], &sum_pdf);
+					num_batch = 0;
+				}
+				continue;
 			}
+#endif
 
-			sum_sample_weight += sc->sample_weight;
+			float bsdf_pdf = 0.0f;
+			float3 eval = bsdf_eval(kg, sd, sc, omega_in, &bsdf_pdf);
+			_shader_bsdf_multi_eval_accum(result_eval, sc, eval, bsdf_pdf, &sum_pdf);
 		}
 	}
 
+#ifdef __BSDF_SIMD_EVAL__
+	if(num_batch) {
+		shader_bsdf_simd_batch_eval(kg, sd, omega_in, batch, num_batch, batch_eval, batch_pdf);
+		for(int j = 0; j < num_batch; j++)
+			_shader_bsdf_multi_eval_accum(result_eval, batch[j], batch_eval[j], batch_pdf[j], &sum_pdf);
+	}
+#endif
+
 	*pdf = (sum_sample_weight > 0.0f)? sum_pdf/sum_sample_weight: 0.0f;
 }
 
 #ifdef __BRANCHED_PATH__
+ccl_device_inline void _shader_bsdf_multi_eval_branched_accum(BsdfEval *result_eval,
+                                                              const ShaderClosure *sc,
+                                                              float3 eval,
+                                                              float bsdf_pdf,
+                                                              float light_pdf,
+                                                              bool use_mis)
+{
+	if(bsdf_pdf != 0.0f) {
+		float mis_weight = use_mis? power_heuristic(light_pdf, bsdf_pdf): 1.0f;
+		bsdf_eval_accum(result_eval,
+		                sc->type,
+		                eval * sc->weight,
+		                mis_weight);
+	}
+}
+
 ccl_device_inline void _shader_bsdf_multi_eval_branched(KernelGlobals *kg,
                                                         ShaderData *sd,
                                                         const float3 omega_in,
@@ -678,20 +791,43 @@ ccl_device_inline void _shader_bsdf_multi_eval_branched(KernelGlobals *kg,
                                                         float light_pdf,
                                                         bool use_mis)
 {
+#ifdef __BSDF_SIMD_EVAL__
+	const ShaderClosure *batch[SHADER_BSDF_SIMD_BATCH_SIZE];
+	float3 batch_eval[SHADER_BSDF_SIMD_BATCH_SIZE];
+	float batch_pdf[SHADER_BSDF_SIMD_BATCH_SIZE];
+	int num_batch = 0;
+#endif
+
 	for(int i = 0; i < sd->num_closure; i++) {
 		const ShaderClosure *sc = &sd->closure[i];
 		if(CLOSURE_IS_BSDF(sc->type)) {
+#ifdef __BSDF_SIMD_EVAL__
+			if(shader_bsdf_simd_batch_supported(sd, sc, omega_in)) {
+				batch[num_batch++] = sc;
+
+				if(num_batch == SHADER_BSDF_SIMD_BATCH_SIZE) {
+					shader_bsdf_simd_batch_eval(kg, sd, omega_in, batch, num_batch, batch_eval, batch_pdf);
+					for(int j = 0; j < num_batch; j++)
+						_shader_bsdf_multi_eval_branched_accum(result_eval, batch[j], batch_eval[j], batch_pdf[j], light_pdf, use_mis);
+					num_batch = 0;
+				}
+				continue;
+			}
+#endif
+
 			float bsdf_pdf = 0.0f;
 			float3 eval = bsdf_eval(kg, sd, sc, omega_in, &bsdf_pdf);
-			if(bsdf_pdf != 0.0f) {
-				float mis_weight = use_mis? power_heuristic(light_pdf, bsdf_pdf): 1.0f;
-				bsdf_eval_accum(result_eval,
-				                sc->type,
-				                eval * sc->weight,
-				                mis_weight);
-			}
+			_shader_bsdf_multi_eval_branched_accum(result_eval, sc, eval, bsdf_pdf, light_pdf, use_mis);
 		}
 	}
+
+#ifdef __BSDF_SIMD_EVAL__
+	if(num_batch) {
+		shader_bsdf_simd_batch_eval(kg, sd, omega_in, batch, num_batch, batch_eval, batch_pdf);
+		for(int j = 0; j < num_batch; j++)
+			_shader_bsdf_multi_eval_branched_accum(result_eval, batch[j], batch_eval[j], batch_pdf[j], light_pdf, use_mis);
+	}
+#endif
 }
 #endif
 
@@ -1009,6 +1145,8 @@ ccl_device float3 shader_holdout_eval(KernelGlobals *kg, ShaderData *sd)
 ccl_device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd,
 	ccl_addr_space PathState *state, float randb, int path_flag, ShaderContext ctx, ccl_global float *buffer, int sample)
 {
+	PROFILING_INIT(kg, PROFILING_SHADER_EVAL);
+
 	sd->num_closure = 0;
 	sd->num_closure_extra = 0;
 	sd->randb_closure = randb;
@@ -1038,6 +1176,8 @@ ccl_device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd,
 ccl_device float3 shader_eval_background(KernelGlobals *kg, ShaderData *sd,
 	ccl_addr_space PathState *state, int path_flag, ShaderContext ctx, float *buffer, int sample)
 {
+	PROFILING_INIT(kg, PROFILING_SHADER_EVAL);
+
 	sd->num_closure = 0;
 	sd->num_closure_extra = 0;
 	sd->randb_closure = 0.0f;
@@ -1225,6 +1365,8 @@ ccl_device_inline void shader_eval_volume(KernelGlobals *kg,
                                           int path_flag,
                                           ShaderContext ctx)
 {
+	PROFILING_INIT(kg, PROFILING_SHADER_EVAL);
+
 	/* motion blur for volumes */
 	if((kernel_data.cam.shuttertime != -1.0f) && sd->object != OBJECT_NONE) {
 		/* Calling find_attribute every time is probably excessive. This should be cached. */
@@ -1303,6 +1445,8 @@ ccl_device_inline void shader_eval_volume(KernelGlobals *kg,
 
 ccl_device void shader_eval_displacement(KernelGlobals *kg, ShaderData *sd, ccl_addr_space PathState *state, ShaderContext ctx)
 {
+	PROFILING_INIT(kg, PROFILING_SHADER_EVAL);
+
 	sd->num_closure = 0;
 	sd->num_closure_extra = 0;
 	sd->randb_closure = 0.0f;
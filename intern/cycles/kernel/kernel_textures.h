@@ -63,6 +63,11 @@ KERNEL_TEX(float4, texture_float4, __light_distribution)
 KERNEL_TEX(float4, texture_float4, __light_data)
 KERNEL_TEX(float2, texture_float2, __light_background_marginal_cdf)
 KERNEL_TEX(float2, texture_float2, __light_background_conditional_cdf)
+KERNEL_TEX(float4, texture_float4, __light_tree_nodes)
+KERNEL_TEX(float4, texture_float4, __light_tree_emitters)
+KERNEL_TEX(uint4, texture_uint4, __light_tree_objects)
+KERNEL_TEX(uint, texture_uint, __light_tree_triangles)
+KERNEL_TEX(uint, texture_uint, __light_tree_lamps)
 
 /* particles */
 KERNEL_TEX(float4, texture_float4, __particles)
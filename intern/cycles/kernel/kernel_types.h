@@ -43,6 +43,7 @@ CCL_NAMESPACE_BEGIN
 #define OBJECT_SIZE 		17
 #define OBJECT_VECTOR_SIZE	6
 #define LIGHT_SIZE		13
+#define LIGHT_TREE_NODE_SIZE	4
 #define FILTER_TABLE_SIZE	1024
 #define RAMP_TABLE_SIZE		256
 #define SHUTTER_TABLE_SIZE		256
@@ -73,11 +74,17 @@ CCL_NAMESPACE_BEGIN
 #  define WORK_POOL_SIZE WORK_POOL_SIZE_CPU
 #endif
 
+/* Number of camera rays intersected together by packet traversal. */
+#define RAY_PACKET_SIZE 4
+
 /* device capabilities */
 #ifdef __KERNEL_CPU__
 #  ifdef __KERNEL_SSE2__
 #    define __QBVH__
+#    define __RAY_PACKETS__
+#    define __BSDF_SIMD_EVAL__
 #  endif
+#  define __LIGHT_TREE__
 #  define __KERNEL_SHADING__
 #  define __KERNEL_ADV_SHADING__
 #  ifndef __SPLIT_KERNEL__
@@ -243,6 +250,7 @@ CCL_NAMESPACE_BEGIN
 typedef enum ShaderEvalType {
 	SHADER_EVAL_DISPLACE,
 	SHADER_EVAL_BACKGROUND,
+	SHADER_EVAL_VOLUME,
 	/* bake types */
 	SHADER_EVAL_BAKE, /* no real shade, it's used in the code to
 	                   * differentiate the type of shader eval from the above
@@ -614,6 +622,10 @@ typedef struct Ray {
 typedef struct Intersection {
 #ifdef __EMBREE__
 	float3 Ng;
+	/* Micropolygon hits on lazily diced patches, object space smooth normal
+	 * and plane offset along Ng for refining the hit position. */
+	float3 N;
+	float plane;
 #endif
 	float t, u, v;
 	int prim;
@@ -813,13 +825,15 @@ enum ShaderDataShaderFlag {
 	SD_SHADER_USE_UNIFORM_ALPHA_SELF_ONLY = (1 << 13), /* uniform alpha only affect shading self */
 	SD_SHADER_OVERRIDE_SAMPLES			  = (1 << 14), /* override samples */
 	SD_SHADER_OVERRIDE_BOUNCES			  = (1 << 15), /* override bounces*/
+	SD_SHADER_HAS_VOLUME_EMISSION		  = (1 << 16), /* has emission in volume shader */
 
 	SD_SHADER_FLAGS = (SD_SHADER_USE_MIS | SD_SHADER_HAS_TRANSPARENT_SHADOW | SD_SHADER_HAS_VOLUME |
 					   SD_SHADER_HAS_ONLY_VOLUME | SD_SHADER_HETEROGENEOUS_VOLUME |
 					   SD_SHADER_HAS_BSSRDF_BUMP | SD_SHADER_VOLUME_EQUIANGULAR | SD_SHADER_VOLUME_MIS |
 					   SD_SHADER_VOLUME_CUBIC | SD_SHADER_HAS_BUMP | SD_SHADER_HAS_DISPLACEMENT | 
 					   SD_SHADER_HAS_CONSTANT_EMISSION | SD_SHADER_USE_UNIFORM_ALPHA |
-					   SD_SHADER_USE_UNIFORM_ALPHA_SELF_ONLY | SD_SHADER_OVERRIDE_SAMPLES | SD_SHADER_OVERRIDE_BOUNCES)
+					   SD_SHADER_USE_UNIFORM_ALPHA_SELF_ONLY | SD_SHADER_OVERRIDE_SAMPLES | SD_SHADER_OVERRIDE_BOUNCES |
+					   SD_SHADER_HAS_VOLUME_EMISSION)
 };
 
 enum ShaderDataObjectFlag {
@@ -832,10 +846,11 @@ enum ShaderDataObjectFlag {
 	SD_OBJECT_OBJECT_INTERSECTS_VOLUME = (1 << 5),  /* object intersects AABB of an object with volume shader */
 	SD_OBJECT_OBJECT_HAS_VERTEX_MOTION = (1 << 6),  /* has position for motion vertices */
 	SD_OBJECT_OBJECT_SHADOW_CATCHER	   = (1 << 7),  /* object is used to catch shadows */
+	SD_OBJECT_LAZY_DICING			   = (1 << 8),  /* mesh patches are diced on first hit */
 
 	SD_OBJECT_FLAGS = (SD_OBJECT_HOLDOUT_MASK | SD_OBJECT_OBJECT_MOTION | SD_OBJECT_TRANSFORM_APPLIED |
 					   SD_OBJECT_NEGATIVE_SCALE_APPLIED | SD_OBJECT_OBJECT_HAS_VOLUME | SD_OBJECT_OBJECT_INTERSECTS_VOLUME |
-					   SD_OBJECT_OBJECT_HAS_VERTEX_MOTION | SD_OBJECT_OBJECT_SHADOW_CATCHER)
+					   SD_OBJECT_OBJECT_HAS_VERTEX_MOTION | SD_OBJECT_OBJECT_SHADOW_CATCHER | SD_OBJECT_LAZY_DICING)
 
 };
 
@@ -1178,7 +1193,7 @@ typedef struct KernelFilm {
 	float mist_falloff;
 
 	int pass_denoising;
-	int pass_pad0;
+	int pass_adaptive;
 	int pass_pad1;
 	int pass_pad2;
 
@@ -1223,6 +1238,12 @@ typedef struct KernelIntegrator {
 	int num_portals;
 	int portal_offset;
 
+	/* light tree */
+	int use_light_tree;
+	int light_tree_triangle_root;
+	int light_tree_lamp_root;
+	int num_light_tree_lamps;
+
 	/* bounces */
 	int min_bounce;
 	int max_bounce;
@@ -1274,14 +1295,25 @@ typedef struct KernelIntegrator {
 	int volume_max_steps;
 	float volume_step_size;
 	int volume_samples;
+	int volume_skip_empty;
+	int volume_majorant_tracking;
 
 	float light_inv_rr_threshold;
 
 	int start_sample;
-	int pad1, pad2, pad3;
+
+	/* adaptive sampling */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+	int adaptive_step;
+	int pad1, pad2;
 } KernelIntegrator;
 static_assert_align(KernelIntegrator, 16);
 
+#ifdef __EMBREE__
+class LazyDicing;
+#endif
+
 typedef struct KernelBVH {
 	/* root node */
 	int root;
@@ -1291,10 +1323,12 @@ typedef struct KernelBVH {
 	int have_instancing;
 	int use_qbvh;
 	int use_bvh_steps;
-	int pad1;
+	/* Bits of quantized aligned QBVH nodes, 0 if they are not compressed. */
+	int num_compressed_node_bits;
 #ifdef __EMBREE__
 	RTCScene scene;
-	int pad2, pad3;
+	/* Patches of lazily diced meshes, NULL if there are none. */
+	LazyDicing *lazy_dicing;
 #endif
 } KernelBVH;
 static_assert_align(KernelBVH, 16);
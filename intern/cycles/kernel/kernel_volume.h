@@ -194,6 +194,418 @@ ccl_device_inline void kernel_volume_step_init(KernelGlobals *kg,
 	*step_offset = path_state_rng_1D_hash(kg, state, 0x1e31d8a4) * step;
 }
 
+/* Empty Space Skipping
+ *
+ * Sparse voxel textures on the CPU mark tiles near non-empty voxels, which
+ * lets ray marching skip shader evaluation for steps through other tiles of
+ * the density attribute. The tiles of the density also cover the other voxel
+ * attributes of the mesh, see MeshManager::device_update_volume_images(). */
+
+#ifdef __KERNEL_CPU__
+/* Distance along the ray from t over which the volume is empty, or a
+ * negative value when this is unknown for the volumes on the stack. */
+ccl_device float kernel_volume_empty_distance(KernelGlobals *kg,
+                                              ShaderData *sd,
+                                              ccl_addr_space VolumeStack *stack,
+                                              Ray *ray,
+                                              float t)
+{
+	/* Velocity offsets lookups by an unknown amount. */
+	if(kernel_data.cam.shuttertime != -1.0f) {
+		return -1.0f;
+	}
+
+	/* Only a single object volume may overlap t, volumes entered later
+	 * end the empty space. */
+	int object = OBJECT_NONE;
+	float t_limit = ray->t;
+
+	for(int i = 0; stack[i].shader != SHADER_NONE; i++) {
+		if(stack[i].t_exit < t) {
+			continue;
+		}
+		if(stack[i].t_enter > t) {
+			t_limit = min(t_limit, stack[i].t_enter);
+			continue;
+		}
+		if(object != OBJECT_NONE || stack[i].object == OBJECT_NONE) {
+			return -1.0f;
+		}
+		object = stack[i].object;
+	}
+
+	if(object == OBJECT_NONE) {
+		return t_limit - t;
+	}
+
+	sd->object = object;
+#ifdef __OBJECT_MOTION__
+	shader_setup_object_transforms(kg, sd, sd->time);
+#endif
+
+	const AttributeDescriptor desc = find_attribute(kg, sd, ATTR_STD_VOLUME_DENSITY);
+	if(desc.offset == ATTR_STD_NOT_FOUND || desc.element != ATTR_ELEMENT_VOXEL) {
+		return -1.0f;
+	}
+
+	/* Ray in normalized texture coordinates, parametrized the same. */
+	const float3 P = ray->P + t*ray->D;
+	const float3 tex_P = volume_normalized_position(kg, sd, P);
+	const float3 tex_D = volume_normalized_position(kg, sd, P + ray->D) - tex_P;
+
+	return min(kernel_tex_image_sparse_empty_distance(kg, desc.offset, tex_P, tex_D),
+	           t_limit - t);
+}
+#endif
+
+ccl_device_inline float kernel_volume_empty_init(KernelGlobals *kg)
+{
+#ifdef __KERNEL_CPU__
+	return (kernel_data.integrator.volume_skip_empty)? 0.0f: -1.0f;
+#else
+	return -1.0f;
+#endif
+}
+
+/* Test if the step from t to new_t is in empty space. empty_t is the end of
+ * the empty space found so far, or negative when skipping is not possible. */
+ccl_device_inline bool kernel_volume_step_is_empty(KernelGlobals *kg,
+                                                   ShaderData *sd,
+                                                   ccl_addr_space PathState *state,
+                                                   Ray *ray,
+                                                   float t,
+                                                   float new_t,
+                                                   float *empty_t)
+{
+#ifdef __KERNEL_CPU__
+	if(*empty_t >= 0.0f && t >= *empty_t) {
+		float distance = kernel_volume_empty_distance(kg, sd, state->volume_stack, ray, t);
+		*empty_t = (distance < 0.0f)? -1.0f: t + distance;
+	}
+
+	return new_t <= *empty_t;
+#else
+	return false;
+#endif
+}
+
+/* Majorant Tracking
+ *
+ * Sparse density images on the CPU have an upper bound of the extinction of
+ * the volume shader for every tile, see
+ * MeshManager::device_update_volume_majorants(). Where a single object volume
+ * with such a density is on the stack, collisions are sampled against the
+ * bound of the tile the ray is in, instead of marching with a fixed step
+ * size. Tiles with a zero bound are crossed without any shader evaluation.
+ *
+ * Shadows use ratio tracking and distance sampling uses weighted delta
+ * tracking [Novák et al. 2014, Kutz et al. 2017]. Where the bound is
+ * exceeded, null collisions are clamped to zero weight like delta tracking
+ * does. */
+
+#ifdef __KERNEL_CPU__
+typedef struct VolumeMajorantTracker {
+	const float *majorant;
+	int grid_size[3];
+
+	/* Current tile, and ray parameter where the ray leaves it per axis. */
+	int tile[3];
+	int step[3];
+	float t_next[3];
+	float t_delta[3];
+
+	/* Position along the ray and end of the segment inside the volume. */
+	float t;
+	float t_end;
+} VolumeMajorantTracker;
+
+/* Once the ray leaves the grid on an axis, clamped lookups do not change
+ * anymore when crossing tiles along it. */
+ccl_device_inline void kernel_volume_majorant_clamp_axis(VolumeMajorantTracker *tracker, int axis)
+{
+	if((tracker->step[axis] < 0 && tracker->tile[axis] < 0) ||
+	   (tracker->step[axis] > 0 && tracker->tile[axis] >= tracker->grid_size[axis]))
+	{
+		tracker->t_next[axis] = FLT_MAX;
+	}
+}
+
+ccl_device bool kernel_volume_majorant_init(KernelGlobals *kg,
+                                            ShaderData *sd,
+                                            ccl_addr_space PathState *state,
+                                            Ray *ray,
+                                            VolumeMajorantTracker *tracker)
+{
+	if(!kernel_data.integrator.volume_majorant_tracking) {
+		return false;
+	}
+
+	/* Velocity offsets lookups by an unknown amount. */
+	if(kernel_data.cam.shuttertime != -1.0f) {
+		return false;
+	}
+
+	ccl_addr_space VolumeStack *stack = state->volume_stack;
+	if(stack[0].shader == SHADER_NONE ||
+	   stack[0].object == OBJECT_NONE ||
+	   stack[1].shader != SHADER_NONE)
+	{
+		return false;
+	}
+
+	sd->object = stack[0].object;
+#ifdef __OBJECT_MOTION__
+	shader_setup_object_transforms(kg, sd, sd->time);
+#endif
+
+	const AttributeDescriptor desc = find_attribute(kg, sd, ATTR_STD_VOLUME_DENSITY);
+	if(desc.offset == ATTR_STD_NOT_FOUND || desc.element != ATTR_ELEMENT_VOXEL) {
+		return false;
+	}
+
+	float3 tile_scale;
+	int3 grid_size;
+	tracker->majorant = kernel_tex_image_majorant(kg, desc.offset, &tile_scale, &grid_size);
+	if(!tracker->majorant) {
+		return false;
+	}
+
+	tracker->grid_size[0] = grid_size.x;
+	tracker->grid_size[1] = grid_size.y;
+	tracker->grid_size[2] = grid_size.z;
+	tracker->t = max(stack[0].t_enter, 0.0f);
+	tracker->t_end = min(stack[0].t_exit, ray->t);
+
+	/* Ray in units of tiles, parametrized the same. */
+	const float3 tex_P = volume_normalized_position(kg, sd, ray->P);
+	const float3 tex_D = volume_normalized_position(kg, sd, ray->P + ray->D) - tex_P;
+	const float3 tile_P = (tex_P + tracker->t*tex_D)*tile_scale;
+	const float3 tile_D = tex_D*tile_scale;
+	const float P[3] = {tile_P.x, tile_P.y, tile_P.z};
+	const float D[3] = {tile_D.x, tile_D.y, tile_D.z};
+
+	for(int axis = 0; axis < 3; axis++) {
+		const float tile = floorf(P[axis]);
+		tracker->tile[axis] = (int)tile;
+
+		if(D[axis] > 0.0f) {
+			tracker->step[axis] = 1;
+			tracker->t_next[axis] = tracker->t + (tile + 1.0f - P[axis])/D[axis];
+			tracker->t_delta[axis] = 1.0f/D[axis];
+		}
+		else if(D[axis] < 0.0f) {
+			tracker->step[axis] = -1;
+			tracker->t_next[axis] = tracker->t + (tile - P[axis])/D[axis];
+			tracker->t_delta[axis] = -1.0f/D[axis];
+		}
+		else {
+			tracker->step[axis] = 0;
+			tracker->t_next[axis] = FLT_MAX;
+			tracker->t_delta[axis] = FLT_MAX;
+		}
+
+		kernel_volume_majorant_clamp_axis(tracker, axis);
+	}
+
+	return true;
+}
+
+/* Advance to the next tentative collision, for an optical depth tau sampled
+ * from an exponential distribution. Tiles outside the grid are clamped to
+ * the border. Returns false when the end of the segment is reached. */
+ccl_device bool kernel_volume_majorant_step(VolumeMajorantTracker *tracker,
+                                            float tau,
+                                            float *majorant)
+{
+	while(tracker->t < tracker->t_end) {
+		const int x = clamp(tracker->tile[0], 0, tracker->grid_size[0] - 1);
+		const int y = clamp(tracker->tile[1], 0, tracker->grid_size[1] - 1);
+		const int z = clamp(tracker->tile[2], 0, tracker->grid_size[2] - 1);
+		const float mu = tracker->majorant[x + (y + z*tracker->grid_size[1])*tracker->grid_size[0]];
+
+		const int axis = (tracker->t_next[0] < tracker->t_next[1])?
+			((tracker->t_next[0] < tracker->t_next[2])? 0: 2):
+			((tracker->t_next[1] < tracker->t_next[2])? 1: 2);
+		const float t_exit = min(tracker->t_next[axis], tracker->t_end);
+		const float tau_tile = mu*(t_exit - tracker->t);
+
+		if(tau < tau_tile) {
+			tracker->t += tau/mu;
+			*majorant = mu;
+			return true;
+		}
+
+		tau -= tau_tile;
+		tracker->t = t_exit;
+		tracker->tile[axis] += tracker->step[axis];
+		tracker->t_next[axis] += tracker->t_delta[axis];
+		kernel_volume_majorant_clamp_axis(tracker, axis);
+	}
+
+	return false;
+}
+
+/* Throughput below this fraction of the initial one is Russian rouletted. */
+#define VOLUME_MAJORANT_RR_THRESHOLD 0.05f
+
+/* Russian roulette after a collision, instead of stopping at a low throughput
+ * or at the step limit which would bias the estimate. Past the step limit
+ * every collision survives with probability one half, so very dense volumes
+ * still terminate quickly. Returns false when the path is terminated. */
+ccl_device_inline bool kernel_volume_majorant_russian_roulette(float3 *tp,
+                                                              float tp_rr,
+                                                              int step,
+                                                              int max_steps,
+                                                              uint *lcg_state)
+{
+	float survive = (tp_rr > 0.0f)? min(max3(*tp)/tp_rr, 1.0f): 1.0f;
+	if(step >= max_steps) {
+		survive *= 0.5f;
+	}
+
+	if(survive < 1.0f) {
+		if(!(lcg_step_float(lcg_state) < survive)) {
+			*tp = make_float3(0.0f, 0.0f, 0.0f);
+			return false;
+		}
+		*tp /= survive;
+	}
+
+	return true;
+}
+
+/* Ratio tracking of the transmittance along the shadow ray, returns false
+ * when the volumes on the stack are not supported. */
+ccl_device bool kernel_volume_shadow_majorant(KernelGlobals *kg,
+                                              ccl_addr_space PathState *state,
+                                              Ray *ray,
+                                              ShaderData *sd,
+                                              float3 *throughput)
+{
+	VolumeMajorantTracker tracker;
+	if(!kernel_volume_majorant_init(kg, sd, state, ray, &tracker)) {
+		return false;
+	}
+
+	float3 tp = *throughput;
+	const float tp_rr = VOLUME_MAJORANT_RR_THRESHOLD*max3(tp);
+	const int max_steps = kernel_data.integrator.volume_max_steps;
+
+	/* Transparent shadows track multiple segments for the same path state,
+	 * decorrelate them by their start position. */
+	uint lcg_state = lcg_state_init(state, 0x2c9277b5) ^
+	                 __float_as_uint(ray->P.x + ray->P.y + ray->P.z);
+
+	for(int i = 0;; i++) {
+		float mu;
+		const float xi = lcg_step_float(&lcg_state);
+		if(!kernel_volume_majorant_step(&tracker, -logf(1.0f - xi), &mu)) {
+			break;
+		}
+
+		float3 sigma_t;
+		sd->ray_length = tracker.t;
+		if(volume_shader_extinction_sample(kg, sd, state, ray->P + tracker.t*ray->D, &sigma_t)) {
+			/* Clamped where the majorant is exceeded, so the rest of the
+			 * path never sees negative throughput. */
+			tp *= max(make_float3(1.0f, 1.0f, 1.0f) - sigma_t*(1.0f/mu),
+			          make_float3(0.0f, 0.0f, 0.0f));
+		}
+
+		if(!kernel_volume_majorant_russian_roulette(&tp, tp_rr, i, max_steps, &lcg_state)) {
+			break;
+		}
+	}
+
+	*throughput = tp;
+	return true;
+}
+
+/* Weighted delta tracking for distance sampling, returns false when the
+ * volumes on the stack are not supported. Emission needs to be integrated
+ * along the whole ray, which is left to ray marching. */
+ccl_device bool kernel_volume_integrate_majorant(KernelGlobals *kg,
+                                                 ccl_addr_space PathState *state,
+                                                 Ray *ray,
+                                                 ShaderData *sd,
+                                                 ccl_addr_space float3 *throughput,
+                                                 VolumeIntegrateResult *result)
+{
+	VolumeMajorantTracker tracker;
+	if(!kernel_volume_majorant_init(kg, sd, state, ray, &tracker)) {
+		return false;
+	}
+
+	const int shader = state->volume_stack[0].shader;
+	if(kernel_tex_fetch(__shader_flag, (shader & SHADER_MASK)*SHADER_SIZE) & SD_SHADER_HAS_VOLUME_EMISSION) {
+		return false;
+	}
+
+	float3 tp = *throughput;
+	const float tp_rr = VOLUME_MAJORANT_RR_THRESHOLD*max3(tp);
+	const int max_steps = kernel_data.integrator.volume_max_steps;
+
+	/* First collision is stratified, further ones use a random sequence. */
+	float xi = path_state_rng_1D_for_decision(kg, state, PRNG_SCATTER_DISTANCE);
+	sd->randb_closure = path_state_rng_1D_for_decision(kg, state, PRNG_PHASE);
+	uint lcg_state = lcg_state_init(state, 0x6d0a4c19);
+
+	*result = VOLUME_PATH_ATTENUATED;
+
+	for(int i = 0;; i++) {
+		float mu;
+		if(!kernel_volume_majorant_step(&tracker, -logf(1.0f - xi), &mu)) {
+			break;
+		}
+		xi = lcg_step_float(&lcg_state);
+
+		/* without closures the collision is a null collision of weight one */
+		const float3 P = ray->P + tracker.t*ray->D;
+		VolumeShaderCoefficients coeff;
+		sd->ray_length = tracker.t;
+		if(!volume_shader_sample(kg, sd, state, P, &coeff)) {
+			if(!kernel_volume_majorant_russian_roulette(&tp, tp_rr, i, max_steps, &lcg_state)) {
+				break;
+			}
+			continue;
+		}
+
+		/* Choose between scattering and a null collision proportional to
+		 * the weighted coefficients, absorption only reduces the weight.
+		 * The null coefficient is clamped where the majorant is exceeded,
+		 * so the throughput stays positive. */
+		const float3 sigma_s = coeff.sigma_s;
+		const float3 sigma_n = max(make_float3(mu, mu, mu) - coeff.sigma_a - coeff.sigma_s,
+		                           make_float3(0.0f, 0.0f, 0.0f));
+		const float scatter_weight = average(tp*sigma_s);
+		const float null_weight = average(tp*sigma_n);
+
+		if(scatter_weight + null_weight <= 0.0f) {
+			tp = make_float3(0.0f, 0.0f, 0.0f);
+			break;
+		}
+
+		const float scatter_pdf = scatter_weight/(scatter_weight + null_weight);
+
+		if(lcg_step_float(&lcg_state) < scatter_pdf) {
+			tp *= sigma_s*(1.0f/(mu*scatter_pdf));
+			sd->P = P;
+			*result = VOLUME_PATH_SCATTERED;
+			break;
+		}
+
+		tp *= sigma_n*(1.0f/(mu*(1.0f - scatter_pdf)));
+
+		if(!kernel_volume_majorant_russian_roulette(&tp, tp_rr, i, max_steps, &lcg_state)) {
+			break;
+		}
+	}
+
+	*throughput = tp;
+	return true;
+}
+#endif
+
 /* Volume Shadows
  *
  * These functions are used to attenuate shadow rays to lights. Both absorption
@@ -221,6 +633,12 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg,
                                                    ShaderData *sd,
                                                    float3 *throughput)
 {
+#ifdef __KERNEL_CPU__
+	if(kernel_volume_shadow_majorant(kg, state, ray, sd, throughput)) {
+		return;
+	}
+#endif
+
 	float3 tp = *throughput;
 	const float tp_eps = 1e-6f; /* todo: this is likely not the right value */
 
@@ -231,6 +649,7 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg,
 
 	/* compute extinction at the start */
 	float t = 0.0f;
+	float empty_t = kernel_volume_empty_init(kg);
 
 	float3 sum = make_float3(0.0f, 0.0f, 0.0f);
 
@@ -249,7 +668,9 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg,
 
 		/* compute attenuation over segment */
 		sd->ray_length = t + step_offset;
-		if(volume_shader_extinction_sample(kg, sd, state, new_P, &sigma_t)) {
+		if(!kernel_volume_step_is_empty(kg, sd, state, ray, t, new_t, &empty_t) &&
+		   volume_shader_extinction_sample(kg, sd, state, new_P, &sigma_t))
+		{
 			/* Compute expf() only for every Nth step, to save some calculations
 			 * because exp(a)*exp(b) = exp(a+b), also do a quick tp_eps check then. */
 
@@ -283,6 +704,8 @@ ccl_device_noinline void kernel_volume_shadow(KernelGlobals *kg,
                                               Ray *ray,
                                               float3 *throughput)
 {
+	PROFILING_INIT(kg, PROFILING_VOLUME);
+
 	shader_setup_from_volume(kg, shadow_sd, ray);
 
 	if(volume_stack_is_heterogeneous(kg, state->volume_stack))
@@ -512,6 +935,13 @@ ccl_device VolumeIntegrateResult kernel_volume_integrate_heterogeneous_distance(
     PathRadiance *L,
     ccl_addr_space float3 *throughput)
 {
+#ifdef __KERNEL_CPU__
+	VolumeIntegrateResult result;
+	if(kernel_volume_integrate_majorant(kg, state, ray, sd, throughput, &result)) {
+		return result;
+	}
+#endif
+
 	float3 tp = *throughput;
 	const float tp_eps = 1e-6f; /* todo: this is likely not the right value */
 
@@ -522,6 +952,7 @@ ccl_device VolumeIntegrateResult kernel_volume_integrate_heterogeneous_distance(
 
 	/* compute coefficients at the start */
 	float t = 0.0f;
+	float empty_t = kernel_volume_empty_init(kg);
 	float3 accum_transmittance = make_float3(1.0f, 1.0f, 1.0f);
 
 	/* pick random color channel, we use the Veach one-sample
@@ -548,7 +979,9 @@ ccl_device VolumeIntegrateResult kernel_volume_integrate_heterogeneous_distance(
 
 		/* compute segment */
 		sd->ray_length = t + step_offset;
-		if(volume_shader_sample(kg, sd, state, new_P, &coeff)) {
+		if(!kernel_volume_step_is_empty(kg, sd, state, ray, t, new_t, &empty_t) &&
+		   volume_shader_sample(kg, sd, state, new_P, &coeff))
+		{
 			int closure_flag = sd->runtime_flag;
 			float3 new_tp;
 			float3 transmittance;
@@ -656,6 +1089,8 @@ ccl_device_noinline VolumeIntegrateResult kernel_volume_integrate(
     ccl_addr_space float3 *throughput,
     bool heterogeneous)
 {
+	PROFILING_INIT(kg, PROFILING_VOLUME);
+
 	shader_setup_from_volume(kg, sd, ray);
 
 	if(heterogeneous)
@@ -706,6 +1141,8 @@ typedef struct VolumeSegment {
 ccl_device void kernel_volume_decoupled_record(KernelGlobals *kg, PathState *state,
 	Ray *ray, ShaderData *sd, VolumeSegment *segment, bool heterogeneous)
 {
+	PROFILING_INIT(kg, PROFILING_VOLUME);
+
 	const float tp_eps = 1e-6f; /* todo: this is likely not the right value */
 
 	/* prepare for volume stepping */
@@ -752,6 +1189,7 @@ ccl_device void kernel_volume_decoupled_record(KernelGlobals *kg, PathState *sta
 	float3 accum_transmittance = make_float3(1.0f, 1.0f, 1.0f);
 	float3 cdf_distance = make_float3(0.0f, 0.0f, 0.0f);
 	float t = 0.0f;
+	float empty_t = kernel_volume_empty_init(kg);
 
 	segment->numsteps = 0;
 	segment->closure_flag = 0;
@@ -775,7 +1213,9 @@ ccl_device void kernel_volume_decoupled_record(KernelGlobals *kg, PathState *sta
 
 		/* compute segment */
 		sd->ray_length = t + step_offset;
-		if(volume_shader_sample(kg, sd, state, new_P, &coeff)) {
+		if(!kernel_volume_step_is_empty(kg, sd, state, ray, t, new_t, &empty_t) &&
+		   volume_shader_sample(kg, sd, state, new_P, &coeff))
+		{
 			int closure_flag = sd->runtime_flag;
 			float3 sigma_t = coeff.sigma_a + coeff.sigma_s;
 
@@ -877,6 +1317,8 @@ ccl_device VolumeIntegrateResult kernel_volume_decoupled_scatter(
 	float3 *throughput, float rphase, float rscatter,
 	const VolumeSegment *segment, const float3 *light_P, bool probalistic_scatter)
 {
+	PROFILING_INIT(kg, PROFILING_VOLUME);
+
 	kernel_assert(segment->closure_flag & SD_RUNTIME_SCATTER);
 
 	/* pick random color channel, we use the Veach one-sample
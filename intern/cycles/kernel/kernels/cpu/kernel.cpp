@@ -92,6 +92,38 @@ void kernel_tex_copy(KernelGlobals *kg,
 #define KERNEL_IMAGE_TEX(type, ttype, tname)
 #include "kernel/kernel_textures.h"
 
+	else if(strstr(name, "__tex_majorant_float4")) {
+		int id = atoi(name + strlen("__tex_majorant_float4_"));
+		int array_index = kernel_tex_index(id);
+
+		if(array_index >= 0 && array_index < kg->texture_float4_images.size()) {
+			kg->texture_float4_images[array_index].majorant_set((float*)mem);
+		}
+	}
+	else if(strstr(name, "__tex_majorant_float")) {
+		int id = atoi(name + strlen("__tex_majorant_float_"));
+		int array_index = kernel_tex_index(id);
+
+		if(array_index >= 0 && array_index < kg->texture_float_images.size()) {
+			kg->texture_float_images[array_index].majorant_set((float*)mem);
+		}
+	}
+	else if(strstr(name, "__tex_grid_float4")) {
+		int id = atoi(name + strlen("__tex_grid_float4_"));
+		int array_index = kernel_tex_index(id);
+
+		if(array_index >= 0 && array_index < kg->texture_float4_images.size()) {
+			kg->texture_float4_images[array_index].grid_set((int*)mem, width, height, depth);
+		}
+	}
+	else if(strstr(name, "__tex_grid_float")) {
+		int id = atoi(name + strlen("__tex_grid_float_"));
+		int array_index = kernel_tex_index(id);
+
+		if(array_index >= 0 && array_index < kg->texture_float_images.size()) {
+			kg->texture_float_images[array_index].grid_set((int*)mem, width, height, depth);
+		}
+	}
 	else if(strstr(name, "__tex_image_float4")) {
 		texture_image_float4 *tex = NULL;
 		int id = atoi(name + strlen("__tex_image_float4_"));
@@ -106,6 +138,8 @@ void kernel_tex_copy(KernelGlobals *kg,
 		if(tex) {
 			tex->data = (float4*)mem;
 			tex->dimensions_set(width, height, depth);
+			tex->grid_set(NULL, 0, 0, 0);
+			tex->majorant_set(NULL);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
 		}
@@ -124,6 +158,8 @@ void kernel_tex_copy(KernelGlobals *kg,
 		if(tex) {
 			tex->data = (float*)mem;
 			tex->dimensions_set(width, height, depth);
+			tex->grid_set(NULL, 0, 0, 0);
+			tex->majorant_set(NULL);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
 		}
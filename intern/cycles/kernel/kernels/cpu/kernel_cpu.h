@@ -24,6 +24,36 @@ void KERNEL_FUNCTION_FULL_NAME(path_trace)(KernelGlobals *kg,
                                            int offset,
                                            int stride);
 
+void KERNEL_FUNCTION_FULL_NAME(path_trace_packet)(KernelGlobals *kg,
+                                                  float *buffer,
+                                                  unsigned int *rng_state,
+                                                  int sample,
+                                                  int x, int y,
+                                                  int num,
+                                                  int offset,
+                                                  int stride);
+
+bool KERNEL_FUNCTION_FULL_NAME(adaptive_check_convergence)(KernelGlobals *kg,
+                                                           float *buffer,
+                                                           int x, int y,
+                                                           int sample,
+                                                           int offset,
+                                                           int stride);
+
+void KERNEL_FUNCTION_FULL_NAME(adaptive_mark_converged)(KernelGlobals *kg,
+                                                        float *buffer,
+                                                        int x, int y,
+                                                        int sample,
+                                                        int offset,
+                                                        int stride);
+
+void KERNEL_FUNCTION_FULL_NAME(adaptive_post_adjust)(KernelGlobals *kg,
+                                                     float *buffer,
+                                                     int x, int y,
+                                                     int num_samples,
+                                                     int offset,
+                                                     int stride);
+
 void KERNEL_FUNCTION_FULL_NAME(convert_to_byte)(KernelGlobals *kg,
                                                 uchar4 *rgba,
                                                 float *buffer,
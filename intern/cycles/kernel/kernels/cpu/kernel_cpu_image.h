@@ -90,6 +90,34 @@ ccl_device float4 kernel_tex_image_interp_3d_ex_impl(KernelGlobals *kg, int tex,
 	}
 }
 
+/* Only float images are stored sparse, see ImageManager::device_make_sparse(). */
+ccl_device float kernel_tex_image_sparse_empty_distance(KernelGlobals *kg, int tex, float3 P, float3 D)
+{
+	switch(kernel_tex_type(tex)) {
+		case IMAGE_DATA_TYPE_FLOAT:
+			return kg->texture_float_images[kernel_tex_index(tex)].sparse_empty_distance(P, D);
+		case IMAGE_DATA_TYPE_FLOAT4:
+			return kg->texture_float4_images[kernel_tex_index(tex)].sparse_empty_distance(P, D);
+		default:
+			return 0.0f;
+	}
+}
+
+ccl_device const float *kernel_tex_image_majorant(KernelGlobals *kg,
+                                                  int tex,
+                                                  float3 *tile_scale,
+                                                  int3 *grid_size)
+{
+	switch(kernel_tex_type(tex)) {
+		case IMAGE_DATA_TYPE_FLOAT:
+			return kg->texture_float_images[kernel_tex_index(tex)].sparse_majorant(tile_scale, grid_size);
+		case IMAGE_DATA_TYPE_FLOAT4:
+			return kg->texture_float4_images[kernel_tex_index(tex)].sparse_majorant(tile_scale, grid_size);
+		default:
+			return NULL;
+	}
+}
+
 CCL_NAMESPACE_END
 
 #endif  // __KERNEL_CPU__
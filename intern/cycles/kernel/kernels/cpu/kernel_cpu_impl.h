@@ -31,6 +31,7 @@
 
 #  include "kernel/kernels/cpu/kernel_cpu_image.h"
 #  include "kernel/kernel_film.h"
+#  include "kernel/kernel_adaptive_sampling.h"
 #  include "kernel/kernel_path.h"
 #  include "kernel/kernel_path_branched.h"
 #  include "kernel/kernel_bake.h"
@@ -86,6 +87,78 @@ void KERNEL_FUNCTION_FULL_NAME(path_trace)(KernelGlobals *kg,
 	}
 }
 
+/* Path tracing of a row of num pixels, starting at x. Camera rays of these
+ * pixels are intersected together when supported by the kernel. */
+void KERNEL_FUNCTION_FULL_NAME(path_trace_packet)(KernelGlobals *kg,
+                                                  float *buffer,
+                                                  unsigned int *rng_state,
+                                                  int sample,
+                                                  int x, int y,
+                                                  int num,
+                                                  int offset,
+                                                  int stride)
+{
+#ifdef __RAY_PACKETS__
+#  ifdef __BRANCHED_PATH__
+	if(!kernel_data.integrator.branched)
+#  endif
+	{
+		kernel_path_trace_packet(kg, buffer, rng_state, sample, x, y, num, offset, stride);
+		return;
+	}
+#endif
+	for(int i = 0; i < num; i++) {
+		KERNEL_FUNCTION_FULL_NAME(path_trace)(kg,
+		                                      buffer,
+		                                      rng_state,
+		                                      sample,
+		                                      x + i, y,
+		                                      offset,
+		                                      stride);
+	}
+}
+
+/* Adaptive Sampling */
+
+bool KERNEL_FUNCTION_FULL_NAME(adaptive_check_convergence)(KernelGlobals *kg,
+                                                           float *buffer,
+                                                           int x, int y,
+                                                           int sample,
+                                                           int offset,
+                                                           int stride)
+{
+	int index = offset + x + y*stride;
+	return kernel_adaptive_check_convergence(kg,
+	                                         buffer + index*kernel_data.film.pass_stride,
+	                                         sample);
+}
+
+void KERNEL_FUNCTION_FULL_NAME(adaptive_mark_converged)(KernelGlobals *kg,
+                                                        float *buffer,
+                                                        int x, int y,
+                                                        int sample,
+                                                        int offset,
+                                                        int stride)
+{
+	int index = offset + x + y*stride;
+	kernel_adaptive_mark_converged(kg,
+	                               buffer + index*kernel_data.film.pass_stride,
+	                               sample);
+}
+
+void KERNEL_FUNCTION_FULL_NAME(adaptive_post_adjust)(KernelGlobals *kg,
+                                                     float *buffer,
+                                                     int x, int y,
+                                                     int num_samples,
+                                                     int offset,
+                                                     int stride)
+{
+	int index = offset + x + y*stride;
+	kernel_adaptive_post_adjust(kg,
+	                            buffer + index*kernel_data.film.pass_stride,
+	                            num_samples);
+}
+
 /* Film */
 
 void KERNEL_FUNCTION_FULL_NAME(convert_to_byte)(KernelGlobals *kg,
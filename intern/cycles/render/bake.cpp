@@ -17,20 +17,16 @@
 #include "render/bake.h"
 #include "render/integrator.h"
 
+#include "util/util_algorithm.h"
+
 CCL_NAMESPACE_BEGIN
 
 BakeData::BakeData(const int object, const size_t tri_offset, const size_t num_pixels):
 m_object(object),
 m_tri_offset(tri_offset),
-m_num_pixels(num_pixels)
+m_num_pixels(0)
 {
-	m_primitive.resize(num_pixels);
-	m_u.resize(num_pixels);
-	m_v.resize(num_pixels);
-	m_dudx.resize(num_pixels);
-	m_dudy.resize(num_pixels);
-	m_dvdx.resize(num_pixels);
-	m_dvdy.resize(num_pixels);
+	resize(num_pixels);
 }
 
 BakeData::~BakeData()
@@ -44,6 +40,18 @@ BakeData::~BakeData()
 	m_dvdy.clear();
 }
 
+void BakeData::resize(const size_t num_pixels)
+{
+	m_num_pixels = num_pixels;
+	m_primitive.resize(num_pixels);
+	m_u.resize(num_pixels);
+	m_v.resize(num_pixels);
+	m_dudx.resize(num_pixels);
+	m_dudy.resize(num_pixels);
+	m_dvdx.resize(num_pixels);
+	m_dvdy.resize(num_pixels);
+}
+
 void BakeData::set(int i, int prim, float uv[2], float dudx, float dudy, float dvdx, float dvdy)
 {
 	m_primitive[i] = (prim == -1 ? -1 : m_tri_offset + prim);
@@ -97,7 +105,6 @@ uint4 BakeData::differentials(int i)
 
 BakeManager::BakeManager()
 {
-	m_bake_data = NULL;
 	m_is_baking = false;
 	need_update = true;
 	m_shader_limit = 512 * 512;
@@ -105,8 +112,6 @@ BakeManager::BakeManager()
 
 BakeManager::~BakeManager()
 {
-	if(m_bake_data)
-		delete m_bake_data;
 }
 
 bool BakeManager::get_baking()
@@ -119,58 +124,56 @@ void BakeManager::set_baking(const bool value)
 	m_is_baking = value;
 }
 
-BakeData *BakeManager::init(const int object, const size_t tri_offset, const size_t num_pixels)
-{
-	m_bake_data = new BakeData(object, tri_offset, num_pixels);
-	return m_bake_data;
-}
-
 void BakeManager::set_shader_limit(const size_t x, const size_t y)
 {
 	m_shader_limit = x * y;
 	m_shader_limit = (size_t)pow(2, ceil(log(m_shader_limit)/log(2)));
 }
 
-bool BakeManager::bake(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress, ShaderEvalType shader_type, const int pass_filter, BakeData *bake_data, float result[])
+bool BakeManager::bake(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress, ShaderEvalType shader_type, const int pass_filter, const int object, const size_t tri_offset, const size_t num_pixels, float result[])
 {
-	size_t num_pixels = bake_data->size();
-
 	int num_samples = is_aa_pass(shader_type)? scene->integrator->aa_samples : 1;
 
 	/* calculate the total pixel samples for the progress bar */
-	total_pixel_samples = 0;
-	for(size_t shader_offset = 0; shader_offset < num_pixels; shader_offset += m_shader_limit) {
-		size_t shader_size = (size_t)fminf(num_pixels - shader_offset, m_shader_limit);
-		total_pixel_samples += shader_size * num_samples;
-	}
+	total_pixel_samples = num_pixels * num_samples;
 	progress.reset_sample();
 	progress.set_total_pixel_samples(total_pixel_samples);
 
-	for(size_t shader_offset = 0; shader_offset < num_pixels; shader_offset += m_shader_limit) {
-		size_t shader_size = (size_t)fminf(num_pixels - shader_offset, m_shader_limit);
+	if(num_pixels == 0) {
+		m_is_baking = false;
+		return false;
+	}
+
+	/* needs to be up to data for attribute access */
+	device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
+
+	/* Tiles are double buffered, bake data of the next tile is populated on
+	 * the host while the device shades the current one. */
+	const size_t num_tiles = (num_pixels + m_shader_limit - 1) / m_shader_limit;
+	BakeData tile_data[2] = {BakeData(object, tri_offset, 0),
+	                         BakeData(object, tri_offset, 0)};
+
+	tile_data[0].resize(min(m_shader_limit, num_pixels));
+	populate_tile_cb(&tile_data[0], 0);
+
+	for(size_t tile = 0; tile < num_tiles; tile++) {
+		BakeData& bake_data = tile_data[tile % 2];
+		size_t shader_offset = tile * m_shader_limit;
+		size_t shader_size = bake_data.size();
 
 		/* setup input for device task */
 		device_vector<uint4> d_input;
 		uint4 *d_input_data = d_input.resize(shader_size * 2);
-		size_t d_input_size = 0;
 
-		for(size_t i = shader_offset; i < (shader_offset + shader_size); i++) {
-			d_input_data[d_input_size++] = bake_data->data(i);
-			d_input_data[d_input_size++] = bake_data->differentials(i);
-		}
-
-		if(d_input_size == 0) {
-			m_is_baking = false;
-			return false;
+		for(size_t i = 0; i < shader_size; i++) {
+			d_input_data[i * 2] = bake_data.data(i);
+			d_input_data[i * 2 + 1] = bake_data.differentials(i);
 		}
 
 		/* run device task */
 		device_vector<float4> d_output;
 		d_output.resize(shader_size);
 
-		/* needs to be up to data for attribute access */
-		device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
-
 		device->mem_alloc("bake_input", d_input, MEM_READ_ONLY);
 		device->mem_copy_to(d_input);
 		device->mem_alloc("bake_output", d_output, MEM_READ_WRITE);
@@ -188,6 +191,16 @@ bool BakeManager::bake(Device *device, DeviceScene *dscene, Scene *scene, Progre
 		task.update_progress_sample = function_bind(&Progress::add_samples_update, &progress, _1, _2);
 
 		device->task_add(task);
+
+		/* stream in the next tile while this one is being shaded */
+		if(tile + 1 < num_tiles) {
+			size_t next_offset = shader_offset + m_shader_limit;
+			BakeData& next_data = tile_data[(tile + 1) % 2];
+
+			next_data.resize(min(m_shader_limit, num_pixels - next_offset));
+			populate_tile_cb(&next_data, next_offset);
+		}
+
 		device->task_wait();
 
 		if(progress.get_cancel()) {
@@ -201,19 +214,17 @@ bool BakeManager::bake(Device *device, DeviceScene *dscene, Scene *scene, Progre
 		device->mem_free(d_input);
 		device->mem_free(d_output);
 
-		/* read result */
-		int k = 0;
-
-		float4 *offset = (float4*)d_output.data_pointer;
+		/* write completed tile to the result */
+		float4 *output = (float4*)d_output.data_pointer;
 
 		size_t depth = 4;
-		for(size_t i=shader_offset; i < (shader_offset + shader_size); i++) {
-			size_t index = i * depth;
-			float4 out = offset[k++];
+		for(size_t i = 0; i < shader_size; i++) {
+			if(bake_data.is_valid(i)) {
+				float *pixel = result + (shader_offset + i) * depth;
+				float4 out = output[i];
 
-			if(bake_data->is_valid(i)) {
-				for(size_t j=0; j < 4; j++) {
-					result[index + j] = out[j];
+				for(size_t j = 0; j < depth; j++) {
+					pixel[j] = out[j];
 				}
 			}
 		}
@@ -20,16 +20,22 @@
 #include "device/device.h"
 #include "render/scene.h"
 
+#include "util/util_function.h"
 #include "util/util_progress.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Bake Data
+ *
+ * Primitive and UV coordinates of the pixels of one bake tile. */
+
 class BakeData {
 public:
 	BakeData(const int object, const size_t tri_offset, const size_t num_pixels);
 	~BakeData();
 
+	void resize(const size_t num_pixels);
 	void set(int i, int prim, float uv[2], float dudx, float dudy, float dvdx, float dvdy);
 	void set_null(int i);
 	int object();
@@ -59,11 +65,17 @@ public:
 	bool get_baking();
 	void set_baking(const bool value);
 
-	BakeData *init(const int object, const size_t tri_offset, const size_t num_pixels);
-
 	void set_shader_limit(const size_t x, const size_t y);
 
-	bool bake(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress, ShaderEvalType shader_type, const int pass_filter, BakeData *bake_data, float result[]);
+	/* Bake num_pixels pixels in tiles of the shader limit size. Bake data of
+	 * each tile is streamed in by the populate callback while the previous
+	 * tile is shaded, and completed tiles are written to the result right
+	 * away, so bake data of no more than two tiles is kept in memory. */
+	bool bake(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress, ShaderEvalType shader_type, const int pass_filter, const int object, const size_t tri_offset, const size_t num_pixels, float result[]);
+
+	/* Fill in bake data of the tile starting at the pixel offset, called for
+	 * tiles in order of their offset. */
+	function<void(BakeData *data, size_t offset)> populate_tile_cb;
 
 	void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene);
@@ -76,7 +88,6 @@ public:
 	size_t total_pixel_samples;
 
 private:
-	BakeData *m_bake_data;
 	bool m_is_baking;
 	size_t m_shader_limit;
 };
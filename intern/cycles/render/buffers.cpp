@@ -67,6 +67,9 @@ bool BufferParams::modified(const BufferParams& params)
 
 RenderTile::RenderTile()
 {
+	task = PATH_TRACE;
+	tile_index = 0;
+
 	x = 0;
 	y = 0;
 	w = 0;
@@ -133,6 +133,10 @@ protected:
 
 class RenderTile {
 public:
+	typedef enum { PATH_TRACE, DENOISE } Task;
+
+	Task task;
+	int tile_index;
 	int x, y, w, h;
 	int start_sample;
 	int num_samples;
@@ -0,0 +1,793 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/dicing_cache.h"
+
+#include "render/attribute.h"
+#include "render/camera.h"
+#include "render/graph.h"
+#include "render/mesh.h"
+#include "render/object.h"
+#include "render/shader.h"
+
+#include "subd/subd_dice.h"
+#include "subd/subd_patch_table.h"
+
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_set.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Bump this whenever tessellation, displacement or the file layout changes,
+ * so old cache entries are not used anymore. */
+#define DICING_CACHE_VERSION 1
+
+static const char dicing_cache_magic[8] = {'C', 'Y', 'C', 'L', 'D', 'I', 'C', 'E'};
+
+struct DicingCacheAttribute {
+	string name;
+	int std;
+	TypeDesc type;
+	int element;
+	uint flags;
+	bool subd;
+	vector<char> buffer;
+};
+
+struct DicingCache::Entry {
+	int subdivision_type;
+	size_t num_subd_verts;
+
+	array<float3> verts;
+	array<int> triangles;
+	array<int> shader;
+	array<bool> smooth;
+	array<int> triangle_patch;
+	array<float2> vert_patch_uv;
+
+	vector<DicingCacheAttribute> attributes;
+
+	bool has_patch_table;
+	PackedPatchTable patch_table;
+
+	/* False while the geometry is only held by the mesh it was stored for. */
+	bool has_geometry;
+
+	Entry() : subdivision_type(0), num_subd_verts(0), has_patch_table(false), has_geometry(false) {}
+};
+
+/* Hashing */
+
+static void md5_append_attributes(MD5Hash& md5, AttributeSet& attributes)
+{
+	md5_append_value(md5, (uint64_t)attributes.attributes.size());
+
+	foreach(Attribute& attr, attributes.attributes) {
+		md5.append(attr.name.string());
+		md5_append_value(md5, (int)attr.std);
+		md5_append_value(md5, (int)attr.type.basetype);
+		md5_append_value(md5, (int)attr.type.aggregate);
+		md5_append_value(md5, (int)attr.type.vecsemantics);
+		md5_append_value(md5, (int)attr.type.arraylen);
+		md5_append_value(md5, (int)attr.element);
+		md5_append_value(md5, attr.flags);
+
+		if(attr.element != ATTR_ELEMENT_CORNER_BYTE && attr.data_sizeof() == sizeof(float3)) {
+			md5_append_float3(md5, attr.data_float3(), attr.buffer.size() / sizeof(float3));
+		}
+		else {
+			md5_append_value(md5, (uint64_t)attr.buffer.size());
+			if(attr.buffer.size()) {
+				md5_append_data(md5, attr.data(), attr.buffer.size());
+			}
+		}
+	}
+}
+
+static bool attributes_have_voxel_data(const AttributeSet& attributes)
+{
+	foreach(const Attribute& attr, attributes.attributes) {
+		if(attr.element == ATTR_ELEMENT_VOXEL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+string DicingCache::key(Mesh *mesh, const Object *object)
+{
+	/* Voxel attributes own image slots, which can not be shared. */
+	if(!mesh->subd_params ||
+	   attributes_have_voxel_data(mesh->attributes) ||
+	   attributes_have_voxel_data(mesh->subd_attributes))
+	{
+		return "";
+	}
+
+	const SubdParams& params = *mesh->subd_params;
+	const bool has_true_displacement = mesh->has_true_displacement();
+
+	MD5Hash md5;
+
+	md5_append_value(md5, (int)DICING_CACHE_VERSION);
+
+	/* Dicing parameters. */
+	md5_append_value(md5, (int)mesh->subdivision_type);
+	md5_append_value(md5, params.ptex);
+	md5_append_value(md5, params.test_steps);
+	md5_append_value(md5, params.split_threshold);
+	md5_append_value(md5, params.dicing_rate);
+	md5_append_value(md5, params.max_level);
+
+	/* Dicing rate only depends on the distance of the mesh to the camera and
+	 * the camera projection, not on where the two are in the world. This way
+	 * moving camera and object together keeps the same key. */
+	md5_append_value(md5, (params.camera != NULL));
+	if(params.camera) {
+		const Camera *cam = params.camera;
+		const Transform objecttocamera = cam->worldtocamera * params.objecttoworld;
+		const float3 dx = transform_direction(&cam->worldtocamera, cam->full_dx);
+		const float3 dy = transform_direction(&cam->worldtocamera, cam->full_dy);
+
+		md5_append_value(md5, objecttocamera);
+		md5_append_value(md5, (int)cam->type);
+		md5_append_value(md5, cam->width);
+		md5_append_value(md5, cam->height);
+		md5_append_value(md5, cam->rastertocamera);
+		md5_append_float3(md5, &dx, 1);
+		md5_append_float3(md5, &dy, 1);
+	}
+	else {
+		md5_append_value(md5, params.objecttoworld);
+	}
+
+	/* Displacement shaders may use world space coordinates and object info. */
+	if(has_true_displacement) {
+		md5_append_value(md5, params.objecttoworld);
+		md5_append_value(md5, (object != NULL));
+		if(object) {
+			md5_append_value(md5, object->random_id);
+			md5_append_value(md5, object->pass_id);
+		}
+	}
+
+	/* Control mesh. */
+	md5_append_float3(md5, mesh->verts.data(), mesh->verts.size());
+	md5_append_value(md5, (uint64_t)mesh->subd_faces.size());
+	for(size_t i = 0; i < mesh->subd_faces.size(); i++) {
+		/* Hash members one by one, the struct has uninitialized padding. */
+		const Mesh::SubdFace& face = mesh->subd_faces[i];
+		md5_append_value(md5, face.start_corner);
+		md5_append_value(md5, face.num_corners);
+		md5_append_value(md5, face.shader);
+		md5_append_value(md5, face.smooth);
+		md5_append_value(md5, face.ptex_offset);
+	}
+	md5_append_array(md5, mesh->subd_face_corners);
+	md5_append_value(md5, mesh->num_ngons);
+	md5_append_array(md5, mesh->subd_creases);
+
+	md5_append_attributes(md5, mesh->attributes);
+	md5_append_attributes(md5, mesh->subd_attributes);
+
+	/* Displacement shaders. */
+	md5_append_value(md5, (uint64_t)mesh->used_shaders.size());
+	foreach(Shader *shader, mesh->used_shaders) {
+		const bool true_displacement = (shader->has_displacement &&
+		                                shader->displacement_method != DISPLACE_BUMP);
+
+		md5_append_value(md5, true_displacement);
+		if(true_displacement) {
+			md5_append_value(md5, (int)shader->displacement_method);
+			shader->graph->hash(md5);
+		}
+	}
+
+	return md5.get_hex();
+}
+
+/* Memory Cache */
+
+DicingCache::DicingCache()
+{
+	num_hits = 0;
+	num_misses = 0;
+}
+
+DicingCache::~DicingCache()
+{
+	clear();
+}
+
+/* Check that geometry read from disk is consistent with itself and the
+ * control mesh, since indices are used without further checks later on. */
+bool DicingCache::is_valid(const Entry& entry, const Mesh *mesh)
+{
+	const size_t num_verts = entry.verts.size();
+	const size_t num_triangles = entry.triangles.size() / 3;
+
+	if(entry.triangles.size() % 3 != 0 ||
+	   entry.shader.size() != num_triangles ||
+	   entry.smooth.size() != num_triangles ||
+	   !(entry.triangle_patch.size() == 0 || entry.triangle_patch.size() == num_triangles) ||
+	   !(entry.vert_patch_uv.size() == 0 || entry.vert_patch_uv.size() == num_verts) ||
+	   entry.num_subd_verts > num_verts)
+	{
+		return false;
+	}
+
+	for(size_t i = 0; i < entry.triangles.size(); i++) {
+		if(entry.triangles[i] < 0 || (size_t)entry.triangles[i] >= num_verts) {
+			return false;
+		}
+	}
+
+	for(size_t i = 0; i < num_triangles; i++) {
+		if(entry.shader[i] < 0 || (size_t)entry.shader[i] >= mesh->used_shaders.size()) {
+			return false;
+		}
+	}
+
+	if(entry.triangle_patch.size() && mesh->subd_faces.size()) {
+		const Mesh::SubdFace& last = mesh->subd_faces[mesh->subd_faces.size()-1];
+		const int num_patches = last.ptex_offset + last.num_ptex_faces();
+
+		for(size_t i = 0; i < num_triangles; i++) {
+			if(entry.triangle_patch[i] < 0 || entry.triangle_patch[i] >= num_patches) {
+				return false;
+			}
+		}
+	}
+
+	if(entry.has_patch_table) {
+		/* Bound counts first so the total size can not overflow. */
+		const PackedPatchTable& patch_table = entry.patch_table;
+		const size_t table_size = patch_table.table.size();
+
+		if(patch_table.num_arrays > table_size ||
+		   patch_table.num_indices > table_size ||
+		   patch_table.num_patches > table_size ||
+		   patch_table.num_nodes > table_size ||
+		   patch_table.total_size() != table_size)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Move geometry arrays between a cache entry and a mesh, in both directions. */
+void DicingCache::swap_geometry(Entry& entry, Mesh *mesh)
+{
+	const int subdivision_type = mesh->subdivision_type;
+	const size_t num_subd_verts = mesh->num_subd_verts;
+
+	mesh->subdivision_type = (Mesh::SubdivisionType)entry.subdivision_type;
+	mesh->num_subd_verts = entry.num_subd_verts;
+	entry.subdivision_type = subdivision_type;
+	entry.num_subd_verts = num_subd_verts;
+
+	array<float3> verts;
+	array<int> triangles;
+	array<int> shader;
+	array<bool> smooth;
+	array<int> triangle_patch;
+	array<float2> vert_patch_uv;
+
+	verts.steal_data(mesh->verts);
+	triangles.steal_data(mesh->triangles);
+	shader.steal_data(mesh->shader);
+	smooth.steal_data(mesh->smooth);
+	triangle_patch.steal_data(mesh->triangle_patch);
+	vert_patch_uv.steal_data(mesh->vert_patch_uv);
+
+	mesh->verts.steal_data(entry.verts);
+	mesh->triangles.steal_data(entry.triangles);
+	mesh->shader.steal_data(entry.shader);
+	mesh->smooth.steal_data(entry.smooth);
+	mesh->triangle_patch.steal_data(entry.triangle_patch);
+	mesh->vert_patch_uv.steal_data(entry.vert_patch_uv);
+
+	entry.verts.steal_data(verts);
+	entry.triangles.steal_data(triangles);
+	entry.shader.steal_data(shader);
+	entry.smooth.steal_data(smooth);
+	entry.triangle_patch.steal_data(triangle_patch);
+	entry.vert_patch_uv.steal_data(vert_patch_uv);
+}
+
+/* Move cached attributes into attribute sets of the mesh. Attributes are
+ * sized by the mesh when added, which must match the cached data. */
+bool DicingCache::restore_attributes(Entry& entry,
+                                     AttributeSet& attributes,
+                                     AttributeSet& subd_attributes)
+{
+	foreach(DicingCacheAttribute& cattr, entry.attributes) {
+		AttributeSet& cattributes = (cattr.subd)? subd_attributes: attributes;
+		Attribute *attr = cattributes.add(ustring(cattr.name),
+		                                  cattr.type,
+		                                  (AttributeElement)cattr.element);
+		attr->std = (AttributeStandard)cattr.std;
+		attr->flags = cattr.flags;
+
+		const bool size_match = (cattr.flags & ATTR_FINAL_SIZE)?
+		        (cattr.buffer.size() % attr->data_sizeof() == 0):
+		        (cattr.buffer.size() == attr->buffer.size());
+
+		if(!size_match) {
+			VLOG(1) << "Dicing cache attribute " << cattr.name << " has "
+			        << cattr.buffer.size() << " bytes, expected "
+			        << attr->buffer.size() << ".";
+			return false;
+		}
+
+		attr->buffer.swap(cattr.buffer);
+	}
+
+	return true;
+}
+
+bool DicingCache::load(const string& key, Mesh *mesh)
+{
+	map<string, Entry*>::iterator it = entries.find(key);
+	Entry *entry = (it != entries.end())? it->second: NULL;
+
+	/* Entries without geometry belong to a mesh which still holds it, or
+	 * their geometry was restored to another mesh already. */
+	if(!(entry && entry->has_geometry) && cache_path != "") {
+		Entry *file_entry = new Entry();
+
+		if(read(filepath(key), *file_entry) && is_valid(*file_entry, mesh)) {
+			delete entry;
+			entry = file_entry;
+			entries[key] = entry;
+		}
+		else {
+			delete file_entry;
+		}
+	}
+
+	if(!(entry && entry->has_geometry)) {
+		num_misses++;
+		return false;
+	}
+
+	/* Attributes are resized to the mesh when added, so this has to come after
+	 * the mesh arrays. */
+	swap_geometry(*entry, mesh);
+
+	AttributeSet attributes, subd_attributes;
+	attributes.triangle_mesh = mesh;
+	subd_attributes.subd_mesh = mesh;
+
+	if(!restore_attributes(*entry, attributes, subd_attributes)) {
+		/* Put back the control mesh and drop the inconsistent entry. */
+		swap_geometry(*entry, mesh);
+		delete entry;
+		entries.erase(key);
+
+		num_misses++;
+		return false;
+	}
+
+	mesh->attributes.clear();
+	mesh->subd_attributes.clear();
+	mesh->attributes.attributes.swap(attributes.attributes);
+	mesh->subd_attributes.attributes.swap(subd_attributes.attributes);
+
+	delete mesh->patch_table;
+	mesh->patch_table = NULL;
+
+	if(entry->has_patch_table) {
+		mesh->patch_table = new PackedPatchTable();
+		*mesh->patch_table = entry->patch_table;
+		mesh->patch_table->table.steal_data(entry->patch_table.table);
+	}
+
+	/* Geometry is owned by the mesh now, keep the entry as marker only. */
+	*entry = Entry();
+
+	mesh_keys[mesh] = key;
+	num_hits++;
+
+	return true;
+}
+
+static void entry_add_attributes(vector<DicingCacheAttribute>& cattributes,
+                                 AttributeSet& attributes,
+                                 bool subd,
+                                 bool steal)
+{
+	foreach(Attribute& attr, attributes.attributes) {
+		DicingCacheAttribute cattr;
+		cattr.name = attr.name.string();
+		cattr.std = attr.std;
+		cattr.type = attr.type;
+		cattr.element = attr.element;
+		cattr.flags = attr.flags;
+		cattr.subd = subd;
+		if(steal) {
+			cattr.buffer.swap(attr.buffer);
+		}
+		else {
+			cattr.buffer = attr.buffer;
+		}
+		cattributes.push_back(cattr);
+	}
+}
+
+void DicingCache::store(const string& key, Mesh *mesh)
+{
+	/* The mesh keeps the geometry until it is released. */
+	map<string, Entry*>::iterator it = entries.find(key);
+	if(it == entries.end()) {
+		entries[key] = new Entry();
+	}
+	mesh_keys[mesh] = key;
+
+	if(cache_path == "") {
+		return;
+	}
+
+	const string entry_filepath = filepath(key);
+	if(path_exists(entry_filepath)) {
+		return;
+	}
+
+	Entry entry;
+
+	entry.subdivision_type = mesh->subdivision_type;
+	entry.num_subd_verts = mesh->num_subd_verts;
+
+	entry.verts = mesh->verts;
+	entry.triangles = mesh->triangles;
+	entry.shader = mesh->shader;
+	entry.smooth = mesh->smooth;
+	entry.triangle_patch = mesh->triangle_patch;
+	entry.vert_patch_uv = mesh->vert_patch_uv;
+
+	entry_add_attributes(entry.attributes, mesh->attributes, false, false);
+	entry_add_attributes(entry.attributes, mesh->subd_attributes, true, false);
+
+	if(mesh->patch_table) {
+		entry.has_patch_table = true;
+		entry.patch_table = *mesh->patch_table;
+	}
+
+	if(!write(entry_filepath, entry)) {
+		VLOG(1) << "Failed to write dicing cache file " << entry_filepath;
+	}
+}
+
+void DicingCache::release(Mesh *mesh)
+{
+	map<const Mesh*, string>::iterator key_it = mesh_keys.find(mesh);
+
+	/* Only geometry as it was stored can be reused. */
+	if(key_it == mesh_keys.end() ||
+	   mesh->num_subd_verts == 0 ||
+	   mesh->use_lazy_dicing ||
+	   mesh->transform_applied)
+	{
+		return;
+	}
+
+	Entry *&entry = entries[key_it->second];
+	if(!entry) {
+		entry = new Entry();
+	}
+	else if(entry->has_geometry) {
+		/* Another mesh with the same key was released already. */
+		return;
+	}
+
+	swap_geometry(*entry, mesh);
+
+	entry_add_attributes(entry->attributes, mesh->attributes, false, true);
+	entry_add_attributes(entry->attributes, mesh->subd_attributes, true, true);
+
+	if(mesh->patch_table) {
+		entry->has_patch_table = true;
+		entry->patch_table = *mesh->patch_table;
+		entry->patch_table.table.steal_data(mesh->patch_table->table);
+	}
+
+	entry->has_geometry = true;
+}
+
+void DicingCache::prune(const vector<Mesh*>& meshes)
+{
+	map<const Mesh*, string> used_mesh_keys;
+	set<string> used_keys;
+
+	foreach(Mesh *mesh, meshes) {
+		map<const Mesh*, string>::iterator it = mesh_keys.find(mesh);
+
+		if(it != mesh_keys.end()) {
+			used_mesh_keys.insert(*it);
+			used_keys.insert(it->second);
+		}
+	}
+
+	mesh_keys.swap(used_mesh_keys);
+
+	map<string, Entry*>::iterator it = entries.begin();
+	while(it != entries.end()) {
+		if(used_keys.find(it->first) == used_keys.end()) {
+			delete it->second;
+			entries.erase(it++);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+void DicingCache::clear()
+{
+	for(map<string, Entry*>::iterator it = entries.begin(); it != entries.end(); it++) {
+		delete it->second;
+	}
+
+	entries.clear();
+	mesh_keys.clear();
+}
+
+/* Disk Cache */
+
+string DicingCache::filepath(const string& key) const
+{
+	/* Spread files over sub-directories to keep directory listings small. */
+	return path_join(path_join(cache_path, key.substr(0, 2)),
+	                 key + ".dice");
+}
+
+template<typename T>
+static bool cache_read_value(FILE *f, T& value)
+{
+	return fread(&value, sizeof(T), 1, f) == 1;
+}
+
+template<typename T>
+static bool cache_write_value(FILE *f, const T& value)
+{
+	return fwrite(&value, sizeof(T), 1, f) == 1;
+}
+
+/* Array sizes are bounded by the remaining file size, so corrupt files can not
+ * cause huge allocations. */
+template<typename T, typename Array>
+static bool cache_read_array(FILE *f, Array& data, size_t file_size)
+{
+	uint64_t size;
+	if(!cache_read_value(f, size)) {
+		return false;
+	}
+	const long offset = ftell(f);
+	if(offset < 0 || (size_t)offset > file_size || size > (file_size - offset)/sizeof(T)) {
+		return false;
+	}
+	data.resize(size);
+	return (size == 0 || fread(&data[0], sizeof(T), size, f) == size);
+}
+
+template<typename T, typename Array>
+static bool cache_write_array(FILE *f, const Array& data)
+{
+	const uint64_t size = data.size();
+	if(!cache_write_value(f, size)) {
+		return false;
+	}
+	return (size == 0 || fwrite(&data[0], sizeof(T), size, f) == size);
+}
+
+static bool cache_read_attribute(FILE *f, DicingCacheAttribute& attr, size_t file_size)
+{
+	vector<char> name;
+	uint8_t basetype, aggregate, vecsemantics;
+	int32_t arraylen, std, element, subd;
+	uint32_t flags;
+
+	if(!(cache_read_array<char>(f, name, file_size) &&
+	     cache_read_value(f, std) &&
+	     cache_read_value(f, basetype) &&
+	     cache_read_value(f, aggregate) &&
+	     cache_read_value(f, vecsemantics) &&
+	     cache_read_value(f, arraylen) &&
+	     cache_read_value(f, element) &&
+	     cache_read_value(f, flags) &&
+	     cache_read_value(f, subd) &&
+	     cache_read_array<char>(f, attr.buffer, file_size)))
+	{
+		return false;
+	}
+
+	/* Only types and elements attributes can be created with. */
+	TypeDesc type;
+	type.basetype = basetype;
+	type.aggregate = aggregate;
+	type.vecsemantics = vecsemantics;
+	type.arraylen = arraylen;
+
+	if(!(type == TypeDesc::TypeFloat || type == TypeDesc::TypeColor ||
+	     type == TypeDesc::TypePoint || type == TypeDesc::TypeVector ||
+	     type == TypeDesc::TypeNormal || type == TypeDesc::TypeMatrix) ||
+	   element < ATTR_ELEMENT_OBJECT || element > ATTR_ELEMENT_CURVE_KEY_MOTION)
+	{
+		return false;
+	}
+
+	attr.name = string(name.begin(), name.end());
+	attr.std = std;
+	attr.type = type;
+	attr.element = element;
+	attr.flags = flags;
+	attr.subd = (subd != 0);
+
+	return true;
+}
+
+static bool cache_write_attribute(FILE *f, const DicingCacheAttribute& attr)
+{
+	const vector<char> name(attr.name.begin(), attr.name.end());
+
+	return cache_write_array<char>(f, name) &&
+	       cache_write_value(f, (int32_t)attr.std) &&
+	       cache_write_value(f, (uint8_t)attr.type.basetype) &&
+	       cache_write_value(f, (uint8_t)attr.type.aggregate) &&
+	       cache_write_value(f, (uint8_t)attr.type.vecsemantics) &&
+	       cache_write_value(f, (int32_t)attr.type.arraylen) &&
+	       cache_write_value(f, (int32_t)attr.element) &&
+	       cache_write_value(f, (uint32_t)attr.flags) &&
+	       cache_write_value(f, (int32_t)attr.subd) &&
+	       cache_write_array<char>(f, attr.buffer);
+}
+
+bool DicingCache::read(const string& filepath, Entry& entry)
+{
+	FILE *f = path_fopen(filepath, "rb");
+	if(!f) {
+		return false;
+	}
+
+	const size_t file_size = path_file_size(filepath);
+
+	char magic[8];
+	uint32_t version;
+	int32_t subdivision_type, has_patch_table;
+	uint64_t num_subd_verts, num_attributes;
+
+	bool ok = cache_read_value(f, magic) &&
+	          memcmp(magic, dicing_cache_magic, sizeof(magic)) == 0 &&
+	          cache_read_value(f, version) &&
+	          version == DICING_CACHE_VERSION &&
+	          cache_read_value(f, subdivision_type) &&
+	          cache_read_value(f, num_subd_verts) &&
+	          cache_read_array<float3>(f, entry.verts, file_size) &&
+	          cache_read_array<int>(f, entry.triangles, file_size) &&
+	          cache_read_array<int>(f, entry.shader, file_size) &&
+	          cache_read_array<bool>(f, entry.smooth, file_size) &&
+	          cache_read_array<int>(f, entry.triangle_patch, file_size) &&
+	          cache_read_array<float2>(f, entry.vert_patch_uv, file_size) &&
+	          cache_read_value(f, num_attributes);
+
+	/* Every attribute takes at least a few bytes in the file. */
+	if(ok && num_attributes > file_size) {
+		ok = false;
+	}
+
+	if(ok) {
+		entry.attributes.resize(num_attributes);
+		for(size_t i = 0; ok && i < num_attributes; i++) {
+			ok = cache_read_attribute(f, entry.attributes[i], file_size);
+		}
+	}
+
+	if(ok) {
+		ok = cache_read_value(f, has_patch_table);
+	}
+
+	if(ok && has_patch_table) {
+		uint64_t num_arrays, num_indices, num_patches, num_nodes;
+		ok = cache_read_value(f, num_arrays) &&
+		     cache_read_value(f, num_indices) &&
+		     cache_read_value(f, num_patches) &&
+		     cache_read_value(f, num_nodes) &&
+		     cache_read_array<uint>(f, entry.patch_table.table, file_size);
+		entry.patch_table.num_arrays = num_arrays;
+		entry.patch_table.num_indices = num_indices;
+		entry.patch_table.num_patches = num_patches;
+		entry.patch_table.num_nodes = num_nodes;
+	}
+
+	/* Trailing data means the file was not written by this version. */
+	ok = ok && (ftell(f) == (long)file_size);
+
+	fclose(f);
+
+	if(!ok) {
+		VLOG(1) << "Ignoring invalid dicing cache file " << filepath;
+		return false;
+	}
+
+	entry.subdivision_type = subdivision_type;
+	entry.num_subd_verts = num_subd_verts;
+	entry.has_patch_table = (has_patch_table != 0);
+
+	return true;
+}
+
+bool DicingCache::write(const string& filepath, const Entry& entry)
+{
+	/* Write to a temporary file first and move it in place once complete, so
+	 * concurrent renders sharing the cache never see partially written files. */
+	const string tmp_filepath = string_printf("%s.%llx.tmp",
+	                                          filepath.c_str(),
+	                                          (unsigned long long)(time_dt()*1e6));
+
+	path_create_directories(tmp_filepath);
+
+	FILE *f = path_fopen(tmp_filepath, "wb");
+	if(!f) {
+		return false;
+	}
+
+	bool ok = cache_write_value(f, dicing_cache_magic) &&
+	          cache_write_value(f, (uint32_t)DICING_CACHE_VERSION) &&
+	          cache_write_value(f, (int32_t)entry.subdivision_type) &&
+	          cache_write_value(f, (uint64_t)entry.num_subd_verts) &&
+	          cache_write_array<float3>(f, entry.verts) &&
+	          cache_write_array<int>(f, entry.triangles) &&
+	          cache_write_array<int>(f, entry.shader) &&
+	          cache_write_array<bool>(f, entry.smooth) &&
+	          cache_write_array<int>(f, entry.triangle_patch) &&
+	          cache_write_array<float2>(f, entry.vert_patch_uv) &&
+	          cache_write_value(f, (uint64_t)entry.attributes.size());
+
+	for(size_t i = 0; ok && i < entry.attributes.size(); i++) {
+		ok = cache_write_attribute(f, entry.attributes[i]);
+	}
+
+	ok = ok && cache_write_value(f, (int32_t)entry.has_patch_table);
+
+	if(ok && entry.has_patch_table) {
+		ok = cache_write_value(f, (uint64_t)entry.patch_table.num_arrays) &&
+		     cache_write_value(f, (uint64_t)entry.patch_table.num_indices) &&
+		     cache_write_value(f, (uint64_t)entry.patch_table.num_patches) &&
+		     cache_write_value(f, (uint64_t)entry.patch_table.num_nodes) &&
+		     cache_write_array<uint>(f, entry.patch_table.table);
+	}
+
+	if(fclose(f) != 0) {
+		ok = false;
+	}
+
+	if(ok && rename(tmp_filepath.c_str(), filepath.c_str()) != 0) {
+		/* Most likely another process wrote the same entry already. */
+		ok = path_exists(filepath);
+	}
+
+	path_remove(tmp_filepath);
+
+	return ok;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DICING_CACHE_H__
+#define __DICING_CACHE_H__
+
+#include "util/util_map.h"
+#include "util/util_string.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class AttributeSet;
+class Mesh;
+class Object;
+
+/* Dicing Cache
+ *
+ * Stores geometry of meshes with adaptive subdivision after tessellation and
+ * true displacement, so meshes which are synchronized again without any
+ * change affecting the result (other updates in the viewport, following
+ * frames of an animation or following renders) do not need to be diced and
+ * displaced again.
+ *
+ * Entries are keyed by MD5 of the control mesh, subdivision parameters, the
+ * position of the mesh relative to the dicing camera, the graphs of
+ * displacement shaders and the object info they can read. Image textures used for displacement are part of the
+ * key by file path only.
+ *
+ * Only one copy of the geometry is kept in memory: while a mesh holds its
+ * diced geometry the cache only remembers the key, and the geometry moves to
+ * the cache when the mesh is cleared for synchronization. Entries are kept
+ * for as long as the mesh they were created for is in the scene, and are
+ * optionally written to disk to be reused across sessions. */
+
+class DicingCache {
+public:
+	DicingCache();
+	~DicingCache();
+
+	/* Compute key for the diced and displaced geometry of the mesh, which must
+	 * not be tessellated yet. Object is the one displacement is evaluated
+	 * for, or NULL. Returns empty string if the mesh can not be cached. */
+	static string key(Mesh *mesh, const Object *object);
+
+	/* Replace mesh content by cached geometry, returns false if there is no
+	 * cache entry for the key. */
+	bool load(const string& key, Mesh *mesh);
+
+	/* Remember the key of a tessellated and displaced mesh, and write its
+	 * geometry to the disk cache. */
+	void store(const string& key, Mesh *mesh);
+
+	/* Move diced geometry out of a mesh which is about to be cleared, so it
+	 * can be restored if the mesh is synchronized with the same key. */
+	void release(Mesh *mesh);
+
+	/* Free memory of entries for meshes which are not in the scene anymore,
+	 * or which were synchronized with a different key since. */
+	void prune(const vector<Mesh*>& meshes);
+
+	void clear();
+
+	/* Directory of the on-disk cache, empty to only cache in memory. */
+	string cache_path;
+
+	/* Number of meshes loaded from and missing in the cache. */
+	size_t num_hits;
+	size_t num_misses;
+
+protected:
+	struct Entry;
+
+	static bool is_valid(const Entry& entry, const Mesh *mesh);
+	static void swap_geometry(Entry& entry, Mesh *mesh);
+	static bool restore_attributes(Entry& entry,
+	                               AttributeSet& attributes,
+	                               AttributeSet& subd_attributes);
+
+	string filepath(const string& key) const;
+	static bool read(const string& filepath, Entry& entry);
+	static bool write(const string& filepath, const Entry& entry);
+
+	map<string, Entry*> entries;
+	map<const Mesh*, string> mesh_keys;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __DICING_CACHE_H__ */
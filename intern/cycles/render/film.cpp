@@ -43,6 +43,7 @@ PassSettings::PassSettings()
 {
 	add(PASS_COMBINED);
 	denoising_passes = false;
+	adaptive_passes = false;
 }
 
 void PassSettings::add(AOV aov)
@@ -209,7 +210,8 @@ bool PassSettings::contains(PassType type) const
 bool PassSettings::modified(const PassSettings& other) const
 {
 	if(aovs.size() != other.aovs.size()
-	   || passes.size() != other.passes.size()) {
+	   || passes.size() != other.passes.size()
+	   || adaptive_passes != other.adaptive_passes) {
 		return true;
 	}
 
@@ -245,7 +247,7 @@ int PassSettings::get_denoising_offset() const
 	return size;
 }
 
-int PassSettings::get_size() const
+int PassSettings::get_adaptive_offset() const
 {
 	int size = get_denoising_offset();
 
@@ -253,6 +255,17 @@ int PassSettings::get_size() const
 		size += 26;
 	}
 
+	return size;
+}
+
+int PassSettings::get_size() const
+{
+	int size = get_adaptive_offset();
+
+	if(adaptive_passes) {
+		size += 4;
+	}
+
 	return align_up(size, 4);
 }
 
@@ -589,6 +602,14 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 		kfilm->pass_denoising = 0;
 	}
 
+	if(passes.adaptive_passes) {
+		kfilm->pass_adaptive = kfilm->pass_stride;
+		kfilm->pass_stride += 4;
+	}
+	else {
+		kfilm->pass_adaptive = 0;
+	}
+
 	kfilm->pass_stride = align_up(kfilm->pass_stride, 4);
 	kfilm->pass_alpha_threshold = pass_alpha_threshold;
 
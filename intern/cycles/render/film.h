@@ -87,6 +87,7 @@ public:
 	bool modified(const PassSettings& other) const;
 
 	int get_denoising_offset() const;
+	int get_adaptive_offset() const;
 	int get_size() const;
 	Pass* get_pass(PassType type, int &offset);
 	AOV* get_aov(ustring name, int &offset);
@@ -96,6 +97,8 @@ public:
 	void add(AOV aov);
 
 	bool denoising_passes;
+	/* Per pixel convergence data for adaptive sampling. */
+	bool adaptive_passes;
 
 protected:
 	array<Pass> passes;
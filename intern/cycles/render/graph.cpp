@@ -24,6 +24,7 @@
 #include "util/util_algorithm.h"
 #include "util/util_debug.h"
 #include "util/util_foreach.h"
+#include "util/util_md5.h"
 #include "util/util_queue.h"
 #include "util/util_logging.h"
 
@@ -1148,6 +1149,22 @@ int ShaderGraph::get_num_closures()
 	return num_closures;
 }
 
+void ShaderGraph::hash(MD5Hash& md5)
+{
+	foreach(ShaderNode *node, nodes) {
+		md5_append_value(md5, node->id);
+		node->hash(md5);
+
+		foreach(ShaderInput *input, node->inputs) {
+			if(input->link) {
+				md5.append(input->name().string());
+				md5_append_value(md5, input->link->parent->id);
+				md5.append(input->link->name().string());
+			}
+		}
+	}
+}
+
 void ShaderGraph::dump_graph(const char *filename)
 {
 	FILE *fd = fopen(filename, "w");
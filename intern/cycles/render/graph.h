@@ -266,6 +266,9 @@ public:
 
 	int get_num_closures();
 
+	/* hash of all nodes and links, for cache keys */
+	void hash(MD5Hash& md5);
+
 	void dump_graph(const char *filename);
 
 protected:
@@ -37,6 +37,7 @@ ImageManager::ImageManager(const DeviceInfo& info)
 {
 	need_update = true;
 	pack_images = false;
+	use_half_float = false;
 	oiio_texture_system = NULL;
 	animation_frame = 0;
 
@@ -54,6 +55,8 @@ ImageManager::ImageManager(const DeviceInfo& info)
 	/* Set image limits */
 	max_num_images = TEX_NUM_MAX;
 	has_half_images = true;
+	/* Sparse lookups are only implemented in the CPU kernel. */
+	has_sparse_images = (device_type == DEVICE_CPU && info.type != DEVICE_MULTI);
 	cuda_fermi_limits = false;
 	
 	if(device_type == DEVICE_CUDA) {
@@ -84,6 +87,11 @@ void ImageManager::set_pack_images(bool pack_images_)
 	pack_images = pack_images_;
 }
 
+void ImageManager::set_half_float_textures(bool use_half_float_)
+{
+	use_half_float = use_half_float_;
+}
+
 void ImageManager::set_oiio_texture_system(void *texture_system)
 {
 	oiio_texture_system = texture_system;
@@ -279,6 +287,21 @@ const string ImageManager::get_mip_map_path(const string& filename)
  * There are special cases for CUDA Fermi, since there we have only 90 image texture
  * slots available and shold keep the flattended numbers in the 0-89 range.
  */
+device_vector<int> *ImageManager::image_grid(DeviceScene *dscene, int flat_slot)
+{
+	ImageDataType type;
+	int slot = flattened_slot_to_type_index(flat_slot, &type);
+
+	if(type == IMAGE_DATA_TYPE_FLOAT4 && slot < dscene->tex_float4_grid.size()) {
+		return dscene->tex_float4_grid[slot];
+	}
+	else if(type == IMAGE_DATA_TYPE_FLOAT && slot < dscene->tex_float_grid.size()) {
+		return dscene->tex_float_grid[slot];
+	}
+
+	return NULL;
+}
+
 int ImageManager::type_index_to_flattened_slot(int slot, ImageDataType type)
 {
 	if (cuda_fermi_limits) {
@@ -374,6 +397,18 @@ int ImageManager::add_image(const string& filename,
 		type = IMAGE_DATA_TYPE_FLOAT;
 	}
 
+	/* Store float images from files with half precision when requested, this
+	 * halves memory usage of HDR environment maps and displacement textures.
+	 * Builtin images can only be read as float or byte. */
+	if(use_half_float && has_half_images && !builtin_data && !generated_data) {
+		if(type == IMAGE_DATA_TYPE_FLOAT4) {
+			type = IMAGE_DATA_TYPE_HALF4;
+		}
+		else if(type == IMAGE_DATA_TYPE_FLOAT) {
+			type = IMAGE_DATA_TYPE_HALF;
+		}
+	}
+
 	if (type == IMAGE_DATA_TYPE_FLOAT && cuda_fermi_limits) {
 		type = IMAGE_DATA_TYPE_FLOAT4;
 	}
@@ -595,6 +630,18 @@ bool ImageManager::file_load_image_generic(Image *img, ImageInput **in, int &wid
 	return true;
 }
 
+/* Half float can't represent values above 65504, converting from float files
+ * gives infinities there which would break shading, so clamp them instead. */
+static void image_clamp_half_infinity(half *pixels, size_t num_values)
+{
+	for(size_t i = 0; i < num_values; i++) {
+		const ushort h = pixels[i];
+		if((h & 0x7fff) == 0x7c00) {
+			pixels[i] = (ushort)((h & 0x8000) | 0x7bff);
+		}
+	}
+}
+
 template<TypeDesc::BASETYPE FileFormat,
          typename StorageType,
          typename DeviceType>
@@ -640,6 +687,9 @@ bool ImageManager::file_load_image(Image *img,
 		else {
 			in->read_image(FileFormat, (uchar*)readpixels);
 		}
+		if(FileFormat == TypeDesc::HALF) {
+			image_clamp_half_infinity((half*)readpixels, num_pixels*components);
+		}
 		if(components > 4) {
 			size_t dimensions = ((size_t)width)*height;
 			for(size_t i = dimensions-1, pixel = 0; pixel < dimensions; pixel++, i--) {
@@ -750,6 +800,294 @@ bool ImageManager::file_load_image(Image *img,
 	return true;
 }
 
+static inline bool image_voxel_is_empty(float f)
+{
+	return f == 0.0f;
+}
+
+static inline bool image_voxel_is_empty(const float4& f)
+{
+	return f.x == 0.0f && f.y == 0.0f && f.z == 0.0f && f.w == 0.0f;
+}
+
+/* Mark tiles in the given range active, clamped to the grid. */
+static void image_sparse_activate(int *grid, int3 grid_size, int3 lo, int3 hi)
+{
+	lo = max(lo, make_int3(0, 0, 0));
+	hi = min(hi, make_int3(grid_size.x - 1, grid_size.y - 1, grid_size.z - 1));
+
+	for(int z = lo.z; z <= hi.z; z++) {
+		for(int y = lo.y; y <= hi.y; y++) {
+			for(int x = lo.x; x <= hi.x; x++) {
+				grid[x + (y + z*grid_size.y)*grid_size.x] |= TEX_SPARSE_TILE_ACTIVE;
+			}
+		}
+	}
+}
+
+/* Convert a dense 3D image to tiles, leaving out tiles where all voxels are
+ * empty. Returns false and keeps the image dense if that would not save
+ * memory. */
+template<typename T>
+bool ImageManager::make_sparse_image(device_vector<T>& tex_img, device_vector<int>& tex_grid)
+{
+	const int width = tex_img.data_width;
+	const int height = tex_img.data_height;
+	const int depth = tex_img.data_depth;
+
+	if(depth <= 1 || !tex_img.data_pointer) {
+		return false;
+	}
+
+	const int3 grid_size = make_int3(tex_sparse_grid_size(width),
+	                                 tex_sparse_grid_size(height),
+	                                 tex_sparse_grid_size(depth));
+	const size_t num_tiles = (size_t)grid_size.x*grid_size.y*grid_size.z;
+	const T *pixels = (const T*)tex_img.data_pointer;
+
+	int *grid = tex_grid.resize(grid_size.x, grid_size.y, grid_size.z);
+	if(!grid) {
+		return false;
+	}
+	memset(grid, 0, sizeof(int)*num_tiles);
+
+	/* Find tiles containing non-empty voxels. */
+	for(int z = 0; z < depth; z++) {
+		for(int y = 0; y < height; y++) {
+			const T *row = pixels + ((size_t)z*height + y)*width;
+			const int tile_row = ((y >> TEX_SPARSE_TILE_SHIFT) +
+			                      (z >> TEX_SPARSE_TILE_SHIFT)*grid_size.y)*grid_size.x;
+
+			for(int x = 0; x < width; x++) {
+				if(!image_voxel_is_empty(row[x])) {
+					grid[tile_row + (x >> TEX_SPARSE_TILE_SHIFT)] = 1;
+				}
+			}
+		}
+	}
+
+	/* Tile 0 is shared by all empty tiles. */
+	size_t num_used_tiles = 1;
+	for(size_t i = 0; i < num_tiles; i++) {
+		if(grid[i]) {
+			grid[i] = (int)(num_used_tiles++ << 1);
+		}
+	}
+
+	const size_t dense_size = (size_t)width*height*depth*sizeof(T);
+	const size_t sparse_size = num_used_tiles*TEX_SPARSE_TILE_VOXELS*sizeof(T) +
+	                           num_tiles*sizeof(int);
+
+	if(sparse_size >= dense_size) {
+		tex_grid.clear();
+		return false;
+	}
+
+	vector<T> tiles(num_used_tiles*TEX_SPARSE_TILE_VOXELS);
+	memset(&tiles[0], 0, sizeof(T)*tiles.size());
+
+	for(int z = 0; z < depth; z++) {
+		for(int y = 0; y < height; y++) {
+			const T *row = pixels + ((size_t)z*height + y)*width;
+
+			for(int x = 0; x < width; x++) {
+				tiles[tex_sparse_voxel_index(grid, grid_size.x, grid_size.y, x, y, z)] = row[x];
+			}
+		}
+	}
+
+	/* Interpolation and ray marching may reach into neighbouring tiles. */
+	for(int z = 0; z < grid_size.z; z++) {
+		for(int y = 0; y < grid_size.y; y++) {
+			for(int x = 0; x < grid_size.x; x++) {
+				if(grid[x + (y + z*grid_size.y)*grid_size.x] >> 1) {
+					image_sparse_activate(grid,
+					                      grid_size,
+					                      make_int3(x - 1, y - 1, z - 1),
+					                      make_int3(x + 1, y + 1, z + 1));
+				}
+			}
+		}
+	}
+
+	VLOG(1) << "Sparse image " << width << "x" << height << "x" << depth
+	        << ", " << num_used_tiles - 1 << " of " << num_tiles << " tiles used, "
+	        << string_human_readable_size(sparse_size) << " instead of "
+	        << string_human_readable_size(dense_size) << ".";
+
+	T *data = tex_img.resize(tiles.size());
+	if(!data) {
+		tex_grid.clear();
+		return false;
+	}
+	memcpy(data, &tiles[0], sizeof(T)*tiles.size());
+
+	/* Keep the resolution, which lookups are based on. The data size is
+	 * that of the tiles. */
+	tex_img.data_width = width;
+	tex_img.data_height = height;
+	tex_img.data_depth = depth;
+
+	return true;
+}
+
+void ImageManager::device_merge_sparse_images(Device *device,
+                                              DeviceScene *dscene,
+                                              const vector<int>& flat_slots)
+{
+	foreach(int flat_slot, flat_slots) {
+		device_vector<int> *tex_grid = image_grid(dscene, flat_slot);
+		device_memory *tex_img = image_memory(dscene, flat_slot);
+		if(!tex_grid || !tex_img) {
+			continue;
+		}
+
+		int *grid = (int*)tex_grid->data_pointer;
+		const int3 grid_size = make_int3(tex_grid->data_width,
+		                                 tex_grid->data_height,
+		                                 tex_grid->data_depth);
+		/* Number of tiles per unit of normalized coordinates. */
+		const float3 tile_scale = make_float3(tex_img->data_width,
+		                                      tex_img->data_height,
+		                                      tex_img->data_depth) * (1.0f/TEX_SPARSE_TILE_SIZE);
+
+		foreach(int other_slot, flat_slots) {
+			if(other_slot == flat_slot) {
+				continue;
+			}
+
+			device_vector<int> *other_grid = image_grid(dscene, other_slot);
+			device_memory *other_img = image_memory(dscene, other_slot);
+			if(!other_img) {
+				continue;
+			}
+
+			if(!other_grid) {
+				/* No tile information, assume all of the image is used. */
+				image_sparse_activate(grid, grid_size, make_int3(0, 0, 0), grid_size);
+				continue;
+			}
+
+			const int *other = (const int*)other_grid->data_pointer;
+			const int3 other_size = make_int3(other_grid->data_width,
+			                                  other_grid->data_height,
+			                                  other_grid->data_depth);
+			const float3 other_tile = make_float3(TEX_SPARSE_TILE_SIZE/(float)other_img->data_width,
+			                                      TEX_SPARSE_TILE_SIZE/(float)other_img->data_height,
+			                                      TEX_SPARSE_TILE_SIZE/(float)other_img->data_depth);
+
+			for(int z = 0; z < other_size.z; z++) {
+				for(int y = 0; y < other_size.y; y++) {
+					for(int x = 0; x < other_size.x; x++) {
+						if(!(other[x + (y + z*other_size.y)*other_size.x] >> 1)) {
+							continue;
+						}
+
+						/* Bounds of the used tile and its neighbours, in tiles
+						 * of this image. */
+						float3 lo = make_float3(x - 1, y - 1, z - 1)*other_tile*tile_scale;
+						float3 hi = make_float3(x + 2, y + 2, z + 2)*other_tile*tile_scale;
+
+						image_sparse_activate(grid,
+						                      grid_size,
+						                      make_int3((int)floorf(lo.x) - 1,
+						                                (int)floorf(lo.y) - 1,
+						                                (int)floorf(lo.z) - 1),
+						                      make_int3((int)floorf(hi.x) + 1,
+						                                (int)floorf(hi.y) + 1,
+						                                (int)floorf(hi.z) + 1));
+					}
+				}
+			}
+		}
+
+		/* Update the grid on the device. */
+		if(tex_grid->device_pointer) {
+			ImageDataType type;
+			flattened_slot_to_type_index(flat_slot, &type);
+			string grid_name = string_printf("__tex_grid_%s_%03d", name_from_type(type).c_str(), flat_slot);
+
+			thread_scoped_lock device_lock(device_mutex);
+			device->tex_free(*tex_grid);
+			device->tex_alloc(grid_name.c_str(),
+			                  *tex_grid,
+			                  INTERPOLATION_CLOSEST,
+			                  EXTENSION_CLIP);
+		}
+	}
+}
+
+void ImageManager::device_update_majorants(Device *device,
+                                           DeviceScene *dscene,
+                                           const map<int, vector<float> >& majorants)
+{
+	for(int i = 0; i < 2; i++) {
+		const ImageDataType type = (i == 0)? IMAGE_DATA_TYPE_FLOAT4: IMAGE_DATA_TYPE_FLOAT;
+		std::vector<device_vector<float>*>& tex_majorants = (i == 0)? dscene->tex_float4_majorant:
+		                                                         dscene->tex_float_majorant;
+		std::vector<device_vector<int>*>& tex_grids = (i == 0)? dscene->tex_float4_grid:
+		                                                   dscene->tex_float_grid;
+
+		if(tex_majorants.size() < tex_grids.size()) {
+			tex_majorants.resize(tex_grids.size(), NULL);
+		}
+
+		for(size_t slot = 0; slot < tex_majorants.size(); slot++) {
+			const int flat_slot = type_index_to_flattened_slot(slot, type);
+			const string name = string_printf("__tex_majorant_%s_%03d", name_from_type(type).c_str(), flat_slot);
+			device_vector<float> *&tex_majorant = tex_majorants[slot];
+
+			device_free_majorant(device, name, tex_majorant);
+
+			map<int, vector<float> >::const_iterator it = majorants.find(flat_slot);
+			device_vector<int> *tex_grid = (slot < tex_grids.size())? tex_grids[slot]: NULL;
+			if(it == majorants.end() || !tex_grid) {
+				continue;
+			}
+
+			/* Majorants are stored on the same grid as the tiles. */
+			const vector<float>& majorant = it->second;
+			assert(majorant.size() == tex_grid->size());
+
+			tex_majorant = new device_vector<float>();
+			float *data = tex_majorant->resize(tex_grid->data_width,
+			                                   tex_grid->data_height,
+			                                   tex_grid->data_depth);
+			memcpy(data, &majorant[0], sizeof(float)*majorant.size());
+
+			thread_scoped_lock device_lock(device_mutex);
+			device->tex_alloc(name.c_str(),
+			                  *tex_majorant,
+			                  INTERPOLATION_CLOSEST,
+			                  EXTENSION_CLIP);
+		}
+	}
+}
+
+void ImageManager::device_free_majorant(Device *device,
+                                        const string& name,
+                                        device_vector<float> *&tex_majorant)
+{
+	if(!tex_majorant) {
+		return;
+	}
+
+	thread_scoped_lock device_lock(device_mutex);
+	device->tex_free(*tex_majorant);
+
+	/* The image in the kernel keeps pointing to the majorant until another
+	 * one is allocated, reset it with an empty one. */
+	tex_majorant->clear();
+	device->tex_alloc(name.c_str(),
+	                  *tex_majorant,
+	                  INTERPOLATION_CLOSEST,
+	                  EXTENSION_CLIP);
+	device->tex_free(*tex_majorant);
+
+	delete tex_majorant;
+	tex_majorant = NULL;
+}
+
 void ImageManager::device_load_image(Device *device,
                                      DeviceScene *dscene,
                                      Scene *scene,
@@ -829,16 +1167,30 @@ void ImageManager::device_load_image(Device *device,
 	int flat_slot = type_index_to_flattened_slot(slot, type);
 
 	string name = string_printf("__tex_image_%s_%03d", name_from_type(type).c_str(), flat_slot);
+	string grid_name = string_printf("__tex_grid_%s_%03d", name_from_type(type).c_str(), flat_slot);
+	string majorant_name = string_printf("__tex_majorant_%s_%03d", name_from_type(type).c_str(), flat_slot);
 
 	if(type == IMAGE_DATA_TYPE_FLOAT4) {
 		if(dscene->tex_float4_image[slot] == NULL)
 			dscene->tex_float4_image[slot] = new device_vector<float4>();
 		device_vector<float4>& tex_img = *dscene->tex_float4_image[slot];
+		device_vector<int> *&tex_grid = dscene->tex_float4_grid[slot];
 
+		if(slot < dscene->tex_float4_majorant.size()) {
+			device_free_majorant(device, majorant_name, dscene->tex_float4_majorant[slot]);
+		}
 		if(tex_img.device_pointer) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_free(tex_img);
 		}
+		if(tex_grid) {
+			if(tex_grid->device_pointer) {
+				thread_scoped_lock device_lock(device_mutex);
+				device->tex_free(*tex_grid);
+			}
+			delete tex_grid;
+			tex_grid = NULL;
+		}
 
 		if(!file_load_image<TypeDesc::FLOAT, float>(img,
 		                                            type,
@@ -854,12 +1206,26 @@ void ImageManager::device_load_image(Device *device,
 			pixels[3] = TEX_IMAGE_MISSING_A;
 		}
 
+		if(has_sparse_images && !pack_images) {
+			tex_grid = new device_vector<int>();
+			if(!make_sparse_image(tex_img, *tex_grid)) {
+				delete tex_grid;
+				tex_grid = NULL;
+			}
+		}
+
 		if(!pack_images) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_alloc(name.c_str(),
 			                  tex_img,
 			                  img->interpolation,
 			                  img->extension);
+			if(tex_grid) {
+				device->tex_alloc(grid_name.c_str(),
+				                  *tex_grid,
+				                  INTERPOLATION_CLOSEST,
+				                  EXTENSION_CLIP);
+			}
 		}
 	}
 	else if(type == IMAGE_DATA_TYPE_FLOAT) {
@@ -869,11 +1235,23 @@ void ImageManager::device_load_image(Device *device,
 		if(dscene->tex_float_image[slot] == NULL)
 			dscene->tex_float_image[slot] = new device_vector<float>();
 		device_vector<float>& tex_img = *dscene->tex_float_image[slot];
+		device_vector<int> *&tex_grid = dscene->tex_float_grid[slot];
 
+		if(slot < dscene->tex_float_majorant.size()) {
+			device_free_majorant(device, majorant_name, dscene->tex_float_majorant[slot]);
+		}
 		if(tex_img.device_pointer) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_free(tex_img);
 		}
+		if(tex_grid) {
+			if(tex_grid->device_pointer) {
+				thread_scoped_lock device_lock(device_mutex);
+				device->tex_free(*tex_grid);
+			}
+			delete tex_grid;
+			tex_grid = NULL;
+		}
 
 		if(!file_load_image<TypeDesc::FLOAT, float>(img,
 		                                            type,
@@ -886,12 +1264,26 @@ void ImageManager::device_load_image(Device *device,
 			pixels[0] = TEX_IMAGE_MISSING_R;
 		}
 
+		if(has_sparse_images && !pack_images) {
+			tex_grid = new device_vector<int>();
+			if(!make_sparse_image(tex_img, *tex_grid)) {
+				delete tex_grid;
+				tex_grid = NULL;
+			}
+		}
+
 		if(!pack_images) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_alloc(name.c_str(),
 			                  tex_img,
 			                  img->interpolation,
 			                  img->extension);
+			if(tex_grid) {
+				device->tex_alloc(grid_name.c_str(),
+				                  *tex_grid,
+				                  INTERPOLATION_CLOSEST,
+				                  EXTENSION_CLIP);
+			}
 		}
 	}
 	else if(type == IMAGE_DATA_TYPE_BYTE4) {
@@ -1099,11 +1491,27 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageD
 
 	if(img) {
 		if(oiio_texture_system && !img->builtin_data) {
-			ustring filename(images[type][slot]->filename);
-		//	((OIIO::TextureSystem*)oiio_texture_system)->invalidate(filename);
+			/* Drop cached tiles, so a changed file on disk is read again.
+			 * Texture system is private to this session, so this does not
+			 * affect other renders. */
+			OIIO::ustring filename(images[type][slot]->filename.c_str());
+			((OIIO::TextureSystem*)oiio_texture_system)->invalidate(filename);
 		}
 		else {
 			device_memory *tex_img = NULL;
+			device_memory *tex_grid = NULL;
+
+			if(type == IMAGE_DATA_TYPE_FLOAT4 || type == IMAGE_DATA_TYPE_FLOAT) {
+				std::vector<device_vector<float>*>& tex_majorants = (type == IMAGE_DATA_TYPE_FLOAT4)?
+					dscene->tex_float4_majorant: dscene->tex_float_majorant;
+
+				if(slot < tex_majorants.size()) {
+					const int flat_slot = type_index_to_flattened_slot(slot, type);
+					const string name = string_printf("__tex_majorant_%s_%03d", name_from_type(type).c_str(), flat_slot);
+					device_free_majorant(device, name, tex_majorants[slot]);
+				}
+			}
+
 			switch(type) {
 				case IMAGE_DATA_TYPE_FLOAT4:
 					if(slot >= dscene->tex_float4_image.size()) {
@@ -1111,6 +1519,10 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageD
 					}
 					tex_img = dscene->tex_float4_image[slot];
 					dscene->tex_float4_image[slot] = NULL;
+					if(slot < dscene->tex_float4_grid.size()) {
+						tex_grid = dscene->tex_float4_grid[slot];
+						dscene->tex_float4_grid[slot] = NULL;
+					}
 					break;
 				case IMAGE_DATA_TYPE_FLOAT:
 					if(slot >= dscene->tex_float_image.size()) {
@@ -1118,6 +1530,10 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageD
 					}
 					tex_img = dscene->tex_float_image[slot];
 					dscene->tex_float_image[slot] = NULL;
+					if(slot < dscene->tex_float_grid.size()) {
+						tex_grid = dscene->tex_float_grid[slot];
+						dscene->tex_float_grid[slot] = NULL;
+					}
 					break;
 				case IMAGE_DATA_TYPE_BYTE:
 					if(slot >= dscene->tex_byte_image.size()) {
@@ -1173,6 +1589,14 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageD
 
 				delete tex_img;
 			}
+			if(tex_grid) {
+				if(tex_grid->device_pointer) {
+					thread_scoped_lock device_lock(device_mutex);
+					device->tex_free(*tex_grid);
+				}
+
+				delete tex_grid;
+			}
 		}
 
 		delete images[type][slot];
@@ -1192,6 +1616,8 @@ void ImageManager::device_prepare_update(DeviceScene *dscene)
 			case IMAGE_DATA_TYPE_FLOAT4:
 				if (dscene->tex_float4_image.size() <= tex_num_images[IMAGE_DATA_TYPE_FLOAT4])
 					dscene->tex_float4_image.resize(tex_num_images[IMAGE_DATA_TYPE_FLOAT4]);
+				if (dscene->tex_float4_grid.size() < dscene->tex_float4_image.size())
+					dscene->tex_float4_grid.resize(dscene->tex_float4_image.size());
 				break;
 			case IMAGE_DATA_TYPE_BYTE:
 				if (dscene->tex_byte_image.size() <= tex_num_images[IMAGE_DATA_TYPE_BYTE])
@@ -1200,6 +1626,8 @@ void ImageManager::device_prepare_update(DeviceScene *dscene)
 			case IMAGE_DATA_TYPE_FLOAT:
 				if (dscene->tex_float_image.size() <= tex_num_images[IMAGE_DATA_TYPE_FLOAT])
 					dscene->tex_float_image.resize(tex_num_images[IMAGE_DATA_TYPE_FLOAT]);
+				if (dscene->tex_float_grid.size() < dscene->tex_float_image.size())
+					dscene->tex_float_grid.resize(dscene->tex_float_image.size());
 				break;
 			case IMAGE_DATA_TYPE_HALF4:
 				if (dscene->tex_half4_image.size() <= tex_num_images[IMAGE_DATA_TYPE_HALF4])
@@ -1506,6 +1934,10 @@ void ImageManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->tex_byte_image.clear();
 	dscene->tex_float4_image.clear();
 	dscene->tex_float_image.clear();
+	dscene->tex_float4_grid.clear();
+	dscene->tex_float_grid.clear();
+	dscene->tex_float4_majorant.clear();
+	dscene->tex_float_majorant.clear();
 	dscene->tex_half4_image.clear();
 	dscene->tex_half_image.clear();
 
@@ -21,6 +21,7 @@
 #include "device/device_memory.h"
 
 #include "util/util_image.h"
+#include "util/util_map.h"
 #include "util/util_string.h"
 #include "util/util_thread.h"
 #include "util/util_vector.h"
@@ -79,9 +80,26 @@ public:
 	void set_oiio_texture_system(void *texture_system);
 	const string get_mip_map_path(const string& filename);
 	void set_pack_images(bool pack_images_);
+	void set_half_float_textures(bool use_half_float_);
 	bool set_animation_frame_update(int frame);
 
 	device_memory *image_memory(DeviceScene *dscene, int flat_slot);
+	/* Tile grid of a 3D image stored sparse, NULL if stored dense. */
+	device_vector<int> *image_grid(DeviceScene *dscene, int flat_slot);
+
+	/* Mark tiles of sparse images active where any of the other given
+	 * images is not empty, so empty space skipping based on one of them
+	 * is valid for all. */
+	void device_merge_sparse_images(Device *device,
+	                                DeviceScene *dscene,
+	                                const vector<int>& flat_slots);
+
+	/* Replace the extinction majorants per tile of sparse images with the
+	 * given ones, indexed by flat slot. Majorants of other images are
+	 * removed. */
+	void device_update_majorants(Device *device,
+	                             DeviceScene *dscene,
+	                             const map<int, vector<float> >& majorants);
 
 	bool need_update;
 
@@ -131,6 +149,7 @@ private:
 	int tex_num_images[IMAGE_DATA_NUM_TYPES];
 	int max_num_images;
 	bool has_half_images;
+	bool has_sparse_images;
 	bool cuda_fermi_limits;
 
 	thread_mutex device_mutex;
@@ -139,6 +158,7 @@ private:
 	vector<Image*> images[IMAGE_DATA_NUM_TYPES];
 	void *oiio_texture_system;
 	bool pack_images;
+	bool use_half_float;
 
 	bool file_load_image_generic(Image *img, ImageInput **in, int &width, int &height, int &depth, int &components);
 
@@ -156,6 +176,13 @@ private:
 
 	uint8_t pack_image_options(ImageDataType type, size_t slot);
 
+	template<typename T>
+	bool make_sparse_image(device_vector<T>& tex_img, device_vector<int>& tex_grid);
+
+	void device_free_majorant(Device *device,
+	                          const string& name,
+	                          device_vector<float> *&tex_majorant);
+
 	void device_load_image(Device *device,
 	                       DeviceScene *dscene,
 	                       Scene *scene,
@@ -47,6 +47,8 @@ NODE_DEFINE(Integrator)
 
 	SOCKET_INT(volume_max_steps, "Volume Max Steps", 1024);
 	SOCKET_FLOAT(volume_step_size, "Volume Step Size", 0.1f);
+	SOCKET_BOOLEAN(volume_skip_empty, "Volume Skip Empty", false);
+	SOCKET_BOOLEAN(volume_majorant_tracking, "Volume Majorant Tracking", true);
 
 	SOCKET_BOOLEAN(caustics_reflective, "Reflective Caustics", true);
 	SOCKET_BOOLEAN(caustics_refractive, "Refractive Caustics", true);
@@ -69,6 +71,10 @@ NODE_DEFINE(Integrator)
 	SOCKET_BOOLEAN(sample_all_lights_direct, "Sample All Lights Direct", true);
 	SOCKET_BOOLEAN(sample_all_lights_indirect, "Sample All Lights Indirect", true);
 	SOCKET_FLOAT(light_sampling_threshold, "Light Sampling Threshold", 0.05f);
+	SOCKET_BOOLEAN(use_light_tree, "Use Light Tree", false);
+
+	SOCKET_FLOAT(adaptive_threshold, "Adaptive Threshold", 0.0f);
+	SOCKET_INT(adaptive_min_samples, "Adaptive Min Samples", 0);
 
 	static NodeEnum method_enum;
 	method_enum.insert("path", PATH);
@@ -141,6 +147,8 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 
 	kintegrator->volume_max_steps = volume_max_steps;
 	kintegrator->volume_step_size = volume_step_size;
+	kintegrator->volume_skip_empty = volume_skip_empty;
+	kintegrator->volume_majorant_tracking = volume_majorant_tracking;
 
 	kintegrator->caustics_reflective = caustics_reflective;
 	kintegrator->caustics_refractive = caustics_refractive;
@@ -183,6 +191,20 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 		kintegrator->light_inv_rr_threshold = 0.0f;
 	}
 
+	/* Adaptive sampling. Convergence is tested every few samples only, after
+	 * an even number of samples so both halves of the error estimate hold the
+	 * same number of samples. */
+	kintegrator->adaptive_threshold = adaptive_threshold;
+	kintegrator->adaptive_step = 4;
+	if(adaptive_min_samples > 0) {
+		kintegrator->adaptive_min_samples = adaptive_min_samples;
+	}
+	else {
+		kintegrator->adaptive_min_samples = max(4, (int)sqrtf((float)aa_samples));
+	}
+	kintegrator->adaptive_min_samples = align_up(kintegrator->adaptive_min_samples,
+	                                             kintegrator->adaptive_step);
+
 	/* sobol directions table */
 	int max_samples = 1;
 
@@ -0,0 +1,392 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/lazy_dicing.h"
+
+#include "render/camera.h"
+#include "render/mesh.h"
+#include "render/object.h"
+#include "render/scene.h"
+#include "render/shader.h"
+
+#include "subd/subd_dice.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_atomic.h"
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+#include "util/util_progress.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Diced Patch */
+
+LazyDicingGrid::LazyDicingGrid(int tri_, int level_)
+: tri(tri_), level(level_), resolution(1 << level_),
+  num_users(0), lru_prev(NULL), lru_next(NULL)
+{
+	verts.resize(((resolution + 1)*(resolution + 2))/2);
+	/* Inner nodes of a complete 4-ary tree with 4^level leaves. */
+	nodes.resize(((1 << (2*level)) - 1)/3);
+}
+
+void LazyDicingGrid::build()
+{
+	if(level > 0) {
+		build_node(0, 0, 0, 0, true);
+	}
+}
+
+void LazyDicingGrid::compute_normals()
+{
+	normals.clear();
+	normals.resize(verts.size(), make_float3(0.0f, 0.0f, 0.0f));
+
+	for(int a = 0; a < resolution; a++) {
+		for(int b = 0; b < resolution - a; b++) {
+			/* Upright triangle at (a, b), and the inverted one next to it
+			 * except on the last diagonal. */
+			for(int k = 0; k < 2; k++) {
+				const bool upright = (k == 0);
+				if(!upright && a + b == resolution - 1) {
+					break;
+				}
+
+				int v[3][2];
+				triangle(a, b, upright, v);
+
+				const int i0 = vert_index(v[0][0], v[0][1]);
+				const int i1 = vert_index(v[1][0], v[1][1]);
+				const int i2 = vert_index(v[2][0], v[2][1]);
+
+				/* Area weighted, same orientation as the Ng of hits. */
+				const float3 Ng = cross(verts[i1] - verts[i0], verts[i2] - verts[i0]);
+				normals[i0] += Ng;
+				normals[i1] += Ng;
+				normals[i2] += Ng;
+			}
+		}
+	}
+
+	for(size_t i = 0; i < normals.size(); i++) {
+		normals[i] = safe_normalize(normals[i]);
+	}
+}
+
+BoundBox LazyDicingGrid::build_node(int index, int node_level, int a, int b, bool upright)
+{
+	const int size = resolution >> node_level;
+	BoundBox bounds = BoundBox::empty;
+
+	if(size == 1) {
+		int v[3][2];
+		triangle(a, b, upright, v);
+
+		for(int k = 0; k < 3; k++) {
+			bounds.grow(verts[vert_index(v[k][0], v[k][1])]);
+		}
+
+		return bounds;
+	}
+
+	int child_a[4], child_b[4];
+	bool child_upright[4];
+	children(a, b, size, upright, child_a, child_b, child_upright);
+
+	for(int k = 0; k < 4; k++) {
+		bounds.grow(build_node(4*index + 1 + k,
+		                       node_level + 1,
+		                       child_a[k],
+		                       child_b[k],
+		                       child_upright[k]));
+	}
+
+	nodes[index] = bounds;
+	return bounds;
+}
+
+size_t LazyDicingGrid::memory_size() const
+{
+	return sizeof(LazyDicingGrid) +
+	       verts.capacity()*sizeof(float3) +
+	       normals.capacity()*sizeof(float3) +
+	       nodes.capacity()*sizeof(BoundBox);
+}
+
+/* Lazy Dicing */
+
+LazyDicing::LazyDicing()
+: shard_memory_limit(0)
+{
+}
+
+LazyDicing::~LazyDicing()
+{
+	free_grids();
+}
+
+static int lazy_dicing_edge_level(const SubdParams& params, float3 P0, float3 P1)
+{
+	float T;
+
+	if(params.camera) {
+		P0 = transform_point(&params.objecttoworld, P0);
+		P1 = transform_point(&params.objecttoworld, P1);
+
+		T = len(P1 - P0) / params.camera->world_to_raster_size((P0 + P1)*0.5f);
+	}
+	else {
+		T = len(P1 - P0);
+	}
+
+	T /= params.dicing_rate;
+
+	if(!(T > 1.0f)) {
+		return 0;
+	}
+
+	return min((int)ceilf(log2f(T)), LAZY_DICING_MAX_LEVEL);
+}
+
+void LazyDicing::device_update(Scene *scene, Progress& progress)
+{
+	device_free();
+
+	shard_memory_limit = ((size_t)max(scene->params.lazy_dicing_cache_size, 1) * 1024 * 1024) /
+	                     LAZY_DICING_NUM_SHARDS;
+
+	/* Displacement is evaluated with the first object using the mesh, same as
+	 * regular true displacement. */
+	map<Mesh*, int> mesh_object;
+	for(size_t i = 0; i < scene->objects.size(); i++) {
+		Mesh *mesh = scene->objects[i]->mesh;
+		if(mesh->use_lazy_dicing && mesh_object.find(mesh) == mesh_object.end()) {
+			mesh_object[mesh] = i;
+		}
+	}
+
+	if(mesh_object.size() == 0) {
+		return;
+	}
+
+	size_t tri_size = 0;
+	foreach(Mesh *mesh, scene->meshes) {
+		tri_size = max(tri_size, mesh->tri_offset + mesh->num_triangles());
+	}
+
+	tri_params.resize(tri_size, 0);
+	tri_object.resize(tri_size, OBJECT_NONE);
+
+	size_t num_patches = 0;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		map<Mesh*, int>::iterator it = mesh_object.find(mesh);
+		if(it == mesh_object.end() || !mesh->subd_params) {
+			continue;
+		}
+
+		progress.set_status("Updating Mesh", "Computing lazy dicing parameters");
+
+		const SubdParams& params = *mesh->subd_params;
+		const size_t num_triangles = mesh->num_triangles();
+
+		for(size_t j = 0; j < num_triangles; j++) {
+			Mesh::Triangle t = mesh->get_triangle(j);
+			uint tri_param = 0;
+
+			for(int edge = 0; edge < 3; edge++) {
+				/* Order end points by index, so both patches sharing the edge
+				 * get exactly the same level. */
+				int v0 = t.v[edge], v1 = t.v[(edge + 1) % 3];
+				if(v0 > v1) {
+					swap(v0, v1);
+				}
+
+				const int level = lazy_dicing_edge_level(params, mesh->verts[v0], mesh->verts[v1]);
+				tri_param |= (uint)level << (edge*8);
+			}
+
+			Shader *shader = (mesh->shader[j] < mesh->used_shaders.size())?
+				mesh->used_shaders[mesh->shader[j]]: scene->default_surface;
+
+			if(shader->has_displacement && shader->displacement_method != DISPLACE_BUMP) {
+				tri_param |= LAZY_DICING_DISPLACE;
+			}
+			if(mesh->smooth[j]) {
+				tri_param |= LAZY_DICING_SMOOTH;
+			}
+
+			tri_params[mesh->tri_offset + j] = tri_param;
+			tri_object[mesh->tri_offset + j] = it->second;
+		}
+
+		num_patches += num_triangles;
+
+		if(progress.get_cancel()) return;
+	}
+
+	VLOG(1) << "Lazy dicing " << num_patches << " patches, cache size "
+	        << string_human_readable_size(shard_memory_limit * LAZY_DICING_NUM_SHARDS) << ".";
+}
+
+void LazyDicing::device_free()
+{
+	size_t num_diced = 0, num_cached = 0, memory = 0;
+
+	for(int i = 0; i < LAZY_DICING_NUM_SHARDS; i++) {
+		num_diced += shards[i].num_diced;
+		num_cached += shards[i].grids.size();
+		memory += shards[i].memory;
+	}
+
+	if(num_diced) {
+		VLOG(1) << "Lazy dicing diced " << num_diced << " patches, "
+		        << num_cached << " cached using "
+		        << string_human_readable_size(memory) << ".";
+	}
+
+	free_grids();
+
+	tri_params.clear();
+	tri_object.clear();
+}
+
+void LazyDicing::free_grids()
+{
+	for(int i = 0; i < LAZY_DICING_NUM_SHARDS; i++) {
+		Shard& shard = shards[i];
+
+		for(unordered_map<int, LazyDicingGrid*>::iterator it = shard.grids.begin();
+		    it != shard.grids.end();
+		    ++it)
+		{
+			delete it->second;
+		}
+
+		shard.grids.clear();
+		shard.lru_head = NULL;
+		shard.lru_tail = NULL;
+		shard.memory = 0;
+		shard.num_diced = 0;
+	}
+}
+
+LazyDicingGrid *LazyDicing::find(int tri)
+{
+	Shard& shard = shards[tri % LAZY_DICING_NUM_SHARDS];
+	thread_scoped_spin_lock lock(shard.lock);
+
+	unordered_map<int, LazyDicingGrid*>::iterator it = shard.grids.find(tri);
+	if(it == shard.grids.end()) {
+		return NULL;
+	}
+
+	LazyDicingGrid *grid = it->second;
+	atomic_add_and_fetch_uint32(&grid->num_users, 1);
+
+	/* Move to front of the LRU list. */
+	if(grid != shard.lru_head) {
+		grid->lru_prev->lru_next = grid->lru_next;
+		if(grid->lru_next) {
+			grid->lru_next->lru_prev = grid->lru_prev;
+		}
+		else {
+			shard.lru_tail = grid->lru_prev;
+		}
+
+		grid->lru_prev = NULL;
+		grid->lru_next = shard.lru_head;
+		shard.lru_head->lru_prev = grid;
+		shard.lru_head = grid;
+	}
+
+	return grid;
+}
+
+LazyDicingGrid *LazyDicing::insert(LazyDicingGrid *grid)
+{
+	const int shard_index = grid->tri % LAZY_DICING_NUM_SHARDS;
+	Shard& shard = shards[shard_index];
+	thread_scoped_spin_lock lock(shard.lock);
+
+	/* Another thread diced the same patch in the meantime. */
+	unordered_map<int, LazyDicingGrid*>::iterator it = shard.grids.find(grid->tri);
+	if(it != shard.grids.end()) {
+		delete grid;
+		grid = it->second;
+		atomic_add_and_fetch_uint32(&grid->num_users, 1);
+		return grid;
+	}
+
+	grid->num_users = 1;
+	grid->lru_prev = NULL;
+	grid->lru_next = shard.lru_head;
+	if(shard.lru_head) {
+		shard.lru_head->lru_prev = grid;
+	}
+	else {
+		shard.lru_tail = grid;
+	}
+	shard.lru_head = grid;
+
+	shard.grids[grid->tri] = grid;
+	shard.memory += grid->memory_size();
+	shard.num_diced++;
+
+	evict(shard_index);
+
+	return grid;
+}
+
+void LazyDicing::release(LazyDicingGrid *grid)
+{
+	atomic_sub_and_fetch_uint32(&grid->num_users, 1);
+}
+
+void LazyDicing::evict(int shard_index)
+{
+	/* Called with the shard locked. Grids still in use by other threads are
+	 * skipped, so the limit may be exceeded temporarily. */
+	Shard& shard = shards[shard_index];
+	LazyDicingGrid *grid = shard.lru_tail;
+
+	while(grid && shard.memory > shard_memory_limit) {
+		LazyDicingGrid *prev = grid->lru_prev;
+
+		if(grid->num_users == 0) {
+			if(prev) {
+				prev->lru_next = grid->lru_next;
+			}
+			else {
+				shard.lru_head = grid->lru_next;
+			}
+			if(grid->lru_next) {
+				grid->lru_next->lru_prev = prev;
+			}
+			else {
+				shard.lru_tail = prev;
+			}
+
+			shard.grids.erase(grid->tri);
+			shard.memory -= grid->memory_size();
+			delete grid;
+		}
+
+		grid = prev;
+	}
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LAZY_DICING_H__
+#define __LAZY_DICING_H__
+
+#include "util/util_boundbox.h"
+#include "util/util_map.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class Mesh;
+class Progress;
+class Scene;
+
+/* Lazy Dicing
+ *
+ * Meshes with adaptive subdivision are only tessellated into coarse patches,
+ * which are placed in the BVH with bounds padded by the displacement bound of
+ * their shaders. A patch is diced and displaced the first time a ray enters
+ * its bounds, into a cache of limited size from which least recently used
+ * grids are evicted. Memory usage thereby no longer depends on the dicing
+ * rate and displacement detail of the whole mesh.
+ *
+ * Only supported with Embree on the CPU, where patches are user geometry
+ * intersected by callbacks in bvh_embree.cpp, and SVM which can evaluate
+ * displacement from within traversal. */
+
+/* Patches are tessellated with this many times the dicing rate. */
+#define LAZY_DICING_PATCH_SCALE 8.0f
+/* Patches are diced into at most 2^level segments per edge. */
+#define LAZY_DICING_MAX_LEVEL 6
+/* Shape factor of Phong tessellation, bulging smooth patches towards the
+ * surface their vertex normals describe. */
+#define LAZY_DICING_PHONG_ALPHA 0.75f
+/* Number of independently locked parts of the cache. */
+#define LAZY_DICING_NUM_SHARDS 64
+
+/* Per patch dicing parameters, packed in an uint. */
+#define LAZY_DICING_EDGE_LEVEL(params, edge) (((params) >> ((edge)*8)) & 0xff)
+#define LAZY_DICING_DISPLACE (1 << 24)
+#define LAZY_DICING_SMOOTH (1 << 25)
+
+/* Diced Patch
+ *
+ * Regular grid of (N+1)(N+2)/2 vertices over the barycentric coordinates of
+ * the patch, with N = 2^level. Grid point (a, b) is at barycentric u = a/N
+ * and v = b/N. Triangles are recursively split into four at their edge
+ * midpoints, giving an implicit 4-ary tree with the micropolygons as leaves.
+ * Bounds are stored for inner nodes only. */
+
+class LazyDicingGrid {
+public:
+	explicit LazyDicingGrid(int tri, int level);
+
+	int tri;
+	int level;
+	int resolution;
+
+	vector<float3> verts;
+	/* Vertex normals for smooth shading, empty for flat patches. */
+	vector<float3> normals;
+	vector<BoundBox> nodes;
+
+	/* Compute bounds of inner nodes, after verts were filled in. */
+	void build();
+	/* Compute normals from the micropolygons around each vertex. */
+	void compute_normals();
+
+	size_t memory_size() const;
+
+	int vert_index(int a, int b) const
+	{
+		return a*(resolution + 1) - (a*(a - 1))/2 + b;
+	}
+
+	/* Vertices of the triangle with corner (a, b) and size of one grid cell,
+	 * ordered so the winding matches the patch. Upright triangles span
+	 * (a, b) to (a+1, b) and (a, b+1), inverted ones (a+1, b), (a, b+1) and
+	 * (a+1, b+1). */
+	void triangle(int a, int b, bool upright, int v[3][2]) const
+	{
+		if(upright) {
+			v[0][0] = a + 1; v[0][1] = b;
+			v[1][0] = a;     v[1][1] = b + 1;
+			v[2][0] = a;     v[2][1] = b;
+		}
+		else {
+			v[0][0] = a + 1; v[0][1] = b + 1;
+			v[1][0] = a;     v[1][1] = b + 1;
+			v[2][0] = a + 1; v[2][1] = b;
+		}
+	}
+
+	/* Corners and orientation of the four children of a node of the given
+	 * size, in the order of their index in the tree. */
+	static void children(int a, int b, int size, bool upright,
+	                     int child_a[4], int child_b[4], bool child_upright[4])
+	{
+		const int h = size/2;
+
+		if(upright) {
+			child_a[0] = a;     child_b[0] = b;     child_upright[0] = true;
+			child_a[1] = a + h; child_b[1] = b;     child_upright[1] = true;
+			child_a[2] = a;     child_b[2] = b + h; child_upright[2] = true;
+			child_a[3] = a;     child_b[3] = b;     child_upright[3] = false;
+		}
+		else {
+			child_a[0] = a + h; child_b[0] = b;     child_upright[0] = false;
+			child_a[1] = a;     child_b[1] = b + h; child_upright[1] = false;
+			child_a[2] = a + h; child_b[2] = b + h; child_upright[2] = false;
+			child_a[3] = a + h; child_b[3] = b + h; child_upright[3] = true;
+		}
+	}
+
+	/* Cache bookkeeping, owned by LazyDicing. */
+	uint32_t num_users;
+	LazyDicingGrid *lru_prev;
+	LazyDicingGrid *lru_next;
+
+protected:
+	BoundBox build_node(int index, int node_level, int a, int b, bool upright);
+};
+
+class LazyDicing {
+public:
+	LazyDicing();
+	~LazyDicing();
+
+	/* Compute dicing parameters of patches, meshes must have their offsets
+	 * computed already. Also frees all cached grids. */
+	void device_update(Scene *scene, Progress& progress);
+	void device_free();
+
+	/* Parameters and object used for displacement of each patch, indexed by
+	 * triangle. */
+	vector<uint> tri_params;
+	vector<int> tri_object;
+
+	/* Grid cache, safe to use from multiple threads while rendering. A found
+	 * or inserted grid stays valid until it is released again. */
+	LazyDicingGrid *find(int tri);
+	LazyDicingGrid *insert(LazyDicingGrid *grid);
+	void release(LazyDicingGrid *grid);
+
+	/* Snap a grid point on an edge diced with a lower level than the grid to
+	 * the points of that edge, so neighboring patches stay watertight. */
+	static void snap(uint params, int level, int a, int b, int *snap_a, int *snap_b)
+	{
+		const int resolution = 1 << level;
+		int shift;
+
+		if(a + b == resolution && (shift = level - (int)LAZY_DICING_EDGE_LEVEL(params, 0)) > 0) {
+			b = (b >> shift) << shift;
+			a = resolution - b;
+		}
+		else if(a == 0 && (shift = level - (int)LAZY_DICING_EDGE_LEVEL(params, 1)) > 0) {
+			b = (b >> shift) << shift;
+		}
+		else if(b == 0 && (shift = level - (int)LAZY_DICING_EDGE_LEVEL(params, 2)) > 0) {
+			a = (a >> shift) << shift;
+		}
+
+		*snap_a = a;
+		*snap_b = b;
+	}
+
+protected:
+	void free_grids();
+	void evict(int shard_index);
+
+	struct Shard {
+		Shard() : lru_head(NULL), lru_tail(NULL), memory(0), num_diced(0) {}
+
+		thread_spin_lock lock;
+		unordered_map<int, LazyDicingGrid*> grids;
+		/* Most recently used first. */
+		LazyDicingGrid *lru_head;
+		LazyDicingGrid *lru_tail;
+		size_t memory;
+		size_t num_diced;
+	};
+
+	Shard shards[LAZY_DICING_NUM_SHARDS];
+	size_t shard_memory_limit;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LAZY_DICING_H__ */
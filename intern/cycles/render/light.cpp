@@ -19,6 +19,7 @@
 #include "render/integrator.h"
 #include "render/film.h"
 #include "render/light.h"
+#include "render/light_tree.h"
 #include "render/mesh.h"
 #include "render/object.h"
 #include "render/scene.h"
@@ -228,6 +229,27 @@ void LightManager::disable_ineffective_light(Device *device, Scene *scene)
 	}
 }
 
+/* Estimated emitted power per unit area of a shader for the light tree. Only
+ * constant emission is known in advance, other emission is assumed to be of
+ * unit strength. */
+static float light_tree_shader_energy(Shader *shader)
+{
+	float3 emission;
+	if(shader->is_constant_emission(&emission)) {
+		return max(average(emission), 0.0f);
+	}
+	return 1.0f;
+}
+
+/* Lamps picked from the light tree instead of uniformly from the distribution.
+ * Distant and background lights are not bounded in space. */
+static bool light_tree_use_lamp(const Light *light)
+{
+	return (light->type == LIGHT_POINT ||
+	        light->type == LIGHT_SPOT ||
+	        light->type == LIGHT_AREA);
+}
+
 bool LightManager::object_usable_as_light(Object *object) {
 	Mesh *mesh = object->mesh;
 	/* Skip objects with NaNs */
@@ -300,6 +322,22 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	float4 *distribution = dscene->light_distribution.resize(num_distribution + 1);
 	float totarea = 0.0f;
 
+	/* Light tree is only supported by the CPU kernel. */
+	const bool use_light_tree = scene->integrator->use_light_tree &&
+	                            device->info.type == DEVICE_CPU &&
+	                            num_distribution > 0;
+	vector<LightTreeEmitter> triangle_emitters;
+	vector<LightTreeEmitter> lamp_emitters;
+	/* Index into the triangle lookup table for each emissive triangle. */
+	vector<uint> triangle_slots;
+	size_t num_triangle_slots = 0;
+	uint4 *light_tree_objects = NULL;
+
+	if(use_light_tree) {
+		light_tree_objects = dscene->light_tree_objects.resize(scene->objects.size());
+		triangle_slots.resize(num_triangles, 0);
+	}
+
 	/* triangles */
 	size_t offset = 0;
 	int j = 0;
@@ -307,6 +345,10 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	foreach(Object *object, scene->objects) {
 		if(progress.get_cancel()) return;
 
+		if(use_light_tree) {
+			light_tree_objects[j] = make_uint4(0, 0, 0, 0);
+		}
+
 		if(!object_usable_as_light(object)) {
 			j++;
 			continue;
@@ -336,6 +378,14 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		}
 
 		size_t mesh_num_triangles = mesh->num_triangles();
+
+		if(use_light_tree) {
+			light_tree_objects[j] = make_uint4(num_triangle_slots,
+			                                   mesh->tri_offset,
+			                                   mesh_num_triangles,
+			                                   0);
+		}
+
 		for(size_t i = 0; i < mesh_num_triangles; i++) {
 			int shader_index = mesh->shader[i];
 			Shader *shader = (shader_index < mesh->used_shaders.size())
@@ -343,6 +393,10 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 			                         : scene->default_surface;
 
 			if(shader->use_mis && shader->has_surface_emission) {
+				if(use_light_tree) {
+					triangle_slots[offset] = num_triangle_slots + i;
+				}
+
 				distribution[offset].x = totarea;
 				distribution[offset].y = __int_as_float(i + mesh->tri_offset);
 				distribution[offset].z = __int_as_float(shader_flag);
@@ -363,10 +417,25 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 					p3 = transform_point(&tfm, p3);
 				}
 
-				totarea += triangle_area(p1, p2, p3);
+				float area = triangle_area(p1, p2, p3);
+				totarea += area;
+
+				if(use_light_tree) {
+					/* Mesh lights emit from both sides. */
+					LightTreeEmitter emitter;
+					emitter.bounds = BoundBox(p1);
+					emitter.bounds.grow(p2);
+					emitter.bounds.grow(p3);
+					emitter.energy = area*light_tree_shader_energy(shader);
+					emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+					emitter.theta_o = M_PI_F;
+					emitter.distribution_id = offset - 1;
+					triangle_emitters.push_back(emitter);
+				}
 			}
 		}
 
+		num_triangle_slots += mesh_num_triangles;
 		j++;
 	}
 
@@ -394,6 +463,45 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 			background_mis = light->use_mis;
 		}
 
+		if(use_light_tree && light_tree_use_lamp(light)) {
+			/* Lamp emission is normalized by the lamp area, so the emitted power
+			 * does not depend on the lamp size and only the strength is used. */
+			Shader *shader = (light->shader) ? light->shader : scene->default_light;
+			LightTreeEmitter emitter;
+			emitter.energy = light_tree_shader_energy(shader);
+			emitter.distribution_id = offset;
+
+			if(light->type == LIGHT_AREA) {
+				float3 axisu = light->axisu*(light->sizeu*light->size);
+				float3 axisv = light->axisv*(light->sizev*light->size);
+				emitter.bounds = BoundBox(light->co - 0.5f*axisu - 0.5f*axisv);
+				emitter.bounds.grow(light->co + 0.5f*axisu - 0.5f*axisv);
+				emitter.bounds.grow(light->co - 0.5f*axisu + 0.5f*axisv);
+				emitter.bounds.grow(light->co + 0.5f*axisu + 0.5f*axisv);
+				emitter.axis = safe_normalize(light->dir);
+				emitter.theta_o = 0.0f;
+			}
+			else {
+				float3 radius = make_float3(light->size, light->size, light->size);
+				emitter.bounds = BoundBox(light->co - radius, light->co + radius);
+				if(light->type == LIGHT_SPOT) {
+					emitter.axis = safe_normalize(light->dir);
+					emitter.theta_o = min(light->spot_angle*0.5f, M_PI_F);
+				}
+				else {
+					emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+					emitter.theta_o = M_PI_F;
+				}
+			}
+
+			/* Every lamp matching the predicate must be in the tree, the kernel
+			 * picks all of them from it. */
+			if(!emitter.bounds.valid()) {
+				emitter.bounds = BoundBox(light->co);
+			}
+			lamp_emitters.push_back(emitter);
+		}
+
 		light_index++;
 		offset++;
 	}
@@ -469,9 +577,60 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 			kintegrator->portal_offset = 0;
 			kintegrator->portal_pdf = 0.0f;
 		}
+
+		/* Light tree */
+		kintegrator->use_light_tree = false;
+		kintegrator->light_tree_triangle_root = -1;
+		kintegrator->light_tree_lamp_root = -1;
+		kintegrator->num_light_tree_lamps = 0;
+
+		if(use_light_tree && (triangle_emitters.size() || lamp_emitters.size())) {
+			/* Separate trees for triangles and lamps, so the share of samples
+			 * between both stays the same as with the distribution. */
+			LightTree tree;
+			kintegrator->light_tree_triangle_root = tree.build(triangle_emitters);
+			const size_t num_triangle_emitters = tree.emitters.size();
+			kintegrator->light_tree_lamp_root = tree.build(lamp_emitters);
+			kintegrator->num_light_tree_lamps = lamp_emitters.size();
+			kintegrator->use_light_tree = true;
+
+			VLOG(1) << "Light tree with " << tree.nodes.size() / LIGHT_TREE_NODE_SIZE
+			        << " nodes for " << tree.emitters.size() << " emitters.";
+
+			/* Lookup of emitter from triangle, needed to get the light pdf of
+			 * mesh lights hit by BSDF rays. Zero means not in the tree. */
+			uint *triangle_map = dscene->light_tree_triangles.resize(max(num_triangle_slots, (size_t)1));
+			memset(triangle_map, 0, sizeof(uint)*dscene->light_tree_triangles.size());
+			for(size_t i = 0; i < num_triangle_emitters; i++) {
+				const int distribution_id = __float_as_int(tree.emitters[i].x);
+				triangle_map[triangle_slots[distribution_id]] = i + 1;
+			}
+
+			/* Lookup of emitter from lamp, used by the kernel to decide which
+			 * lamps are picked from the tree and to get their light pdf. */
+			uint *lamp_map = dscene->light_tree_lamps.resize(max(num_lights, (size_t)1));
+			memset(lamp_map, 0, sizeof(uint)*dscene->light_tree_lamps.size());
+			for(size_t i = num_triangle_emitters; i < tree.emitters.size(); i++) {
+				const int distribution_id = __float_as_int(tree.emitters[i].x);
+				lamp_map[distribution_id - num_triangles] = i + 1;
+			}
+
+			dscene->light_tree_nodes.copy(&tree.nodes[0], tree.nodes.size());
+			dscene->light_tree_emitters.copy(&tree.emitters[0], tree.emitters.size());
+
+			device->tex_alloc("__light_tree_nodes", dscene->light_tree_nodes);
+			device->tex_alloc("__light_tree_emitters", dscene->light_tree_emitters);
+			device->tex_alloc("__light_tree_objects", dscene->light_tree_objects);
+			device->tex_alloc("__light_tree_triangles", dscene->light_tree_triangles);
+			device->tex_alloc("__light_tree_lamps", dscene->light_tree_lamps);
+		}
+		else {
+			dscene->light_tree_objects.clear();
+		}
 	}
 	else {
 		dscene->light_distribution.clear();
+		dscene->light_tree_objects.clear();
 
 		kintegrator->num_distribution = 0;
 		kintegrator->num_all_lights = 0;
@@ -482,6 +641,10 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		kintegrator->num_portals = 0;
 		kintegrator->portal_offset = 0;
 		kintegrator->portal_pdf = 0.0f;
+		kintegrator->use_light_tree = false;
+		kintegrator->light_tree_triangle_root = -1;
+		kintegrator->light_tree_lamp_root = -1;
+		kintegrator->num_light_tree_lamps = 0;
 
 		kfilm->pass_shadow_scale = 1.0f;
 	}
@@ -877,11 +1040,21 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->light_data);
 	device->tex_free(dscene->light_background_marginal_cdf);
 	device->tex_free(dscene->light_background_conditional_cdf);
+	device->tex_free(dscene->light_tree_nodes);
+	device->tex_free(dscene->light_tree_emitters);
+	device->tex_free(dscene->light_tree_objects);
+	device->tex_free(dscene->light_tree_triangles);
+	device->tex_free(dscene->light_tree_lamps);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
 	dscene->light_background_marginal_cdf.clear();
 	dscene->light_background_conditional_cdf.clear();
+	dscene->light_tree_nodes.clear();
+	dscene->light_tree_emitters.clear();
+	dscene->light_tree_objects.clear();
+	dscene->light_tree_triangles.clear();
+	dscene->light_tree_lamps.clear();
 }
 
 void LightManager::tag_update(Scene * /*scene*/)
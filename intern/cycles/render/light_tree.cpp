@@ -0,0 +1,183 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/light_tree.h"
+
+#include "kernel/kernel_types.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Emitters within a leaf are picked by energy only, regardless of the shading
+ * point, so keep leaves small. */
+#define LIGHT_TREE_MAX_LEAF_SIZE 4
+
+/* Grow cone of normals given by axis and theta_o to also contain the other
+ * cone. */
+static void light_tree_cone_merge(float3 *axis,
+                                  float *theta_o,
+                                  float3 other_axis,
+                                  float other_theta_o)
+{
+	float3 a_axis = *axis;
+	float a_theta_o = *theta_o;
+
+	/* Make a the wider cone. */
+	if(a_theta_o < other_theta_o) {
+		swap(a_axis, other_axis);
+		swap(a_theta_o, other_theta_o);
+	}
+
+	*axis = a_axis;
+	*theta_o = a_theta_o;
+
+	if(a_theta_o >= M_PI_F) {
+		return;
+	}
+
+	const float theta_d = safe_acosf(dot(a_axis, other_axis));
+
+	if(min(theta_d + other_theta_o, M_PI_F) <= a_theta_o) {
+		/* Other cone is inside the wider one already. */
+		return;
+	}
+
+	const float new_theta_o = 0.5f*(a_theta_o + theta_d + other_theta_o);
+	const float3 ortho = other_axis - a_axis*dot(a_axis, other_axis);
+	const float ortho_len = len(ortho);
+
+	if(new_theta_o >= M_PI_F || ortho_len < 1e-6f) {
+		/* Covers all directions, or axes are opposite in which case there is
+		 * no well defined axis in between them. */
+		*theta_o = M_PI_F;
+		return;
+	}
+
+	/* Rotate axis of the wider cone towards the other one. */
+	const float theta_r = new_theta_o - a_theta_o;
+	*axis = normalize(a_axis*cosf(theta_r) + ortho*(sinf(theta_r)/ortho_len));
+	*theta_o = new_theta_o;
+}
+
+struct LightTreeCentroidCompare {
+	int dim;
+
+	explicit LightTreeCentroidCompare(int dim_) : dim(dim_) {}
+
+	bool operator()(const LightTreeEmitter& a, const LightTreeEmitter& b) const
+	{
+		const float3 ca = a.centroid();
+		const float3 cb = b.centroid();
+		return (&ca.x)[dim] < (&cb.x)[dim];
+	}
+};
+
+int LightTree::build(vector<LightTreeEmitter>& tree_emitters)
+{
+	if(tree_emitters.size() == 0) {
+		return -1;
+	}
+
+	return recursive_build(tree_emitters, 0, tree_emitters.size(), -1);
+}
+
+int LightTree::recursive_build(vector<LightTreeEmitter>& tree_emitters,
+                               int start,
+                               int end,
+                               int parent)
+{
+	BoundBox bounds = BoundBox::empty;
+	BoundBox centroid_bounds = BoundBox::empty;
+	float energy = 0.0f;
+	float3 axis = tree_emitters[start].axis;
+	float theta_o = tree_emitters[start].theta_o;
+
+	for(int i = start; i < end; i++) {
+		const LightTreeEmitter& emitter = tree_emitters[i];
+
+		bounds.grow(emitter.bounds);
+		centroid_bounds.grow(emitter.centroid());
+		energy += emitter.energy;
+
+		if(i != start) {
+			light_tree_cone_merge(&axis, &theta_o, emitter.axis, emitter.theta_o);
+		}
+	}
+
+	/* Nodes array may be reallocated by the recursion below, so only use
+	 * indices into it. */
+	const int node = nodes.size() / LIGHT_TREE_NODE_SIZE;
+	nodes.resize(nodes.size() + LIGHT_TREE_NODE_SIZE);
+
+	nodes[node*LIGHT_TREE_NODE_SIZE + 0] = make_float4(bounds.min.x, bounds.min.y, bounds.min.z, energy);
+	nodes[node*LIGHT_TREE_NODE_SIZE + 1] = make_float4(bounds.max.x, bounds.max.y, bounds.max.z, theta_o);
+	nodes[node*LIGHT_TREE_NODE_SIZE + 2] = make_float4(axis.x, axis.y, axis.z, 0.0f);
+
+	const int num_emitters = end - start;
+
+	if(num_emitters <= LIGHT_TREE_MAX_LEAF_SIZE) {
+		const int first_emitter = emitters.size();
+
+		for(int i = start; i < end; i++) {
+			emitters.push_back(make_float4(__int_as_float(tree_emitters[i].distribution_id),
+			                               tree_emitters[i].energy,
+			                               __int_as_float(node),
+			                               0.0f));
+		}
+
+		nodes[node*LIGHT_TREE_NODE_SIZE + 3] = make_float4(__int_as_float(first_emitter),
+		                                                   __int_as_float(num_emitters),
+		                                                   __int_as_float(parent),
+		                                                   0.0f);
+		return node;
+	}
+
+	/* Split at the median centroid along the largest dimension. */
+	const float3 extent = centroid_bounds.size();
+	int dim = 0;
+	if(extent.y > extent.x) {
+		dim = 1;
+	}
+	if(extent.z > max(extent.x, extent.y)) {
+		dim = 2;
+	}
+
+	const int mid = (start + end) / 2;
+	std::nth_element(tree_emitters.begin() + start,
+	                 tree_emitters.begin() + mid,
+	                 tree_emitters.begin() + end,
+	                 LightTreeCentroidCompare(dim));
+
+	/* Left child directly follows this node. */
+	recursive_build(tree_emitters, start, mid, node);
+	const int right = recursive_build(tree_emitters, mid, end, node);
+
+	nodes[node*LIGHT_TREE_NODE_SIZE + 3] = make_float4(__int_as_float(right),
+	                                                   __int_as_float(0),
+	                                                   __int_as_float(parent),
+	                                                   0.0f);
+	return node;
+}
+
+void LightTree::clear()
+{
+	nodes.clear();
+	emitters.clear();
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "util/util_boundbox.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Tree Emitter
+ *
+ * Single triangle or lamp as seen by the light tree. Emission directions are
+ * bounded by a cone of normals around axis with spread theta_o, light leaves
+ * the surface within a hemisphere around each of these normals. */
+
+struct LightTreeEmitter {
+	BoundBox bounds;
+	float energy;
+	float3 axis;
+	float theta_o;
+
+	/* Index of the entry in the light distribution. */
+	int distribution_id;
+
+	float3 centroid() const { return bounds.center(); }
+};
+
+/* Light Tree
+ *
+ * Binary tree over emitters, used to pick lights by their estimated
+ * contribution to a shading point rather than by power alone. Each node
+ * bounds position, energy and emission directions of all emitters below it,
+ * following "Importance Sampling of Many Lights with Adaptive Tree Splitting"
+ * by Conty Estevez and Kulla.
+ *
+ * Multiple trees can be packed into the same arrays. Nodes are stored depth
+ * first, so the left child of an inner node directly follows it. Emitters of
+ * a leaf are stored contiguously and picked proportional to their energy. */
+
+class LightTree {
+public:
+	/* Packed nodes, LIGHT_TREE_NODE_SIZE float4 each. */
+	vector<float4> nodes;
+	/* Packed emitters: distribution index, energy and leaf node. */
+	vector<float4> emitters;
+
+	/* Build tree over the given emitters, reordering them. Returns index of the
+	 * root node, or -1 if there are no emitters. */
+	int build(vector<LightTreeEmitter>& tree_emitters);
+
+	void clear();
+
+protected:
+	int recursive_build(vector<LightTreeEmitter>& tree_emitters,
+	                    int start,
+	                    int end,
+	                    int parent);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
@@ -16,9 +16,11 @@
 
 #include "bvh/bvh.h"
 #include "bvh/bvh_build.h"
+#include "bvh/bvh_cache.h"
 
 #include "render/camera.h"
 #include "render/curves.h"
+#include "render/dicing_cache.h"
 #include "device/device.h"
 #include "render/graph.h"
 #include "render/shader.h"
@@ -35,8 +37,10 @@
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
+#include "util/util_path.h"
 #include "util/util_progress.h"
 #include "util/util_set.h"
+#include "util/util_time.h"
 
 #ifdef WITH_EMBREE
 #	include "bvh/bvh_embree.h"
@@ -466,6 +470,9 @@ Mesh::Mesh()
 	subd_params = NULL;
 
 	patch_table = NULL;
+
+	use_lazy_dicing = false;
+	lazy_dicing_bound = 0.0f;
 }
 
 Mesh::~Mesh()
@@ -567,6 +574,9 @@ void Mesh::clear(bool preserve_voxel_data)
 
 	subd_creases.clear();
 
+	use_lazy_dicing = false;
+	lazy_dicing_bound = 0.0f;
+
 	curve_attributes.clear();
 	subd_attributes.clear();
 	attributes.clear(preserve_voxel_data);
@@ -681,6 +691,12 @@ void Mesh::compute_bounds()
 		for(size_t i = 0; i < verts_size; i++)
 			bnds.grow(verts[i]);
 
+		if(use_lazy_dicing) {
+			size_t triangles_size = num_triangles();
+			for(size_t i = 0; i < triangles_size; i++)
+				bnds.grow(lazy_dicing_patch_bounds(i));
+		}
+
 		for(size_t i = 0; i < curve_keys_size; i++)
 			bnds.grow(curve_keys[i], curve_radius[i]);
 
@@ -1038,8 +1054,49 @@ void Mesh::pack_patches(uint *patch_data, uint vert_offset, uint face_offset, ui
 	}
 }
 
+void Mesh::get_bvh_params(DeviceScene *dscene,
+                          SceneParams *params,
+                          BVHParams& bparams) const
+{
+	bparams.use_spatial_split = params->use_bvh_spatial_split;
+	bparams.use_qbvh = params->use_qbvh;
+	bparams.num_compressed_node_bits = params->num_bvh_compressed_node_bits;
+	bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
+	                              params->use_bvh_unaligned_nodes;
+	bparams.use_curve_strands = bparams.use_unaligned_nodes &&
+	                            params->use_bvh_curve_strands;
+	bparams.num_motion_triangle_steps = params->num_bvh_time_steps;
+	bparams.num_motion_curve_steps = params->num_bvh_time_steps;
+	bparams.refit_sah_threshold = params->bvh_refit_sah_threshold;
+	bparams.bvh_type = params->bvh_type;
+	bparams.use_bvh_embree = params->use_bvh_embree;
+	bparams.curve_flags = dscene->data.curve.curveflags;
+	bparams.curve_subdivisions = dscene->data.curve.subdivisions;
+	bparams.cache_path = params->bvh_cache_path;
+}
+
+bool Mesh::has_bvh_cache_entry(DeviceScene *dscene, SceneParams *params)
+{
+	if(params->bvh_cache_path == "" || transform_applied) {
+		return false;
+	}
+
+	BVHParams bparams;
+	get_bvh_params(dscene, params, bparams);
+
+	Object object;
+	object.mesh = this;
+
+	vector<Object*> objects;
+	objects.push_back(&object);
+
+	const string key = BVHCache::key(bparams, objects);
+	return key != "" && path_exists(BVHCache::filepath(bparams, key));
+}
+
 void Mesh::compute_bvh(DeviceScene *dscene,
                        SceneParams *params,
+                       Stats *stats,
                        Progress *progress,
                        int n,
                        int total)
@@ -1062,29 +1119,25 @@ void Mesh::compute_bvh(DeviceScene *dscene,
 		vector<Object*> objects;
 		objects.push_back(&object);
 
-		if(bvh && !need_update_rebuild) {
+		bool rebuild = (bvh == NULL || need_update_rebuild);
+
+		if(!rebuild) {
 			progress->set_status(msg, "Refitting BVH");
 			bvh->objects = objects;
-			bvh->refit(*progress);
+			/* Falls back to full rebuild when deformation made tree quality
+			 * degrade too much. */
+			rebuild = !bvh->refit(*progress);
 		}
-		else {
+
+		if(rebuild) {
 			progress->set_status(msg, "Building BVH");
 
 			BVHParams bparams;
-			bparams.use_spatial_split = params->use_bvh_spatial_split;
-			bparams.use_qbvh = params->use_qbvh;
-			bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
-			                              params->use_bvh_unaligned_nodes;
-			bparams.num_motion_triangle_steps = params->num_bvh_time_steps;
-			bparams.num_motion_curve_steps = params->num_bvh_time_steps;
-			bparams.bvh_type = params->bvh_type;
-			bparams.use_bvh_embree = params->use_bvh_embree;
-			bparams.curve_flags = dscene->data.curve.curveflags;
-			bparams.curve_subdivisions = dscene->data.curve.subdivisions;
+			get_bvh_params(dscene, params, bparams);
 
 			delete bvh;
 			bvh = BVH::create(bparams, objects);
-			MEM_GUARDED_CALL(progress, bvh->build, *progress);
+			MEM_GUARDED_CALL(progress, bvh->build, *progress, stats);
 		}
 	}
 
@@ -1128,6 +1181,29 @@ bool Mesh::has_true_displacement() const
 	return false;
 }
 
+BoundBox Mesh::lazy_dicing_patch_bounds(size_t tri) const
+{
+	Triangle t = get_triangle(tri);
+	const float3 P0 = verts[t.v[0]], P1 = verts[t.v[1]], P2 = verts[t.v[2]];
+
+	BoundBox bounds = BoundBox::empty;
+	bounds.grow(P0);
+	bounds.grow(P1);
+	bounds.grow(P2);
+
+	float pad = lazy_dicing_bound;
+
+	/* Phong tessellation moves points by less than the longest edge. */
+	if(smooth[tri]) {
+		pad += LAZY_DICING_PHONG_ALPHA * max(max(len(P1 - P0), len(P2 - P1)), len(P0 - P2));
+	}
+
+	bounds.min = bounds.min - make_float3(pad, pad, pad);
+	bounds.max = bounds.max + make_float3(pad, pad, pad);
+
+	return bounds;
+}
+
 bool Mesh::need_build_bvh() const
 {
 	return !transform_applied || has_surface_bssrdf;
@@ -1150,6 +1226,8 @@ MeshManager::MeshManager()
 	bvh = NULL;
 	need_update = true;
 	need_flags_update = true;
+	need_bvh_update = false;
+	volume_majorant_tracking = false;
 }
 
 MeshManager::~MeshManager()
@@ -1839,7 +1917,11 @@ void MeshManager::device_update_mesh(Device *device,
 	}
 }
 
-void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+void MeshManager::device_update_bvh(Device *device,
+                                    DeviceScene *dscene,
+                                    Scene *scene,
+                                    bool instances_updated,
+                                    Progress& progress)
 {
 	/* bvh build */
 	progress.set_status("Updating Scene BVH", "Building");
@@ -1850,9 +1932,12 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	BVHParams bparams;
 	bparams.top_level = true;
 	bparams.use_qbvh = scene->params.use_qbvh;
+	bparams.num_compressed_node_bits = scene->params.num_bvh_compressed_node_bits;
 	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
 	bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
 	                              scene->params.use_bvh_unaligned_nodes;
+	bparams.use_curve_strands = bparams.use_unaligned_nodes &&
+	                            scene->params.use_bvh_curve_strands;
 	bparams.num_motion_triangle_steps = scene->params.num_bvh_time_steps;
 	bparams.num_motion_curve_steps = scene->params.num_bvh_time_steps;
 	bparams.bvh_type = scene->params.bvh_type;
@@ -1860,8 +1945,20 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	bparams.curve_flags = dscene->data.curve.curveflags;
 	bparams.curve_subdivisions = dscene->data.curve.subdivisions;
 
-	delete bvh;
+	BVH *prev_bvh = bvh;
 	bvh = BVH::create(bparams, scene->objects);
+
+	/* When no object level BVH changed, their merged data from the previous
+	 * update is reused and only the top level is rebuilt. */
+	if(prev_bvh && !instances_updated &&
+	   !bparams.use_bvh_embree &&
+	   prev_bvh->params.use_qbvh == bparams.use_qbvh &&
+	   prev_bvh->params.num_compressed_node_bits == bparams.num_compressed_node_bits)
+	{
+		bvh->take_instances(prev_bvh);
+	}
+	delete prev_bvh;
+
 	bvh->build(progress, &device->stats);
 
 	if(progress.get_cancel()) return;
@@ -1914,6 +2011,9 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 
 	dscene->data.bvh.root = pack.root_index;
 	dscene->data.bvh.use_qbvh = scene->params.use_qbvh;
+	dscene->data.bvh.num_compressed_node_bits = (scene->params.use_qbvh)
+	        ? scene->params.num_bvh_compressed_node_bits
+	        : 0;
 	dscene->data.bvh.use_bvh_steps = (scene->params.num_bvh_time_steps != 0);
 
 #ifdef WITH_EMBREE
@@ -1922,6 +2022,7 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	} else {
 		dscene->data.bvh.scene = NULL;
 	}
+	dscene->data.bvh.lazy_dicing = (lazy_dicing.tri_params.size())? &lazy_dicing: NULL;
 #endif
 }
 
@@ -2036,12 +2137,15 @@ void MeshManager::device_update_volume_images(Device *device,
 	TaskPool pool;
 	ImageManager *image_manager = scene->image_manager;
 	set<int> volume_images;
+	vector<vector<int> > mesh_volume_images;
 
 	foreach(Mesh *mesh, scene->meshes) {
 		if(!mesh->need_update) {
 			continue;
 		}
 
+		vector<int> mesh_images;
+
 		foreach(Attribute& attr, mesh->attributes.attributes) {
 			if(attr.element != ATTR_ELEMENT_VOXEL) {
 				continue;
@@ -2051,8 +2155,13 @@ void MeshManager::device_update_volume_images(Device *device,
 
 			if(voxel->slot != -1) {
 				volume_images.insert(voxel->slot);
+				mesh_images.push_back(voxel->slot);
 			}
 		}
+
+		if(mesh_images.size() > 1) {
+			mesh_volume_images.push_back(mesh_images);
+		}
 	}
 
 	image_manager->device_prepare_update(dscene);
@@ -2066,12 +2175,48 @@ void MeshManager::device_update_volume_images(Device *device,
 								&progress));
 	}
 	pool.wait_work();
+
+	/* Empty space skipping uses the density grid only, make it cover the
+	 * other voxel attributes of the mesh as well. */
+	foreach(const vector<int>& mesh_images, mesh_volume_images) {
+		image_manager->device_merge_sparse_images(device, dscene, mesh_images);
+	}
+}
+
+void MeshManager::device_update_top_level_bvh(Device *device,
+                                              DeviceScene *dscene,
+                                              Scene *scene,
+                                              Progress& progress)
+{
+	VLOG(1) << "Updating top level BVH only.";
+
+#ifdef __OBJECT_MOTION__
+	Scene::MotionType need_motion = scene->need_motion(device->info.advanced_shading);
+	bool motion_blur = need_motion == Scene::MOTION_BLUR;
+#else
+	bool motion_blur = false;
+#endif
+
+	foreach(Object *object, scene->objects) {
+		object->compute_bounds(motion_blur);
+	}
+
+	/* Object level BVHs and all mesh arrays stay as they are. */
+	device_free_bvh(device, dscene);
+	device_update_bvh(device, dscene, scene, false, progress);
 }
 
 void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
-	if(!need_update)
+	if(!need_update) {
+		if(need_bvh_update && bvh) {
+			scoped_timer bvh_timer(&device->stats.bvh_build_time);
+			device_update_top_level_bvh(device, dscene, scene, progress);
+			if(progress.get_cancel()) return;
+		}
+		need_bvh_update = false;
 		return;
+	}
 
 	VLOG(1) << "Total " << scene->meshes.size() << " meshes.";
 
@@ -2106,6 +2251,32 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		}
 	}
 
+	/* Meshes restored from the dicing cache are already displaced, and meshes
+	 * to be stored once displacement is done. */
+	const bool use_dicing_cache = scene->params.use_dicing_cache;
+	set<Mesh*> cached_meshes;
+	vector<pair<Mesh*, string> > uncached_meshes;
+
+	if(use_dicing_cache) {
+		dicing_cache.cache_path = scene->params.dicing_cache_path;
+		dicing_cache.num_hits = 0;
+		dicing_cache.num_misses = 0;
+	}
+	else {
+		dicing_cache.clear();
+	}
+
+	/* With lazy dicing meshes are only tessellated into coarse patches here,
+	 * which are diced and displaced as rays hit them. Patches are intersected
+	 * by Embree callbacks, which can only evaluate SVM displacement. */
+#ifdef WITH_EMBREE
+	const bool use_lazy_dicing = scene->params.use_lazy_dicing &&
+	                             scene->params.use_bvh_embree &&
+	                             scene->params.shadingsystem == SHADINGSYSTEM_SVM;
+#else
+	const bool use_lazy_dicing = false;
+#endif
+
 	size_t i = 0;
 	foreach(Mesh *mesh, scene->meshes) {
 		if(mesh->need_update &&
@@ -2121,8 +2292,48 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 			progress.set_status("Updating Mesh", msg);
 
-			DiagSplit dsplit(*mesh->subd_params);
-			mesh->tessellate(&dsplit);
+			const bool lazy = use_lazy_dicing && !mesh->has_motion_blur();
+
+			/* Key must be computed before tessellation modifies the mesh.
+			 * Displacement is evaluated for the first object using the mesh,
+			 * same as in displace(). */
+			string key = "";
+			if(use_dicing_cache && !lazy) {
+				const Object *object = NULL;
+				foreach(const Object *ob, scene->objects) {
+					if(ob->mesh == mesh) {
+						object = ob;
+						break;
+					}
+				}
+				key = DicingCache::key(mesh, object);
+			}
+
+			if(lazy) {
+				SubdParams params = *mesh->subd_params;
+				params.dicing_rate *= LAZY_DICING_PATCH_SCALE;
+
+				DiagSplit dsplit(params);
+				mesh->tessellate(&dsplit);
+
+				mesh->use_lazy_dicing = true;
+				foreach(Shader *shader, mesh->used_shaders) {
+					if(shader->has_displacement && shader->displacement_method != DISPLACE_BUMP) {
+						mesh->lazy_dicing_bound = max(mesh->lazy_dicing_bound, shader->displacement_bound);
+					}
+				}
+			}
+			else if(key != "" && dicing_cache.load(key, mesh)) {
+				cached_meshes.insert(mesh);
+			}
+			else {
+				DiagSplit dsplit(*mesh->subd_params);
+				mesh->tessellate(&dsplit);
+
+				if(key != "") {
+					uncached_meshes.push_back(std::make_pair(mesh, key));
+				}
+			}
 
 			i++;
 
@@ -2135,7 +2346,9 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	bool old_need_object_flags_update = false;
 	foreach(Mesh *mesh, scene->meshes) {
 		if(mesh->need_update &&
-		   mesh->has_true_displacement())
+		   mesh->has_true_displacement() &&
+		   !mesh->use_lazy_dicing &&
+		   cached_meshes.find(mesh) == cached_meshes.end())
 		{
 			true_displacement_used = true;
 			break;
@@ -2172,6 +2385,8 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	bool displacement_done = false;
 	foreach(Mesh *mesh, scene->meshes) {
 		if(mesh->need_update &&
+		   !mesh->use_lazy_dicing &&
+		   cached_meshes.find(mesh) == cached_meshes.end() &&
 		   displace(device, dscene, scene, mesh, progress))
 		{
 			displacement_done = true;
@@ -2189,7 +2404,23 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		if(progress.get_cancel()) return;
 	}
 
+	/* Update dicing cache. */
+	if(use_dicing_cache) {
+		for(size_t j = 0; j < uncached_meshes.size(); j++) {
+			dicing_cache.store(uncached_meshes[j].second, uncached_meshes[j].first);
+		}
+		dicing_cache.prune(scene->meshes);
+
+		VLOG(1) << "Dicing cache: " << dicing_cache.num_hits << " hits, "
+		        << dicing_cache.num_misses << " misses.";
+	}
+
+	/* Update lazy dicing, after mesh offsets are known. */
+	lazy_dicing.device_update(scene, progress);
+	if(progress.get_cancel()) return;
+
 	/* Update bvh. */
+	const double bvh_start_time = time_dt();
 	size_t num_bvh = 0;
 	foreach(Mesh *mesh, scene->meshes) {
 		if(mesh->need_update && mesh->need_build_bvh()) {
@@ -2206,6 +2437,7 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 			                        mesh,
 			                        dscene,
 			                        &scene->params,
+			                        &device->stats,
 			                        &progress,
 			                        i,
 			                        num_bvh));
@@ -2220,6 +2452,12 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	VLOG(2) << "Objects BVH build pool statistics:\n"
 	        << summary.full_report();
 
+	if(scene->params.bvh_cache_path != "") {
+		VLOG(1) << "BVH cache statistics: "
+		        << device->stats.bvh_cache_hits << " hits, "
+		        << device->stats.bvh_cache_misses << " misses.";
+	}
+
 	foreach(Shader *shader, scene->shaders) {
 		shader->need_update_attributes = false;
 	}
@@ -2239,13 +2477,15 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	if(progress.get_cancel()) return;
 
-	device_update_bvh(device, dscene, scene, progress);
+	device_update_bvh(device, dscene, scene, num_bvh != 0, progress);
+	device->stats.bvh_build_time = time_dt() - bvh_start_time;
 	if(progress.get_cancel()) return;
 
 	device_update_mesh(device, dscene, scene, false, progress);
 	if(progress.get_cancel()) return;
 
 	need_update = false;
+	need_bvh_update = false;
 
 	if(true_displacement_used) {
 		/* Re-tag flags for update, so they're re-evaluated
@@ -2258,7 +2498,7 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	}
 }
 
-void MeshManager::device_free(Device *device, DeviceScene *dscene)
+void MeshManager::device_free_bvh(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->bvh_nodes);
 	device->tex_free(dscene->bvh_leaf_nodes);
@@ -2270,6 +2510,23 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->prim_index);
 	device->tex_free(dscene->prim_object);
 	device->tex_free(dscene->prim_time);
+
+	dscene->bvh_nodes.clear();
+	dscene->bvh_leaf_nodes.clear();
+	dscene->object_node.clear();
+	dscene->prim_tri_verts.clear();
+	dscene->prim_tri_index.clear();
+	dscene->prim_type.clear();
+	dscene->prim_visibility.clear();
+	dscene->prim_index.clear();
+	dscene->prim_object.clear();
+	dscene->prim_time.clear();
+}
+
+void MeshManager::device_free(Device *device, DeviceScene *dscene)
+{
+	device_free_bvh(device, dscene);
+
 	device->tex_free(dscene->tri_shader);
 	device->tex_free(dscene->tri_vnormal);
 	device->tex_free(dscene->tri_vindex);
@@ -2283,15 +2540,6 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->attributes_float3);
 	device->tex_free(dscene->attributes_uchar4);
 
-	dscene->bvh_nodes.clear();
-	dscene->object_node.clear();
-	dscene->prim_tri_verts.clear();
-	dscene->prim_tri_index.clear();
-	dscene->prim_type.clear();
-	dscene->prim_visibility.clear();
-	dscene->prim_index.clear();
-	dscene->prim_object.clear();
-	dscene->prim_time.clear();
 	dscene->tri_shader.clear();
 	dscene->tri_vnormal.clear();
 	dscene->tri_vindex.clear();
@@ -2305,6 +2553,8 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->attributes_float3.clear();
 	dscene->attributes_uchar4.clear();
 
+	lazy_dicing.device_free();
+
 #ifdef WITH_OSL
 	OSLGlobals *og = (OSLGlobals*)device->osl_memory();
 
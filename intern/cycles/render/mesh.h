@@ -20,6 +20,8 @@
 #include "graph/node.h"
 
 #include "render/attribute.h"
+#include "render/dicing_cache.h"
+#include "render/lazy_dicing.h"
 #include "render/shader.h"
 
 #include "util/util_boundbox.h"
@@ -34,12 +36,14 @@ CCL_NAMESPACE_BEGIN
 
 class Attribute;
 class BVH;
+class BVHParams;
 class Device;
 class DeviceScene;
 class Mesh;
 class Progress;
 class Scene;
 class SceneParams;
+class Stats;
 class AttributeRequest;
 struct SubdParams;
 class DiagSplit;
@@ -231,6 +235,11 @@ public:
 
 	PackedPatchTable *patch_table;
 
+	/* Triangles are coarse patches diced when first hit by a ray, their
+	 * bounds are padded by the displacement bound of the shaders. */
+	bool use_lazy_dicing;
+	float lazy_dicing_bound;
+
 	uint motion_steps;
 	bool use_motion_blur;
 
@@ -287,8 +296,16 @@ public:
 	void pack_curves(Scene *scene, float4 *curve_key_co, float4 *curve_data, size_t curvekey_offset);
 	void pack_patches(uint *patch_data, uint vert_offset, uint face_offset, uint corner_offset);
 
+	void get_bvh_params(DeviceScene *dscene,
+	                    SceneParams *params,
+	                    BVHParams& bparams) const;
+	/* Check if the persistent BVH cache has an entry for the mesh in its
+	 * current, untransformed state. */
+	bool has_bvh_cache_entry(DeviceScene *dscene, SceneParams *params);
+
 	void compute_bvh(DeviceScene *dscene,
 	                 SceneParams *params,
+	                 Stats *stats,
 	                 Progress *progress,
 	                 int n,
 	                 int total);
@@ -301,6 +318,10 @@ public:
 	bool has_motion_blur() const;
 	bool has_true_displacement() const;
 
+	/* Bounds of a lazily diced patch, including displacement and the bulge of
+	 * smooth patches. */
+	BoundBox lazy_dicing_patch_bounds(size_t tri) const;
+
 	/* Check whether the mesh should have own BVH built separately. Briefly,
 	 * own BVH is needed for mesh, if:
 	 *
@@ -325,6 +346,14 @@ public:
 
 	bool need_update;
 	bool need_flags_update;
+	/* Only object transforms changed, so mesh data stays valid and only the
+	 * top level BVH is rebuilt. Ignored when need_update is set. */
+	bool need_bvh_update;
+	/* Majorant tracking setting the majorants were last computed with. */
+	bool volume_majorant_tracking;
+
+	DicingCache dicing_cache;
+	LazyDicing lazy_dicing;
 
 	MeshManager();
 	~MeshManager();
@@ -339,11 +368,22 @@ public:
 	void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 
 	void device_free(Device *device, DeviceScene *dscene);
+	void device_free_bvh(Device *device, DeviceScene *dscene);
 
 	void tag_update(Scene *scene);
 
 	void create_volume_mesh(Scene *scene, DeviceScene *dscene, Mesh *mesh, Progress &progress);
 
+	/* Upper bounds of the extinction of volume shaders per tile of sparse
+	 * density images, needs all other scene data on the device. */
+	void device_update_volume_majorants(Device *device,
+	                                    DeviceScene *dscene,
+	                                    Scene *scene,
+	                                    Progress& progress);
+	/* Check if the majorants are outdated, must be called before the scene
+	 * managers clear their update tags. */
+	bool need_update_volume_majorants(Scene *scene);
+
 protected:
 	/* Calculate verts/triangles/curves offsets in global arrays. */
 	void mesh_calc_offset(Scene *scene);
@@ -367,8 +407,14 @@ protected:
 	void device_update_bvh(Device *device,
 	                       DeviceScene *dscene,
 	                       Scene *scene,
+	                       bool instances_updated,
 	                       Progress& progress);
 
+	void device_update_top_level_bvh(Device *device,
+	                                 DeviceScene *dscene,
+	                                 Scene *scene,
+	                                 Progress& progress);
+
 	void device_update_displacement_images(Device *device,
 	                                       DeviceScene *dscene,
 	                                       Scene *scene,
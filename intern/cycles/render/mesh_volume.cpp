@@ -16,7 +16,13 @@
 
 #include "render/mesh.h"
 #include "render/attribute.h"
+#include "render/image.h"
+#include "render/integrator.h"
+#include "render/object.h"
 #include "render/scene.h"
+#include "render/shader.h"
+
+#include "device/device.h"
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
@@ -396,6 +402,9 @@ void VolumeMeshBuilder::convert_quads_to_tris(const vector<QuadData> &quads,
 struct VoxelAttributeGrid {
 	float *data;
 	int channels;
+	/* Tile grid of sparse images, NULL for dense. */
+	int *grid;
+	int grid_width, grid_height;
 };
 
 void MeshManager::create_volume_mesh(Scene *scene,
@@ -434,6 +443,17 @@ void MeshManager::create_volume_mesh(Scene *scene,
 		VoxelAttributeGrid voxel_grid;
 		voxel_grid.data = (float*)image_memory->data_pointer;
 		voxel_grid.channels = image_memory->data_elements;
+		voxel_grid.grid = NULL;
+		voxel_grid.grid_width = 0;
+		voxel_grid.grid_height = 0;
+
+		device_vector<int> *image_grid = scene->image_manager->image_grid(dscene, voxel->slot);
+		if(image_grid) {
+			voxel_grid.grid = (int*)image_grid->data_pointer;
+			voxel_grid.grid_width = image_grid->data_width;
+			voxel_grid.grid_height = image_grid->data_height;
+		}
+
 		voxel_grids.push_back(voxel_grid);
 	}
 
@@ -497,9 +517,15 @@ void MeshManager::create_volume_mesh(Scene *scene,
 				for(size_t i = 0; i < voxel_grids.size(); ++i) {
 					const VoxelAttributeGrid &voxel_grid = voxel_grids[i];
 					const int channels = voxel_grid.channels;
+					const size_t index = (voxel_grid.grid)?
+						tex_sparse_voxel_index(voxel_grid.grid,
+						                       voxel_grid.grid_width,
+						                       voxel_grid.grid_height,
+						                       x, y, z):
+						voxel_index;
 
 					for(int c = 0; c < channels; c++) {
-						if(voxel_grid.data[voxel_index * channels + c] >= isovalue) {
+						if(voxel_grid.data[index * channels + c] >= isovalue) {
 							builder.add_node_with_padding(x, y, z);
 							break;
 						}
@@ -544,4 +570,292 @@ void MeshManager::create_volume_mesh(Scene *scene,
 			<< "Mb.";
 }
 
+/* Volume Majorants
+ *
+ * Upper bound of the extinction per tile of sparse density images, for
+ * tracking collisions through heterogeneous volumes in the kernel. Volume
+ * shaders are evaluated once per tile, at the voxel with the highest density.
+ * Tiles without voxel data are evaluated at their center as well, since
+ * shaders may produce density there, for example from an offset or a
+ * procedural texture. The bound of a tile is the largest of these values over
+ * the tile and its neighbours, which interpolation reaches into, scaled by a
+ * safety margin.
+ *
+ * This is an estimate, shaders which vary a lot within a tile may exceed it.
+ * The kernel then clamps null collisions, which slightly darkens the volume. */
+
+/* Safety margin on the evaluated extinction. */
+#define VOLUME_MAJORANT_MARGIN 1.5f
+
+/* Voxel with the highest density in each tile, the center voxel for inactive
+ * tiles. */
+static void volume_majorant_tile_voxels(const device_memory& tex_img,
+                                        const device_vector<int>& tex_grid,
+                                        vector<int3>& tile_voxels)
+{
+	const float *data = (const float*)tex_img.data_pointer;
+	const int *grid = (const int*)tex_grid.data_pointer;
+	const int channels = tex_img.data_elements;
+	const int value_channels = min(channels, 3);
+	const int3 resolution = make_int3(tex_img.data_width, tex_img.data_height, tex_img.data_depth);
+	const int3 grid_size = make_int3(tex_grid.data_width, tex_grid.data_height, tex_grid.data_depth);
+
+	tile_voxels.resize(tex_grid.size());
+
+	for(int tz = 0; tz < grid_size.z; tz++) {
+		for(int ty = 0; ty < grid_size.y; ty++) {
+			for(int tx = 0; tx < grid_size.x; tx++) {
+				const int tile = tx + (ty + tz*grid_size.y)*grid_size.x;
+				const int center = TEX_SPARSE_TILE_SIZE/2;
+				int local = center + (center + center*TEX_SPARSE_TILE_SIZE)*TEX_SPARSE_TILE_SIZE;
+
+				if(grid[tile] & TEX_SPARSE_TILE_ACTIVE) {
+					/* Tiles without data all share the first, empty tile. */
+					const float *tile_data = data + (size_t)(grid[tile] >> 1)*TEX_SPARSE_TILE_VOXELS*channels;
+					float max_value = -FLT_MAX;
+
+					for(int i = 0; i < TEX_SPARSE_TILE_VOXELS; i++) {
+						for(int c = 0; c < value_channels; c++) {
+							if(tile_data[i*channels + c] > max_value) {
+								max_value = tile_data[i*channels + c];
+								local = i;
+							}
+						}
+					}
+				}
+
+				/* Tiles at the border may extend past the resolution. */
+				tile_voxels[tile] = make_int3(
+					min((tx << TEX_SPARSE_TILE_SHIFT) + (local & TEX_SPARSE_TILE_MASK), resolution.x - 1),
+					min((ty << TEX_SPARSE_TILE_SHIFT) + ((local >> TEX_SPARSE_TILE_SHIFT) & TEX_SPARSE_TILE_MASK), resolution.y - 1),
+					min((tz << TEX_SPARSE_TILE_SHIFT) + (local >> (2*TEX_SPARSE_TILE_SHIFT)), resolution.z - 1));
+			}
+		}
+	}
+}
+
+bool MeshManager::need_update_volume_majorants(Scene *scene)
+{
+	if(scene->integrator->volume_majorant_tracking != volume_majorant_tracking) {
+		return true;
+	}
+
+	if(!volume_majorant_tracking) {
+		return false;
+	}
+
+	/* Only changes of volume shaders, volume meshes and their objects, and of
+	 * images which volume shaders may read from, affect the majorants. */
+	bool have_volume = false;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(mesh->has_volume) {
+			if(mesh->need_update) {
+				return true;
+			}
+			have_volume = true;
+		}
+	}
+
+	if(!have_volume) {
+		return false;
+	}
+
+	foreach(Shader *shader, scene->shaders) {
+		if(shader->has_volume && shader->need_update) {
+			return true;
+		}
+	}
+
+	/* Transform only updates skip the object manager flag, but move the
+	 * positions at which volume shaders are evaluated. */
+	foreach(Object *object, scene->objects) {
+		if(object->need_transform_update && object->mesh->has_volume) {
+			return true;
+		}
+	}
+
+	return scene->object_manager->need_update || scene->image_manager->need_update;
+}
+
+void MeshManager::device_update_volume_majorants(Device *device,
+                                                 DeviceScene *dscene,
+                                                 Scene *scene,
+                                                 Progress& progress)
+{
+	ImageManager *image_manager = scene->image_manager;
+
+	/* Per density image, voxels at which shaders are evaluated and the
+	 * largest extinction found there. */
+	map<int, vector<int3> > tile_voxels;
+	map<int, vector<float> > tile_extinction;
+
+	volume_majorant_tracking = scene->integrator->volume_majorant_tracking;
+
+	/* Pairs of world space position and object and shader to evaluate,
+	 * along with the image and tile they are for. */
+	vector<uint4> input;
+	vector<std::pair<int, int> > input_tiles;
+
+	if(scene->integrator->volume_majorant_tracking) {
+		for(size_t object_index = 0; object_index < scene->objects.size(); object_index++) {
+			Object *object = scene->objects[object_index];
+			Mesh *mesh = object->mesh;
+
+			if(!mesh->has_volume) {
+				continue;
+			}
+
+			Attribute *attr = mesh->attributes.find(ATTR_STD_VOLUME_DENSITY);
+			if(!attr || attr->element != ATTR_ELEMENT_VOXEL) {
+				continue;
+			}
+
+			const int flat_slot = attr->data_voxel()->slot;
+			device_memory *tex_img = image_manager->image_memory(dscene, flat_slot);
+			device_vector<int> *tex_grid = image_manager->image_grid(dscene, flat_slot);
+			if(!tex_img || !tex_grid) {
+				continue;
+			}
+
+			if(tile_voxels.find(flat_slot) == tile_voxels.end()) {
+				volume_majorant_tile_voxels(*tex_img, *tex_grid, tile_voxels[flat_slot]);
+				tile_extinction[flat_slot].resize(tex_grid->size(), 0.0f);
+			}
+
+			/* From normalized texture coordinates to world space, the
+			 * object transform is kept when it is applied to the mesh. */
+			Transform tfm = object->tfm;
+			Attribute *attr_tfm = mesh->attributes.find(ATTR_STD_GENERATED_TRANSFORM);
+			if(attr_tfm) {
+				tfm = tfm * transform_inverse(*attr_tfm->data_transform());
+			}
+
+			const float3 inv_resolution = make_float3(1.0f/tex_img->data_width,
+			                                          1.0f/tex_img->data_height,
+			                                          1.0f/tex_img->data_depth);
+			const vector<int3>& voxels = tile_voxels[flat_slot];
+
+			foreach(Shader *shader, mesh->used_shaders) {
+				if(!shader->has_volume) {
+					continue;
+				}
+
+				const int shader_id = scene->shader_manager->get_shader_id(shader);
+
+				for(size_t tile = 0; tile < voxels.size(); tile++) {
+					const float3 P = transform_point(&tfm,
+						(make_float3(voxels[tile].x, voxels[tile].y, voxels[tile].z) +
+						 make_float3(0.5f, 0.5f, 0.5f))*inv_resolution);
+
+					input.push_back(make_uint4(__float_as_uint(P.x),
+					                           __float_as_uint(P.y),
+					                           __float_as_uint(P.z),
+					                           0));
+					input.push_back(make_uint4(object_index, shader_id, 0, 0));
+					input_tiles.push_back(std::make_pair(flat_slot, (int)tile));
+				}
+			}
+		}
+	}
+
+	if(input_tiles.size()) {
+		progress.set_status("Updating Meshes", "Computing volume majorants");
+
+		/* Evaluate extinction on device. */
+		const int num_inputs = input_tiles.size();
+		device_vector<uint4> d_input;
+		device_vector<float4> d_output;
+
+		uint4 *d_input_data = d_input.resize(input.size());
+		memcpy(d_input_data, &input[0], sizeof(uint4)*input.size());
+
+		d_output.resize(num_inputs);
+		memset((void*)d_output.data_pointer, 0, d_output.memory_size());
+
+		device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
+
+		device->mem_alloc("volume_majorant_input", d_input, MEM_READ_ONLY);
+		device->mem_copy_to(d_input);
+		device->mem_alloc("volume_majorant_output", d_output, MEM_WRITE_ONLY);
+
+		DeviceTask main_task(DeviceTask::SHADER);
+		main_task.shader_input = d_input.device_pointer;
+		main_task.shader_output = d_output.device_pointer;
+		main_task.shader_eval_type = SHADER_EVAL_VOLUME;
+		main_task.shader_x = 0;
+		main_task.shader_w = num_inputs;
+		main_task.num_samples = 1;
+		main_task.get_cancel = function_bind(&Progress::get_cancel, &progress);
+
+		list<DeviceTask> split_tasks;
+		main_task.split(split_tasks, 1, 128*128);
+
+		foreach(DeviceTask& task, split_tasks) {
+			device->task_add(task);
+			device->task_wait();
+			device->mem_copy_from(d_output, task.shader_x, 1, task.shader_w, sizeof(float4));
+		}
+
+		device->mem_free(d_input);
+		device->mem_free(d_output);
+
+		if(progress.get_cancel()) {
+			return;
+		}
+
+		const float4 *d_output_data = (const float4*)d_output.data_pointer;
+
+		for(int i = 0; i < num_inputs; i++) {
+			float& extinction = tile_extinction[input_tiles[i].first][input_tiles[i].second];
+			extinction = max(extinction, max(d_output_data[i].x, max(d_output_data[i].y, d_output_data[i].z)));
+		}
+	}
+
+	/* Largest extinction of the tile and its neighbours. */
+	map<int, vector<float> > majorants;
+	size_t num_tiles = 0;
+
+	for(map<int, vector<float> >::iterator it = tile_extinction.begin();
+	    it != tile_extinction.end();
+	    ++it)
+	{
+		const int flat_slot = it->first;
+		const vector<float>& extinction = it->second;
+		const vector<int3>& voxels = tile_voxels[flat_slot];
+		device_vector<int> *tex_grid = image_manager->image_grid(dscene, flat_slot);
+		const int3 grid_size = make_int3(tex_grid->data_width, tex_grid->data_height, tex_grid->data_depth);
+		vector<float>& majorant = majorants[flat_slot];
+
+		majorant.resize(extinction.size(), 0.0f);
+
+		for(int z = 0; z < grid_size.z; z++) {
+			for(int y = 0; y < grid_size.y; y++) {
+				for(int x = 0; x < grid_size.x; x++) {
+					const int tile = x + (y + z*grid_size.y)*grid_size.x;
+					float value = 0.0f;
+					for(int nz = max(z - 1, 0); nz <= min(z + 1, grid_size.z - 1); nz++) {
+						for(int ny = max(y - 1, 0); ny <= min(y + 1, grid_size.y - 1); ny++) {
+							for(int nx = max(x - 1, 0); nx <= min(x + 1, grid_size.x - 1); nx++) {
+								value = max(value, extinction[nx + (ny + nz*grid_size.y)*grid_size.x]);
+							}
+						}
+					}
+
+					majorant[tile] = value*VOLUME_MAJORANT_MARGIN;
+				}
+			}
+		}
+
+		num_tiles += majorant.size();
+	}
+
+	if(majorants.size()) {
+		VLOG(1) << "Volume majorants for " << majorants.size() << " images, "
+		        << num_tiles << " tiles, " << input_tiles.size() << " shader evaluations.";
+	}
+
+	image_manager->device_update_majorants(device, dscene, majorants);
+}
+
 CCL_NAMESPACE_END
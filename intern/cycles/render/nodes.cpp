@@ -1958,6 +1958,27 @@ void BsdfNode::compile(OSLCompiler& /*compiler*/)
 	assert(0);
 }
 
+void BsdfNode::constant_fold(const ConstantFolder& folder)
+{
+	ShaderInput *color_in = input("Color");
+
+	/* Closures with zero weight never contribute. Often this only shows up
+	 * once node groups are flattened and their inputs are folded. */
+	if(color_in && !color_in->link && color == make_float3(0.0f, 0.0f, 0.0f)) {
+		/* A black surface is still opaque, without any closure linked to the
+		 * output the shader would be treated as volume only. */
+		foreach(ShaderInput *to, folder.output->links) {
+			if(to->parent->special_type == SHADER_SPECIAL_TYPE_OUTPUT &&
+			   to->name() == "Surface")
+			{
+				return;
+			}
+		}
+
+		folder.discard();
+	}
+}
+
 /* Anisotropic BSDF Closure */
 
 NODE_DEFINE(AnisotropicBsdfNode)
@@ -374,6 +374,7 @@ public:
 
 	bool has_spatial_varying() { return true; }
 	void compile(SVMCompiler& compiler, ShaderInput *param1, ShaderInput *param2, ShaderInput *param3 = NULL, ShaderInput *param4 = NULL);
+	void constant_fold(const ConstantFolder& folder);
 	virtual ClosureType get_closure_type() { return closure; }
 
 	float3 color;
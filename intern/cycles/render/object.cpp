@@ -68,6 +68,7 @@ Object::Object()
 	motion.mid = transform_empty();
 	motion.post = transform_empty();
 	use_motion = false;
+	need_transform_update = false;
 
 	light_linking_prev = 0;
 	shadow_linking_prev = 0;
@@ -239,6 +240,27 @@ void Object::tag_update(Scene *scene)
 	scene->object_manager->need_update = true;
 }
 
+void Object::tag_transform_update(Scene *scene)
+{
+	/* Mesh data changes as well when the transform was applied to it. */
+	if(!mesh || mesh->transform_applied) {
+		tag_update(scene);
+		return;
+	}
+
+	foreach(Shader *shader, mesh->used_shaders) {
+		if(shader->use_mis && shader->has_surface_emission)
+			scene->light_manager->need_update = true;
+	}
+
+	need_transform_update = true;
+
+	scene->camera->need_flags_update = true;
+	scene->mesh_manager->need_bvh_update = true;
+	scene->object_manager->need_transform_update = true;
+	scene->object_manager->need_flags_update = true;
+}
+
 vector<float> Object::motion_times()
 {
 	/* compute times at which we sample motion for this object */
@@ -275,6 +297,7 @@ ObjectManager::ObjectManager()
 {
 	need_update = true;
 	need_flags_update = true;
+	need_transform_update = false;
 }
 
 ObjectManager::~ObjectManager()
@@ -553,8 +576,76 @@ void ObjectManager::device_update_transforms(Device *device,
 	dscene->data.bvh.have_instancing = true;
 }
 
+bool ObjectManager::device_update_object_transforms_partial(Device *device,
+                                                            DeviceScene *dscene,
+                                                            Scene *scene)
+{
+	UpdateObejctTransformState state;
+	state.need_motion = scene->need_motion(device->info.advanced_shading);
+
+	/* Motion data and static transforms need the full update, as does any
+	 * change to the number of objects. */
+	if(state.need_motion != Scene::MOTION_NONE ||
+	   dscene->objects.size() != OBJECT_SIZE*scene->objects.size() ||
+	   dscene->object_flag.size() != scene->objects.size())
+	{
+		return false;
+	}
+
+	state.have_motion = dscene->data.bvh.have_motion;
+	state.have_curves = dscene->data.bvh.have_curves;
+	state.scene = scene;
+	state.queue_start_object = 0;
+	state.object_flag = dscene->object_flag.get_data();
+	state.objects = dscene->objects.get_data();
+	state.objects_vector = NULL;
+
+	int numparticles = 1;
+	foreach(ParticleSystem *psys, scene->particle_systems) {
+		state.particle_offset[psys] = numparticles;
+		numparticles += psys->particles.size();
+	}
+
+	int num_updated = 0;
+	int object_index = 0;
+	foreach(Object *ob, scene->objects) {
+		if(ob->need_transform_update) {
+			device_update_object_transform(&state, ob, object_index);
+			num_updated++;
+		}
+		object_index++;
+	}
+
+	VLOG(1) << "Updated transform of " << num_updated << " objects.";
+
+	device->tex_free(dscene->objects);
+	device->tex_alloc("__objects", dscene->objects);
+
+	/* Flags were reset for updated objects, device_update_flags() adds the
+	 * volume and shadow catcher ones back. */
+	device->tex_free(dscene->object_flag);
+	need_flags_update = true;
+
+	return true;
+}
+
 void ObjectManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
+	if(!need_update && need_transform_update) {
+		progress.set_status("Updating Objects", "Copying Transformations to device");
+
+		if(!device_update_object_transforms_partial(device, dscene, scene)) {
+			/* Fall back to updating everything. */
+			need_update = true;
+			scene->mesh_manager->need_update = true;
+		}
+	}
+
+	need_transform_update = false;
+	foreach(Object *object, scene->objects) {
+		object->need_transform_update = false;
+	}
+
 	if(!need_update)
 		return;
 
@@ -625,6 +716,12 @@ void ObjectManager::device_update_flags(Device *device,
 		else {
 			object_flag[object_index] &= ~SD_OBJECT_OBJECT_SHADOW_CATCHER;
 		}
+		if(object->mesh->use_lazy_dicing) {
+			object_flag[object_index] |= SD_OBJECT_LAZY_DICING;
+		}
+		else {
+			object_flag[object_index] &= ~SD_OBJECT_LAZY_DICING;
+		}
 
 		if(bounds_valid) {
 			foreach(Object *volume_object, volume_objects) {
@@ -733,8 +830,13 @@ void ObjectManager::apply_static_transforms(DeviceScene *dscene, Scene *scene, u
 		 *
 		 * Could be solved by moving reference counter to Mesh.
 		 */
+		/* A mesh with an entry in the persistent BVH cache keeps its own BVH,
+		 * so it is loaded instead of being rebuilt with the transform applied.
+		 * Otherwise the transformed mesh is cached, which is found again as
+		 * long as the object does not move. */
 		if((mesh_users[object->mesh] == 1 && !object->mesh->has_surface_bssrdf) &&
-		   !object->mesh->has_true_displacement() && object->mesh->subdivision_type == Mesh::SUBDIVISION_NONE)
+		   !object->mesh->has_true_displacement() && object->mesh->subdivision_type == Mesh::SUBDIVISION_NONE &&
+		   !object->mesh->has_bvh_cache_entry(dscene, &scene->params))
 		{
 			if(!(motion_blur && object->use_motion)) {
 				if(!object->mesh->transform_applied) {
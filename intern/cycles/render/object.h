@@ -64,11 +64,17 @@ public:
 
 	ParticleSystem *particle_system;
 	int particle_index;
+
+	/* Only the transform changed since the last device update. */
+	bool need_transform_update;
 	
 	Object();
 	~Object();
 
 	void tag_update(Scene *scene);
+	/* Cheaper update for when only tfm changed, only updates this object's
+	 * packed data and the top level BVH. */
+	void tag_transform_update(Scene *scene);
 
 	void compute_bounds(bool motion_blur);
 	void apply_transform(bool apply_to_motion);
@@ -87,6 +93,9 @@ class ObjectManager {
 public:
 	bool need_update;
 	bool need_flags_update;
+	/* Objects tagged with need_transform_update only need their transform
+	 * updated, ignored when need_update is set. */
+	bool need_transform_update;
 
 	ObjectManager();
 	~ObjectManager();
@@ -156,6 +165,9 @@ protected:
 	                                    Object *ob,
 	                                    const int object_index);
 	void device_update_object_transform_task(UpdateObejctTransformState *state);
+	bool device_update_object_transforms_partial(Device *device,
+	                                             DeviceScene *dscene,
+	                                             Scene *scene);
 	bool device_update_object_transform_pop_work(
 	        UpdateObejctTransformState *state,
 	        int *start_index,
@@ -694,6 +694,8 @@ void OSLCompiler::add(ShaderNode *node, const char *name, bool isfilepath)
 		}
 	}
 	else if(current_type == SHADER_TYPE_VOLUME) {
+		if(info && info->has_surface_emission)
+			current_shader->has_volume_emission = true;
 		if(node->has_spatial_varying())
 			current_shader->has_volume_spatial_varying = true;
 	}
@@ -997,6 +999,8 @@ void OSLCompiler::generate_nodes(const ShaderNodeSet& nodes)
 						}
 					}
 					else if(current_type == SHADER_TYPE_VOLUME) {
+						if(node->has_surface_emission())
+							current_shader->has_volume_emission = true;
 						if(node->has_spatial_varying())
 							current_shader->has_volume_spatial_varying = true;
 					}
@@ -1087,6 +1091,7 @@ void OSLCompiler::compile(Scene *scene, OSLGlobals *og, Shader *shader)
 		shader->has_surface_bssrdf = false;
 		shader->has_bssrdf_bump = false;
 		shader->has_volume = false;
+		shader->has_volume_emission = false;
 		shader->has_displacement = false;
 		shader->has_surface_spatial_varying = false;
 		shader->has_volume_spatial_varying = false;
@@ -55,6 +55,7 @@ Scene::Scene(const SceneParams& params_, const DeviceInfo& device_info_)
 	object_manager = new ObjectManager();
 	integrator = new Integrator();
 	image_manager = new ImageManager(device_info_);
+	image_manager->set_half_float_textures(params.texture.use_half_float);
 	particle_system_manager = new ParticleSystemManager();
 	curve_system_manager = new CurveSystemManager();
 	bake_manager = new BakeManager();
@@ -137,6 +138,7 @@ void Scene::device_update(Device *device_, Progress& progress)
 		device = device_;
 
 	bool print_stats = need_data_update();
+	bool need_volume_majorants = mesh_manager->need_update_volume_majorants(this);
 
 	/* The order of updates is important, because there's dependencies between
 	 * the different managers, using data computed by previous managers.
@@ -235,6 +237,13 @@ void Scene::device_update(Device *device_, Progress& progress)
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	if(need_volume_majorants) {
+		progress.set_status("Updating Volume Majorants");
+		mesh_manager->device_update_volume_majorants(device, &dscene, this, progress);
+
+		if(progress.get_cancel() || device->have_error()) return;
+	}
+
 	if(device->have_error() == false) {
 		progress.set_status("Updating Device", "Writing constant memory");
 		device->const_copy_to("__data", &dscene.data, sizeof(dscene.data));
@@ -299,7 +308,9 @@ bool Scene::need_data_update()
 	return (background->need_update
 		|| image_manager->need_update
 		|| object_manager->need_update
+		|| object_manager->need_transform_update
 		|| mesh_manager->need_update
+		|| mesh_manager->need_bvh_update
 		|| light_manager->need_update
 		|| lookup_tables->need_update
 		|| integrator->need_update
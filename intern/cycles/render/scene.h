@@ -98,6 +98,11 @@ public:
 	device_vector<float4> light_data;
 	device_vector<float2> light_background_marginal_cdf;
 	device_vector<float2> light_background_conditional_cdf;
+	device_vector<float4> light_tree_nodes;
+	device_vector<float4> light_tree_emitters;
+	device_vector<uint4> light_tree_objects;
+	device_vector<uint> light_tree_triangles;
+	device_vector<uint> light_tree_lamps;
 
 	/* particles */
 	device_vector<float4> particles;
@@ -122,6 +127,14 @@ public:
 	std::vector<device_vector<half>* > tex_half_image;
 	std::vector<device_vector<ushort4>* > tex_ushort4_image;
 	std::vector<device_vector<uint16_t>* > tex_ushort_image;
+
+	/* cpu tile grids of sparse 3d float images */
+	std::vector<device_vector<int>* > tex_float4_grid;
+	std::vector<device_vector<int>* > tex_float_grid;
+
+	/* cpu extinction majorants per tile of sparse 3d float images */
+	std::vector<device_vector<float>* > tex_float4_majorant;
+	std::vector<device_vector<float>* > tex_float_majorant;
 	
 	/* opencl images */
 	device_vector<uchar4> tex_image_byte4_packed;
@@ -138,7 +151,7 @@ class TextureCacheParams {
 public:
 	TextureCacheParams() : cache_size(1024), tile_size(64), diffuse_blur(1.0f/64.f),
 	glossy_blur(0.0f), auto_convert(true), accept_unmipped(true), accept_untiled(true),
-	auto_tile(true), auto_mip(true) { }
+	auto_tile(true), auto_mip(true), use_half_float(false) { }
 	
 	bool modified(const TextureCacheParams& params)
 	{
@@ -150,7 +163,8 @@ public:
 				 && accept_unmipped == params.accept_unmipped
 				 && accept_untiled == params.accept_untiled
 				 && auto_tile == params.auto_tile
-				 && auto_mip == params.auto_mip);
+				 && auto_mip == params.auto_mip
+				 && use_half_float == params.use_half_float);
 	}
 	
 	int cache_size;
@@ -162,6 +176,8 @@ public:
 	bool accept_untiled;
 	bool auto_tile;
 	bool auto_mip;
+	/* Store float image textures as half float, halving their memory usage. */
+	bool use_half_float;
 };
 
 /* Scene Parameters */
@@ -177,9 +193,26 @@ public:
 	} bvh_type;
 	bool use_bvh_spatial_split;
 	bool use_bvh_unaligned_nodes;
+	/* Group consecutive segments of hair strands into oriented leaves. */
+	bool use_bvh_curve_strands;
 	int num_bvh_time_steps;
+	/* Rebuild refitted BVH once its SAH cost grew by this factor, zero to
+	 * always refit. */
+	float bvh_refit_sah_threshold;
 	bool use_qbvh;
+	/* Quantize QBVH child bounds to 8 or 16 bits, 0 for full precision. */
+	int num_bvh_compressed_node_bits;
 	bool use_bvh_embree;
+	/* Directory of the persistent on-disk BVH cache, empty to disable. */
+	string bvh_cache_path;
+	/* Reuse diced and displaced geometry of subdivision meshes. The on-disk
+	 * cache directory is optional, empty to cache in memory only. */
+	bool use_dicing_cache;
+	string dicing_cache_path;
+	/* Dice subdivision patches when first hit by a ray, keeping at most the
+	 * cache size in megabytes of diced geometry. Embree only. */
+	bool use_lazy_dicing;
+	int lazy_dicing_cache_size;
 	bool persistent_data;
 	int texture_limit;
 	TextureCacheParams texture;
@@ -190,9 +223,17 @@ public:
 		bvh_type = BVH_DYNAMIC;
 		use_bvh_spatial_split = false;
 		use_bvh_unaligned_nodes = true;
+		use_bvh_curve_strands = true;
 		num_bvh_time_steps = 0;
+		bvh_refit_sah_threshold = 1.5f;
 		use_qbvh = false;
+		num_bvh_compressed_node_bits = 0;
 		use_bvh_embree = false;
+		bvh_cache_path = "";
+		use_dicing_cache = false;
+		dicing_cache_path = "";
+		use_lazy_dicing = false;
+		lazy_dicing_cache_size = 1024;
 		persistent_data = false;
 		texture_limit = 0;
 	}
@@ -202,11 +243,19 @@ public:
 		&& bvh_type == params.bvh_type
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
 		&& use_bvh_unaligned_nodes == params.use_bvh_unaligned_nodes
+		&& use_bvh_curve_strands == params.use_bvh_curve_strands
 		&& num_bvh_time_steps == params.num_bvh_time_steps
+		&& bvh_refit_sah_threshold == params.bvh_refit_sah_threshold
 		&& use_qbvh == params.use_qbvh
+		&& num_bvh_compressed_node_bits == params.num_bvh_compressed_node_bits
 		&& persistent_data == params.persistent_data
 		&& texture_limit == params.texture_limit
 		&& use_bvh_embree == params.use_bvh_embree
+		&& bvh_cache_path == params.bvh_cache_path
+		&& use_dicing_cache == params.use_dicing_cache
+		&& dicing_cache_path == params.dicing_cache_path
+		&& use_lazy_dicing == params.use_lazy_dicing
+		&& lazy_dicing_cache_size == params.lazy_dicing_cache_size
 		&& texture_limit == params.texture_limit)
 		&& !texture.modified(params.texture); }
 };
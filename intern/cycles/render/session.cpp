@@ -53,6 +53,16 @@ Session::Session(const SessionParams& params_)
 
 	TaskScheduler::init(params.threads);
 
+	/* Tiles of final renders may be split to keep all CPU threads busy.
+	 * Progressive refine keeps buffers per tile, so tiles must stay fixed. */
+	if(params.use_tile_splitting &&
+	   params.device.type == DEVICE_CPU &&
+	   params.background &&
+	   !params.progressive_refine)
+	{
+		tile_manager.set_split_threads(TaskScheduler::num_threads());
+	}
+
 	device = Device::create(params.device, stats, params.background);
 
 	if(params.background && params.output_path.empty()) {
@@ -78,6 +88,7 @@ Session::Session(const SessionParams& params_)
 	gpu_need_tonemap = false;
 	pause = false;
 	kernels_loaded = false;
+	num_active_render_tiles = 0;
 
 	/* TODO(sergey): Check if it's indeed optimal value for the split kernel. */
 	max_closure_global = 1;
@@ -116,6 +127,8 @@ Session::~Session()
 	/* clean up */
 	foreach(RenderBuffers *buffers, tile_buffers)
 		delete buffers;
+	foreach(RenderBuffers *buffers, denoising_buffers)
+		delete buffers;
 
 	delete buffers;
 	delete display;
@@ -361,10 +374,40 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	Tile tile;
 	int device_num = device->device_number(tile_device);
 
+	/* Denoise tiles first, so their buffers can be freed as early as
+	 * possible. Once all tiles are rendering, wait for tiles to become ready
+	 * for denoising, instead of leaving them all to the last thread which
+	 * is still rendering. */
+	if(params.use_denoising) {
+		bool denoise_tile = tile_manager.next_denoise_tile(tile);
+
+		while(!denoise_tile &&
+		      num_active_render_tiles > 0 &&
+		      !tile_manager.has_tiles() &&
+		      !progress.get_cancel())
+		{
+			denoising_cond.wait(tile_lock);
+			denoise_tile = tile_manager.next_denoise_tile(tile);
+		}
+
+		if(denoise_tile) {
+			get_denoising_tile(tile, rtile);
+			rtile.task = RenderTile::DENOISE;
+
+			device->map_tile(tile_device, rtile);
+
+			return true;
+		}
+	}
+
 	if(!tile_manager.next_tile(tile, device_num))
 		return false;
+
+	num_active_render_tiles++;
 	
 	/* fill render tile */
+	rtile.task = RenderTile::PATH_TRACE;
+	rtile.tile_index = tile.index;
 	rtile.x = tile_manager.state.buffer.full_x + tile.x;
 	rtile.y = tile_manager.state.buffer.full_y + tile.y;
 	rtile.w = tile.w;
@@ -460,9 +503,20 @@ void Session::release_tile(RenderTile& rtile)
 {
 	thread_scoped_lock tile_lock(tile_mutex);
 
-	progress.add_finished_tile();
+	if(rtile.task == RenderTile::PATH_TRACE) {
+		if(tile_manager.finish_tile(rtile.tile_index))
+			progress.add_finished_tile();
+		num_active_render_tiles--;
+	}
+
+	if(params.use_denoising) {
+		release_denoising_tile(rtile);
 
-	if(write_render_tile_cb) {
+		/* wake up threads waiting for tiles to denoise */
+		if(rtile.task == RenderTile::PATH_TRACE)
+			denoising_cond.notify_all();
+	}
+	else if(write_render_tile_cb) {
 		if(params.progressive_refine == false) {
 			/* todo: optimize this by making it thread safe and removing lock */
 			write_render_tile_cb(rtile);
@@ -474,6 +528,151 @@ void Session::release_tile(RenderTile& rtile)
 	update_status_time();
 }
 
+bool Session::requeue_tile(RenderTile& rtile)
+{
+	/* Only tiles with their own temporary buffers can start over, shared
+	 * buffers already hold part of the samples of the failed device. Stop
+	 * the render then, instead of silently leaving the tile empty. */
+	if(!(params.background && params.output_path.empty()) || params.progressive_refine) {
+		progress.set_error("Device failed to render a tile, and the tile can not "
+		                   "be rendered again with a shared render buffer");
+		return false;
+	}
+
+	thread_scoped_lock tile_lock(tile_mutex);
+
+	delete rtile.buffers;
+	rtile.buffers = NULL;
+
+	tile_manager.requeue_tile(rtile.tile_index,
+	                          rtile.x - tile_manager.state.buffer.full_x,
+	                          rtile.y - tile_manager.state.buffer.full_y,
+	                          rtile.w,
+	                          rtile.h);
+
+	num_active_render_tiles--;
+	denoising_cond.notify_all();
+
+	return true;
+}
+
+void Session::get_denoising_tile(const Tile& tile, RenderTile& rtile)
+{
+	rtile.x = tile_manager.state.buffer.full_x + tile.x;
+	rtile.y = tile_manager.state.buffer.full_y + tile.y;
+	rtile.w = tile.w;
+	rtile.h = tile.h;
+	rtile.start_sample = tile_manager.state.sample;
+	rtile.num_samples = tile_manager.state.num_samples;
+	rtile.resolution = tile_manager.state.resolution_divider;
+
+	/* tile may have stopped early when rendering was canceled */
+	rtile.sample = denoising_samples[tile.index];
+
+	RenderBuffers *tilebuffers = denoising_buffers[tile.index];
+
+	if(tilebuffers) {
+		tilebuffers->params.get_offset_stride(rtile.offset, rtile.stride);
+	}
+	else {
+		tilebuffers = buffers;
+		tile_manager.state.buffer.get_offset_stride(rtile.offset, rtile.stride);
+	}
+
+	rtile.buffer = tilebuffers->buffer.device_pointer;
+	rtile.rng_state = tilebuffers->rng_state.device_pointer;
+	rtile.buffers = tilebuffers;
+}
+
+void Session::release_denoising_tile(RenderTile& rtile)
+{
+	int index = tile_manager.get_grid_index(rtile.x - tile_manager.state.buffer.full_x,
+	                                        rtile.y - tile_manager.state.buffer.full_y);
+
+	if(denoising_buffers.size() != tile_manager.state.grid_state.size()) {
+		denoising_buffers.resize(tile_manager.state.grid_state.size(), NULL);
+		denoising_samples.resize(tile_manager.state.grid_state.size(), 0);
+	}
+
+	if(rtile.task == RenderTile::PATH_TRACE) {
+		/* Keep buffers of temporary tiles around for the denoising of this
+		 * tile and its neighbours, and show the noisy result meanwhile. */
+		if(rtile.buffers != buffers)
+			denoising_buffers[index] = rtile.buffers;
+		denoising_samples[index] = rtile.sample;
+
+		if(update_render_tile_cb)
+			update_render_tile_cb(rtile);
+
+		tile_manager.finish_render_tile(index);
+		return;
+	}
+
+	if(write_render_tile_cb)
+		write_render_tile_cb(rtile);
+
+	vector<int> free_tiles;
+	tile_manager.finish_denoise_tile(index, free_tiles);
+
+	foreach(int free_index, free_tiles) {
+		delete denoising_buffers[free_index];
+		denoising_buffers[free_index] = NULL;
+	}
+}
+
+void Session::map_neighbor_tiles(RenderTile *tiles, Device *tile_device)
+{
+	thread_scoped_lock tile_lock(tile_mutex);
+
+	int index = tile_manager.get_grid_index(tiles[4].x - tile_manager.state.buffer.full_x,
+	                                        tiles[4].y - tile_manager.state.buffer.full_y);
+
+	for(int i = 0; i < 9; i++) {
+		if(i == 4)
+			continue;
+
+		Tile tile;
+		if(tile_manager.get_neighbor_tile(index, i%3 - 1, i/3 - 1, tile)) {
+			get_denoising_tile(tile, tiles[i]);
+			tiles[i].task = RenderTile::DENOISE;
+
+			device->map_tile(tile_device, tiles[i]);
+		}
+		else {
+			tiles[i] = RenderTile();
+		}
+	}
+}
+
+void Session::finish_denoising()
+{
+	thread_scoped_lock tile_lock(tile_mutex);
+
+	/* Tiles which were rendered but not denoised when rendering was canceled
+	 * are written as they are. */
+	for(size_t i = 0; i < denoising_buffers.size(); i++) {
+		RenderBuffers *tilebuffers = denoising_buffers[i];
+		if(!tilebuffers)
+			continue;
+
+		TileDenoiseState tile_state = tile_manager.state.grid_state[i];
+		if(tile_state == TILE_RENDERED || tile_state == TILE_DENOISE) {
+			Tile tile;
+			RenderTile rtile;
+			tile_manager.get_neighbor_tile(i, 0, 0, tile);
+			get_denoising_tile(tile, rtile);
+
+			if(write_render_tile_cb)
+				write_render_tile_cb(rtile);
+		}
+
+		delete tilebuffers;
+	}
+
+	denoising_buffers.clear();
+	denoising_samples.clear();
+}
+
 void Session::run_cpu()
 {
 	bool tiles_written = false;
@@ -573,6 +772,28 @@ void Session::run_cpu()
 
 		device->task_wait();
 
+		/* Render tiles which were given back by failed devices, e.g. a network
+		 * server which stopped responding, on the remaining devices. Stop when a
+		 * whole pass does not finish any tile anymore. */
+		int finished_tiles = -1;
+		while(params.background &&
+		      !progress.get_cancel() &&
+		      tile_manager.has_tiles() &&
+		      progress.get_finished_tiles() > finished_tiles)
+		{
+			finished_tiles = progress.get_finished_tiles();
+
+			{
+				thread_scoped_lock buffers_lock(buffers_mutex);
+				path_trace();
+			}
+
+			device->task_wait();
+		}
+
+		if(params.use_denoising)
+			finish_denoising();
+
 		{
 			thread_scoped_lock reset_lock(delayed_reset.mutex);
 			thread_scoped_lock buffers_lock(buffers_mutex);
@@ -764,6 +985,22 @@ void Session::set_samples(int samples)
 	}
 }
 
+void Session::set_denoising(bool denoising, const DenoiseParams& denoising_params)
+{
+	/* Denoising is done by the CPU device in between rendering tiles, with
+	 * all samples of a tile rendered at once. The filter expects the same
+	 * number of samples for all pixels of a tile, which adaptive sampling
+	 * does not guarantee. */
+	params.use_denoising = denoising &&
+	                       params.device.type == DEVICE_CPU &&
+	                       params.background &&
+	                       !params.progressive_refine &&
+	                       !(scene && scene->integrator->adaptive_threshold > 0.0f);
+	params.denoising = denoising_params;
+
+	tile_manager.set_denoising(params.use_denoising);
+}
+
 void Session::set_pause(bool pause_)
 {
 	bool notify = false;
@@ -809,11 +1046,12 @@ void Session::update_scene()
 	}
 
 	/* number of samples is needed by multi jittered
-	 * sampling pattern and by baking */
+	 * sampling pattern, by baking and by adaptive sampling */
 	Integrator *integrator = scene->integrator;
 	BakeManager *bake_manager = scene->bake_manager;
 
 	if(integrator->sampling_pattern == SAMPLING_PATTERN_CMJ ||
+	   integrator->adaptive_threshold > 0.0f ||
 	   bake_manager->get_baking())
 	{
 		int aa_samples = tile_manager.num_samples;
@@ -889,9 +1127,12 @@ void Session::path_trace()
 	
 	task.acquire_tile = function_bind(&Session::acquire_tile, this, _1, _2);
 	task.release_tile = function_bind(&Session::release_tile, this, _1);
+	task.requeue_tile = function_bind(&Session::requeue_tile, this, _1);
 	task.get_cancel = function_bind(&Progress::get_cancel, &this->progress);
 	task.update_tile_sample = function_bind(&Session::update_tile_sample, this, _1);
 	task.update_progress_sample = function_bind(&Progress::add_samples, &this->progress, _1, _2);
+	task.map_neighbor_tiles = function_bind(&Session::map_neighbor_tiles, this, _1, _2);
+	task.denoising_params = params.denoising;
 	task.need_finish_queue = params.progressive_refine;
 	task.integrator_branched = scene->integrator->method == Integrator::BRANCHED_PATH;
 	task.requested_tile_size = params.tile_size;
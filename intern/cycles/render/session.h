@@ -54,6 +54,10 @@ public:
 	TileOrder tile_order;
 	int start_resolution;
 	int threads;
+	bool use_tile_splitting;
+
+	bool use_denoising;
+	DenoiseParams denoising;
 
 	bool display_buffer_linear;
 
@@ -76,6 +80,9 @@ public:
 		tile_size = make_int2(64, 64);
 		start_resolution = INT_MAX;
 		threads = 0;
+		use_tile_splitting = false;
+
+		use_denoising = false;
 
 		display_buffer_linear = false;
 
@@ -99,6 +106,7 @@ public:
 		&& tile_size == params.tile_size
 		&& start_resolution == params.start_resolution
 		&& threads == params.threads
+		&& use_tile_splitting == params.use_tile_splitting
 		&& display_buffer_linear == params.display_buffer_linear
 		&& cancel_timeout == params.cancel_timeout
 		&& reset_timeout == params.reset_timeout
@@ -139,6 +147,7 @@ public:
 	void reset(BufferParams& params, int samples);
 	void set_samples(int samples);
 	void set_pause(bool pause);
+	void set_denoising(bool denoising, const DenoiseParams& denoising_params);
 
 	void update_scene();
 	void load_kernels();
@@ -176,6 +185,12 @@ protected:
 	bool acquire_tile(Device *tile_device, RenderTile& tile);
 	void update_tile_sample(RenderTile& tile);
 	void release_tile(RenderTile& tile);
+	bool requeue_tile(RenderTile& tile);
+
+	void get_denoising_tile(const Tile& tile, RenderTile& rtile);
+	void release_denoising_tile(RenderTile& rtile);
+	void map_neighbor_tiles(RenderTile *tiles, Device *tile_device);
+	void finish_denoising();
 
 	bool device_use_gl;
 
@@ -204,6 +219,15 @@ protected:
 
 	vector<RenderBuffers *> tile_buffers;
 
+	/* denoising, buffers and number of rendered samples of tiles indexed by
+	 * tile grid index */
+	vector<RenderBuffers *> denoising_buffers;
+	vector<int> denoising_samples;
+	/* tiles handed out for path tracing, once there are no more tiles to
+	 * render threads wait for these to finish to get tiles to denoise */
+	int num_active_render_tiles;
+	thread_condition_variable denoising_cond;
+
 	DeviceRequestedFeatures get_requested_device_features();
 
 	/* ** Split kernel routines ** */
@@ -30,6 +30,7 @@
 #include "render/tables.h"
 
 #include "util/util_foreach.h"
+#include "util/util_logging.h"
 #include "kernel/kernel_oiio_globals.h"
 #include "util/util_murmurhash.h"
 
@@ -163,6 +164,7 @@ NODE_DEFINE(Shader)
 	displacement_method_enum.insert("true", DISPLACE_TRUE);
 	displacement_method_enum.insert("both", DISPLACE_BOTH);
 	SOCKET_ENUM(displacement_method, "Displacement Method", displacement_method_enum, DISPLACE_BUMP);
+	SOCKET_FLOAT(displacement_bound, "Displacement Bound", 0.1f);
 
 	return type;
 }
@@ -196,6 +198,7 @@ Shader::Shader()
 	has_surface_emission = false;
 	has_surface_bssrdf = false;
 	has_volume = false;
+	has_volume_emission = false;
 	has_displacement = false;
 	has_bssrdf_bump = false;
 	has_surface_spatial_varying = false;
@@ -476,6 +479,8 @@ void ShaderManager::device_update_common(Device *device,
 		}
 		if(shader->heterogeneous_volume && shader->has_volume_spatial_varying)
 			flag |= SD_SHADER_HETEROGENEOUS_VOLUME;
+		if(shader->has_volume_emission)
+			flag |= SD_SHADER_HAS_VOLUME_EMISSION;
 		if(shader->has_bssrdf_bump)
 			flag |= SD_SHADER_HAS_BSSRDF_BUMP;
 		if(shader->volume_sampling_method == VOLUME_SAMPLING_EQUIANGULAR)
@@ -690,16 +695,18 @@ void ShaderManager::free_memory()
 
 void ShaderManager::texture_system_init()
 {
-	ts = TextureSystem::create(true);
+	/* Every session gets its own texture system rather than the process wide
+	 * shared one, so the cache budget from the session parameters is honored
+	 * and invalidating images in one session (viewport for example) does not
+	 * flush tiles another session (final render) is still using. */
+	ts = TextureSystem::create(false);
 	ts->attribute("gray_to_rgb", 1);
 	ts->attribute("forcefloat", 1);
 }
 
 void ShaderManager::texture_system_free()
 {
-	std::cout << ts->getstats(2) << std::endl;
-	ts->reset_stats();
-	ts->invalidate_all(true);
+	VLOG(1) << "Texture cache statistics:\n" << ts->getstats(2);
 	TextureSystem::destroy(ts);
 	ts = NULL;
 }
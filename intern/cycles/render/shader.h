@@ -35,6 +35,7 @@
 #include "util/util_string.h"
 #include "util/util_thread.h"
 #include "util/util_types.h"
+#include "util/util_vector.h"
 #include "kernel/kernel_oiio_globals.h"
 
 CCL_NAMESPACE_BEGIN
@@ -132,6 +133,7 @@ public:
 	bool has_surface_emission;
 	bool has_surface_transparent;
 	bool has_volume;
+	bool has_volume_emission;
 	bool has_displacement;
 	bool has_surface_bssrdf;
 	bool has_bssrdf_bump;
@@ -142,6 +144,9 @@ public:
 
 	/* displacement */
 	DisplacementMethod displacement_method;
+	/* maximum distance true displacement moves the surface, used to bound
+	 * patches that are diced lazily */
+	float displacement_bound;
 
 	/* requested mesh attributes */
 	AttributeRequestSet attributes;
@@ -150,6 +155,9 @@ public:
 	uint id;
 	bool used;
 
+	/* compiled SVM program, reused while the shader does not change */
+	vector<int4> svm_nodes;
+
 #ifdef WITH_OSL
 	/* osl shading state references */
 	OSL::ShaderGroupRef osl_surface_ref;
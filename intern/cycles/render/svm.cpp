@@ -15,6 +15,7 @@
  */
 
 #include "device/device.h"
+#include "render/film.h"
 #include "render/graph.h"
 #include "render/light.h"
 #include "render/mesh.h"
@@ -34,6 +35,8 @@ CCL_NAMESPACE_BEGIN
 /* Shader Manager */
 
 SVMShaderManager::SVMShaderManager()
+: num_shared_segments_(0),
+  num_reused_shaders_(0)
 {
 	texture_system_init();
 }
@@ -57,19 +60,51 @@ void SVMShaderManager::device_update_shader(Scene *scene,
 	}
 	assert(shader->graph);
 
-	vector<int4> svm_nodes;
-	svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+	/* Program of an unchanged shader can be used as is. Integrator settings
+	 * and film passes are compiled into programs, so those changing still
+	 * needs everything to be compiled again. */
+	bool use_previous = !shader->need_update &&
+	                    !shader->svm_nodes.empty() &&
+	                    !shader->has_integrator_dependency &&
+	                    !scene->film->need_update;
+
+	if(!use_previous) {
+		vector<int4> svm_nodes;
+		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+
+		SVMCompiler::Summary summary;
+		SVMCompiler compiler(scene->shader_manager, scene->image_manager, scene->film);
+		compiler.background = (shader == scene->default_background);
+		compiler.compile(scene, shader, svm_nodes, 0, &summary);
+
+		VLOG(2) << "Compilation summary:\n"
+		        << "Shader name: " << shader->name << "\n"
+		        << summary.full_report();
 
-	SVMCompiler::Summary summary;
-	SVMCompiler compiler(scene->shader_manager, scene->image_manager, scene->film);
-	compiler.background = (shader == scene->default_background);
-	compiler.compile(scene, shader, svm_nodes, 0, &summary);
+		shader->svm_nodes.swap(svm_nodes);
+	}
 
-	VLOG(2) << "Compilation summary:\n"
-	        << "Shader name: " << shader->name << "\n"
-	        << summary.full_report();
+	const vector<int4>& svm_nodes = shader->svm_nodes;
+
+	/* The program is made of surface (with bump falling through into it),
+	 * volume and displacement segments. Jumps inside a segment are relative,
+	 * so segments with the same nodes can be shared between shaders, which is
+	 * common for materials built from the same node groups. */
+	const int segment_start[4] = {svm_nodes[0].y,
+	                              svm_nodes[0].z,
+	                              svm_nodes[0].w,
+	                              (int)svm_nodes.size()};
+	string segment_key[3];
+	for(int i = 0; i < 3; i++) {
+		assert(segment_start[i] <= segment_start[i + 1]);
+		segment_key[i] = string((const char*)&svm_nodes[segment_start[i]],
+		                        sizeof(int4) * (segment_start[i + 1] - segment_start[i]));
+	}
 
 	nodes_lock_.lock();
+	if(use_previous) {
+		num_reused_shaders_++;
+	}
 	if(shader->use_mis && shader->has_surface_emission) {
 		scene->light_manager->need_update = true;
 	}
@@ -77,18 +112,31 @@ void SVMShaderManager::device_update_shader(Scene *scene,
 	/* The copy needs to be done inside the lock, if another thread resizes the array 
 	 * while memcpy is running, it'll be copying into possibly invalid/freed ram. 
 	 */
-	size_t global_nodes_size = global_svm_nodes->size();
-	global_svm_nodes->resize(global_nodes_size + svm_nodes.size());
-	
+	int global_offset[3];
+	for(int i = 0; i < 3; i++) {
+		unordered_map<string, int>::iterator it = shared_segments_.find(segment_key[i]);
+		if(it != shared_segments_.end()) {
+			global_offset[i] = it->second;
+			num_shared_segments_++;
+			continue;
+		}
+
+		/* Copy new nodes to global storage. */
+		size_t global_nodes_size = global_svm_nodes->size();
+		global_svm_nodes->resize(global_nodes_size + segment_start[i + 1] - segment_start[i]);
+		memcpy(&global_svm_nodes->at(global_nodes_size),
+		       &svm_nodes[segment_start[i]],
+		       segment_key[i].size());
+
+		global_offset[i] = global_nodes_size;
+		shared_segments_[segment_key[i]] = global_nodes_size;
+	}
+
 	/* Offset local SVM nodes to a global address space. */
 	int4& jump_node = global_svm_nodes->at(shader->id);
-	jump_node.y = svm_nodes[0].y + global_nodes_size - 1;
-	jump_node.z = svm_nodes[0].z + global_nodes_size - 1;
-	jump_node.w = svm_nodes[0].w + global_nodes_size - 1;
-	/* Copy new nodes to global storage. */
-	memcpy(&global_svm_nodes->at(global_nodes_size),
-	       &svm_nodes[1],
-	       sizeof(int4) * (svm_nodes.size() - 1));
+	jump_node.y = global_offset[0];
+	jump_node.z = global_offset[1];
+	jump_node.w = global_offset[2];
 	nodes_lock_.unlock();
 }
 
@@ -115,6 +163,10 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
 	}
 
+	shared_segments_.clear();
+	num_shared_segments_ = 0;
+	num_reused_shaders_ = 0;
+
 	TaskPool task_pool;
 	foreach(Shader *shader, scene->shaders) {
 		task_pool.push(function_bind(&SVMShaderManager::device_update_shader,
@@ -127,10 +179,16 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 	}
 	task_pool.wait_work();
 
+	shared_segments_.clear();
+
 	if(progress.get_cancel()) {
 		return;
 	}
 
+	VLOG(1) << "Shared " << num_shared_segments_ << " SVM program segments "
+	        << "between shaders.";
+	VLOG(1) << "Reused " << num_reused_shaders_ << " previously compiled shaders.";
+
 	dscene->svm_nodes.copy((uint4*)&svm_nodes[0], svm_nodes.size());
 	device->tex_alloc("__svm_nodes", dscene->svm_nodes);
 
@@ -525,6 +583,10 @@ void SVMCompiler::generate_closure_node(ShaderNode *node,
 				current_shader->has_bssrdf_bump = true;
 		}
 	}
+	else if(current_type == SHADER_TYPE_VOLUME) {
+		if(node->has_surface_emission())
+			current_shader->has_volume_emission = true;
+	}
 }
 
 void SVMCompiler::generated_shared_closure_nodes(ShaderNode *root_node,
@@ -878,6 +940,7 @@ void SVMCompiler::compile(Scene *scene,
 	shader->has_surface_bssrdf = false;
 	shader->has_bssrdf_bump = false;
 	shader->has_volume = false;
+	shader->has_volume_emission = false;
 	shader->has_displacement = false;
 	shader->has_surface_spatial_varying = false;
 	shader->has_volume_spatial_varying = false;
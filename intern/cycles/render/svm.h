@@ -21,6 +21,7 @@
 #include "render/graph.h"
 #include "render/shader.h"
 
+#include "util/util_map.h"
 #include "util/util_set.h"
 #include "util/util_string.h"
 #include "util/util_thread.h"
@@ -53,6 +54,13 @@ protected:
 	/* Lock used to synchronize threaded nodes compilation. */
 	thread_spin_lock nodes_lock_;
 
+	/* Offsets of compiled program segments in the global nodes array, keyed
+	 * by their content, so shaders compiling to the same nodes share them. */
+	unordered_map<string, int> shared_segments_;
+	int num_shared_segments_;
+	/* Number of shaders which were not compiled again, for statistics. */
+	int num_reused_shaders_;
+
 	void device_update_shader(Scene *scene,
 	                          Shader *shader,
 	                          Progress *progress,
@@ -17,6 +17,7 @@
 #include "render/tile.h"
 
 #include "util/util_algorithm.h"
+#include "util/util_foreach.h"
 #include "util/util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -94,6 +95,8 @@ TileManager::TileManager(bool progressive_, int num_samples_, int2 tile_size_, i
 	start_resolution = start_resolution_;
 	num_samples = num_samples_;
 	num_devices = num_devices_;
+	split_threads = 0;
+	use_denoising = false;
 	preserve_tile_device = preserve_tile_device_;
 	background = background_;
 
@@ -134,6 +137,10 @@ void TileManager::reset(BufferParams& params_, int num_samples_)
 	state.num_samples = 0;
 	state.resolution_divider = get_divider(params.width, params.height, start_resolution);
 	state.tiles.clear();
+	state.tile_parts.clear();
+	state.grid_size = make_int2(0, 0);
+	state.grid_state.clear();
+	state.denoise_tiles.clear();
 }
 
 void TileManager::set_samples(int num_samples_)
@@ -323,6 +330,8 @@ void TileManager::set_tiles()
 	int image_h = max(1, params.height/resolution);
 
 	state.num_tiles = gen_tiles(!background);
+	state.tile_parts.clear();
+	state.tile_parts.resize(state.num_tiles, 1);
 
 	state.buffer.width = image_w;
 	state.buffer.height = image_h;
@@ -331,6 +340,38 @@ void TileManager::set_tiles()
 	state.buffer.full_y = params.full_y/resolution;
 	state.buffer.full_width = max(1, params.full_width/resolution);
 	state.buffer.full_height = max(1, params.full_height/resolution);
+
+	state.denoise_tiles.clear();
+	state.grid_state.clear();
+
+	if(use_denoising) {
+		state.grid_size = make_int2((image_w + tile_size.x - 1)/tile_size.x,
+		                            (image_h + tile_size.y - 1)/tile_size.y);
+		state.grid_state.resize(state.grid_size.x*state.grid_size.y, TILE_RENDER);
+	}
+}
+
+bool TileManager::split_tile(Tile& tile, Tile& other)
+{
+	/* Don't go below this size, per tile overhead would dominate. */
+	const int min_size = 16;
+
+	if(tile.w >= tile.h && tile.w >= min_size*2) {
+		const int w = tile.w/2;
+		other = Tile(tile.index, tile.x + w, tile.y, tile.w - w, tile.h, tile.device);
+		tile.w = w;
+		state.tile_parts[tile.index]++;
+		return true;
+	}
+	else if(tile.h >= min_size*2) {
+		const int h = tile.h/2;
+		other = Tile(tile.index, tile.x, tile.y + h, tile.w, tile.h - h, tile.device);
+		tile.h = h;
+		state.tile_parts[tile.index]++;
+		return true;
+	}
+
+	return false;
 }
 
 bool TileManager::next_tile(Tile& tile, int device)
@@ -340,11 +381,141 @@ bool TileManager::next_tile(Tile& tile, int device)
 	if((logical_device >= state.tiles.size()) || state.tiles[logical_device].empty())
 		return false;
 
-	tile = Tile(state.tiles[logical_device].front());
-	state.tiles[logical_device].pop_front();
+	list<Tile>& tiles = state.tiles[logical_device];
+
+	tile = Tile(tiles.front());
+	tiles.pop_front();
+
+	/* Near the end of the frame threads would otherwise run out of tiles
+	 * while a few others are still busy with whole ones. Keep at least one
+	 * tile per thread around by splitting, the other half goes to the front
+	 * of the list so the next thread continues right next to this one. */
+	Tile other;
+	int num_queued = (int)tiles.size();
+	while(!use_denoising &&
+	      num_queued + 1 < split_threads &&
+	      split_tile(tile, other))
+	{
+		tiles.push_front(other);
+		num_queued++;
+	}
+
+	return true;
+}
+
+void TileManager::requeue_tile(int index, int x, int y, int w, int h, int device)
+{
+	int logical_device = preserve_tile_device? device: 0;
+
+	if(logical_device >= state.tiles.size())
+		return;
+
+	state.tiles[logical_device].push_front(Tile(index, x, y, w, h, device));
+}
+
+bool TileManager::finish_tile(int index)
+{
+	/* Tiles of a previous reset are counted as finished. */
+	if(index < 0 || index >= state.tile_parts.size())
+		return true;
+
+	return --state.tile_parts[index] == 0;
+}
+
+int TileManager::get_grid_index(int x, int y)
+{
+	return (y/tile_size.y)*state.grid_size.x + x/tile_size.x;
+}
+
+bool TileManager::get_neighbor_tile(int index, int dx, int dy, Tile& tile)
+{
+	int tx = index % state.grid_size.x + dx;
+	int ty = index / state.grid_size.x + dy;
+
+	if(tx < 0 || ty < 0 || tx >= state.grid_size.x || ty >= state.grid_size.y)
+		return false;
+
+	int x = tx*tile_size.x;
+	int y = ty*tile_size.y;
+	int w = min(tile_size.x, state.buffer.width - x);
+	int h = min(tile_size.y, state.buffer.height - y);
+
+	tile = Tile(ty*state.grid_size.x + tx, x, y, w, h, 0);
+	return true;
+}
+
+bool TileManager::neighbors_in_state(int index, TileDenoiseState tile_state)
+{
+	Tile tile;
+	for(int dy = -1; dy <= 1; dy++) {
+		for(int dx = -1; dx <= 1; dx++) {
+			if(get_neighbor_tile(index, dx, dy, tile) &&
+			   state.grid_state[tile.index] < tile_state)
+			{
+				return false;
+			}
+		}
+	}
 	return true;
 }
 
+bool TileManager::next_denoise_tile(Tile& tile)
+{
+	if(state.denoise_tiles.empty())
+		return false;
+
+	tile = state.denoise_tiles.front();
+	state.denoise_tiles.pop_front();
+
+	return true;
+}
+
+void TileManager::finish_render_tile(int index)
+{
+	state.grid_state[index] = TILE_RENDERED;
+
+	/* This tile may have been the last missing neighbour of tiles around it. */
+	Tile tile;
+	for(int dy = -1; dy <= 1; dy++) {
+		for(int dx = -1; dx <= 1; dx++) {
+			if(get_neighbor_tile(index, dx, dy, tile) &&
+			   state.grid_state[tile.index] == TILE_RENDERED &&
+			   neighbors_in_state(tile.index, TILE_RENDERED))
+			{
+				state.grid_state[tile.index] = TILE_DENOISE;
+				state.denoise_tiles.push_back(tile);
+			}
+		}
+	}
+}
+
+void TileManager::finish_denoise_tile(int index, vector<int>& free_tiles)
+{
+	state.grid_state[index] = TILE_DENOISED;
+
+	Tile tile;
+	for(int dy = -1; dy <= 1; dy++) {
+		for(int dx = -1; dx <= 1; dx++) {
+			if(get_neighbor_tile(index, dx, dy, tile) &&
+			   state.grid_state[tile.index] == TILE_DENOISED &&
+			   neighbors_in_state(tile.index, TILE_DENOISED))
+			{
+				state.grid_state[tile.index] = TILE_DONE;
+				free_tiles.push_back(tile.index);
+			}
+		}
+	}
+}
+
+bool TileManager::has_tiles()
+{
+	foreach(list<Tile>& tiles, state.tiles) {
+		if(!tiles.empty())
+			return true;
+	}
+	return false;
+}
+
 bool TileManager::done()
 {
 	int end_sample = (range_num_samples == -1)
@@ -51,6 +51,15 @@ enum TileOrder {
 	TILE_HILBERT_SPIRAL = 5,
 };
 
+/* Tile state for denoising, in order of progress. */
+enum TileDenoiseState {
+	TILE_RENDER = 0,
+	TILE_RENDERED,
+	TILE_DENOISE,
+	TILE_DENOISED,
+	TILE_DONE,
+};
+
 /* Tile Manager */
 
 class TileManager {
@@ -62,7 +71,11 @@ public:
 		int sample;
 		int num_samples;
 		int resolution_divider;
+		/* Number of tiles of the frame. Tiles split at the end of the
+		 * frame keep the index of the tile they were split from. */
 		int num_tiles;
+		/* Number of parts of each tile still to be rendered. */
+		vector<int> tile_parts;
 
 		/* Total samples over all pixels: Generally num_samples*num_pixels,
 		 * but can be higher due to the initial resolution division for previews. */
@@ -70,6 +83,12 @@ public:
 		/* This vector contains a list of tiles for every logical device in the session.
 		 * In each list, the tiles are sorted according to the tile order setting. */
 		vector<list<Tile> > tiles;
+
+		/* Size and denoising state of the regular grid of tiles, and tiles
+		 * which are ready to be denoised. */
+		int2 grid_size;
+		vector<TileDenoiseState> grid_state;
+		list<Tile> denoise_tiles;
 	} state;
 
 	int num_samples;
@@ -82,10 +101,39 @@ public:
 	void set_samples(int num_samples);
 	bool next();
 	bool next_tile(Tile& tile, int device = 0);
+	/* Put tile back at the front of the queue to be handed out again. */
+	void requeue_tile(int index, int x, int y, int w, int h, int device = 0);
+	/* Mark part of a tile as rendered, returns true once the whole tile is. */
+	bool finish_tile(int index);
+	bool has_tiles();
 	bool done();
 
 	void set_tile_order(TileOrder tile_order_) { tile_order = tile_order_; }
 
+	/* Split tiles in half when handing them out once fewer tiles than
+	 * threads are left, so all threads stay busy until the frame is done.
+	 * Zero disables splitting. */
+	void set_split_threads(int split_threads_) { split_threads = split_threads_; }
+
+	/* ** Denoising of final renders. ** */
+
+	/* Tiles are handed out for denoising once all their neighbours are
+	 * rendered, since the filter reads pixels across tile borders. Buffers
+	 * of a tile are needed until all its neighbours are denoised as well.
+	 * Tiles are identified by their index in the regular grid of tiles, so
+	 * tiles are not split while denoising. */
+	void set_denoising(bool use_denoising_) { use_denoising = use_denoising_; }
+
+	int get_grid_index(int x, int y);
+	/* Get tile of the grid next to the given one, returns false if it is
+	 * outside of the image. */
+	bool get_neighbor_tile(int index, int dx, int dy, Tile& tile);
+	bool next_denoise_tile(Tile& tile);
+	void finish_render_tile(int index);
+	/* Mark tile as denoised, and append tiles whose buffers are no longer
+	 * needed by any neighbour to free_tiles. */
+	void finish_denoise_tile(int index, vector<int>& free_tiles);
+
 	/* ** Sample range rendering. ** */
 
 	/* Start sample in the range. */
@@ -105,6 +153,8 @@ protected:
 	TileOrder tile_order;
 	int start_resolution;
 	int num_devices;
+	int split_threads;
+	bool use_denoising;
 
 	/* in some cases it is important that the same tile will be returned for the same
 	 * device it was originally generated for (i.e. viewport rendering when buffer is
@@ -127,6 +177,14 @@ protected:
 
 	/* Generate tile list, return number of tiles. */
 	int gen_tiles(bool sliced);
+
+	/* Split tile in half along its longer side, keeping the first half in
+	 * tile. Returns false if the tile is too small to be split. */
+	bool split_tile(Tile& tile, Tile& other);
+
+	/* Returns true if all existing neighbours of the tile, including the
+	 * tile itself, are at least in the given state. */
+	bool neighbors_in_state(int index, TileDenoiseState tile_state);
 };
 
 CCL_NAMESPACE_END
@@ -187,7 +187,7 @@ static void build_patch_map(PackedPatchTable& table, OpenSubdiv::Far::PatchTable
 
 /* packed patch table functions */
 
-size_t PackedPatchTable::total_size()
+size_t PackedPatchTable::total_size() const
 {
 	return num_arrays * PATCH_ARRAY_SIZE +
 		   num_indices +
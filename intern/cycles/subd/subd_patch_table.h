@@ -51,7 +51,7 @@ struct PackedPatchTable {
 	size_t num_nodes;
 
 	/* calculated size from num_* members */
-	size_t total_size();
+	size_t total_size() const;
 
 	void pack(Far::PatchTable* patch_table, int offset = 0);
 	void copy_adjusting_offsets(uint* dest, int doffset);
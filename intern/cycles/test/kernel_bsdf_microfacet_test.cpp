@@ -0,0 +1,171 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "kernel/kernel_compat_cpu.h"
+#include "kernel/kernel_math.h"
+#include "kernel/kernel_types.h"
+#include "kernel/split/kernel_split_data.h"
+#include "kernel/kernel_globals.h"
+#include "kernel/kernel_montecarlo.h"
+
+#include "kernel/closure/bsdf_util.h"
+#include "kernel/closure/bsdf_microfacet.h"
+
+#include "util/util_hash.h"
+
+CCL_NAMESPACE_BEGIN
+
+#ifdef __BSDF_SIMD_EVAL__
+
+namespace {
+
+class RandomSequence {
+public:
+	explicit RandomSequence(uint seed) : seed_(seed), index_(0) {}
+
+	float next()
+	{
+		return (float)hash_int_2d(seed_, index_++) * (1.0f/(float)0xFFFFFFFF);
+	}
+
+	float3 next_direction()
+	{
+		const float z = 1.0f - 2.0f*next();
+		const float r = safe_sqrtf(1.0f - z*z);
+		const float phi = M_2PI_F*next();
+		return make_float3(r*cosf(phi), r*sinf(phi), z);
+	}
+
+	/* Direction in the hemisphere around N, so most samples are valid. */
+	float3 next_direction(const float3 N)
+	{
+		const float3 D = next_direction();
+		return (dot(D, N) < 0.0f)? -D: D;
+	}
+
+private:
+	uint seed_;
+	uint index_;
+};
+
+/* Same kinds of lobes as a layered principled material: specular, clearcoat
+ * and plain glossy. */
+void setup_random_closure(RandomSequence& rng,
+                          const float3 N,
+                          int kind,
+                          MicrofacetBsdf *bsdf,
+                          MicrofacetExtra *extra)
+{
+	memset(bsdf, 0, sizeof(MicrofacetBsdf));
+	memset(extra, 0, sizeof(MicrofacetExtra));
+
+	bsdf->weight = make_float3(1.0f, 1.0f, 1.0f);
+	bsdf->N = N;
+	bsdf->alpha_x = 0.01f + 0.99f*rng.next();
+	bsdf->ior = 1.0f + rng.next();
+
+	extra->color = make_float3(rng.next(), rng.next(), rng.next());
+	extra->cspec0 = make_float3(rng.next(), rng.next(), rng.next());
+	extra->clearcoat = rng.next();
+
+	switch(kind) {
+		case 0:
+			bsdf_microfacet_ggx_setup(bsdf);
+			break;
+		case 1:
+			bsdf->extra = extra;
+			bsdf_microfacet_ggx_fresnel_setup(bsdf);
+			break;
+		default:
+			bsdf->extra = extra;
+			bsdf_microfacet_ggx_clearcoat_setup(bsdf);
+			break;
+	}
+}
+
+void expect_float_near(float a, float b)
+{
+	EXPECT_NEAR(a, b, 1e-4f*max(fabsf(a), 1.0f));
+}
+
+}  // namespace
+
+TEST(kernel_bsdf_microfacet, ggx_eval_simd_supported) {
+	RandomSequence rng(0);
+	MicrofacetBsdf bsdf;
+	MicrofacetExtra extra;
+
+	setup_random_closure(rng, make_float3(0.0f, 0.0f, 1.0f), 0, &bsdf, &extra);
+	EXPECT_TRUE(bsdf_microfacet_ggx_eval_simd_supported((const ShaderClosure*)&bsdf));
+
+	/* Anisotropic and near specular closures use the scalar code. */
+	bsdf.alpha_y = 0.5f*bsdf.alpha_x;
+	EXPECT_FALSE(bsdf_microfacet_ggx_eval_simd_supported((const ShaderClosure*)&bsdf));
+
+	bsdf.alpha_x = bsdf.alpha_y = 0.0f;
+	EXPECT_FALSE(bsdf_microfacet_ggx_eval_simd_supported((const ShaderClosure*)&bsdf));
+
+	bsdf.alpha_x = bsdf.alpha_y = 0.5f;
+	bsdf.type = CLOSURE_BSDF_MICROFACET_BECKMANN_ID;
+	EXPECT_FALSE(bsdf_microfacet_ggx_eval_simd_supported((const ShaderClosure*)&bsdf));
+}
+
+TEST(kernel_bsdf_microfacet, ggx_eval_reflect_simd) {
+	RandomSequence rng(1);
+
+	for(int iteration = 0; iteration < 1000; iteration++) {
+		/* Batches of one to four closures, which may share a normal as they
+		 * do in layered materials. */
+		const int num_closures = 1 + iteration % 4;
+		const float3 Ng = rng.next_direction();
+
+		MicrofacetBsdf bsdfs[4];
+		MicrofacetExtra extras[4];
+		const ShaderClosure *closures[4];
+
+		for(int i = 0; i < num_closures; i++) {
+			const float3 N = (rng.next() < 0.5f)? Ng: rng.next_direction(Ng);
+			setup_random_closure(rng, N, (iteration + i) % 3, &bsdfs[i], &extras[i]);
+			closures[i] = (const ShaderClosure*)&bsdfs[i];
+		}
+
+		const float3 I = rng.next_direction(Ng);
+		const float3 omega_in = rng.next_direction(Ng);
+
+		float3 eval[4];
+		float pdf[4];
+		bsdf_microfacet_ggx_eval_reflect_simd(closures, num_closures, I, omega_in, eval, pdf);
+
+		for(int i = 0; i < num_closures; i++) {
+			float scalar_pdf = 0.0f;
+			const float3 scalar_eval = bsdf_microfacet_ggx_eval_reflect(closures[i],
+			                                                            I,
+			                                                            omega_in,
+			                                                            &scalar_pdf);
+
+			expect_float_near(pdf[i], scalar_pdf);
+			expect_float_near(eval[i].x, scalar_eval.x);
+			expect_float_near(eval[i].y, scalar_eval.y);
+			expect_float_near(eval[i].z, scalar_eval.z);
+		}
+	}
+}
+
+#endif  /* __BSDF_SIMD_EVAL__ */
+
+CCL_NAMESPACE_END
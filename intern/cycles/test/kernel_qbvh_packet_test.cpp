@@ -0,0 +1,236 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "kernel/kernel_compat_cpu.h"
+#include "kernel/kernel_math.h"
+#include "kernel/kernel_types.h"
+#include "kernel/split/kernel_split_data.h"
+#include "kernel/kernel_globals.h"
+#include "kernel/kernels/cpu/kernel_cpu_image.h"
+
+/* Host side headers come after the kernel types, so these are compiled with
+ * the same CPU kernel features, but before the traversal code which declares
+ * nested namespaces. */
+#include "bvh/bvh.h"
+#include "bvh/bvh4.h"
+
+#include "render/mesh.h"
+#include "render/object.h"
+
+#include "util/util_hash.h"
+#include "util/util_progress.h"
+
+#include "kernel/kernel_random.h"
+#include "kernel/kernel_projection.h"
+#include "kernel/kernel_montecarlo.h"
+#include "kernel/kernel_differential.h"
+#include "kernel/kernel_camera.h"
+
+#include "kernel/geom/geom.h"
+#include "kernel/bvh/bvh.h"
+
+CCL_NAMESPACE_BEGIN
+
+#ifdef __RAY_PACKETS__
+
+namespace {
+
+class RandomSequence {
+public:
+	explicit RandomSequence(uint seed) : seed_(seed), index_(0) {}
+
+	float next()
+	{
+		return (float)hash_int_2d(seed_, index_++) * (1.0f/(float)0xFFFFFFFF);
+	}
+
+	float3 next_point(float size)
+	{
+		return make_float3(next(), next(), next()) * size;
+	}
+
+private:
+	uint seed_;
+	uint index_;
+};
+
+/* Scene of randomly placed small triangles, with leaves of one triangle so
+ * the tree is deep and many QBVH nodes have less than four children. */
+class PacketTestScene {
+public:
+	explicit PacketTestScene(int num_compressed_node_bits)
+	{
+		RandomSequence rng(0);
+		const int num_triangles = 103;
+
+		mesh.transform_applied = true;
+		mesh.reserve_mesh(num_triangles*3, num_triangles);
+		for(int i = 0; i < num_triangles; i++) {
+			const float3 P = rng.next_point(10.0f);
+			mesh.add_vertex(P);
+			mesh.add_vertex(P + rng.next_point(1.0f));
+			mesh.add_vertex(P + rng.next_point(1.0f));
+			mesh.add_triangle(i*3 + 0, i*3 + 1, i*3 + 2, 0, false);
+		}
+		mesh.compute_bounds();
+
+		object.mesh = &mesh;
+		object.compute_bounds(false);
+
+		vector<Object*> objects;
+		objects.push_back(&object);
+
+		BVHParams params;
+		params.top_level = true;
+		params.use_qbvh = true;
+		params.num_compressed_node_bits = num_compressed_node_bits;
+		params.max_triangle_leaf_size = 1;
+
+		Progress progress;
+		bvh = BVH::create(params, objects);
+		bvh->build(progress);
+
+		PackedBVH& pack = bvh->pack;
+
+		kg = new KernelGlobals();
+		kg->__bvh_nodes.data = (float4*)&pack.nodes[0];
+		kg->__bvh_nodes.width = pack.nodes.size();
+		kg->__bvh_leaf_nodes.data = (float4*)&pack.leaf_nodes[0];
+		kg->__bvh_leaf_nodes.width = pack.leaf_nodes.size();
+		kg->__prim_tri_index.data = &pack.prim_tri_index[0];
+		kg->__prim_tri_index.width = pack.prim_tri_index.size();
+		kg->__prim_tri_verts.data = &pack.prim_tri_verts[0];
+		kg->__prim_tri_verts.width = pack.prim_tri_verts.size();
+		kg->__prim_type.data = (uint*)&pack.prim_type[0];
+		kg->__prim_type.width = pack.prim_type.size();
+		kg->__prim_visibility.data = &pack.prim_visibility[0];
+		kg->__prim_visibility.width = pack.prim_visibility.size();
+		kg->__prim_index.data = (uint*)&pack.prim_index[0];
+		kg->__prim_index.width = pack.prim_index.size();
+		kg->__prim_object.data = (uint*)&pack.prim_object[0];
+		kg->__prim_object.width = pack.prim_object.size();
+
+		kg->__data.bvh.root = pack.root_index;
+		kg->__data.bvh.use_qbvh = true;
+		kg->__data.bvh.num_compressed_node_bits = num_compressed_node_bits;
+	}
+
+	~PacketTestScene()
+	{
+		delete kg;
+		delete bvh;
+	}
+
+	/* Whether any node of the uncompressed layout has an empty child slot. */
+	bool has_partial_nodes() const
+	{
+		const PackedBVH& pack = bvh->pack;
+		for(size_t i = 0; i + BVH_QNODE_SIZE <= pack.nodes.size(); i += BVH_QNODE_SIZE) {
+			const float4 min_x = *(const float4*)&pack.nodes[i + 1];
+			const float4 max_x = *(const float4*)&pack.nodes[i + 2];
+			for(int c = 0; c < 4; c++) {
+				if(min_x[c] > max_x[c]) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	Mesh mesh;
+	Object object;
+	BVH *bvh;
+	KernelGlobals *kg;
+};
+
+void test_packet_intersect(int num_compressed_node_bits)
+{
+	PacketTestScene scene(num_compressed_node_bits);
+	KernelGlobals *kg = scene.kg;
+	RandomSequence rng(1);
+
+	if(num_compressed_node_bits == 0) {
+		EXPECT_TRUE(scene.has_partial_nodes());
+	}
+
+	int num_hits = 0;
+
+	for(int iteration = 0; iteration < 500; iteration++) {
+		/* Coherent rays from a shared origin, like camera rays, with some
+		 * lanes inactive. */
+		const float3 P = make_float3(-5.0f, -5.0f, -5.0f) + rng.next_point(20.0f);
+		const float3 target = rng.next_point(10.0f);
+		const int active = (iteration % 5 == 0)? 0x5: 0xF;
+
+		Ray rays[RAY_PACKET_SIZE];
+		for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+			rays[i].P = P;
+			rays[i].D = normalize(target + rng.next_point(2.0f) - P);
+			rays[i].t = FLT_MAX;
+			rays[i].time = 0.5f;
+		}
+
+		Intersection isect[RAY_PACKET_SIZE];
+		qbvh_intersect_packet(kg, rays, isect, PATH_RAY_CAMERA, active);
+
+		for(int i = 0; i < RAY_PACKET_SIZE; i++) {
+			if(!(active & (1 << i))) {
+				continue;
+			}
+
+			Intersection single_isect;
+			const bool hit = scene_intersect(kg,
+			                                 rays[i],
+			                                 PATH_RAY_CAMERA,
+			                                 &single_isect,
+			                                 NULL,
+			                                 0.0f,
+			                                 0.0f,
+			                                 0);
+
+			EXPECT_EQ(isect[i].prim != PRIM_NONE, hit);
+			if(hit) {
+				EXPECT_EQ(isect[i].prim, single_isect.prim);
+				EXPECT_EQ(isect[i].object, single_isect.object);
+				EXPECT_FLOAT_EQ(isect[i].t, single_isect.t);
+				num_hits++;
+			}
+		}
+	}
+
+	/* Make sure the rays actually hit something. */
+	EXPECT_GT(num_hits, 100);
+}
+
+}  // namespace
+
+TEST(kernel_qbvh_packet, intersect) {
+	test_packet_intersect(0);
+}
+
+TEST(kernel_qbvh_packet, intersect_compressed8) {
+	test_packet_intersect(8);
+}
+
+TEST(kernel_qbvh_packet, intersect_compressed16) {
+	test_packet_intersect(16);
+}
+
+#endif  /* __RAY_PACKETS__ */
+
+CCL_NAMESPACE_END
@@ -20,7 +20,11 @@
 #include "render/graph.h"
 #include "render/scene.h"
 #include "render/nodes.h"
+#include "render/shader.h"
+#include "render/svm.h"
+#include "util/util_foreach.h"
 #include "util/util_logging.h"
+#include "util/util_progress.h"
 #include "util/util_string.h"
 #include "util/util_vector.h"
 
@@ -153,6 +157,17 @@ protected:
 	map<string, ShaderNode *> node_map_;
 };
 
+/* Gives access to compilation of a single shader into the global SVM nodes
+ * array, which otherwise needs a device to run. */
+class SVMShaderManagerTest : public SVMShaderManager {
+public:
+	void update_shader(Scene *scene, Shader *shader, vector<int4> *global_svm_nodes)
+	{
+		Progress progress;
+		device_update_shader(scene, shader, &progress, global_svm_nodes);
+	}
+};
+
 }  // namespace
 
 #define DEFINE_COMMON_VARIABLES(builder_name, mock_log_name) \
@@ -298,6 +313,102 @@ TEST(render_graph, constant_fold_background2)
 	graph.finalize(&scene);
 }
 
+/*
+ * Tests:
+ *  - folding of BSDF nodes with black color to nothing.
+ */
+TEST(render_graph, constant_fold_bsdf_black)
+{
+	DEFINE_COMMON_VARIABLES(builder, log);
+
+	EXPECT_ANY_MESSAGE(log);
+	CORRECT_INFO_MESSAGE(log, "Discarding closure Diffuse.");
+	CORRECT_INFO_MESSAGE(log, "Folding AddClosure::Closure to socket Glossy::BSDF.");
+
+	builder
+		.add_node(ShaderNodeBuilder<DiffuseBsdfNode>("Diffuse")
+		          .set("Color", make_float3(0.0f, 0.0f, 0.0f)))
+		.add_node(ShaderNodeBuilder<GlossyBsdfNode>("Glossy"))
+		.add_node(ShaderNodeBuilder<AddClosureNode>("AddClosure"))
+		.add_connection("Diffuse::BSDF", "AddClosure::Closure1")
+		.add_connection("Glossy::BSDF", "AddClosure::Closure2")
+		.output_closure("AddClosure::Closure");
+
+	graph.finalize(&scene);
+}
+
+/*
+ * Tests:
+ *  - NOT folding of black BSDF nodes linked directly to the surface output,
+ *    which would leave the shader without a surface.
+ */
+TEST(render_graph, constant_fold_bsdf_black_surface)
+{
+	DEFINE_COMMON_VARIABLES(builder, log);
+
+	EXPECT_ANY_MESSAGE(log);
+	INVALID_INFO_MESSAGE(log, "Discarding closure Diffuse.");
+
+	builder
+		.add_node(ShaderNodeBuilder<DiffuseBsdfNode>("Diffuse")
+		          .set("Color", make_float3(0.0f, 0.0f, 0.0f)))
+		.output_closure("Diffuse::BSDF");
+
+	graph.finalize(&scene);
+
+	EXPECT_TRUE(graph.output()->input("Surface")->link != NULL);
+}
+
+/*
+ * Tests:
+ *  - folding of black BSDF nodes after their color is folded, and removal of
+ *    the Add Closure around them.
+ */
+TEST(render_graph, constant_fold_bsdf_black_folded)
+{
+	DEFINE_COMMON_VARIABLES(builder, log);
+
+	EXPECT_ANY_MESSAGE(log);
+	CORRECT_INFO_MESSAGE(log, "Folding Invert::Color to constant (0, 0, 0).");
+	CORRECT_INFO_MESSAGE(log, "Discarding closure Diffuse.");
+	CORRECT_INFO_MESSAGE(log, "Folding AddClosure::Closure to socket Glossy::BSDF.");
+
+	builder
+		.add_node(ShaderNodeBuilder<InvertNode>("Invert")
+		          .set("Fac", 1.0f)
+		          .set("Color", make_float3(1.0f, 1.0f, 1.0f)))
+		.add_node(ShaderNodeBuilder<DiffuseBsdfNode>("Diffuse"))
+		.add_node(ShaderNodeBuilder<GlossyBsdfNode>("Glossy"))
+		.add_node(ShaderNodeBuilder<AddClosureNode>("AddClosure"))
+		.add_connection("Invert::Color", "Diffuse::Color")
+		.add_connection("Diffuse::BSDF", "AddClosure::Closure1")
+		.add_connection("Glossy::BSDF", "AddClosure::Closure2")
+		.output_closure("AddClosure::Closure");
+
+	graph.finalize(&scene);
+}
+
+/*
+ * Tests:
+ *  - NOT folding of BSDF nodes with a color which is not constant.
+ */
+TEST(render_graph, constant_fold_bsdf_linked_color)
+{
+	DEFINE_COMMON_VARIABLES(builder, log);
+
+	EXPECT_ANY_MESSAGE(log);
+	INVALID_INFO_MESSAGE(log, "Discarding closure Diffuse.");
+
+	builder
+		.add_attribute("Attribute")
+		.add_node(ShaderNodeBuilder<DiffuseBsdfNode>("Diffuse")
+		          .set("Color", make_float3(0.0f, 0.0f, 0.0f)))
+		.add_connection("Attribute::Color", "Diffuse::Color")
+		.output_closure("Diffuse::BSDF");
+
+	graph.finalize(&scene);
+}
+
 /*
  * Tests:
  *  - Folding of Add Closure with only one input.
@@ -1677,4 +1788,85 @@ TEST(render_graph, constant_fold_convert_color_float_color)
 	graph.finalize(&scene);
 }
 
+/*
+ * Tests:
+ *  - sharing of identical SVM program segments between shaders.
+ */
+TEST(render_graph, svm_share_segments)
+{
+	util_logging_start();
+	util_logging_verbosity_set(1);
+	ScopedMockLog log;
+	DeviceInfo device_info;
+	SceneParams scene_params;
+	Scene scene(scene_params, device_info);
+	SVMShaderManagerTest svm_shader_manager;
+
+	EXPECT_ANY_MESSAGE(log);
+
+	/* First two shaders are the same, the third one only differs in the
+	 * surface and has the same empty volume and displacement. */
+	for(int i = 0; i < 3; i++) {
+		ShaderGraph *graph = new ShaderGraph();
+		ShaderGraphBuilder builder(graph);
+
+		builder.add_attribute("Attribute");
+		if(i < 2) {
+			builder
+				.add_node(ShaderNodeBuilder<DiffuseBsdfNode>("BSDF"))
+				.add_connection("Attribute::Color", "BSDF::Color");
+		}
+		else {
+			builder
+				.add_node(ShaderNodeBuilder<GlossyBsdfNode>("BSDF"))
+				.add_connection("Attribute::Fac", "BSDF::Roughness");
+		}
+		builder.output_closure("BSDF::BSDF");
+
+		Shader *shader = new Shader();
+		shader->name = string_printf("Shader%d", i);
+		shader->id = i;
+		shader->set_graph(graph);
+		scene.shaders.push_back(shader);
+	}
+
+	vector<int4> svm_nodes;
+	for(int i = 0; i < 3; i++) {
+		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+	}
+
+	foreach(Shader *shader, scene.shaders) {
+		svm_shader_manager.update_shader(&scene, shader, &svm_nodes);
+	}
+
+	const vector<int4>& nodes0 = scene.shaders[0]->svm_nodes;
+	const vector<int4>& nodes2 = scene.shaders[2]->svm_nodes;
+
+	EXPECT_EQ(svm_nodes[0].y, svm_nodes[1].y);
+	EXPECT_EQ(svm_nodes[0].z, svm_nodes[1].z);
+	EXPECT_EQ(svm_nodes[0].w, svm_nodes[1].w);
+
+	EXPECT_NE(svm_nodes[0].y, svm_nodes[2].y);
+	EXPECT_EQ(svm_nodes[0].z, svm_nodes[2].z);
+	EXPECT_EQ(svm_nodes[0].w, svm_nodes[2].w);
+
+	/* Only the program of the first shader and the surface of the third one
+	 * are copied. */
+	EXPECT_EQ(svm_nodes.size(), 3 + (nodes0.size() - 1) + (nodes2[0].z - nodes2[0].y));
+
+	/* Shared segments hold the same nodes as the program of each shader. */
+	for(int i = 0; i < 3; i++) {
+		const vector<int4>& nodes = scene.shaders[i]->svm_nodes;
+		const int local_start[4] = {nodes[0].y, nodes[0].z, nodes[0].w, (int)nodes.size()};
+		const int global_start[3] = {svm_nodes[i].y, svm_nodes[i].z, svm_nodes[i].w};
+
+		for(int segment = 0; segment < 3; segment++) {
+			for(int j = local_start[segment]; j < local_start[segment + 1]; j++) {
+				const int4& node = svm_nodes[global_start[segment] + j - local_start[segment]];
+				EXPECT_EQ(memcmp(&node, &nodes[j], sizeof(int4)), 0);
+			}
+		}
+	}
+}
+
 CCL_NAMESPACE_END
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/lazy_dicing.h"
+
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Grid on the patch (1, 0, 0), (0, 1, 0), (0, 0, 0) in the z = 0 plane. */
+LazyDicingGrid *create_flat_grid(int tri, int level)
+{
+	LazyDicingGrid *grid = new LazyDicingGrid(tri, level);
+	const float inv_resolution = 1.0f/grid->resolution;
+
+	for(int a = 0; a <= grid->resolution; a++) {
+		for(int b = 0; b <= grid->resolution - a; b++) {
+			grid->verts[grid->vert_index(a, b)] = make_float3(a*inv_resolution,
+			                                                  b*inv_resolution,
+			                                                  0.0f);
+		}
+	}
+
+	grid->build();
+	return grid;
+}
+
+}  // namespace
+
+TEST(render_lazy_dicing, grid_vert_index) {
+	LazyDicingGrid grid(0, 3);
+	vector<bool> used(grid.verts.size(), false);
+
+	for(int a = 0; a <= grid.resolution; a++) {
+		for(int b = 0; b <= grid.resolution - a; b++) {
+			const int index = grid.vert_index(a, b);
+			ASSERT_GE(index, 0);
+			ASSERT_LT(index, (int)grid.verts.size());
+			EXPECT_FALSE(used[index]);
+			used[index] = true;
+		}
+	}
+}
+
+TEST(render_lazy_dicing, grid_bounds) {
+	LazyDicingGrid *grid = create_flat_grid(0, 2);
+
+	const BoundBox& root = grid->nodes[0];
+
+	for(size_t i = 0; i < grid->verts.size(); i++) {
+		const float3 P = grid->verts[i];
+		EXPECT_TRUE(P.x >= root.min.x && P.y >= root.min.y && P.z >= root.min.z);
+		EXPECT_TRUE(P.x <= root.max.x && P.y <= root.max.y && P.z <= root.max.z);
+	}
+
+	EXPECT_EQ(grid->nodes[0].min.x, 0.0f);
+	EXPECT_EQ(grid->nodes[0].max.x, 1.0f);
+	EXPECT_EQ(grid->nodes[0].max.y, 1.0f);
+
+	delete grid;
+}
+
+TEST(render_lazy_dicing, grid_normals) {
+	LazyDicingGrid *grid = create_flat_grid(0, 3);
+	grid->compute_normals();
+
+	ASSERT_EQ(grid->normals.size(), grid->verts.size());
+
+	/* Same orientation as cross(p1 - p0, p2 - p0) of the micropolygons. */
+	int v[3][2];
+	grid->triangle(0, 0, true, v);
+	const float3 p0 = grid->verts[grid->vert_index(v[0][0], v[0][1])];
+	const float3 p1 = grid->verts[grid->vert_index(v[1][0], v[1][1])];
+	const float3 p2 = grid->verts[grid->vert_index(v[2][0], v[2][1])];
+	const float3 Ng = normalize(cross(p1 - p0, p2 - p0));
+
+	for(size_t i = 0; i < grid->normals.size(); i++) {
+		EXPECT_NEAR(dot(grid->normals[i], Ng), 1.0f, 1e-5f);
+	}
+
+	delete grid;
+}
+
+TEST(render_lazy_dicing, snap) {
+	/* Level 2 patch with edge 0 (a + b = N) diced at level 1 only. */
+	const uint params = (1 << 0) | (2 << 8) | (2 << 16);
+	int a, b;
+
+	LazyDicing::snap(params, 2, 3, 1, &a, &b);
+	EXPECT_EQ(a, 4);
+	EXPECT_EQ(b, 0);
+
+	LazyDicing::snap(params, 2, 2, 2, &a, &b);
+	EXPECT_EQ(a, 2);
+	EXPECT_EQ(b, 2);
+
+	/* Interior points are never moved. */
+	LazyDicing::snap(params, 2, 1, 1, &a, &b);
+	EXPECT_EQ(a, 1);
+	EXPECT_EQ(b, 1);
+}
+
+TEST(render_lazy_dicing, cache_find_insert) {
+	LazyDicing lazy_dicing;
+
+	EXPECT_EQ(lazy_dicing.find(7), (LazyDicingGrid*)NULL);
+
+	LazyDicingGrid *grid = lazy_dicing.insert(create_flat_grid(7, 1));
+	EXPECT_EQ(grid->tri, 7);
+	EXPECT_EQ(grid->num_users, 1u);
+
+	/* Grid stays cached while it is in use. */
+	LazyDicingGrid *found = lazy_dicing.find(7);
+	EXPECT_EQ(found, grid);
+	EXPECT_EQ(grid->num_users, 2u);
+
+	/* Inserting a grid diced concurrently by another thread returns the one
+	 * in the cache. */
+	LazyDicingGrid *other = lazy_dicing.insert(create_flat_grid(7, 1));
+	EXPECT_EQ(other, grid);
+	EXPECT_EQ(grid->num_users, 3u);
+
+	lazy_dicing.release(grid);
+	lazy_dicing.release(grid);
+	lazy_dicing.release(grid);
+	EXPECT_EQ(grid->num_users, 0u);
+}
+
+TEST(render_lazy_dicing, cache_evict) {
+	/* Without device update the memory limit is zero, so any grid which is
+	 * not in use gets evicted when another grid is added to the shard. */
+	LazyDicing lazy_dicing;
+	const int tri_a = 3;
+	const int tri_b = 3 + LAZY_DICING_NUM_SHARDS;
+	const int tri_c = 3 + 2*LAZY_DICING_NUM_SHARDS;
+
+	LazyDicingGrid *grid_a = lazy_dicing.insert(create_flat_grid(tri_a, 1));
+	LazyDicingGrid *grid_b = lazy_dicing.insert(create_flat_grid(tri_b, 1));
+
+	/* Both are in use. */
+	EXPECT_EQ(lazy_dicing.find(tri_a), grid_a);
+	lazy_dicing.release(grid_a);
+
+	lazy_dicing.release(grid_a);
+	LazyDicingGrid *grid_c = lazy_dicing.insert(create_flat_grid(tri_c, 1));
+
+	EXPECT_EQ(lazy_dicing.find(tri_a), (LazyDicingGrid*)NULL);
+	EXPECT_EQ(lazy_dicing.find(tri_b), grid_b);
+	lazy_dicing.release(grid_b);
+
+	lazy_dicing.release(grid_b);
+	lazy_dicing.release(grid_c);
+}
+
+CCL_NAMESPACE_END
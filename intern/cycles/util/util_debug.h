@@ -47,6 +47,9 @@ public:
 		/* Whether QBVH usage is allowed or not. */
 		bool qbvh;
 
+		/* Whether camera rays are intersected in packets. */
+		bool ray_packets;
+
 		/* Whether split kernel is used */
 		bool split_kernel;
 	};
@@ -103,13 +103,28 @@ ccl_device_inline float half_to_float(half h)
 {
 	float f;
 
-	*((int*) &f) = ((h & 0x8000) << 16) | (((h & 0x7c00) + 0x1C000) << 13) | ((h & 0x03FF) << 13);
+	/* Zero and denormals are flushed to zero, rebiasing the exponent would
+	 * turn them into small positive values otherwise. */
+	const int exponent = h & 0x7c00;
+	const int sign = (h & 0x8000) << 16;
+	const int bits = ((exponent + 0x1C000) << 13) | ((h & 0x03FF) << 13);
+
+	*((int*) &f) = sign | ((exponent != 0)? bits: 0);
 
 	return f;
 }
 
 ccl_device_inline float4 half4_to_float4(half4 h)
 {
+#ifdef __KERNEL_AVX2__
+	/* Hardware conversion, available together with AVX2. It keeps denormals,
+	 * flush them to zero same as half_to_float() by masking everything but
+	 * the sign of values below the smallest normal half. */
+	const __m128 f = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)&h));
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 normal = _mm_cmpge_ps(_mm_andnot_ps(sign, f), _mm_set1_ps(6.103515625e-05f));
+	return float4(_mm_and_ps(f, _mm_or_ps(normal, sign)));
+#else
 	float4 f;
 
 	f.x = half_to_float(h.x);
@@ -118,6 +133,7 @@ ccl_device_inline float4 half4_to_float4(half4 h)
 	f.w = half_to_float(h.w);
 
 	return f;
+#endif
 }
 
 ccl_device_inline half float_to_half(float f)
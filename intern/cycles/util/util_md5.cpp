@@ -23,6 +23,7 @@
 
 /* Minor modifications done to remove some code and change style. */
 
+#include "util_algorithm.h"
 #include "util_md5.h"
 #include "util_path.h"
 
@@ -310,6 +311,13 @@ void MD5Hash::append(const uint8_t *data, int nbytes)
 		memcpy(buf, p, left);
 }
 
+void MD5Hash::append(const string& str)
+{
+	if(str.size()) {
+		append((const uint8_t*)str.c_str(), str.size());
+	}
+}
+
 bool MD5Hash::append_file(const string& filepath)
 {
 	FILE *f = path_fopen(filepath, "rb");
@@ -380,5 +388,34 @@ string util_md5_string(const string& str)
 	return md5.get_hex();
 }
 
+void md5_append_data(MD5Hash& md5, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t*)data;
+	/* MD5Hash works with int sizes, feed huge arrays in chunks. */
+	while(size > 0) {
+		const size_t chunk = min(size, (size_t)(1 << 30));
+		md5.append(bytes, (int)chunk);
+		bytes += chunk;
+		size -= chunk;
+	}
+}
+
+void md5_append_float3(MD5Hash& md5, const float3 *data, size_t size)
+{
+	/* Go via small buffer to keep MD5 calls cheap. */
+	const size_t buffer_size = 1024;
+	float buffer[buffer_size*3];
+	md5_append_value(md5, (uint64_t)size);
+	for(size_t i = 0; i < size; i += buffer_size) {
+		const size_t num = min(buffer_size, size - i);
+		for(size_t j = 0; j < num; j++) {
+			buffer[j*3 + 0] = data[i + j].x;
+			buffer[j*3 + 1] = data[i + j].y;
+			buffer[j*3 + 2] = data[i + j].z;
+		}
+		md5_append_data(md5, buffer, sizeof(float)*3*num);
+	}
+}
+
 CCL_NAMESPACE_END
 
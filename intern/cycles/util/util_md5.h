@@ -32,6 +32,7 @@
 
 #include "util/util_string.h"
 #include "util/util_types.h"
+#include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -41,6 +42,7 @@ public:
 	~MD5Hash();
 
 	void append(const uint8_t *data, int size);
+	void append(const string& str);
 	bool append_file(const string& filepath);
 	string get_hex();
 
@@ -55,6 +57,29 @@ protected:
 
 string util_md5_string(const string& str);
 
+/* Helpers for computing cache keys from render data. */
+
+void md5_append_data(MD5Hash& md5, const void *data, size_t size);
+
+/* Padding of float3 is not guaranteed to be initialized, only hash the actual
+ * coordinates. */
+void md5_append_float3(MD5Hash& md5, const float3 *data, size_t size);
+
+template<typename T>
+void md5_append_value(MD5Hash& md5, const T& value)
+{
+	md5_append_data(md5, &value, sizeof(T));
+}
+
+template<typename T>
+void md5_append_array(MD5Hash& md5, const array<T>& data)
+{
+	md5_append_value(md5, (uint64_t)data.size());
+	if(data.size()) {
+		md5_append_data(md5, data.data(), sizeof(T)*data.size());
+	}
+}
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_MD5_H__ */
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_profiling.h"
+
+#include <algorithm>
+
+#include "util/util_foreach.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Interval between samples, in seconds. */
+#define PROFILING_INTERVAL 0.001
+
+const char *profiling_event_name(ProfilingEvent event)
+{
+	switch(event) {
+		case PROFILING_UNKNOWN: return "unknown";
+		case PROFILING_RAY_SETUP: return "ray_setup";
+		case PROFILING_PATH_INTEGRATE: return "path_integrate";
+		case PROFILING_INTERSECT: return "intersect";
+		case PROFILING_INTERSECT_SHADOW: return "intersect_shadow";
+		case PROFILING_INTERSECT_SUBSURFACE: return "intersect_subsurface";
+		case PROFILING_INTERSECT_VOLUME: return "intersect_volume";
+		case PROFILING_SHADER_SETUP: return "shader_setup";
+		case PROFILING_SHADER_EVAL: return "shader_eval";
+		case PROFILING_SURFACE_BOUNCE: return "surface_bounce";
+		case PROFILING_LIGHT_SAMPLE: return "light_sample";
+		case PROFILING_AO: return "ao";
+		case PROFILING_SUBSURFACE: return "subsurface";
+		case PROFILING_VOLUME: return "volume";
+		case PROFILING_WRITE_RESULT: return "write_result";
+		case PROFILING_NUM_EVENTS: break;
+	}
+	return "";
+}
+
+Profiler::Profiler()
+: event_samples(PROFILING_NUM_EVENTS, 0),
+  num_samples(0),
+  num_rays(0),
+  do_stop_worker(true),
+  worker(NULL)
+{
+}
+
+Profiler::~Profiler()
+{
+	stop();
+}
+
+void Profiler::reset()
+{
+	thread_scoped_lock lock(mutex);
+	std::fill(event_samples.begin(), event_samples.end(), 0);
+	num_samples = 0;
+	num_rays = 0;
+}
+
+void Profiler::run()
+{
+	double next_sample = time_dt();
+
+	while(!do_stop_worker) {
+		{
+			thread_scoped_lock lock(mutex);
+			foreach(ProfilingState *state, states) {
+				const uint32_t event = state->event;
+				if(state->active && event < PROFILING_NUM_EVENTS) {
+					event_samples[event]++;
+					num_samples++;
+				}
+			}
+		}
+
+		/* Schedule from the previous sample time rather than from now, so
+		 * time spent sampling does not skew the interval. */
+		next_sample += PROFILING_INTERVAL;
+		const double now = time_dt();
+		if(next_sample > now) {
+			time_sleep(next_sample - now);
+		}
+		else {
+			next_sample = now;
+		}
+	}
+}
+
+void Profiler::start()
+{
+	if(worker != NULL) {
+		return;
+	}
+	do_stop_worker = false;
+	worker = new thread(function_bind(&Profiler::run, this));
+}
+
+void Profiler::stop()
+{
+	if(worker == NULL) {
+		return;
+	}
+	do_stop_worker = true;
+	worker->join();
+	delete worker;
+	worker = NULL;
+}
+
+void Profiler::add_state(ProfilingState *state)
+{
+	thread_scoped_lock lock(mutex);
+	state->event = PROFILING_UNKNOWN;
+	state->num_rays = 0;
+	state->active = true;
+	states.push_back(state);
+}
+
+void Profiler::remove_state(ProfilingState *state)
+{
+	thread_scoped_lock lock(mutex);
+	std::vector<ProfilingState*>::iterator it = std::find(states.begin(), states.end(), state);
+	if(it != states.end()) {
+		states.erase(it);
+	}
+	state->active = false;
+	num_rays += state->num_rays;
+}
+
+uint64_t Profiler::get_event(ProfilingEvent event)
+{
+	thread_scoped_lock lock(mutex);
+	return event_samples[event];
+}
+
+uint64_t Profiler::get_num_samples()
+{
+	thread_scoped_lock lock(mutex);
+	return num_samples;
+}
+
+uint64_t Profiler::get_num_rays()
+{
+	thread_scoped_lock lock(mutex);
+	return num_rays;
+}
+
+bool Profiler::active() const
+{
+	return worker != NULL;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2011-2017 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_PROFILING_H__
+#define __UTIL_PROFILING_H__
+
+#include <vector>
+
+#include "util/util_thread.h"
+#include "util/util_types.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Parts of the CPU kernel which time is accounted to. Nested parts take
+ * precedence, so time spent in shadow ray intersection is accounted to
+ * intersection and not to light sampling. */
+enum ProfilingEvent {
+	PROFILING_UNKNOWN = 0,
+	PROFILING_RAY_SETUP,
+	PROFILING_PATH_INTEGRATE,
+	PROFILING_INTERSECT,
+	PROFILING_INTERSECT_SHADOW,
+	PROFILING_INTERSECT_SUBSURFACE,
+	PROFILING_INTERSECT_VOLUME,
+	PROFILING_SHADER_SETUP,
+	PROFILING_SHADER_EVAL,
+	PROFILING_SURFACE_BOUNCE,
+	PROFILING_LIGHT_SAMPLE,
+	PROFILING_AO,
+	PROFILING_SUBSURFACE,
+	PROFILING_VOLUME,
+	PROFILING_WRITE_RESULT,
+
+	PROFILING_NUM_EVENTS,
+};
+
+const char *profiling_event_name(ProfilingEvent event);
+
+/* Per-thread state, written by the kernel and polled by the profiler. */
+struct ProfilingState {
+	ProfilingState() : event(PROFILING_UNKNOWN), active(false), num_rays(0) {}
+
+	volatile uint32_t event;
+	volatile bool active;
+
+	/* Number of rays traced by this thread, including shadow rays. */
+	uint64_t num_rays;
+};
+
+/* Sampling profiler
+ *
+ * Instead of timing every kernel function, which would cost more than many of
+ * these functions take themselves, a worker thread wakes up every millisecond
+ * and records which event each of the registered render threads is in. */
+class Profiler {
+public:
+	Profiler();
+	~Profiler();
+
+	void reset();
+
+	void start();
+	void stop();
+
+	void add_state(ProfilingState *state);
+	void remove_state(ProfilingState *state);
+
+	/* Number of samples recorded in the given event, and in total. */
+	uint64_t get_event(ProfilingEvent event);
+	uint64_t get_num_samples();
+
+	/* Rays traced by threads which finished so far. */
+	uint64_t get_num_rays();
+
+	bool active() const;
+
+protected:
+	void run();
+
+	/* Plain std::vector, util_stats.h is included by the guarded allocator. */
+	std::vector<uint64_t> event_samples;
+	uint64_t num_samples;
+	uint64_t num_rays;
+
+	volatile bool do_stop_worker;
+	thread *worker;
+
+	thread_mutex mutex;
+	std::vector<ProfilingState*> states;
+};
+
+/* Sets the event of a thread for the lifetime of the helper, restoring the
+ * previous event once the scope is left. */
+class ProfilingHelper {
+public:
+	ProfilingHelper(ProfilingState *state, ProfilingEvent event)
+	: state(state)
+	{
+		previous_event = state->event;
+		state->event = event;
+	}
+
+	~ProfilingHelper()
+	{
+		state->event = previous_event;
+	}
+
+	inline void set_event(ProfilingEvent event)
+	{
+		state->event = event;
+	}
+
+	inline void count_ray()
+	{
+		state->num_rays++;
+	}
+
+protected:
+	ProfilingState *state;
+	uint32_t previous_event;
+};
+
+CCL_NAMESPACE_END
+
+#endif  /* __UTIL_PROFILING_H__ */
@@ -18,6 +18,7 @@
 #define __UTIL_STATS_H__
 
 #include "util/util_atomic.h"
+#include "util/util_profiling.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -25,7 +26,8 @@ class Stats {
 public:
 	enum static_init_t { static_init = 0 };
 
-	Stats() : mem_used(0), mem_peak(0) {}
+	Stats() : mem_used(0), mem_peak(0), bvh_cache_hits(0), bvh_cache_misses(0),
+	          bvh_build_time(0.0) {}
 	explicit Stats(static_init_t) {}
 
 	void mem_alloc(size_t size) {
@@ -38,8 +40,26 @@ public:
 		atomic_sub_and_fetch_z(&mem_used, size);
 	}
 
+	void bvh_cache_hit() {
+		atomic_add_and_fetch_z(&bvh_cache_hits, 1);
+	}
+
+	void bvh_cache_miss() {
+		atomic_add_and_fetch_z(&bvh_cache_misses, 1);
+	}
+
 	size_t mem_used;
 	size_t mem_peak;
+
+	/* Number of BVHs loaded from and missing in the persistent BVH cache. */
+	size_t bvh_cache_hits;
+	size_t bvh_cache_misses;
+
+	/* Wall clock time spent building BVHs in the last scene update. */
+	double bvh_build_time;
+
+	/* Sampling profiler of the CPU kernel, only running when started. */
+	Profiler profiler;
 };
 
 CCL_NAMESPACE_END
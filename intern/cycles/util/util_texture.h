@@ -17,6 +17,8 @@
 #ifndef __UTIL_TEXTURE_H__
 #define __UTIL_TEXTURE_H__
 
+#include "util/util_types.h"
+
 CCL_NAMESPACE_BEGIN
 
 /* Texture limits on devices. */
@@ -52,6 +54,35 @@ CCL_NAMESPACE_BEGIN
 #  define kernel_tex_index(tex) (tex >> 3)
 #endif
 
+/* Sparse 3D textures on the CPU are stored as tiles of 8x8x8 voxels, with a
+ * grid indexing into them. Grid entries hold the tile index shifted left by
+ * one, tile 0 is all zero and shared by all empty tiles. The lowest bit marks
+ * tiles which contain non-empty voxels, or are next to such a tile. */
+#define TEX_SPARSE_TILE_SHIFT 3
+#define TEX_SPARSE_TILE_SIZE (1 << TEX_SPARSE_TILE_SHIFT)
+#define TEX_SPARSE_TILE_MASK (TEX_SPARSE_TILE_SIZE - 1)
+#define TEX_SPARSE_TILE_VOXELS (TEX_SPARSE_TILE_SIZE*TEX_SPARSE_TILE_SIZE*TEX_SPARSE_TILE_SIZE)
+#define TEX_SPARSE_TILE_ACTIVE 1
+
+ccl_device_inline int tex_sparse_grid_size(int size)
+{
+	return (size + TEX_SPARSE_TILE_MASK) >> TEX_SPARSE_TILE_SHIFT;
+}
+
+ccl_device_inline size_t tex_sparse_voxel_index(const int *grid,
+                                                int grid_width,
+                                                int grid_height,
+                                                int x, int y, int z)
+{
+	const int tile = (x >> TEX_SPARSE_TILE_SHIFT) +
+	                 ((y >> TEX_SPARSE_TILE_SHIFT) +
+	                  (z >> TEX_SPARSE_TILE_SHIFT)*grid_height)*grid_width;
+	return (size_t)(grid[tile] >> 1)*TEX_SPARSE_TILE_VOXELS +
+	       (x & TEX_SPARSE_TILE_MASK) +
+	       ((y & TEX_SPARSE_TILE_MASK) << TEX_SPARSE_TILE_SHIFT) +
+	       ((z & TEX_SPARSE_TILE_MASK) << (2*TEX_SPARSE_TILE_SHIFT));
+}
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_TEXTURE_H__ */